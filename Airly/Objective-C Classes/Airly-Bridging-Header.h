@@ -9,8 +9,10 @@
 @import CocoaAsyncSocket;
 
 #import "Synaction.h"
+#import "SynactionAudioStream.h"
 #import "ConnectivityManager.h"
 #import "Packet.h"
+#import "FileTransferManager.h"
 #import "SLColorArt.h"
 #import "Bass.h"
 
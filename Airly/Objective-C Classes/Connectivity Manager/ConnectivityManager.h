@@ -12,11 +12,13 @@
 @import CocoaAsyncSocket;
 #import "Packet.h"
 
+typedef void(^PacketHandler)(Packet * _Nonnull packet, GCDAsyncSocket * _Nonnull socket);
+
 @protocol ConnectivityManagerDelegate <NSObject>
 
 @optional
 - (void)socket:(GCDAsyncSocket * _Nonnull)socket didAcceptNewSocket:(GCDAsyncSocket * _Nonnull)newSocket;
-- (void)didReceivePacket:(Packet * _Nonnull)packet fromSocket:(GCDAsyncSocket *_Nonnull)socket ;
+- (void)didReceivePacket:(Packet * _Nonnull)packet fromSocket:(GCDAsyncSocket *_Nonnull)socket ;// Only packets whose command has no registered handler.
 - (void)socketDidDisconnect:(GCDAsyncSocket * _Nonnull)socket withError:(NSError * _Nonnull)error;
 - (void)socket:(GCDAsyncSocket * _Nonnull)socket didConnectToHost:(NSString * _Nonnull)host port:(UInt16)port;
 - (void)didConnectToService:(NSNetService * _Nonnull)service;
@@ -36,9 +38,11 @@
 + (_Nullable instancetype)sharedManager;
 
 - (void)sendPacket:(Packet * _Nonnull)packet toSockets:(NSArray<GCDAsyncSocket *> *_Nonnull)sockets;
+- (void)registerCommand:(PacketCommand)command handler:(PacketHandler _Nullable)handler;// Every packet with this command goes to handler, and only to it. Replaces the previous one, nil removes it.
 - (void)startBonjourBroadcast;
 - (void)startBrowsingForBonjourBroadcast;
 - (void)stopBonjour;
 - (void)disconnectSockets;
+- (void)benchmarkPacketEncodingWithIterations:(NSUInteger)iterations;// Logs bytes on the wire and encode/decode time of a sync pong, archived against PacketWire.
 
 @end
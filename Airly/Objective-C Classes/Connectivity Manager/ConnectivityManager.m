@@ -8,16 +8,22 @@
 //
 
 #import "ConnectivityManager.h"
+#import "PacketScheduler.h"
+#import "PacketReader.h"
 
 #define PacketString @"Packet"
 
-@interface ConnectivityManager () <NSNetServiceDelegate, NSNetServiceBrowserDelegate, GCDAsyncSocketDelegate>
+@interface ConnectivityManager () <NSNetServiceDelegate, NSNetServiceBrowserDelegate, GCDAsyncSocketDelegate> {
+    PacketHandler packetHandlers[PacketCommandCount];// Indexed by command
+}
 
 @property (strong, nonatomic) GCDAsyncSocket *serverSocket;
 @property (strong, nonatomic) NSNetService *service;
 @property (strong, nonatomic) NSMutableArray *services;
 @property (strong, nonatomic) NSNetServiceBrowser *serviceBrowser;
 @property (strong, nonatomic) NSString * _Nullable hostName;
+@property (strong, nonatomic) NSMapTable <GCDAsyncSocket *, PacketScheduler *> *schedulers;// Keeps file chunks behind control packets, one per socket
+@property (strong, nonatomic) NSMapTable <GCDAsyncSocket *, PacketReader *> *readers;// Many packets per read, one per socket
 
 @end
 
@@ -31,6 +37,8 @@
         
         sharedManager.services = [NSMutableArray new];
         sharedManager.allSockets = [NSMutableArray new];
+        sharedManager.schedulers = [NSMapTable weakToStrongObjectsMapTable];
+        sharedManager.readers = [NSMapTable weakToStrongObjectsMapTable];
     });
     
     return sharedManager;
@@ -141,38 +149,115 @@
 - (void)sendPacket:(Packet *)packet toSockets:(NSArray<GCDAsyncSocket *> *)sockets {
     NSLog(@"Sending packet to sockets");
     
-    // Encode Packet Data
-    NSError *error;
-    NSData *packetData = [NSKeyedArchiver archivedDataWithRootObject:packet requiringSecureCoding:FALSE error:&error];
-    if (error) NSLog(@"%@", error);
-    
-    // Initialize Buffer
-    NSMutableData *buffer = [[NSMutableData alloc] init];
+    // Frame the body with a fixed header, see PacketWire.h
+    PacketWireHeader header = [packet wireHeader];
+    uint8_t headerBytes[PacketWireHeaderLength];
+    PacketWireEncodeHeader(&header, headerBytes);
     
-    // Fill Buffer
-    uint64_t headerLength = [packetData length];
-    [buffer appendBytes:&headerLength length:sizeof(uint64_t)];
-    [buffer appendBytes:[packetData bytes] length:[packetData length]];
+    // Header and body go out as separate segments, every socket shares the same ones. Nothing is copied per listener.
+    NSArray <NSData *> *segments = [@[[NSData dataWithBytes:headerBytes length:PacketWireHeaderLength]] arrayByAddingObjectsFromArray:[packet bodySegments]];
     
-    // Write Buffer
     for (GCDAsyncSocket *socket in sockets) {
-        [socket writeData:buffer withTimeout:-1.0 tag:0];
+        PacketScheduler *scheduler = [self.schedulers objectForKey:socket];
+        if (!scheduler) {
+            scheduler = [[PacketScheduler alloc] initWithSocket:socket];
+            [self.schedulers setObject:scheduler forKey:socket];
+        }
+        
+        [scheduler sendSegments:segments priority:packet.priority];
     }
 }
 
-- (uint64_t)parseHeader:(NSData *)data {
-    uint64_t headerLength = 0;
-    memcpy(&headerLength, [data bytes], sizeof(uint64_t));
+- (void)registerCommand:(PacketCommand)command handler:(PacketHandler)handler {
+    if ((NSUInteger)command >= PacketCommandCount) {
+        NSLog(@"Can't register a handler for unknown command %d.", command);
+        return;
+    }
     
-    return headerLength;
+    packetHandlers[command] = [handler copy];
+}
+
+// Every socket gets its own reader, for as long as it's connected.
+- (void)startReadingFromSocket:(GCDAsyncSocket *)socket {
+    PacketReader *reader = [[PacketReader alloc] initWithSocket:socket];
+    [self.readers setObject:reader forKey:socket];
+    [reader readNextBytes];
 }
 
-- (Packet *)parseBody:(NSData *)data {
-    NSError *error;
-    Packet *packet = [NSKeyedUnarchiver unarchivedObjectOfClass:[Packet class] fromData:data error:&error];
-    if (error) NSLog(@"%@", error);
+// One lookup per packet, however many commands there are. Unregistered commands fall back to the delegate.
+- (void)deliverPacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    PacketHandler handler = ((NSUInteger)packet.command < PacketCommandCount) ? packetHandlers[packet.command] : nil;
     
-    return packet;
+    if (handler) {
+        handler(packet, socket);
+        
+    } else if (self.delegate && [self.delegate respondsToSelector:@selector(didReceivePacket:fromSocket:)]) {
+        [self.delegate didReceivePacket:packet fromSocket:socket];
+    }
+}
+
+- (void)benchmarkPacketEncodingWithIterations:(NSUInteger)iterations {
+    uint64_t now = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    
+    // What the old path sent: the payload archived, then wrapped with the Packet keys and archived again.
+    NSData *(^archivedEncode)(void) = ^NSData *{
+        NSDictionary *payloadDict = @{@"command": @"syncPong", @"timeReceived": @(now), @"timeSent": @(now)};
+        NSData *payload = [NSKeyedArchiver archivedDataWithRootObject:payloadDict requiringSecureCoding:FALSE error:nil];
+        
+        return [NSKeyedArchiver archivedDataWithRootObject:@{@"data": payload, @"type": @(PacketTypeControl), @"action": @(PacketActionSync)} requiringSecureCoding:FALSE error:nil];
+    };
+    
+    NSData *(^wireEncode)(void) = ^NSData *{
+        Packet *packet = [[Packet alloc] initWithCommand:PacketCommandSyncPong type:PacketTypeControl action:PacketActionSync];
+        [packet setUInt64:now forField:PacketFieldTimeSent];
+        [packet setUInt64:now forField:PacketFieldTimeReceived];
+        
+        PacketWireHeader header = [packet wireHeader];
+        uint8_t headerBytes[PacketWireHeaderLength];
+        PacketWireEncodeHeader(&header, headerBytes);
+        
+        NSMutableData *buffer = [[NSMutableData alloc] initWithBytes:headerBytes length:PacketWireHeaderLength];
+        [buffer appendData:packet.data];
+        
+        return buffer;
+    };
+    
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        NSData *archived = archivedEncode();
+        NSData *wire = wireEncode();
+        NSSet *payloadClasses = [NSSet setWithObjects:[NSDictionary class], [NSString class], [NSNumber class], [NSData class], nil];
+        
+        uint64_t start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        for (NSUInteger i = 0; i < iterations; i++) @autoreleasepool { archivedEncode(); }
+        uint64_t archivedEncodeTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+        
+        // Both decodes end with a handler holding the packet and reading a field out of it, like the socket path.
+        start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        uint64_t checksum = 0;
+        for (NSUInteger i = 0; i < iterations; i++) @autoreleasepool {
+            NSDictionary *packetDict = [NSKeyedUnarchiver unarchivedObjectOfClasses:payloadClasses fromData:archived error:nil];
+            NSDictionary *payloadDict = [NSKeyedUnarchiver unarchivedObjectOfClasses:payloadClasses fromData:packetDict[@"data"] error:nil];
+            checksum += ((NSNumber *)payloadDict[@"timeReceived"]).unsignedLongLongValue;
+        }
+        uint64_t archivedDecodeTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+        
+        start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        for (NSUInteger i = 0; i < iterations; i++) @autoreleasepool { wireEncode(); }
+        uint64_t wireEncodeTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+        
+        start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        for (NSUInteger i = 0; i < iterations; i++) @autoreleasepool {
+            PacketWireHeader header;
+            if (!PacketWireDecodeHeader(wire.bytes, wire.length, &header)) continue;
+            
+            Packet *packet = [[Packet alloc] initWithHeader:header body:[NSData dataWithBytes:(const uint8_t *)wire.bytes + PacketWireHeaderLength length:header.length]];
+            checksum += [packet uint64ForField:PacketFieldTimeReceived];
+        }
+        uint64_t wireDecodeTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+        
+        double count = MAX(iterations, 1);
+        NSLog(@"Packet encoding benchmark, sync pong: archived %lu bytes, encode %.2fus, decode %.2fus. Wire %lu bytes, encode %.2fus, decode %.2fus (%llu).", (unsigned long)(archived.length + sizeof(uint64_t)), archivedEncodeTime/count/1000.0, archivedDecodeTime/count/1000.0, (unsigned long)wire.length, wireEncodeTime/count/1000.0, wireDecodeTime/count/1000.0, checksum & 1);
+    });
 }
 
 #pragma mark - NSNetServiceDelegate
@@ -254,23 +339,23 @@
     [self.allSockets addObject:newSocket];
     
     // Read Data from Socket
-    [newSocket readDataToLength:sizeof(uint64_t) withTimeout:-1.0 tag:0];
-    
-    // Call Delegates
-    if (self.delegate && [self.delegate respondsToSelector:@selector(socket:didAcceptNewSocket:)]) {
-        [self.delegate socket:socket didAcceptNewSocket:newSocket];
-    }
+    [self startReadingFromSocket:newSocket];
     
+    // Call Delegates. Synaction goes first so the timing channel is offered before any calibration request.
     if (self.synaction && [self.synaction respondsToSelector:@selector(socket:didAcceptNewSocket:)]) {
         [self.synaction socket:socket didAcceptNewSocket:newSocket];
     }
+    
+    if (self.delegate && [self.delegate respondsToSelector:@selector(socket:didAcceptNewSocket:)]) {
+        [self.delegate socket:socket didAcceptNewSocket:newSocket];
+    }
 }
 
 - (void)socket:(GCDAsyncSocket *)socket didConnectToHost:(NSString *)host port:(UInt16)port {
     NSLog(@"Socket did connect to Host: %@ Port: %hu", host, port);
     
     // Start Reading
-    [socket readDataToLength:sizeof(uint64_t) withTimeout:-1.0 tag:0];
+    [self startReadingFromSocket:socket];
     
     // Set the host socket
     self.hostSocket = socket;
@@ -289,29 +374,30 @@
 }
 
 - (void)socket:(GCDAsyncSocket *)socket didReadData:(NSData *)data withTag:(long)tag {
-    if (tag == 0) {
-        uint64_t bodyLength = [self parseHeader:data];
-        [socket readDataToLength:(NSUInteger)bodyLength withTimeout:-1.0 tag:1];
-        
-    } else if (tag == 1) {
-        Packet *packet = [self parseBody:data];
-        
-        if (self.delegate && [self.delegate respondsToSelector:@selector(didReceivePacket:fromSocket:)]) {
-            [self.delegate didReceivePacket:packet fromSocket:socket];
-        }
-        
-        if (self.synaction && [self.synaction respondsToSelector:@selector(didReceivePacket:fromSocket:)]) {
-            [self.synaction didReceivePacket:packet fromSocket:socket];
-        }
-        
-        [socket readDataToLength:sizeof(uint64_t) withTimeout:-1 tag:0];
+    if (tag != PacketReaderTag) return;
+    
+    // Every packet the read completed, then the next read.
+    PacketReader *reader = [self.readers objectForKey:socket];
+    BOOL readable = [reader socketDidReadDataOfLength:data.length handler:^(Packet *packet) {
+        [self deliverPacket:packet fromSocket:socket];
+    }];
+    
+    if (!readable) {
+        NSLog(@"Disconnecting from %@, its stream can't be read any further.", socket.connectedHost);
+        [socket disconnect];
     }
 }
 
+- (void)socket:(GCDAsyncSocket *)socket didWriteDataWithTag:(long)tag {
+    [[self.schedulers objectForKey:socket] socketDidWriteDataWithTag:tag];
+}
+
 - (void)socketDidDisconnect:(GCDAsyncSocket *)socket withError:(NSError *)error {
     NSLog(@"%s error: %@", __PRETTY_FUNCTION__, error);
     
     self.hostSocket = nil;
+    [self.schedulers removeObjectForKey:socket];
+    [self.readers removeObjectForKey:socket];
     
     if (socket) {
         [self.allSockets removeObject:socket];
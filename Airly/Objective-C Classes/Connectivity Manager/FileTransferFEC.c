@@ -0,0 +1,285 @@
+//
+//  FileTransferFEC.c
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#include "FileTransferFEC.h"
+
+#include <string.h>
+
+// MARK: - GF(256)
+// Powers of 2 modulo x^8 + x^4 + x^3 + x^2 + 1, doubled so a sum of two logarithms never wraps.
+static const uint8_t FileTransferFECExp[512] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d, 0x3a, 0x74, 0xe8, 0xcd, 0x87, 0x13, 0x26,
+    0x4c, 0x98, 0x2d, 0x5a, 0xb4, 0x75, 0xea, 0xc9, 0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0,
+    0x9d, 0x27, 0x4e, 0x9c, 0x25, 0x4a, 0x94, 0x35, 0x6a, 0xd4, 0xb5, 0x77, 0xee, 0xc1, 0x9f, 0x23,
+    0x46, 0x8c, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0, 0x5d, 0xba, 0x69, 0xd2, 0xb9, 0x6f, 0xde, 0xa1,
+    0x5f, 0xbe, 0x61, 0xc2, 0x99, 0x2f, 0x5e, 0xbc, 0x65, 0xca, 0x89, 0x0f, 0x1e, 0x3c, 0x78, 0xf0,
+    0xfd, 0xe7, 0xd3, 0xbb, 0x6b, 0xd6, 0xb1, 0x7f, 0xfe, 0xe1, 0xdf, 0xa3, 0x5b, 0xb6, 0x71, 0xe2,
+    0xd9, 0xaf, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0d, 0x1a, 0x34, 0x68, 0xd0, 0xbd, 0x67, 0xce,
+    0x81, 0x1f, 0x3e, 0x7c, 0xf8, 0xed, 0xc7, 0x93, 0x3b, 0x76, 0xec, 0xc5, 0x97, 0x33, 0x66, 0xcc,
+    0x85, 0x17, 0x2e, 0x5c, 0xb8, 0x6d, 0xda, 0xa9, 0x4f, 0x9e, 0x21, 0x42, 0x84, 0x15, 0x2a, 0x54,
+    0xa8, 0x4d, 0x9a, 0x29, 0x52, 0xa4, 0x55, 0xaa, 0x49, 0x92, 0x39, 0x72, 0xe4, 0xd5, 0xb7, 0x73,
+    0xe6, 0xd1, 0xbf, 0x63, 0xc6, 0x91, 0x3f, 0x7e, 0xfc, 0xe5, 0xd7, 0xb3, 0x7b, 0xf6, 0xf1, 0xff,
+    0xe3, 0xdb, 0xab, 0x4b, 0x96, 0x31, 0x62, 0xc4, 0x95, 0x37, 0x6e, 0xdc, 0xa5, 0x57, 0xae, 0x41,
+    0x82, 0x19, 0x32, 0x64, 0xc8, 0x8d, 0x07, 0x0e, 0x1c, 0x38, 0x70, 0xe0, 0xdd, 0xa7, 0x53, 0xa6,
+    0x51, 0xa2, 0x59, 0xb2, 0x79, 0xf2, 0xf9, 0xef, 0xc3, 0x9b, 0x2b, 0x56, 0xac, 0x45, 0x8a, 0x09,
+    0x12, 0x24, 0x48, 0x90, 0x3d, 0x7a, 0xf4, 0xf5, 0xf7, 0xf3, 0xfb, 0xeb, 0xcb, 0x8b, 0x0b, 0x16,
+    0x2c, 0x58, 0xb0, 0x7d, 0xfa, 0xe9, 0xcf, 0x83, 0x1b, 0x36, 0x6c, 0xd8, 0xad, 0x47, 0x8e, 0x01,
+    0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d, 0x3a, 0x74, 0xe8, 0xcd, 0x87, 0x13, 0x26, 0x4c,
+    0x98, 0x2d, 0x5a, 0xb4, 0x75, 0xea, 0xc9, 0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0x9d,
+    0x27, 0x4e, 0x9c, 0x25, 0x4a, 0x94, 0x35, 0x6a, 0xd4, 0xb5, 0x77, 0xee, 0xc1, 0x9f, 0x23, 0x46,
+    0x8c, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0, 0x5d, 0xba, 0x69, 0xd2, 0xb9, 0x6f, 0xde, 0xa1, 0x5f,
+    0xbe, 0x61, 0xc2, 0x99, 0x2f, 0x5e, 0xbc, 0x65, 0xca, 0x89, 0x0f, 0x1e, 0x3c, 0x78, 0xf0, 0xfd,
+    0xe7, 0xd3, 0xbb, 0x6b, 0xd6, 0xb1, 0x7f, 0xfe, 0xe1, 0xdf, 0xa3, 0x5b, 0xb6, 0x71, 0xe2, 0xd9,
+    0xaf, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0d, 0x1a, 0x34, 0x68, 0xd0, 0xbd, 0x67, 0xce, 0x81,
+    0x1f, 0x3e, 0x7c, 0xf8, 0xed, 0xc7, 0x93, 0x3b, 0x76, 0xec, 0xc5, 0x97, 0x33, 0x66, 0xcc, 0x85,
+    0x17, 0x2e, 0x5c, 0xb8, 0x6d, 0xda, 0xa9, 0x4f, 0x9e, 0x21, 0x42, 0x84, 0x15, 0x2a, 0x54, 0xa8,
+    0x4d, 0x9a, 0x29, 0x52, 0xa4, 0x55, 0xaa, 0x49, 0x92, 0x39, 0x72, 0xe4, 0xd5, 0xb7, 0x73, 0xe6,
+    0xd1, 0xbf, 0x63, 0xc6, 0x91, 0x3f, 0x7e, 0xfc, 0xe5, 0xd7, 0xb3, 0x7b, 0xf6, 0xf1, 0xff, 0xe3,
+    0xdb, 0xab, 0x4b, 0x96, 0x31, 0x62, 0xc4, 0x95, 0x37, 0x6e, 0xdc, 0xa5, 0x57, 0xae, 0x41, 0x82,
+    0x19, 0x32, 0x64, 0xc8, 0x8d, 0x07, 0x0e, 0x1c, 0x38, 0x70, 0xe0, 0xdd, 0xa7, 0x53, 0xa6, 0x51,
+    0xa2, 0x59, 0xb2, 0x79, 0xf2, 0xf9, 0xef, 0xc3, 0x9b, 0x2b, 0x56, 0xac, 0x45, 0x8a, 0x09, 0x12,
+    0x24, 0x48, 0x90, 0x3d, 0x7a, 0xf4, 0xf5, 0xf7, 0xf3, 0xfb, 0xeb, 0xcb, 0x8b, 0x0b, 0x16, 0x2c,
+    0x58, 0xb0, 0x7d, 0xfa, 0xe9, 0xcf, 0x83, 0x1b, 0x36, 0x6c, 0xd8, 0xad, 0x47, 0x8e, 0x01, 0x02
+};
+
+static const uint8_t FileTransferFECLog[256] = {
+    0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1a, 0xc6, 0x03, 0xdf, 0x33, 0xee, 0x1b, 0x68, 0xc7, 0x4b,
+    0x04, 0x64, 0xe0, 0x0e, 0x34, 0x8d, 0xef, 0x81, 0x1c, 0xc1, 0x69, 0xf8, 0xc8, 0x08, 0x4c, 0x71,
+    0x05, 0x8a, 0x65, 0x2f, 0xe1, 0x24, 0x0f, 0x21, 0x35, 0x93, 0x8e, 0xda, 0xf0, 0x12, 0x82, 0x45,
+    0x1d, 0xb5, 0xc2, 0x7d, 0x6a, 0x27, 0xf9, 0xb9, 0xc9, 0x9a, 0x09, 0x78, 0x4d, 0xe4, 0x72, 0xa6,
+    0x06, 0xbf, 0x8b, 0x62, 0x66, 0xdd, 0x30, 0xfd, 0xe2, 0x98, 0x25, 0xb3, 0x10, 0x91, 0x22, 0x88,
+    0x36, 0xd0, 0x94, 0xce, 0x8f, 0x96, 0xdb, 0xbd, 0xf1, 0xd2, 0x13, 0x5c, 0x83, 0x38, 0x46, 0x40,
+    0x1e, 0x42, 0xb6, 0xa3, 0xc3, 0x48, 0x7e, 0x6e, 0x6b, 0x3a, 0x28, 0x54, 0xfa, 0x85, 0xba, 0x3d,
+    0xca, 0x5e, 0x9b, 0x9f, 0x0a, 0x15, 0x79, 0x2b, 0x4e, 0xd4, 0xe5, 0xac, 0x73, 0xf3, 0xa7, 0x57,
+    0x07, 0x70, 0xc0, 0xf7, 0x8c, 0x80, 0x63, 0x0d, 0x67, 0x4a, 0xde, 0xed, 0x31, 0xc5, 0xfe, 0x18,
+    0xe3, 0xa5, 0x99, 0x77, 0x26, 0xb8, 0xb4, 0x7c, 0x11, 0x44, 0x92, 0xd9, 0x23, 0x20, 0x89, 0x2e,
+    0x37, 0x3f, 0xd1, 0x5b, 0x95, 0xbc, 0xcf, 0xcd, 0x90, 0x87, 0x97, 0xb2, 0xdc, 0xfc, 0xbe, 0x61,
+    0xf2, 0x56, 0xd3, 0xab, 0x14, 0x2a, 0x5d, 0x9e, 0x84, 0x3c, 0x39, 0x53, 0x47, 0x6d, 0x41, 0xa2,
+    0x1f, 0x2d, 0x43, 0xd8, 0xb7, 0x7b, 0xa4, 0x76, 0xc4, 0x17, 0x49, 0xec, 0x7f, 0x0c, 0x6f, 0xf6,
+    0x6c, 0xa1, 0x3b, 0x52, 0x29, 0x9d, 0x55, 0xaa, 0xfb, 0x60, 0x86, 0xb1, 0xbb, 0xcc, 0x3e, 0x5a,
+    0xcb, 0x59, 0x5f, 0xb0, 0x9c, 0xa9, 0xa0, 0x51, 0x0b, 0xf5, 0x16, 0xeb, 0x7a, 0x75, 0x2c, 0xd7,
+    0x4f, 0xae, 0xd5, 0xe9, 0xe6, 0xe7, 0xad, 0xe8, 0x74, 0xd6, 0xf4, 0xea, 0xa8, 0x50, 0x58, 0xaf
+};
+
+static inline uint8_t FileTransferFECMultiply(uint8_t a, uint8_t b) {
+    return (a && b) ? FileTransferFECExp[FileTransferFECLog[a] + FileTransferFECLog[b]] : 0;
+}
+
+static inline uint8_t FileTransferFECInverse(uint8_t a) {
+    return FileTransferFECExp[255 - FileTransferFECLog[a]];
+}
+
+// Cauchy coefficient of data symbol j in parity symbol p. p >= k > j so they never cancel out.
+static inline uint8_t FileTransferFECCoefficient(size_t p, size_t j) {
+    return FileTransferFECInverse((uint8_t)(p ^ j));
+}
+
+// destination += coefficient * source
+static void FileTransferFECAddMultiple(uint8_t *destination, const uint8_t *source, uint8_t coefficient, size_t length) {
+    if (coefficient == 0) return;
+    
+    if (coefficient == 1) {
+        for (size_t i = 0; i < length; i++) destination[i] ^= source[i];
+        return;
+    }
+    
+    unsigned logCoefficient = FileTransferFECLog[coefficient];
+    for (size_t i = 0; i < length; i++) {
+        if (source[i]) destination[i] ^= FileTransferFECExp[logCoefficient + FileTransferFECLog[source[i]]];
+    }
+}
+
+static void FileTransferFECScale(uint8_t *bytes, uint8_t coefficient, size_t length) {
+    if (coefficient == 1) return;
+    
+    unsigned logCoefficient = FileTransferFECLog[coefficient];
+    for (size_t i = 0; i < length; i++) {
+        if (bytes[i]) bytes[i] = FileTransferFECExp[logCoefficient + FileTransferFECLog[bytes[i]]];
+    }
+}
+
+// MARK: - Layout
+size_t FileTransferFECDataSymbols(size_t chunkLength) {
+    size_t k = (chunkLength + FileTransferFECMaxPayload - 1) / FileTransferFECMaxPayload;
+    if (k < 1) k = 1;
+    if (k > FileTransferFECMaxSymbols - 1) k = FileTransferFECMaxSymbols - 1;
+    
+    return k;
+}
+
+size_t FileTransferFECParitySymbols(size_t k, double redundancy) {
+    size_t m = (size_t)(k * redundancy + 0.999);
+    if (m < 1) m = 1;
+    if (k + m > FileTransferFECMaxSymbols) m = FileTransferFECMaxSymbols - k;
+    
+    return m;
+}
+
+size_t FileTransferFECSymbolLength(size_t chunkLength, size_t k) {
+    return (chunkLength + k - 1) / k;
+}
+
+// k is capped so k + m fits FileTransferFECMaxSymbols, past that symbols grow over FileTransferFECMaxPayload.
+size_t FileTransferFECMaxChunkLength(double redundancy) {
+    size_t k = FileTransferFECMaxSymbols - 1;
+    
+    while (k > 1) {
+        double m = k * redundancy + 0.999;
+        if (m < 1) m = 1;
+        if ((double)k + (double)(uint64_t)m <= FileTransferFECMaxSymbols) break;
+        
+        k--;
+    }
+    
+    return k * FileTransferFECMaxPayload;
+}
+
+static inline void FileTransferFECWrite16(uint8_t *bytes, uint16_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+static inline void FileTransferFECWrite32(uint8_t *bytes, uint32_t value) {
+    for (int i = 0; i < 4; i++) bytes[i] = (uint8_t)(value >> (8 * i));
+}
+
+static inline void FileTransferFECWrite64(uint8_t *bytes, uint64_t value) {
+    for (int i = 0; i < 8; i++) bytes[i] = (uint8_t)(value >> (8 * i));
+}
+
+static inline uint32_t FileTransferFECRead32(const uint8_t *bytes) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | bytes[i];
+    
+    return value;
+}
+
+static inline uint64_t FileTransferFECRead64(const uint8_t *bytes) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | bytes[i];
+    
+    return value;
+}
+
+void FileTransferFECEncodeHeader(const FileTransferFECHeader *header, uint8_t bytes[FileTransferFECHeaderLength]) {
+    FileTransferFECWrite16(bytes, FileTransferFECMagic);
+    bytes[2] = header->k;
+    bytes[3] = header->symbol;
+    FileTransferFECWrite32(bytes + 4, header->chunk);
+    FileTransferFECWrite64(bytes + 8, header->transferID);
+    FileTransferFECWrite32(bytes + 16, header->chunkLength);
+}
+
+bool FileTransferFECDecodeHeader(const uint8_t *bytes, size_t length, FileTransferFECHeader *header) {
+    if (length < FileTransferFECHeaderLength) return false;
+    if ((uint16_t)(bytes[0] | (bytes[1] << 8)) != FileTransferFECMagic) return false;
+    
+    header->k = bytes[2];
+    header->symbol = bytes[3];
+    header->chunk = FileTransferFECRead32(bytes + 4);
+    header->transferID = FileTransferFECRead64(bytes + 8);
+    header->chunkLength = FileTransferFECRead32(bytes + 16);
+    
+    return header->k > 0 && header->symbol < FileTransferFECMaxSymbols;
+}
+
+// MARK: - Coding
+void FileTransferFECEncode(const uint8_t *const *data, size_t k, size_t symbolLength, size_t index, uint8_t *parity) {
+    memset(parity, 0, symbolLength);
+    
+    for (size_t j = 0; j < k; j++) {
+        FileTransferFECAddMultiple(parity, data[j], FileTransferFECCoefficient(index, j), symbolLength);
+    }
+}
+
+bool FileTransferFECDecode(uint8_t **symbols, uint8_t *indices, size_t k, size_t symbolLength, uint8_t *scratch) {
+    if (k == 0 || k >= FileTransferFECMaxSymbols) return false;
+    
+    // Move every data symbol we got to its own slot. The slots left over hold parity.
+    bool seen[FileTransferFECMaxSymbols] = {false};
+    for (size_t i = 0; i < k; i++) {
+        if (indices[i] >= FileTransferFECMaxSymbols || seen[indices[i]]) return false;
+        seen[indices[i]] = true;
+    }
+    
+    for (size_t i = 0; i < k; i++) {
+        while (indices[i] < k && indices[i] != i) {
+            size_t j = indices[i];
+            
+            uint8_t *symbol = symbols[j];
+            symbols[j] = symbols[i];
+            symbols[i] = symbol;
+            
+            indices[i] = indices[j];
+            indices[j] = (uint8_t)j;
+        }
+    }
+    
+    size_t missing[FileTransferFECMaxSymbols];
+    size_t missingCount = 0;
+    for (size_t j = 0; j < k; j++) {
+        if (indices[j] != j) missing[missingCount++] = j;
+    }
+    
+    if (missingCount == 0) return true;
+    
+    // Take the data we have out of each parity symbol, what's left only depends on the missing data.
+    for (size_t r = 0; r < missingCount; r++) {
+        uint8_t *parity = symbols[missing[r]];
+        size_t p = indices[missing[r]];
+        
+        for (size_t j = 0; j < k; j++) {
+            if (indices[j] == j) FileTransferFECAddMultiple(parity, symbols[j], FileTransferFECCoefficient(p, j), symbolLength);
+        }
+        
+        for (size_t c = 0; c < missingCount; c++) {
+            scratch[r * missingCount + c] = FileTransferFECCoefficient(p, missing[c]);
+        }
+    }
+    
+    // Gauss-Jordan on that square Cauchy matrix, applying every row operation to the symbols as well.
+    for (size_t c = 0; c < missingCount; c++) {
+        size_t pivot = c;
+        while (pivot < missingCount && scratch[pivot * missingCount + c] == 0) pivot++;
+        if (pivot == missingCount) return false;
+        
+        if (pivot != c) {
+            for (size_t i = 0; i < missingCount; i++) {
+                uint8_t value = scratch[c * missingCount + i];
+                scratch[c * missingCount + i] = scratch[pivot * missingCount + i];
+                scratch[pivot * missingCount + i] = value;
+            }
+            
+            uint8_t *symbol = symbols[missing[c]];
+            symbols[missing[c]] = symbols[missing[pivot]];
+            symbols[missing[pivot]] = symbol;
+        }
+        
+        uint8_t inverse = FileTransferFECInverse(scratch[c * missingCount + c]);
+        for (size_t i = 0; i < missingCount; i++) {
+            scratch[c * missingCount + i] = FileTransferFECMultiply(scratch[c * missingCount + i], inverse);
+        }
+        FileTransferFECScale(symbols[missing[c]], inverse, symbolLength);
+        
+        for (size_t r = 0; r < missingCount; r++) {
+            uint8_t factor = scratch[r * missingCount + c];
+            if (r == c || factor == 0) continue;
+            
+            for (size_t i = 0; i < missingCount; i++) {
+                scratch[r * missingCount + i] ^= FileTransferFECMultiply(factor, scratch[c * missingCount + i]);
+            }
+            FileTransferFECAddMultiple(symbols[missing[r]], symbols[missing[c]], factor, symbolLength);
+        }
+    }
+    
+    for (size_t r = 0; r < missingCount; r++) {
+        indices[missing[r]] = (uint8_t)missing[r];
+    }
+    
+    return true;
+}
@@ -0,0 +1,60 @@
+//
+//  FileTransferFEC.h
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#ifndef FileTransferFEC_h
+#define FileTransferFEC_h
+
+// Reed-Solomon erasure code over GF(256) for multicast chunks. A chunk is cut into k data symbols that go
+// out as they are, followed by m parity symbols. Any k of the k + m symbols rebuild the chunk, so a listener
+// can lose up to m datagrams of every chunk without asking for it again. The parity rows come from a Cauchy
+// matrix, every k by k choice of rows is invertible.
+//
+// Each symbol travels in one datagram behind a fixed header:
+//
+//   magic u16 | k u8 | symbol u8 | chunk u32 | transfer u64 | chunk length u32   (20 bytes)
+//
+// followed by ceil(chunk length / k) bytes, the last data symbol padded with zeros. Little endian.
+// Plain C so it can be benchmarked and checked away from the sockets.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FileTransferFECMagic 0x4D41// "AM"
+#define FileTransferFECHeaderLength 20
+#define FileTransferFECMaxSymbols 255// k + m
+#define FileTransferFECMaxPayload 1380// Symbol bytes per datagram, keeps it under a Wi-Fi MTU
+
+typedef struct {
+    uint8_t k;// Data symbols in the chunk
+    uint8_t symbol;// Below k data, from k on parity
+    uint32_t chunk;// Index in the file
+    uint64_t transferID;
+    uint32_t chunkLength;
+} FileTransferFECHeader;
+
+// MARK: - Layout
+size_t FileTransferFECDataSymbols(size_t chunkLength);// k for a chunk, so each symbol fits FileTransferFECMaxPayload.
+size_t FileTransferFECParitySymbols(size_t k, double redundancy);// m for redundancy parity per data symbol, at least 1.
+size_t FileTransferFECSymbolLength(size_t chunkLength, size_t k);
+size_t FileTransferFECMaxChunkLength(double redundancy);// Longest chunk whose k + m symbols all fit a datagram, without cutting m short.
+
+void FileTransferFECEncodeHeader(const FileTransferFECHeader *header, uint8_t bytes[FileTransferFECHeaderLength]);
+bool FileTransferFECDecodeHeader(const uint8_t *bytes, size_t length, FileTransferFECHeader *header);// False if too short or not ours.
+
+// MARK: - Coding
+// Writes parity symbol index (k <= index < k + m) of the k data symbols to parity. Data symbols are symbolLength
+// long, pad the last one.
+void FileTransferFECEncode(const uint8_t *const *data, size_t k, size_t symbolLength, size_t index, uint8_t *parity);
+
+// Rebuilds the data symbols from any k symbols. symbols[i] holds symbol indices[i], on return symbols[j] holds
+// data symbol j for every j < k, the pointers are swapped around to get there. False if the indices repeat or are
+// out of range. scratch must hold k * k bytes.
+bool FileTransferFECDecode(uint8_t **symbols, uint8_t *indices, size_t k, size_t symbolLength, uint8_t *scratch);
+
+#endif /* FileTransferFEC_h */
@@ -0,0 +1,90 @@
+//
+//  FileTransferManager.h
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "ConnectivityManager.h"
+
+// Streams a file to peers in fixed-size chunks instead of one packet holding all of it.
+//
+// The host sends an offer (a Load packet with the file's metadata), the peer answers with an ack holding the
+// length it already has and how many chunks it can take. From then on every chunk written is acked, and the
+// host never has more than that window of chunks on the way to a peer. It reads each chunk from disk as it
+// sends it, so its memory stays at a few chunks per peer whatever the file's length. Chunks are separate
+// packets, anything else sent meanwhile waits behind at most one window of them.
+//
+// Chunks don't have to come in order. The first and last go first so the file can be opened, then the ones
+// from the position the peer asked for, then the rest. The peer writes each one in place in a partial file
+// of the full length, and can play from it before it's complete, see FileTransferPlayable.
+//
+// Offers carry a hash of the file's content. Peers keep the files they received under it, up to cacheBudget,
+// dropping the least recently played first. Offered a file it has, a peer answers with its full length and
+// nothing else is sent, replaying a song or rejoining a session costs one round trip. A received file, or a
+// cached one, only counts once it hashes to the offer. One that doesn't is received again from scratch, the
+// peer holds its last ack until it knows.
+//
+// Songs coming up can be prefetched: offered the same way, straight into the cache. A prefetch only gets a small
+// window and goes to a peer when no other file is, so control packets and the current song never wait behind
+// more than a couple of its chunks. When the song comes up its offer takes the transfer over where it is.
+//
+// If a transfer is interrupted the peer notes which chunks it got. Offered the same transfer again, after a
+// reconnect for example, it carries on from there.
+//
+// Offered to multicastMinimumPeers or more at once, the file goes out once to a multicast group instead, each
+// chunk cut into datagrams with Reed-Solomon parity so a peer rebuilds it from any k of them (FileTransferFEC.h).
+// At the end of the pass every peer answers with a bitmap of the chunks it still misses, and gets those over
+// its stream like above. A peer that can't join the group just misses everything.
+//
+// Everything runs on the connectivity manager's delegate queue, except FileTransferAvailability.
+
+#define FileTransferDefaultChunkSize 65536
+#define FileTransferMinChunkSize 4096// Peers refuse offers with chunks outside these
+#define FileTransferMaxChunkSize 1048576
+#define FileTransferDefaultWindow 8
+#define FileTransferDefaultCacheBudget 536870912
+#define FileTransferDefaultMulticastMinimumPeers 3
+#define FileTransferDefaultMulticastRedundancy 0.1
+#define FileTransferDefaultMulticastBytesPerSecond 2000000
+
+typedef NS_ENUM(NSUInteger, FileTransferDistribution) {
+    FileTransferDistributionUnicast,// A stream per peer
+    FileTransferDistributionMulticast// Once to the group when enough peers are offered the file together
+};
+
+typedef void(^FileTransferCompletion)(NSURL * _Nullable url, NSError * _Nullable error);
+typedef BOOL(^FileTransferAvailability)(uint64_t offset, uint64_t length);// Wether those bytes of the file are in. Lock free, safe on the audio thread.
+typedef void(^FileTransferPlayable)(NSURL * _Nonnull url, uint64_t length, FileTransferAvailability _Nonnull availability);// The file's head and tail are in, it can be opened. The rest fills in as availability says.
+
+@interface FileTransferManager : NSObject
+
++ (_Nullable instancetype)sharedManager;
+
+// Host
+- (void)sendFileAtURL:(NSURL * _Nonnull)url withOffer:(Packet * _Nonnull)offer toSockets:(NSArray <GCDAsyncSocket *> * _Nonnull)sockets;// Offer is a Load packet with the metadata set, the transfer fields get added to it. Sending the same unchanged file again resumes it.
+- (void)prefetchFileAtURL:(NSURL * _Nonnull)url toSockets:(NSArray <GCDAsyncSocket *> * _Nonnull)sockets;// Peers cache it without playing it. Send it later like any file, the offer is all that's left.
+- (void)cancelTransferToSocket:(GCDAsyncSocket * _Nonnull)socket;
+- (void)cancelAllTransfers;
+- (void)benchmarkDistributionWithListeners:(NSUInteger)listeners;// Logs the host's bytes on the wire for 1, 2, 4... up to listeners, unicast against multicast, simulated in process with the real codec.
+
+// Peer
+- (void)receiveFileForOffer:(Packet * _Nonnull)offer fromSocket:(GCDAsyncSocket * _Nonnull)socket playable:(FileTransferPlayable _Nullable)playable completion:(FileTransferCompletion _Nonnull)completion;// Completion gets the file in the cache, play it from there. Straight away if it was cached already.
+- (void)prioritizeOffset:(uint64_t)offset;// Asks the host to send the current transfer from there on next, once per chunk.
+- (BOOL)hasReceivedRangeAtOffset:(uint64_t)offset length:(uint64_t)length;// Of the current transfer.
+- (void)cancelReceiving;// Partial files are kept, the same transfer offered again resumes.
+
+@property (nonatomic) NSUInteger chunkSize;// Host. Bytes in each chunk, 4KB to 1MB. Defaults to 64KB. Multicast caps it to FileTransferFECMaxChunkLength, 311KB at the default redundancy.
+@property (nonatomic) FileTransferDistribution distribution;// Host. Defaults to multicast.
+@property (nonatomic) NSUInteger multicastMinimumPeers;// Host. Defaults to 3, fewer get streams.
+@property (nonatomic) double multicastRedundancy;// Host. Parity symbols per data symbol. Defaults to 0.1.
+@property (nonatomic) NSUInteger multicastBytesPerSecond;// Host. Pace of the pass, parity included. Defaults to 2MB/s.
+@property (nonatomic) NSUInteger receiveWindow;// Peer. Chunks the host may have on the way to us. Defaults to 8.
+@property (nonatomic) uint64_t cacheBudget;// Peer. Bytes of received songs kept on disk, and the longest file accepted. Defaults to 512MB.
+@property (nonatomic, readonly) uint64_t bytesReceived;// Peer. Of the current transfer, including what was resumed.
+@property (nonatomic, readonly) uint64_t expectedLength;// Peer. Of the current transfer, 0 if none.
+
+@end
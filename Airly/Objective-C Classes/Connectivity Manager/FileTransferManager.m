@@ -0,0 +1,1245 @@
+//
+//  FileTransferManager.m
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#import "FileTransferManager.h"
+#import "FileTransferFEC.h"
+#import "FileTransferSimulator.h"
+
+// Frameworks
+#import <stdatomic.h>
+#import <CommonCrypto/CommonDigest.h>
+
+#define FileTransferPartialPrefix @"Transfer-"
+#define FileTransferPartialExtension @"part"
+#define FileTransferChunkMapExtension @"chunks"// Which chunks of the partial file are in, kept when a transfer is interrupted
+#define FileTransferCacheDirectory @"Songs"// In Caches, files named by the hex of their content hash
+#define FileTransferBackgroundWindow 2// Chunks of a prefetch on the way to a peer, keeps what's queued ahead of control packets short
+#define FileTransferMulticastGroup @"239.255.65.76"
+#define FileTransferMulticastPort 45876
+
+// Host. Where one peer is in a transfer.
+@interface FileTransferPeer : NSObject
+
+@property (strong, nonatomic) NSMutableIndexSet *pendingChunks;// Not sent yet
+@property (nonatomic) NSUInteger inFlight;// Sent and not acked
+@property (nonatomic) NSUInteger cursor;// Chunks from here on go first, the peer moves it to where it plays
+@property (nonatomic) NSUInteger window;// In chunks, 0 until the peer answered the offer
+@property (nonatomic) BOOL multicast;// Gets the multicast pass, then only what it still misses over its stream
+
+@end
+
+@implementation FileTransferPeer
+@end
+
+// Host. A file being sent, to any number of peers.
+@interface FileTransferSend : NSObject
+
+@property (nonatomic) uint64_t transferID;
+@property (nonatomic) uint64_t length;
+@property (nonatomic) NSUInteger chunkSize;
+@property (nonatomic) NSUInteger chunkCount;
+@property (strong, nonatomic) NSURL *url;
+@property (strong, nonatomic) NSDate *modificationDate;// With length, tells an unchanged file from a new one at the same URL
+@property (strong, nonatomic) NSData *contentHash;
+@property (strong, nonatomic) NSFileHandle *fileHandle;
+@property (strong, nonatomic) NSMapTable <GCDAsyncSocket *, FileTransferPeer *> *peers;
+@property (nonatomic) BOOL multicasting;// A pass is running
+@property (nonatomic) BOOL multicastPending;// Starts once a peer answers that it needs the file
+@property (nonatomic) BOOL background;// A prefetch, only sent to a peer when nothing else is
+
+@end
+
+@implementation FileTransferSend
+@end
+
+// Peer. Symbols of one multicast chunk, until there are enough to rebuild it. Multicast queue only.
+@interface FileTransferFECBlock : NSObject {
+@public
+    uint8_t indices[FileTransferFECMaxSymbols];
+}
+
+@property (nonatomic) size_t k;
+@property (nonatomic) size_t count;
+@property (nonatomic) size_t chunkLength;
+@property (nonatomic) size_t symbolLength;
+@property (strong, nonatomic) NSMutableData *symbols;// count symbols back to back
+
+@end
+
+@implementation FileTransferFECBlock
+@end
+
+// Peer. A file being received, written in place as chunks arrive in any order.
+@interface FileTransferReceive : NSObject {
+@public
+    _Atomic uint8_t *chunkMap;// 1 once a chunk is on disk. Read from the audio thread, see -availability
+}
+
+@property (nonatomic) uint64_t transferID;
+@property (nonatomic) uint64_t length;
+@property (nonatomic) uint64_t bytesReceived;
+@property (nonatomic) NSUInteger chunkSize;
+@property (nonatomic) NSUInteger chunkCount;
+@property (nonatomic) NSUInteger chunksReceived;
+@property (nonatomic) NSUInteger prioritizedChunk;// Last one asked of the host, NSNotFound if none
+@property (nonatomic) BOOL announcedPlayable;
+@property (nonatomic) BOOL verifying;// All in, being hashed
+@property (strong, nonatomic) Packet *heldAck;// The last one the host waits on, sent once the file checks out
+@property (strong, nonatomic) NSData *contentHash;// As offered, nil if the offer had none
+@property (nonatomic) double multicastRedundancy;// As offered, bounds the symbols a multicast chunk can have
+@property (strong, nonatomic) NSURL *partialURL;
+@property (strong, nonatomic) NSURL *cacheURL;// Where the file goes once it's all in, nil if the offer had no hash
+@property (strong, nonatomic) NSFileHandle *fileHandle;
+@property (weak, nonatomic) GCDAsyncSocket *socket;
+@property (copy, nonatomic) FileTransferPlayable playable;
+@property (copy, nonatomic) FileTransferCompletion completion;
+
+@end
+
+@implementation FileTransferReceive
+
+- (instancetype)initWithLength:(uint64_t)length chunkSize:(NSUInteger)chunkSize {
+    self = [super init];
+    
+    if (self) {
+        self.length = length;
+        self.chunkSize = MAX(chunkSize, 1);
+        self.chunkCount = (NSUInteger)((length + self.chunkSize - 1) / self.chunkSize);
+        self.prioritizedChunk = NSNotFound;
+        chunkMap = calloc(MAX(self.chunkCount, 1), sizeof(_Atomic uint8_t));
+        if (!chunkMap) return nil;
+    }
+    
+    return self;
+}
+
+- (void)dealloc {
+    free((void *)chunkMap);
+}
+
+- (BOOL)hasChunk:(NSUInteger)index {
+    return atomic_load_explicit(&chunkMap[index], memory_order_acquire) != 0;
+}
+
+- (NSUInteger)lengthOfChunk:(NSUInteger)index {
+    return (NSUInteger)MIN((uint64_t)self.chunkSize, self.length - (uint64_t)index * self.chunkSize);
+}
+
+- (uint64_t)contiguousLength {
+    NSUInteger index = 0;
+    while (index < self.chunkCount && [self hasChunk:index]) index++;
+    
+    return MIN((uint64_t)index * self.chunkSize, self.length);
+}
+
+// Lock free, only reads the chunk map. The block keeps the map alive for as long as a player holds it.
+- (FileTransferAvailability)availability {
+    FileTransferReceive *receive = self;
+    _Atomic uint8_t *map = chunkMap;
+    uint64_t fileLength = self.length;
+    uint64_t chunkSize = self.chunkSize;
+    
+    return ^BOOL(uint64_t offset, uint64_t length) {
+        (void)receive;// Owns map
+        if (offset >= fileLength) return YES;// Nothing past the end to wait for
+        
+        uint64_t end = MIN(offset + MAX(length, 1), fileLength);
+        for (uint64_t index = offset / chunkSize; index * chunkSize < end; index++) {
+            if (atomic_load_explicit(&map[index], memory_order_acquire) == 0) return NO;
+        }
+        
+        return YES;
+    };
+}
+
+@end
+
+@interface FileTransferManager () <GCDAsyncUdpSocketDelegate>
+
+@property (strong, nonatomic) NSMutableDictionary <NSNumber *, FileTransferSend *> *sends;
+@property (strong, nonatomic) NSMutableDictionary <NSNumber *, FileTransferReceive *> *receives;
+@property (nonatomic) uint64_t lastOfferedTransferID;// Peer
+@property (strong, nonatomic) NSCache <NSString *, NSData *> *contentHashes;// Host. By path, size and modification date
+
+// Multicast. Datagrams are built and read on multicastQueue, everything else stays on the main queue.
+@property (strong, nonatomic) dispatch_queue_t multicastQueue;
+@property (strong, nonatomic) GCDAsyncUdpSocket *multicastSendSocket;// Host. Unbound, never receives
+@property (strong, nonatomic) GCDAsyncUdpSocket *multicastReceiveSocket;// Peer. Bound and in the group while a transfer is on
+@property (strong, nonatomic) dispatch_source_t multicastTimer;// Host. Paces the running pass
+@property (strong, nonatomic) FileTransferReceive *multicastReceive;// Peer. Multicast queue only
+@property (copy, nonatomic) NSString *multicastHost;// Peer. Address datagrams have to come from. Multicast queue only
+@property (strong, nonatomic) NSMutableDictionary <NSNumber *, FileTransferFECBlock *> *multicastBlocks;// Peer. Multicast queue only
+
+@end
+
+@implementation FileTransferManager
+
++ (instancetype)sharedManager {
+    static FileTransferManager *sharedManager = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedManager = [[self alloc] init];
+        
+        sharedManager.sends = [NSMutableDictionary new];
+        sharedManager.receives = [NSMutableDictionary new];
+        sharedManager.chunkSize = FileTransferDefaultChunkSize;
+        sharedManager.receiveWindow = FileTransferDefaultWindow;
+        sharedManager.cacheBudget = FileTransferDefaultCacheBudget;
+        sharedManager.contentHashes = [NSCache new];
+        sharedManager.distribution = FileTransferDistributionMulticast;
+        sharedManager.multicastMinimumPeers = FileTransferDefaultMulticastMinimumPeers;
+        sharedManager.multicastRedundancy = FileTransferDefaultMulticastRedundancy;
+        sharedManager.multicastBytesPerSecond = FileTransferDefaultMulticastBytesPerSecond;
+        sharedManager.multicastQueue = dispatch_queue_create("Airly.FileTransfer.Multicast", DISPATCH_QUEUE_SERIAL);
+        sharedManager.multicastBlocks = [NSMutableDictionary new];
+        
+        [sharedManager registerPacketHandlers];
+    });
+    
+    return sharedManager;
+}
+
+- (void)registerPacketHandlers {
+    __weak typeof(self) weakSelf = self;
+    ConnectivityManager *connectivityManager = [ConnectivityManager sharedManager];
+    
+    [connectivityManager registerCommand:PacketCommandFileChunk handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleChunkPacket:packet fromSocket:socket];
+    }];
+    
+    [connectivityManager registerCommand:PacketCommandFileAck handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleAckPacket:packet fromSocket:socket];
+    }];
+    
+    [connectivityManager registerCommand:PacketCommandFileMulticastEnd handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleMulticastEndPacket:packet fromSocket:socket];
+    }];
+    
+    [connectivityManager registerCommand:PacketCommandFilePrefetch handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf receiveFileForOffer:packet fromSocket:socket playable:nil completion:^(NSURL *url, NSError *error) {
+            if (error) NSLog(@"Error prefetching song: %@", error);
+        } prefetch:YES];
+    }];
+}
+
+#pragma mark - Host
+- (void)sendFileAtURL:(NSURL *)url withOffer:(Packet *)offer toSockets:(NSArray<GCDAsyncSocket *> *)sockets {
+    [self sendFileAtURL:url withOffer:offer toSockets:sockets background:NO];
+}
+
+- (void)prefetchFileAtURL:(NSURL *)url toSockets:(NSArray<GCDAsyncSocket *> *)sockets {
+    Packet *offer = [[Packet alloc] initWithCommand:PacketCommandFilePrefetch type:PacketTypeFile action:PacketActionUnknown];
+    [self sendFileAtURL:url withOffer:offer toSockets:sockets background:YES];
+}
+
+- (void)sendFileAtURL:(NSURL *)url withOffer:(Packet *)offer toSockets:(NSArray<GCDAsyncSocket *> *)sockets background:(BOOL)background {
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:url.path error:nil];
+    if (!attributes) {
+        NSLog(@"Can't send missing file %@.", url);
+        return;
+    }
+    
+    // Hash the file once, off the main queue, then come back with it.
+    NSString *hashKey = [NSString stringWithFormat:@"%@|%llu|%f", url.path, [attributes fileSize], [attributes fileModificationDate].timeIntervalSinceReferenceDate];
+    NSData *contentHash = [self.contentHashes objectForKey:hashKey];
+    
+    if (!contentHash) {
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            NSData *contentHash = [FileTransferManager contentHashOfFileAtURL:url];
+            
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (!contentHash) {
+                    NSLog(@"Can't read %@ to send it.", url);
+                    return;
+                }
+                
+                [self.contentHashes setObject:contentHash forKey:hashKey];
+                [self sendFileAtURL:url withOffer:offer toSockets:sockets background:background];
+            });
+        });
+        
+        return;
+    }
+    
+    // Same file, same transfer. Peers that already have part of it pick up where they left off.
+    FileTransferSend *send = nil;
+    for (FileTransferSend *existingSend in self.sends.allValues) {
+        if ([existingSend.url isEqual:url]) {
+            send = existingSend;
+            break;
+        }
+    }
+    
+    if (send && (send.length != [attributes fileSize] || ![send.modificationDate isEqualToDate:[attributes fileModificationDate]])) {
+        [self finishSend:send];
+        send = nil;
+    }
+    
+    if (!send) {
+        send = [FileTransferSend new];
+        uint64_t transferID = 0;
+        memcpy(&transferID, contentHash.bytes, sizeof(transferID));// The same song is the same transfer, even after the host restarts
+        send.transferID = transferID;
+        send.url = url;
+        send.length = [attributes fileSize];
+        send.modificationDate = [attributes fileModificationDate];
+        send.contentHash = contentHash;
+        send.chunkSize = self.chunkSize;
+        
+        // Multicast chunks have to fit FEC blocks of datagrams under the MTU, streams take them the same size.
+        size_t multicastChunkSize = FileTransferFECMaxChunkLength(self.multicastRedundancy);
+        if (self.distribution == FileTransferDistributionMulticast && multicastChunkSize >= FileTransferMinChunkSize) {
+            send.chunkSize = MIN(send.chunkSize, multicastChunkSize);
+        }
+        
+        send.chunkCount = (NSUInteger)((send.length + send.chunkSize - 1) / send.chunkSize);
+        send.fileHandle = [NSFileHandle fileHandleForReadingFromURL:url error:nil];
+        send.peers = [NSMapTable strongToStrongObjectsMapTable];
+        send.background = background;
+        
+        if (!send.fileHandle) {
+            NSLog(@"Can't open %@ to send it.", url);
+            return;
+        }
+        
+        self.sends[@(send.transferID)] = send;
+        
+    } else if (background) {
+        if (!send.background) return;// Already going out for real
+        
+        // Only peers that joined since get the prefetch offer, the others are on their way.
+        NSMutableArray <GCDAsyncSocket *> *newSockets = [NSMutableArray new];
+        for (GCDAsyncSocket *socket in sockets) {
+            if (![send.peers objectForKey:socket]) [newSockets addObject:socket];
+        }
+        
+        if (newSockets.count == 0) return;
+        sockets = newSockets;
+        
+    } else {
+        send.background = NO;// The prefetched song came up, it goes first now
+    }
+    
+    // Enough listeners and every chunk goes out once for all of them. A pass already running picks up the newcomers.
+    // Prefetches trickle to each peer between everything else instead.
+    BOOL multicast = !background && (self.distribution == FileTransferDistributionMulticast) && (sockets.count >= self.multicastMinimumPeers || send.multicasting || send.multicastPending) && send.chunkSize <= FileTransferFECMaxChunkLength(self.multicastRedundancy);
+    
+    for (GCDAsyncSocket *socket in sockets) {
+        FileTransferPeer *peer = [FileTransferPeer new];
+        peer.multicast = multicast;
+        [send.peers setObject:peer forKey:socket];
+    }
+    
+    [offer setUInt64:send.transferID forField:PacketFieldTransferID];
+    [offer setUInt64:send.length forField:PacketFieldLength];
+    [offer setUInt64:send.chunkSize forField:PacketFieldChunkSize];
+    [offer setData:send.contentHash forField:PacketFieldContentHash];
+    
+    if (multicast) {
+        [offer setUInt64:FileTransferMulticastPort forField:PacketFieldPort4];
+        [offer setDouble:self.multicastRedundancy forField:PacketFieldRedundancy];
+    }
+    
+    NSLog(@"Offering %llu bytes to %lu peers%@.", send.length, (unsigned long)sockets.count, multicast ? @" over multicast" : (background ? @" ahead of time" : @""));
+    [[ConnectivityManager sharedManager] sendPacket:offer toSockets:sockets];
+    
+    // Peers that have it cached say so first, the pass only goes out if one of them needs it.
+    if (multicast && !send.multicasting) {
+        send.multicastPending = YES;
+    }
+}
+
++ (NSData *)contentHashOfFileAtURL:(NSURL *)url {
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingFromURL:url error:nil];
+    if (!fileHandle) return nil;
+    
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    
+    while (true) {
+        @autoreleasepool {
+            NSData *data = [fileHandle readDataOfLength:1048576];
+            if (data.length == 0) break;
+            
+            CC_SHA256_Update(&context, data.bytes, (CC_LONG)data.length);
+        }
+    }
+    
+    [fileHandle closeFile];
+    
+    NSMutableData *contentHash = [NSMutableData dataWithLength:CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(contentHash.mutableBytes, &context);
+    
+    return contentHash;
+}
+
+- (void)cancelTransferToSocket:(GCDAsyncSocket *)socket {
+    for (FileTransferSend *send in self.sends.allValues) {
+        if (![send.peers objectForKey:socket]) continue;
+        
+        [send.peers removeObjectForKey:socket];
+        [self settleSend:send];
+    }
+}
+
+- (void)cancelAllTransfers {
+    for (FileTransferSend *send in self.sends.allValues) {
+        [self finishSend:send];
+    }
+    
+    [self stopMulticast];
+    [self.multicastSendSocket close];
+    self.multicastSendSocket = nil;
+}
+
+// A pending pass only waits on multicast peers that haven't answered the offer yet. Once none is left, because
+// they all had it cached or went away, it never starts, and a send nobody is left on is done with.
+- (void)settleSend:(FileTransferSend *)send {
+    if (send.multicastPending) {
+        BOOL awaitingAnswer = NO;
+        for (FileTransferPeer *peer in send.peers.objectEnumerator) {
+            if (peer.multicast && !peer.pendingChunks) {
+                awaitingAnswer = YES;
+                break;
+            }
+        }
+        
+        if (!awaitingAnswer) send.multicastPending = NO;
+    }
+    
+    // Nobody left to send it to, a later offer hashes to the same transfer and resumes anyway.
+    if (send.peers.count == 0 && !send.multicasting && !send.multicastPending) {
+        [self finishSend:send];
+    }
+}
+
+- (void)finishSend:(FileTransferSend *)send {
+    if (send.multicasting) {
+        [self stopMulticast];
+    }
+    
+    [send.fileHandle closeFile];
+    [send.peers removeAllObjects];
+    [self.sends removeObjectForKey:@(send.transferID)];
+}
+
+// An ack answers the offer (Length, what the peer already has), the end of a multicast pass (Missing), a chunk
+// (Offset) or asks for a part of the file first (Position).
+- (void)handleAckPacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    FileTransferSend *send = self.sends[@([packet uint64ForField:PacketFieldTransferID])];
+    FileTransferPeer *peer = [send.peers objectForKey:socket];
+    if (!peer) return;// Cancelled or replaced meanwhile
+    
+    NSData *missing = [packet dataForField:PacketFieldMissing];
+    
+    if (missing) {
+        // Only what the pass didn't get through comes over the stream.
+        const uint8_t *bits = missing.bytes;
+        peer.pendingChunks = [NSMutableIndexSet indexSet];
+        for (NSUInteger index = 0; index < send.chunkCount && index / 8 < missing.length; index++) {
+            if (bits[index / 8] & (1 << (index % 8))) [peer.pendingChunks addIndex:index];
+        }
+        
+        NSLog(@"Peer %@ missed %lu of %lu chunks over multicast.", socket.connectedHost, (unsigned long)peer.pendingChunks.count, (unsigned long)send.chunkCount);
+        peer.inFlight = 0;
+        peer.cursor = 0;
+        
+    } else if ([packet hasField:PacketFieldLength]) {
+        uint64_t resumedLength = [packet uint64ForField:PacketFieldLength];
+        NSUInteger resumedChunks = (resumedLength >= send.length) ? send.chunkCount : (NSUInteger)(resumedLength / send.chunkSize);
+        
+        // Multicast peers missing anything wait for the pass, the first of them starts it.
+        if (peer.multicast && resumedChunks < send.chunkCount) {
+            if (send.multicastPending) {
+                send.multicastPending = NO;
+                [self startMulticastOfTransfer:send];
+            }
+            
+            return;
+        }
+        
+        peer.pendingChunks = [NSMutableIndexSet indexSetWithIndexesInRange:NSMakeRange(resumedChunks, send.chunkCount - MIN(resumedChunks, send.chunkCount))];
+        peer.inFlight = 0;
+        peer.cursor = resumedChunks;
+        
+    } else if (!peer.pendingChunks) {
+        return;// Chunks from before a re-offer, ours haven't started
+    }
+    
+    if ([packet hasField:PacketFieldOffset] && peer.inFlight > 0) {
+        peer.inFlight--;
+    }
+    
+    if ([packet hasField:PacketFieldPosition]) {
+        peer.cursor = (NSUInteger)([packet uint64ForField:PacketFieldPosition] / send.chunkSize);
+    }
+    
+    peer.window = (NSUInteger)MAX([packet uint64ForField:PacketFieldWindow], 1);
+    
+    if (peer.pendingChunks.count == 0 && peer.inFlight == 0) {
+        NSLog(@"Peer %@ received the whole file.", socket.connectedHost);
+        [send.peers removeObjectForKey:socket];
+        [self settleSend:send];
+        
+        [self sendBackgroundChunksToSocket:socket];
+        return;
+    }
+    
+    [self sendChunksOfTransfer:send toPeer:peer socket:socket];
+}
+
+// Whether a song the peer is waiting on is still going to it. Prefetches hold off until it's through.
+- (BOOL)isSendingForegroundToSocket:(GCDAsyncSocket *)socket {
+    for (FileTransferSend *send in self.sends.allValues) {
+        FileTransferPeer *peer = [send.peers objectForKey:socket];
+        
+        if (!send.background && peer && (peer.pendingChunks.count > 0 || peer.inFlight > 0 || send.multicasting || send.multicastPending)) {
+            return YES;
+        }
+    }
+    
+    return NO;
+}
+
+- (void)sendBackgroundChunksToSocket:(GCDAsyncSocket *)socket {
+    for (FileTransferSend *send in self.sends.allValues) {
+        FileTransferPeer *peer = [send.peers objectForKey:socket];
+        
+        if (send.background && peer) {
+            [self sendChunksOfTransfer:send toPeer:peer socket:socket];
+        }
+    }
+}
+
+// The head and tail first so the peer can open the file, then from the cursor on, then whatever was skipped.
+- (NSUInteger)nextChunkOfTransfer:(FileTransferSend *)send forPeer:(FileTransferPeer *)peer {
+    NSMutableIndexSet *pendingChunks = peer.pendingChunks;
+    
+    if ([pendingChunks containsIndex:0]) return 0;
+    if ([pendingChunks containsIndex:send.chunkCount - 1]) return send.chunkCount - 1;
+    
+    NSUInteger index = [pendingChunks indexGreaterThanOrEqualToIndex:peer.cursor];
+    return (index != NSNotFound) ? index : pendingChunks.firstIndex;
+}
+
+// Fills the peer's window. Each chunk is read right before it goes out, nothing else of the file is held.
+- (void)sendChunksOfTransfer:(FileTransferSend *)send toPeer:(FileTransferPeer *)peer socket:(GCDAsyncSocket *)socket {
+    NSUInteger window = peer.window;
+    
+    if (send.background) {
+        if ([self isSendingForegroundToSocket:socket]) return;
+        window = MIN(window, FileTransferBackgroundWindow);
+    }
+    
+    while (peer.pendingChunks.count > 0 && peer.inFlight < window) {
+        NSUInteger index = [self nextChunkOfTransfer:send forPeer:peer];
+        uint64_t offset = (uint64_t)index * send.chunkSize;
+        
+        [send.fileHandle seekToFileOffset:offset];
+        NSData *chunk = [send.fileHandle readDataOfLength:(NSUInteger)MIN((uint64_t)send.chunkSize, send.length - offset)];
+        
+        if (chunk.length == 0) {
+            NSLog(@"File %@ ended early at %llu, stopping its transfer.", send.url, offset);
+            [send.peers removeObjectForKey:socket];
+            return;
+        }
+        
+        Packet *packet = [[Packet alloc] initWithCommand:PacketCommandFileChunk type:PacketTypeFile action:PacketActionUnknown];
+        [packet setUInt64:send.transferID forField:PacketFieldTransferID];
+        [packet setUInt64:offset forField:PacketFieldOffset];
+        [packet setData:chunk forField:PacketFieldFile];
+        packet.priority = PacketPriorityBulk;
+        
+        [[ConnectivityManager sharedManager] sendPacket:packet toSockets:@[socket]];
+        [peer.pendingChunks removeIndex:index];
+        peer.inFlight++;
+    }
+}
+
+#pragma mark - Peer
+- (void)receiveFileForOffer:(Packet *)offer fromSocket:(GCDAsyncSocket *)socket playable:(FileTransferPlayable)playable completion:(FileTransferCompletion)completion {
+    [self receiveFileForOffer:offer fromSocket:socket playable:playable completion:completion prefetch:NO];
+}
+
+// A prefetch only fills the cache. It doesn't become the current transfer, and leaves one already running alone.
+- (void)receiveFileForOffer:(Packet *)offer fromSocket:(GCDAsyncSocket *)socket playable:(FileTransferPlayable)playable completion:(FileTransferCompletion)completion prefetch:(BOOL)prefetch {
+    if (![offer hasField:PacketFieldTransferID] || ![offer hasField:PacketFieldLength]) {
+        completion(nil, [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{NSLocalizedDescriptionKey: @"The offer has no transfer."}]);
+        return;
+    }
+    
+    // The offer sizes what we allocate and write, a bogus one mustn't take the memory or the disk.
+    uint64_t length = [offer uint64ForField:PacketFieldLength];
+    uint64_t chunkSize = [offer uint64ForField:PacketFieldChunkSize];
+    if (chunkSize < FileTransferMinChunkSize || chunkSize > FileTransferMaxChunkSize || length > self.cacheBudget) {
+        NSLog(@"Refused an offer of %llu bytes in %llu byte chunks.", length, chunkSize);
+        completion(nil, [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadTooLargeError userInfo:@{NSLocalizedDescriptionKey: @"The offered file is too large or badly chunked."}]);
+        return;
+    }
+    
+    uint64_t transferID = [offer uint64ForField:PacketFieldTransferID];
+    NSData *contentHash = [offer dataForField:PacketFieldContentHash];
+    NSURL *cacheURL = contentHash ? [self cacheURLForContentHash:contentHash] : nil;
+    
+    // Cached, the whole length answers the offer and nothing gets sent. The file has to hash to the offer,
+    // the same length isn't enough. One that doesn't is dropped and received again.
+    NSDictionary *cacheAttributes = cacheURL ? [[NSFileManager defaultManager] attributesOfItemAtPath:cacheURL.path error:nil] : nil;
+    if (cacheAttributes && [cacheAttributes fileSize] == length && !self.receives[@(transferID)]) {
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            BOOL matches = [[FileTransferManager contentHashOfFileAtURL:cacheURL] isEqualToData:contentHash];
+            
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (!matches) {
+                    NSLog(@"Cached song %@ doesn't match its hash, receiving it again.", cacheURL.lastPathComponent);
+                    [[NSFileManager defaultManager] removeItemAtURL:cacheURL error:nil];
+                    [self receiveFileForOffer:offer fromSocket:socket playable:playable completion:completion prefetch:prefetch];
+                    return;
+                }
+                
+                [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate: [NSDate date]} ofItemAtPath:cacheURL.path error:nil];
+                if (!prefetch) self.lastOfferedTransferID = transferID;
+                
+                Packet *packet = [[Packet alloc] initWithCommand:PacketCommandFileAck type:PacketTypeFile action:PacketActionUnknown];
+                [packet setUInt64:transferID forField:PacketFieldTransferID];
+                [packet setUInt64:length forField:PacketFieldLength];
+                [[ConnectivityManager sharedManager] sendPacket:packet toSockets:@[socket]];
+                
+                NSLog(@"Song %@ is cached, skipping its transfer.", cacheURL.lastPathComponent);
+                completion(cacheURL, nil);
+            });
+        });
+        
+        return;
+    }
+    
+    // An offer we're already receiving only needs to hear what we have again.
+    FileTransferReceive *receive = self.receives[@(transferID)];
+    if (receive && prefetch) return;
+    
+    if (!receive) {
+        receive = [[FileTransferReceive alloc] initWithLength:length chunkSize:(NSUInteger)chunkSize];
+        if (!receive) {
+            completion(nil, [NSError errorWithDomain:NSPOSIXErrorDomain code:ENOMEM userInfo:@{NSLocalizedDescriptionKey: @"Not enough memory to receive the file."}]);
+            return;
+        }
+        
+        receive.transferID = transferID;
+        receive.partialURL = [self partialURLForTransfer:transferID];
+        receive.cacheURL = cacheURL;
+        receive.contentHash = contentHash;
+        
+        [self removePartialFilesExceptTransfer:transferID];
+        
+        // Resume from whatever an interrupted attempt left, if it noted which chunks it got.
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        NSURL *chunkMapURL = [receive.partialURL.URLByDeletingPathExtension URLByAppendingPathExtension:FileTransferChunkMapExtension];
+        NSData *chunkMap = [NSData dataWithContentsOfURL:chunkMapURL];
+        
+        if (![fileManager fileExistsAtPath:receive.partialURL.path] || chunkMap.length != receive.chunkCount) {
+            [fileManager createFileAtPath:receive.partialURL.path contents:nil attributes:nil];
+            chunkMap = nil;
+        }
+        
+        [fileManager removeItemAtURL:chunkMapURL error:nil];
+        
+        // Full length from the start, chunks are written where they belong and the player can open it early.
+        receive.fileHandle = [NSFileHandle fileHandleForWritingToURL:receive.partialURL error:nil];
+        if (!receive.fileHandle) {
+            completion(nil, [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:@{NSLocalizedDescriptionKey: @"Can't write the received file."}]);
+            return;
+        }
+        
+        [receive.fileHandle truncateFileAtOffset:receive.length];
+        
+        const uint8_t *chunks = chunkMap.bytes;
+        for (NSUInteger index = 0; index < chunkMap.length; index++) {
+            if (chunks[index]) {
+                atomic_store_explicit(&receive->chunkMap[index], 1, memory_order_release);
+                receive.chunksReceived++;
+                receive.bytesReceived += [receive lengthOfChunk:index];
+            }
+        }
+        
+        self.receives[@(transferID)] = receive;
+        
+        if (receive.chunksReceived > 0) {
+            NSLog(@"Resuming transfer with %lu of %lu chunks.", (unsigned long)receive.chunksReceived, (unsigned long)receive.chunkCount);
+        }
+    }
+    
+    receive.socket = socket;
+    receive.playable = playable;
+    receive.completion = completion;
+    if (!prefetch) self.lastOfferedTransferID = transferID;
+    
+    if ([offer hasField:PacketFieldPort4]) {
+        receive.multicastRedundancy = [offer doubleForField:PacketFieldRedundancy];
+        [self joinMulticastForTransfer:receive port:(uint16_t)[offer uint64ForField:PacketFieldPort4]];
+    }
+    
+    // Answer the offer with the chunks we have in a row, anything past them gets sent again and skipped.
+    Packet *packet = [self ackPacketForTransfer:receive];
+    [packet setUInt64:[receive contiguousLength] forField:PacketFieldLength];
+    [self sendFinalAckPacket:packet forTransfer:receive];
+    
+    [self updateTransfer:receive];
+}
+
+- (void)prioritizeOffset:(uint64_t)offset {
+    FileTransferReceive *receive = self.receives[@(self.lastOfferedTransferID)];
+    if (!receive || offset >= receive.length) return;
+    
+    NSUInteger index = (NSUInteger)(offset / receive.chunkSize);
+    if (index == receive.prioritizedChunk) return;
+    receive.prioritizedChunk = index;
+    
+    Packet *packet = [self ackPacketForTransfer:receive];
+    [packet setUInt64:offset forField:PacketFieldPosition];
+    [self sendAckPacket:packet forTransfer:receive];
+}
+
+- (BOOL)hasReceivedRangeAtOffset:(uint64_t)offset length:(uint64_t)length {
+    FileTransferReceive *receive = self.receives[@(self.lastOfferedTransferID)];
+    return receive ? [receive availability](offset, length) : NO;
+}
+
+- (void)cancelReceiving {
+    for (FileTransferReceive *receive in self.receives.allValues) {
+        [receive.fileHandle closeFile];
+        
+        // Note what we got, a later offer of the same transfer resumes from it.
+        NSMutableData *chunkMap = [NSMutableData dataWithLength:receive.chunkCount];
+        uint8_t *chunks = chunkMap.mutableBytes;
+        for (NSUInteger index = 0; index < receive.chunkCount; index++) {
+            chunks[index] = [receive hasChunk:index];
+        }
+        
+        [chunkMap writeToURL:[receive.partialURL.URLByDeletingPathExtension URLByAppendingPathExtension:FileTransferChunkMapExtension] atomically:YES];
+    }
+    
+    [self.receives removeAllObjects];
+    [self leaveMulticast];
+}
+
+- (void)handleChunkPacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    FileTransferReceive *receive = self.receives[@([packet uint64ForField:PacketFieldTransferID])];
+    if (!receive) return;
+    
+    uint64_t offset = [packet uint64ForField:PacketFieldOffset];
+    if (![self writeChunk:[packet dataForField:PacketFieldFile] atOffset:offset ofTransfer:receive]) return;
+    
+    // Chunks sent again after a resume are acked too, so the window keeps moving.
+    Packet *ack = [self ackPacketForTransfer:receive];
+    [ack setUInt64:offset forField:PacketFieldOffset];
+    [self sendFinalAckPacket:ack forTransfer:receive];
+    
+    [self updateTransfer:receive];
+}
+
+// NO if the chunk doesn't fit the file. One we already have isn't rewritten.
+- (BOOL)writeChunk:(NSData *)chunk atOffset:(uint64_t)offset ofTransfer:(FileTransferReceive *)receive {
+    NSUInteger index = (NSUInteger)(offset / receive.chunkSize);
+    
+    if (offset % receive.chunkSize != 0 || index >= receive.chunkCount || chunk.length != [receive lengthOfChunk:index]) {
+        NSLog(@"Dropped a bad chunk at %llu.", offset);
+        return NO;
+    }
+    
+    if (![receive hasChunk:index]) {
+        [receive.fileHandle seekToFileOffset:offset];
+        [receive.fileHandle writeData:chunk];
+        
+        atomic_store_explicit(&receive->chunkMap[index], 1, memory_order_release);
+        receive.chunksReceived++;
+        receive.bytesReceived += chunk.length;
+    }
+    
+    return YES;
+}
+
+- (Packet *)ackPacketForTransfer:(FileTransferReceive *)receive {
+    Packet *packet = [[Packet alloc] initWithCommand:PacketCommandFileAck type:PacketTypeFile action:PacketActionUnknown];
+    [packet setUInt64:receive.transferID forField:PacketFieldTransferID];
+    [packet setUInt64:self.receiveWindow forField:PacketFieldWindow];
+    
+    return packet;
+}
+
+- (void)sendAckPacket:(Packet *)packet forTransfer:(FileTransferReceive *)receive {
+    if (!receive.socket) return;
+    
+    [[ConnectivityManager sharedManager] sendPacket:packet toSockets:@[receive.socket]];
+}
+
+// An ack that tells the host we have everything waits until the file hashes to the offer, the host
+// forgets us after it and couldn't resend anything.
+- (void)sendFinalAckPacket:(Packet *)packet forTransfer:(FileTransferReceive *)receive {
+    if (receive.contentHash && receive.chunksReceived == receive.chunkCount && self.receives[@(receive.transferID)] == receive) {
+        receive.heldAck = packet;
+        return;
+    }
+    
+    [self sendAckPacket:packet forTransfer:receive];
+}
+
+// Tells the owner once the file can be opened, and once it's all in.
+- (void)updateTransfer:(FileTransferReceive *)receive {
+    BOOL hasHeadAndTail = (receive.chunkCount == 0) || ([receive hasChunk:0] && [receive hasChunk:receive.chunkCount - 1]);
+    
+    if (!receive.announcedPlayable && hasHeadAndTail && receive.playable) {
+        receive.announcedPlayable = YES;
+        receive.playable(receive.partialURL, receive.length, [receive availability]);
+    }
+    
+    if (receive.chunksReceived < receive.chunkCount || receive.verifying) return;
+    
+    if (!receive.contentHash) {
+        [self completeTransfer:receive];
+        return;
+    }
+    
+    // Nothing goes in the cache, or to the player as done, before it hashes to what was offered.
+    receive.verifying = YES;
+    NSURL *partialURL = receive.partialURL;
+    NSData *contentHash = receive.contentHash;
+    
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        BOOL matches = [[FileTransferManager contentHashOfFileAtURL:partialURL] isEqualToData:contentHash];
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            receive.verifying = NO;
+            if (self.receives[@(receive.transferID)] != receive) return;// Cancelled meanwhile
+            
+            if (matches) {
+                [self completeTransfer:receive];
+                
+            } else {
+                [self restartTransfer:receive];
+            }
+        });
+    });
+}
+
+// Drops every chunk and asks the host for all of them again. The partial file stays where it is, a player
+// may have it open, availability keeps it waiting until the chunks are back.
+- (void)restartTransfer:(FileTransferReceive *)receive {
+    NSLog(@"Received file doesn't match its hash, receiving all %llu bytes again.", receive.length);
+    
+    for (NSUInteger index = 0; index < receive.chunkCount; index++) {
+        atomic_store_explicit(&receive->chunkMap[index], 0, memory_order_release);
+    }
+    
+    receive.chunksReceived = 0;
+    receive.bytesReceived = 0;
+    receive.heldAck = nil;
+    
+    [receive.fileHandle truncateFileAtOffset:0];
+    [receive.fileHandle truncateFileAtOffset:receive.length];
+    [[NSFileManager defaultManager] removeItemAtURL:[receive.partialURL.URLByDeletingPathExtension URLByAppendingPathExtension:FileTransferChunkMapExtension] error:nil];
+    
+    // Every chunk missing, the host sends them all over the stream.
+    NSMutableData *missing = [NSMutableData dataWithLength:(receive.chunkCount + 7) / 8];
+    memset(missing.mutableBytes, 0xFF, missing.length);
+    
+    Packet *ack = [self ackPacketForTransfer:receive];
+    [ack setData:missing forField:PacketFieldMissing];
+    [self sendAckPacket:ack forTransfer:receive];
+}
+
+- (void)completeTransfer:(FileTransferReceive *)receive {
+    if (receive.heldAck) {
+        [self sendAckPacket:receive.heldAck forTransfer:receive];
+        receive.heldAck = nil;
+    }
+    
+    [receive.fileHandle closeFile];
+    [self.receives removeObjectForKey:@(receive.transferID)];
+    
+    NSLog(@"Received all %llu bytes of the file.", receive.length);
+    
+    // A player reading the partial file keeps its open file across the move.
+    NSURL *url = receive.partialURL;
+    if (receive.cacheURL) {
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        [fileManager createDirectoryAtURL:receive.cacheURL.URLByDeletingLastPathComponent withIntermediateDirectories:YES attributes:nil error:nil];
+        [fileManager removeItemAtURL:receive.cacheURL error:nil];
+        
+        NSError *error = nil;
+        if ([fileManager moveItemAtURL:receive.partialURL toURL:receive.cacheURL error:&error]) {
+            url = receive.cacheURL;
+            [self trimCacheKeepingURL:url];
+            
+        } else {
+            NSLog(@"Can't cache received song: %@", error);
+        }
+    }
+    
+    receive.completion(url, nil);
+    
+    dispatch_async(self.multicastQueue, ^{
+        if (self.multicastReceive == receive) {
+            self.multicastReceive = nil;
+            [self.multicastBlocks removeAllObjects];
+        }
+    });
+}
+
+#pragma mark - Cache
+- (NSURL *)cacheURLForContentHash:(NSData *)contentHash {
+    NSMutableString *name = [NSMutableString stringWithCapacity:contentHash.length * 2];
+    const uint8_t *bytes = contentHash.bytes;
+    for (NSUInteger i = 0; i < contentHash.length; i++) {
+        [name appendFormat:@"%02x", bytes[i]];
+    }
+    
+    NSURL *cachesURL = [[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask].firstObject;
+    return [[cachesURL URLByAppendingPathComponent:FileTransferCacheDirectory isDirectory:YES] URLByAppendingPathComponent:name isDirectory:NO];
+}
+
+// Drops the songs played longest ago until the cache fits cacheBudget. A hit touches its file, so the
+// modification date is when it was last offered.
+- (void)trimCacheKeepingURL:(NSURL *)keepURL {
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSArray <NSURLResourceKey> *keys = @[NSURLFileSizeKey, NSURLContentModificationDateKey];
+    NSArray <NSURL *> *urls = [fileManager contentsOfDirectoryAtURL:keepURL.URLByDeletingLastPathComponent includingPropertiesForKeys:keys options:NSDirectoryEnumerationSkipsHiddenFiles error:nil];
+    
+    NSMutableArray <NSDictionary *> *entries = [NSMutableArray arrayWithCapacity:urls.count];
+    uint64_t cacheLength = 0;
+    
+    for (NSURL *url in urls) {
+        NSDictionary *values = [url resourceValuesForKeys:keys error:nil];
+        cacheLength += [values[NSURLFileSizeKey] unsignedLongLongValue];
+        if (![url.lastPathComponent isEqualToString:keepURL.lastPathComponent]) [entries addObject:@{@"url": url, @"values": values ?: @{}}];
+    }
+    
+    [entries sortUsingComparator:^NSComparisonResult(NSDictionary *entry1, NSDictionary *entry2) {
+        return [entry1[@"values"][NSURLContentModificationDateKey] compare:entry2[@"values"][NSURLContentModificationDateKey]];
+    }];
+    
+    for (NSDictionary *entry in entries) {
+        if (cacheLength <= self.cacheBudget) break;
+        
+        if ([fileManager removeItemAtURL:entry[@"url"] error:nil]) {
+            cacheLength -= MIN(cacheLength, [entry[@"values"][NSURLFileSizeKey] unsignedLongLongValue]);
+            NSLog(@"Evicted cached song %@.", [entry[@"url"] lastPathComponent]);
+        }
+    }
+}
+
+- (NSURL *)partialURLForTransfer:(uint64_t)transferID {
+    NSString *name = [NSString stringWithFormat:@"%@%016llx.%@", FileTransferPartialPrefix, transferID, FileTransferPartialExtension];
+    return [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+}
+
+// Partial files of songs that were never finished would otherwise pile up.
+- (void)removePartialFilesExceptTransfer:(uint64_t)transferID {
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSString *keep = [self partialURLForTransfer:transferID].lastPathComponent.stringByDeletingPathExtension;
+    
+    for (NSString *name in [fileManager contentsOfDirectoryAtPath:NSTemporaryDirectory() error:nil]) {
+        BOOL isPartial = [name.pathExtension isEqualToString:FileTransferPartialExtension] || [name.pathExtension isEqualToString:FileTransferChunkMapExtension];
+        
+        if ([name hasPrefix:FileTransferPartialPrefix] && isPartial && ![name.stringByDeletingPathExtension isEqualToString:keep]) {
+            
+            BOOL receiving = NO;
+            for (FileTransferReceive *receive in self.receives.allValues) {
+                receiving = receiving || [receive.partialURL.lastPathComponent.stringByDeletingPathExtension isEqualToString:name.stringByDeletingPathExtension];
+            }
+            
+            if (!receiving) {
+                [fileManager removeItemAtPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name] error:nil];
+            }
+        }
+    }
+}
+
+#pragma mark - Multicast
+// The datagrams of one chunk, see FileTransferFEC.h.
+static NSArray <NSData *> *FileTransferMulticastDatagrams(NSData *chunk, NSUInteger index, uint64_t transferID, double redundancy) {
+    size_t k = FileTransferFECDataSymbols(chunk.length);
+    size_t m = FileTransferFECParitySymbols(k, redundancy);
+    size_t symbolLength = FileTransferFECSymbolLength(chunk.length, k);
+    
+    NSMutableData *padded = [NSMutableData dataWithData:chunk];
+    padded.length = k * symbolLength;
+    
+    const uint8_t *data[FileTransferFECMaxSymbols];
+    for (size_t j = 0; j < k; j++) data[j] = (const uint8_t *)padded.bytes + j * symbolLength;
+    
+    NSMutableArray <NSData *> *datagrams = [NSMutableArray arrayWithCapacity:k + m];
+    for (size_t symbol = 0; symbol < k + m; symbol++) {
+        NSMutableData *datagram = [NSMutableData dataWithLength:FileTransferFECHeaderLength + symbolLength];
+        uint8_t *bytes = datagram.mutableBytes;
+        
+        FileTransferFECHeader header = {(uint8_t)k, (uint8_t)symbol, (uint32_t)index, transferID, (uint32_t)chunk.length};
+        FileTransferFECEncodeHeader(&header, bytes);
+        
+        if (symbol < k) {
+            memcpy(bytes + FileTransferFECHeaderLength, data[symbol], symbolLength);
+            
+        } else {
+            FileTransferFECEncode(data, k, symbolLength, symbol, bytes + FileTransferFECHeaderLength);
+        }
+        
+        [datagrams addObject:datagram];
+    }
+    
+    return datagrams;
+}
+
+// Host. Sends every chunk once to the group, k data and m parity datagrams each, at multicastBytesPerSecond.
+// The head and tail go first like over a stream. Peers answer the end of the pass with what they still miss.
+- (void)startMulticastOfTransfer:(FileTransferSend *)send {
+    [self stopMulticast];
+    
+    if (send.chunkCount == 0) return;
+    
+    if (!self.multicastSendSocket) {
+        self.multicastSendSocket = [[GCDAsyncUdpSocket alloc] initWithDelegate:self delegateQueue:self.multicastQueue];
+    }
+    
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingFromURL:send.url error:nil];
+    if (!fileHandle) return;
+    
+    send.multicasting = YES;
+    
+    uint64_t transferID = send.transferID;
+    uint64_t length = send.length;
+    NSUInteger chunkSize = send.chunkSize;
+    NSUInteger chunkCount = send.chunkCount;
+    double redundancy = self.multicastRedundancy;
+    GCDAsyncUdpSocket *multicastSocket = self.multicastSendSocket;
+    
+    // One chunk per tick, its datagrams together.
+    double bytesPerChunk = chunkSize * (1.0 + redundancy);
+    uint64_t interval = (uint64_t)(bytesPerChunk / MAX(self.multicastBytesPerSecond, 1) * NSEC_PER_SEC);
+    __block NSUInteger position = 0;
+    
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.multicastQueue);
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, 0), interval, interval/10);
+    
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(timer, ^{
+        if (position >= chunkCount) {
+            dispatch_source_cancel(timer);
+            [fileHandle closeFile];
+            
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [weakSelf finishMulticastOfTransfer:transferID];
+            });
+            
+            return;
+        }
+        
+        // 0, last, 1, 2, ...
+        NSUInteger index = (position == 0) ? 0 : ((position == 1) ? chunkCount - 1 : position - 1);
+        position++;
+        
+        uint64_t offset = (uint64_t)index * chunkSize;
+        [fileHandle seekToFileOffset:offset];
+        NSData *chunk = [fileHandle readDataOfLength:(NSUInteger)MIN((uint64_t)chunkSize, length - offset)];
+        
+        for (NSData *datagram in FileTransferMulticastDatagrams(chunk, index, transferID, redundancy)) {
+            [multicastSocket sendData:datagram toHost:FileTransferMulticastGroup port:FileTransferMulticastPort withTimeout:-1 tag:0];
+        }
+    });
+    
+    self.multicastTimer = timer;
+    dispatch_resume(timer);
+}
+
+- (void)stopMulticast {
+    if (self.multicastTimer) {
+        dispatch_source_cancel(self.multicastTimer);
+        self.multicastTimer = nil;
+    }
+    
+    for (FileTransferSend *send in self.sends.allValues) {
+        send.multicasting = NO;
+    }
+}
+
+// Every multicast peer says what it missed, that comes over its stream.
+- (void)finishMulticastOfTransfer:(uint64_t)transferID {
+    FileTransferSend *send = self.sends[@(transferID)];
+    if (!send.multicasting) return;
+    
+    send.multicasting = NO;
+    self.multicastTimer = nil;
+    
+    NSMutableArray <GCDAsyncSocket *> *sockets = [NSMutableArray new];
+    for (GCDAsyncSocket *socket in send.peers) {
+        if ([send.peers objectForKey:socket].multicast) [sockets addObject:socket];
+    }
+    
+    Packet *packet = [[Packet alloc] initWithCommand:PacketCommandFileMulticastEnd type:PacketTypeFile action:PacketActionUnknown];
+    [packet setUInt64:transferID forField:PacketFieldTransferID];
+    
+    NSLog(@"Multicast pass done, asking %lu peers what they missed.", (unsigned long)sockets.count);
+    [[ConnectivityManager sharedManager] sendPacket:packet toSockets:sockets];
+}
+
+// Peer
+- (void)joinMulticastForTransfer:(FileTransferReceive *)receive port:(uint16_t)port {
+    if (!self.multicastReceiveSocket) {
+        GCDAsyncUdpSocket *multicastSocket = [[GCDAsyncUdpSocket alloc] initWithDelegate:self delegateQueue:self.multicastQueue];
+        NSError *error = nil;
+        
+        if (![multicastSocket enableReusePort:YES error:&error] || ![multicastSocket bindToPort:port error:&error] || ![multicastSocket joinMulticastGroup:FileTransferMulticastGroup error:&error] || ![multicastSocket beginReceiving:&error]) {
+            NSLog(@"Can't join the multicast group, the host will resend everything over the stream: %@", error);
+            [multicastSocket close];
+            return;
+        }
+        
+        self.multicastReceiveSocket = multicastSocket;
+    }
+    
+    // Anyone on the network can send to the group, only the host we're connected to is listened to.
+    NSString *host = receive.socket.connectedHost;
+    
+    dispatch_async(self.multicastQueue, ^{
+        self.multicastReceive = receive;
+        self.multicastHost = host;
+        [self.multicastBlocks removeAllObjects];
+    });
+}
+
+- (void)leaveMulticast {
+    [self.multicastReceiveSocket close];
+    self.multicastReceiveSocket = nil;
+    
+    dispatch_async(self.multicastQueue, ^{
+        self.multicastReceive = nil;
+        self.multicastHost = nil;
+        [self.multicastBlocks removeAllObjects];
+    });
+}
+
+- (void)handleMulticastEndPacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    uint64_t transferID = [packet uint64ForField:PacketFieldTransferID];
+    FileTransferReceive *receive = self.receives[@(transferID)];
+    
+    if (!receive) {
+        // Done already, an empty bitmap lets the host forget us.
+        if (transferID != self.lastOfferedTransferID) return;
+        
+        Packet *ack = [[Packet alloc] initWithCommand:PacketCommandFileAck type:PacketTypeFile action:PacketActionUnknown];
+        [ack setUInt64:transferID forField:PacketFieldTransferID];
+        [ack setData:[NSData dataWithBytes:"" length:1] forField:PacketFieldMissing];
+        [[ConnectivityManager sharedManager] sendPacket:ack toSockets:@[socket]];
+        
+        return;
+    }
+    
+    // Chunks rebuilt on the multicast queue may still be on their way here, ask once they're written.
+    dispatch_async(self.multicastQueue, ^{
+        dispatch_async(dispatch_get_main_queue(), ^{
+            NSMutableData *missing = [NSMutableData dataWithLength:(receive.chunkCount + 7) / 8];
+            uint8_t *bits = missing.mutableBytes;
+            for (NSUInteger index = 0; index < receive.chunkCount; index++) {
+                if (![receive hasChunk:index]) bits[index / 8] |= (uint8_t)(1 << (index % 8));
+            }
+            
+            Packet *ack = [self ackPacketForTransfer:receive];
+            [ack setData:missing forField:PacketFieldMissing];
+            [self sendFinalAckPacket:ack forTransfer:receive];
+        });
+    });
+}
+
+#pragma mark - GCDAsyncUdpSocketDelegate
+// Multicast queue. Collects symbols until a chunk can be rebuilt, then writes it on the main queue.
+- (void)udpSocket:(GCDAsyncUdpSocket *)sock didReceiveData:(NSData *)data fromAddress:(NSData *)address withFilterContext:(id)filterContext {
+    FileTransferReceive *receive = self.multicastReceive;
+    FileTransferFECHeader header;
+    
+    if (!receive || !self.multicastHost || ![[GCDAsyncUdpSocket hostFromAddress:address] isEqualToString:self.multicastHost]) return;
+    if (!FileTransferFECDecodeHeader(data.bytes, data.length, &header) || header.transferID != receive.transferID) return;
+    if (header.chunk >= receive.chunkCount || [receive hasChunk:header.chunk] || header.chunkLength != [receive lengthOfChunk:header.chunk]) return;
+    
+    size_t k = FileTransferFECDataSymbols(header.chunkLength);
+    size_t symbolLength = FileTransferFECSymbolLength(header.chunkLength, k);
+    if (header.k != k || header.symbol >= k + FileTransferFECParitySymbols(k, receive.multicastRedundancy) || data.length != FileTransferFECHeaderLength + symbolLength) return;
+    
+    FileTransferFECBlock *block = self.multicastBlocks[@(header.chunk)];
+    if (!block) {
+        block = [FileTransferFECBlock new];
+        block.k = k;
+        block.chunkLength = header.chunkLength;
+        block.symbolLength = symbolLength;
+        block.symbols = [NSMutableData dataWithCapacity:k * symbolLength];
+        self.multicastBlocks[@(header.chunk)] = block;
+    }
+    
+    for (size_t i = 0; i < block.count; i++) {
+        if (block->indices[i] == header.symbol) return;
+    }
+    
+    block->indices[block.count] = header.symbol;
+    [block.symbols appendBytes:(const uint8_t *)data.bytes + FileTransferFECHeaderLength length:symbolLength];
+    block.count++;
+    
+    if (block.count < k) return;
+    
+    [self.multicastBlocks removeObjectForKey:@(header.chunk)];
+    
+    uint8_t *symbols[FileTransferFECMaxSymbols];
+    for (size_t i = 0; i < k; i++) symbols[i] = (uint8_t *)block.symbols.mutableBytes + i * symbolLength;
+    
+    NSMutableData *scratch = [NSMutableData dataWithLength:k * k];
+    if (!FileTransferFECDecode(symbols, block->indices, k, symbolLength, scratch.mutableBytes)) return;
+    
+    // The pointers got shuffled into data order, lay the chunk out from them.
+    NSMutableData *chunk = [NSMutableData dataWithLength:header.chunkLength];
+    for (size_t j = 0; j < k; j++) {
+        size_t offset = j * symbolLength;
+        memcpy((uint8_t *)chunk.mutableBytes + offset, symbols[j], MIN(symbolLength, header.chunkLength - offset));
+    }
+    
+    uint64_t offset = (uint64_t)header.chunk * receive.chunkSize;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (self.receives[@(receive.transferID)] != receive) return;
+        
+        if ([self writeChunk:chunk atOffset:offset ofTransfer:receive]) {
+            [self updateTransfer:receive];
+        }
+    });
+}
+
+#pragma mark - Benchmark
+- (void)benchmarkDistributionWithListeners:(NSUInteger)listeners {
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        double losses[] = {0.01, 0.05};
+        
+        for (size_t i = 0; i < sizeof(losses)/sizeof(losses[0]); i++) {
+            for (NSUInteger count = 1;; count = MIN(count * 2, listeners)) {
+                FileTransferDistributionConfig config = {10 * 1024 * 1024, self.chunkSize, count, self.multicastRedundancy, losses[i]};
+                FileTransferDistributionReport report;
+                
+                uint64_t start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                FileTransferSimulateDistribution(&config, 42, &report);
+                uint64_t time = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+                
+                NSLog(@"Distribution benchmark, 10MB to %lu listeners at %.0f%% loss: unicast %.1fMB, multicast %.1fMB + %.1fMB resent (%lu chunks)%@, took %.0fms.", (unsigned long)count, losses[i]*100, report.unicastBytes/1e6, report.multicastBytes/1e6, report.repairBytes/1e6, (unsigned long)report.chunksRepaired, report.verified ? @"" : @" DECODE MISMATCH", time/1e6);
+                
+                if (count >= listeners) break;
+            }
+        }
+    });
+}
+
+#pragma mark - Progress
+- (uint64_t)bytesReceived {
+    return self.receives[@(self.lastOfferedTransferID)].bytesReceived;
+}
+
+- (uint64_t)expectedLength {
+    return self.receives[@(self.lastOfferedTransferID)].length;
+}
+
+@end
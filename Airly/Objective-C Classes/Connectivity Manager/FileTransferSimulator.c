@@ -0,0 +1,138 @@
+//
+//  FileTransferSimulator.c
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#include "FileTransferSimulator.h"
+#include "FileTransferFEC.h"
+#include "PacketWire.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define FileTransferSimulatorDatagramOverhead 28// IPv4 and UDP headers
+#define FileTransferSimulatorSegmentOverhead 40// IPv4 and TCP headers
+#define FileTransferSimulatorSegmentLength 1448// TCP payload per segment
+#define FileTransferSimulatorChunkFields 38// Transfer ID, offset and the file field's header, see FileTransferManager.m
+
+// MARK: - Helpers
+static uint64_t FileTransferSimulationRandom(uint64_t *state) {// splitmix64
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+    return z ^ (z >> 31);
+}
+
+static double FileTransferSimulationUniform(uint64_t *state) {// [0, 1)
+    return (FileTransferSimulationRandom(state) >> 11) * (1.0/9007199254740992.0);
+}
+
+// One chunk packet on a stream, as the wire carries it.
+static uint64_t FileTransferSimulationStreamBytes(size_t chunkLength) {
+    uint64_t payload = PacketWireHeaderLength + FileTransferSimulatorChunkFields + chunkLength;
+    uint64_t segments = (payload + FileTransferSimulatorSegmentLength - 1) / FileTransferSimulatorSegmentLength;
+
+    return payload + segments * FileTransferSimulatorSegmentOverhead;
+}
+
+// MARK: - Simulation
+void FileTransferSimulateDistribution(const FileTransferDistributionConfig *config, uint64_t seed, FileTransferDistributionReport *report) {
+    memset(report, 0, sizeof(*report));
+    report->verified = true;
+
+    uint64_t random = seed;
+    size_t chunkSize = config->chunkSize ? config->chunkSize : 1;
+    size_t chunkCount = (config->fileLength + chunkSize - 1) / chunkSize;
+
+    size_t maxK = FileTransferFECDataSymbols(chunkSize);
+    size_t maxSymbolLength = FileTransferFECSymbolLength(chunkSize, maxK);
+    size_t datagramLength = FileTransferFECHeaderLength + maxSymbolLength;
+
+    uint8_t *chunk = calloc(maxK, maxSymbolLength);
+    uint8_t *datagrams = malloc(FileTransferFECMaxSymbols * datagramLength);
+    uint8_t *received = malloc(maxK * maxSymbolLength);
+    uint8_t *scratch = malloc(maxK * maxK);
+
+    if (!chunk || !datagrams || !received || !scratch) {
+        report->verified = false;
+        free(chunk); free(datagrams); free(received); free(scratch);
+        return;
+    }
+
+    for (size_t index = 0; index < chunkCount; index++) {
+        size_t chunkLength = (index + 1 < chunkCount) ? chunkSize : config->fileLength - index * chunkSize;
+        size_t k = FileTransferFECDataSymbols(chunkLength);
+        size_t m = FileTransferFECParitySymbols(k, config->redundancy);
+        size_t symbolLength = FileTransferFECSymbolLength(chunkLength, k);
+
+        // Some song bytes, with the last symbol padded like the sender does.
+        memset(chunk, 0, k * symbolLength);
+        for (size_t i = 0; i < chunkLength; i++) chunk[i] = (uint8_t)FileTransferSimulationRandom(&random);
+
+        report->unicastBytes += config->listeners * FileTransferSimulationStreamBytes(chunkLength);
+
+        // Build every datagram of the chunk once, exactly as they'd go out.
+        const uint8_t *data[FileTransferFECMaxSymbols];
+        for (size_t j = 0; j < k; j++) data[j] = chunk + j * symbolLength;
+
+        for (size_t symbol = 0; symbol < k + m; symbol++) {
+            uint8_t *datagram = datagrams + symbol * datagramLength;
+            FileTransferFECHeader header = {(uint8_t)k, (uint8_t)symbol, (uint32_t)index, seed, (uint32_t)chunkLength};
+            FileTransferFECEncodeHeader(&header, datagram);
+
+            if (symbol < k) {
+                memcpy(datagram + FileTransferFECHeaderLength, data[symbol], symbolLength);
+
+            } else {
+                FileTransferFECEncode(data, k, symbolLength, symbol, datagram + FileTransferFECHeaderLength);
+            }
+
+            report->multicastBytes += FileTransferFECHeaderLength + symbolLength + FileTransferSimulatorDatagramOverhead;
+            report->datagrams++;
+        }
+
+        // Every listener keeps the first k datagrams that make it, and rebuilds the chunk from them.
+        for (size_t listener = 0; listener < config->listeners; listener++) {
+            uint8_t *symbols[FileTransferFECMaxSymbols];
+            uint8_t indices[FileTransferFECMaxSymbols];
+            size_t count = 0;
+
+            for (size_t symbol = 0; symbol < k + m && count < k; symbol++) {
+                if (FileTransferSimulationUniform(&random) < config->loss) continue;
+
+                FileTransferFECHeader header;
+                const uint8_t *datagram = datagrams + symbol * datagramLength;
+                if (!FileTransferFECDecodeHeader(datagram, FileTransferFECHeaderLength + symbolLength, &header)) continue;
+
+                symbols[count] = received + count * symbolLength;
+                memcpy(symbols[count], datagram + FileTransferFECHeaderLength, symbolLength);
+                indices[count] = header.symbol;
+                count++;
+            }
+
+            if (count < k) {
+                report->repairBytes += FileTransferSimulationStreamBytes(chunkLength);
+                report->chunksRepaired++;
+                continue;
+            }
+
+            if (!FileTransferFECDecode(symbols, indices, k, symbolLength, scratch)) {
+                report->verified = false;
+                continue;
+            }
+
+            for (size_t j = 0; j < k; j++) {
+                if (memcmp(symbols[j], data[j], symbolLength) != 0) report->verified = false;
+            }
+        }
+    }
+
+    free(chunk);
+    free(datagrams);
+    free(received);
+    free(scratch);
+}
@@ -0,0 +1,41 @@
+//
+//  FileTransferSimulator.h
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#ifndef FileTransferSimulator_h
+#define FileTransferSimulator_h
+
+// Loopback comparison of sending a file to many listeners over one stream each against multicasting it once
+// with forward error correction. The multicast side runs the real FileTransferFEC code on every datagram each
+// listener gets, drops datagrams at random per listener, and resends over the stream whatever a listener still
+// can't rebuild, like the NACK fallback does. The same seed always gives the same result.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    size_t fileLength;
+    size_t chunkSize;
+    size_t listeners;
+    double redundancy;// Parity symbols per data symbol
+    double loss;// Per datagram, independently for every listener
+} FileTransferDistributionConfig;
+
+// Host bytes on the wire, IPv4 and transport headers included.
+typedef struct {
+    uint64_t unicastBytes;// Every listener gets every chunk over its own stream
+    uint64_t multicastBytes;// Every datagram, sent once
+    uint64_t repairBytes;// Chunks resent over a stream after the listeners' NACKs
+    size_t datagrams;
+    size_t chunksRepaired;// Across all listeners
+    bool verified;// Every chunk a listener rebuilt matched the original
+} FileTransferDistributionReport;
+
+void FileTransferSimulateDistribution(const FileTransferDistributionConfig *config, uint64_t seed, FileTransferDistributionReport *report);
+
+#endif /* FileTransferSimulator_h */
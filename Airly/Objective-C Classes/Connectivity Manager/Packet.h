@@ -8,9 +8,7 @@
 
 #import <Foundation/Foundation.h>
 
-extern  NSString * _Nonnull  const PacketKeyData;
-extern  NSString * _Nonnull const PacketKeyType;
-extern  NSString * _Nonnull const PacketKeyAction;
+#import "PacketWire.h"
 
 typedef enum {
     PacketTypeUnknown = -1,
@@ -27,14 +25,42 @@ typedef enum {
     PacketActionPause,
 } PacketAction;
 
-@interface Packet : NSObject <NSCoding, NSSecureCoding>
+typedef enum {
+    PacketPriorityControl = 0,// Play, pause, sync, acks
+    PacketPriorityBulk,// File chunks, they wait for control packets. See PacketScheduler.h
+} PacketPriority;
+
+@interface Packet : NSObject
 
-@property (strong, nonatomic) NSData * _Nullable data;// Must conform to NSCoding
+@property (strong, nonatomic) NSData * _Nullable data;// The encoded body, see PacketWire.h. Joined on every call for a packet being built, send bodySegments instead.
 @property (assign, nonatomic) PacketType type;// Optionally assign a type to this packet
 @property (assign, nonatomic) PacketAction action;// Optionally assign a action to this packet
+@property (assign, nonatomic) PacketCommand command;// What the body holds
+@property (assign, nonatomic) PacketPriority priority;// Control unless set, not sent
+
+- (_Nonnull instancetype)initWithCommand:(PacketCommand)command type:(PacketType)type action:(PacketAction)action;// Then add fields with the setters below.
+- (_Nonnull instancetype)initWithData:(_Nonnull id)data type:(PacketType)type action:(PacketAction)action;// An already encoded body, PacketCommandArchived unless command is set after.
+- (_Nullable instancetype)initWithHeader:(PacketWireHeader)header body:(NSData * _Nonnull)body;// Received packet, nil if the body is malformed.
+
+// Building. Fields are appended in order, set each once.
+- (void)setUInt64:(uint64_t)value forField:(PacketField)field;
+- (void)setInt64:(int64_t)value forField:(PacketField)field;
+- (void)setDouble:(double)value forField:(PacketField)field;
+- (void)setBool:(BOOL)value forField:(PacketField)field;
+- (void)setData:(NSData * _Nonnull)value forField:(PacketField)field;
+- (void)setString:(NSString * _Nonnull)value forField:(PacketField)field;
+
+// Reading a received packet. Missing fields read as 0, NO or nil.
+- (BOOL)hasField:(PacketField)field;
+- (uint64_t)uint64ForField:(PacketField)field;
+- (int64_t)int64ForField:(PacketField)field;
+- (double)doubleForField:(PacketField)field;
+- (BOOL)boolForField:(PacketField)field;
+- (NSData * _Nullable)dataForField:(PacketField)field;
+- (NSString * _Nullable)stringForField:(PacketField)field;
 
-- (_Nonnull instancetype)initWithData:(_Nonnull id)data type:(PacketType)type action:(PacketAction)action;
-- (_Nullable instancetype)initWithCoder:(NSCoder * _Nonnull)coder;
-- (void)encodeWithCoder:(NSCoder * _Nonnull)coder;
+- (PacketWireHeader)wireHeader;// Header to frame the body with.
+- (NSArray <NSData *> * _Nonnull)bodySegments;// The body as immutable pieces, large bytes fields aren't copied. Safe to share between sockets.
+- (NSUInteger)bodyLength;
 
 @end
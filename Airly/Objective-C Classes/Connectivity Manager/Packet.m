@@ -8,19 +8,28 @@
 
 #import "Packet.h"
 
-NSString * const PacketKeyData = @"data";
-NSString * const PacketKeyType = @"type";
-NSString * const PacketKeyAction = @"action";
+#define PacketSegmentMinLength 4096// Bytes fields this long are referenced instead of copied into the body
+
+@interface Packet () {
+    PacketWireFields fields;// Views into data, filled once when received
+}
+
+@property (strong, nonatomic) NSMutableData *body;// While building, where small fields go
+@property (strong, nonatomic) NSMutableArray <NSData *> *segments;// While building, the body in order. Large values are their own segment.
+
+@end
 
 @implementation Packet
 
 #pragma mark -
 #pragma mark Initialization
-- (instancetype)initWithData:(_Nonnull id)data type:(PacketType)type action:(PacketAction)action {
+- (instancetype)initWithCommand:(PacketCommand)command type:(PacketType)type action:(PacketAction)action {
     self = [super init];
     
     if (self) {
-        self.data = data;
+        self.body = [NSMutableData new];
+        self.segments = [NSMutableArray arrayWithObject:self.body];
+        self.command = command;
         self.type = type;
         self.action = action;
     }
@@ -28,29 +37,152 @@ NSString * const PacketKeyAction = @"action";
     return self;
 }
 
-#pragma mark -
-#pragma mark NSCoding Protocol
-- (void)encodeWithCoder:(NSCoder * _Nonnull)coder {
-    [coder encodeObject:self.data forKey:PacketKeyData];
-    [coder encodeInteger:self.type forKey:PacketKeyType];
-    [coder encodeInteger:self.action forKey:PacketKeyAction];
+- (instancetype)initWithData:(_Nonnull id)data type:(PacketType)type action:(PacketAction)action {
+    self = [super init];
+    
+    if (self) {
+        self.data = data;
+        self.command = PacketCommandArchived;
+        self.type = type;
+        self.action = action;
+    }
+    
+    return self;
 }
 
-- (_Nullable instancetype)initWithCoder:(NSCoder * _Nonnull)decoder {
+- (instancetype)initWithHeader:(PacketWireHeader)header body:(NSData *)body {
     self = [super init];
     
     if (self) {
-        [self setData:[decoder decodeObjectOfClass:[NSData class] forKey:PacketKeyData]];
-        [self setType:(PacketType)[decoder decodeIntegerForKey:PacketKeyType]];
-        [self setAction:(PacketAction)[decoder decodeIntegerForKey:PacketKeyAction]];
+        self.data = body;
+        self.command = (PacketCommand)header.command;
+        self.type = (PacketType)header.type;
+        self.action = (PacketAction)header.action;
+        
+        // Untyped bodies are handed over as they are.
+        BOOL hasFields = (self.command != PacketCommandArchived && self.command != PacketCommandProbe);
+        if (hasFields && !PacketWireDecodeFields(body.bytes, body.length, &fields)) return nil;
     }
     
     return self;
 }
 
-#pragma mark NSSecureCoding Protocol
-+ (BOOL)supportsSecureCoding {
-    return TRUE;
+- (PacketWireHeader)wireHeader {
+    return (PacketWireHeader){.version = PacketWireVersion, .type = (int8_t)self.type, .action = (int8_t)self.action, .command = (uint16_t)self.command, .length = (uint32_t)self.bodyLength};
+}
+
+- (NSArray <NSData *> *)bodySegments {
+    if (!self.segments) return self.data ? @[self.data] : @[];
+    
+    // Only the small field runs are copied, large values go out from the caller's own buffer.
+    NSMutableArray <NSData *> *bodySegments = [NSMutableArray arrayWithCapacity:self.segments.count];
+    for (NSData *segment in self.segments) {
+        if (segment.length > 0) [bodySegments addObject:[segment copy]];
+    }
+    
+    return bodySegments;
+}
+
+- (NSUInteger)bodyLength {
+    if (!self.segments) return self.data.length;
+    
+    NSUInteger length = 0;
+    for (NSData *segment in self.segments) length += segment.length;
+    
+    return length;
+}
+
+- (NSData *)data {
+    if (!self.segments) return _data;
+    
+    // A built packet only joins its segments if someone asks for it whole.
+    NSMutableData *data = [NSMutableData dataWithCapacity:self.bodyLength];
+    for (NSData *segment in self.segments) [data appendData:segment];
+    
+    return data;
+}
+
+#pragma mark - Building
+- (void)setUInt64:(uint64_t)value forField:(PacketField)field {
+    uint8_t bytes[PacketWireMaxFieldHeaderLength + 8];
+    [self.body appendBytes:bytes length:PacketWireEncodeUInt64(bytes, field, value)];
+}
+
+- (void)setInt64:(int64_t)value forField:(PacketField)field {
+    uint8_t bytes[PacketWireMaxFieldHeaderLength + 8];
+    [self.body appendBytes:bytes length:PacketWireEncodeInt64(bytes, field, value)];
+}
+
+- (void)setDouble:(double)value forField:(PacketField)field {
+    uint8_t bytes[PacketWireMaxFieldHeaderLength + 8];
+    [self.body appendBytes:bytes length:PacketWireEncodeDouble(bytes, field, value)];
+}
+
+- (void)setBool:(BOOL)value forField:(PacketField)field {
+    uint8_t bytes[PacketWireMaxFieldHeaderLength + 8];
+    [self.body appendBytes:bytes length:PacketWireEncodeBool(bytes, field, value)];
+}
+
+- (void)setData:(NSData *)value forField:(PacketField)field {
+    uint8_t bytes[PacketWireMaxFieldHeaderLength + 8];
+    [self.body appendBytes:bytes length:PacketWireEncodeBytesHeader(bytes, field, (uint32_t)value.length)];
+    
+    if (value.length < PacketSegmentMinLength) {
+        [self.body appendData:value];
+        return;
+    }
+    
+    // Reference it and carry on in a fresh run after it.
+    [self.segments addObject:[value copy]];
+    self.body = [NSMutableData new];
+    [self.segments addObject:self.body];
+}
+
+- (void)setString:(NSString *)value forField:(PacketField)field {
+    [self setData:[value dataUsingEncoding:NSUTF8StringEncoding] forField:field];
+}
+
+#pragma mark - Reading
+- (BOOL)hasField:(PacketField)field {
+    for (size_t i = 0; i < fields.count; i++) {
+        if (fields.fields[i].tag == field) return YES;
+    }
+    
+    return NO;
+}
+
+- (uint64_t)uint64ForField:(PacketField)field {
+    const PacketWireField *wireField = PacketWireFieldsFind(&fields, field, PacketFieldKindUInt64);
+    return wireField ? wireField->unsignedValue : 0;
+}
+
+- (int64_t)int64ForField:(PacketField)field {
+    const PacketWireField *wireField = PacketWireFieldsFind(&fields, field, PacketFieldKindInt64);
+    return wireField ? wireField->signedValue : 0;
+}
+
+- (double)doubleForField:(PacketField)field {
+    const PacketWireField *wireField = PacketWireFieldsFind(&fields, field, PacketFieldKindDouble);
+    return wireField ? wireField->doubleValue : 0;
+}
+
+- (BOOL)boolForField:(PacketField)field {
+    const PacketWireField *wireField = PacketWireFieldsFind(&fields, field, PacketFieldKindBool);
+    return wireField ? wireField->boolValue : NO;
+}
+
+- (NSData *)dataForField:(PacketField)field {
+    const PacketWireField *wireField = PacketWireFieldsFind(&fields, field, PacketFieldKindBytes);
+    if (!wireField) return nil;
+    
+    return [self.data subdataWithRange:NSMakeRange((NSUInteger)(wireField->bytes - (const uint8_t *)self.data.bytes), wireField->length)];
+}
+
+- (NSString *)stringForField:(PacketField)field {
+    const PacketWireField *wireField = PacketWireFieldsFind(&fields, field, PacketFieldKindBytes);
+    if (!wireField) return nil;
+    
+    return [[NSString alloc] initWithBytes:wireField->bytes length:wireField->length encoding:NSUTF8StringEncoding];
 }
 
 @end
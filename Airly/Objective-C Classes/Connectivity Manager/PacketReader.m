@@ -0,0 +1,228 @@
+//
+//  PacketReader.m
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#import "PacketReader.h"
+
+#define PacketReaderBenchmarkTagHeader 0
+#define PacketReaderBenchmarkTagBody 1
+
+@interface PacketReader () {
+    PacketWireStream stream;
+}
+
+@property (weak, nonatomic) GCDAsyncSocket *socket;
+@property (strong, nonatomic) NSMutableData *buffer;// The ring's bytes, read into in place
+@property (copy, nonatomic) void (^handler)(Packet *packet);// While draining
+
+@end
+
+// Reads the same packets back either way, on its own loopback connection.
+@interface PacketReaderBenchmark : NSObject <GCDAsyncSocketDelegate>
+
+@property (strong, nonatomic) dispatch_queue_t queue;
+@property (strong, nonatomic) GCDAsyncSocket *listenSocket;
+@property (strong, nonatomic) GCDAsyncSocket *readSocket;
+@property (strong, nonatomic) GCDAsyncSocket *writeSocket;
+@property (strong, nonatomic) PacketReader *reader;// nil reads two at a time per packet, like before
+
+@property (strong, nonatomic) NSData *packets;// Every frame, back to back
+@property (nonatomic) NSUInteger packetCount;
+@property (nonatomic) NSUInteger packetsRead;
+@property (nonatomic) BOOL usesReader;
+@property (nonatomic) uint64_t start;
+@property (strong, nonatomic) NSData *header;// Of the packet being read, two reads per packet only
+@property (copy, nonatomic) void (^completion)(double packetsPerSecond);
+
+- (void)runWithCompletion:(void (^)(double packetsPerSecond))completion;
+
+@end
+
+// One frame of the ring, made a packet. Its body is copied out, the ring gets reused.
+static bool PacketReaderHandleFrame(void *context, const PacketWireHeader *header, const uint8_t *body) {
+    PacketReader *reader = (__bridge PacketReader *)context;
+    Packet *packet = [[Packet alloc] initWithHeader:*header body:[NSData dataWithBytes:body length:header->length]];
+    
+    if (packet) {
+        reader.handler(packet);
+        
+    } else {
+        NSLog(@"Dropped a malformed packet from %@.", reader.socket.connectedHost);
+    }
+    
+    return true;
+}
+
+@implementation PacketReader
+
+- (instancetype)initWithSocket:(GCDAsyncSocket *)socket {
+    self = [super init];
+    
+    if (self) {
+        self.socket = socket;
+        self.buffer = [NSMutableData dataWithLength:PacketReaderDefaultCapacity];
+        PacketWireStreamInit(&stream, self.buffer.mutableBytes, self.buffer.length, PacketWireMaxBodyLength);
+    }
+    
+    return self;
+}
+
+- (void)dealloc {
+    PacketWireStreamFree(&stream);
+}
+
+- (void)readNextBytes {
+    // A packet longer than the ring gets one it fits in, once.
+    size_t frameLength = PacketWireStreamFrameLength(&stream);
+    
+    if (frameLength > stream.capacity) {
+        NSUInteger capacity = self.buffer.length * 2;
+        while (capacity < frameLength) capacity *= 2;
+        
+        NSMutableData *buffer = [NSMutableData dataWithLength:capacity];
+        PacketWireStreamMove(&stream, buffer.mutableBytes, capacity);
+        self.buffer = buffer;
+    }
+    
+    // Only ever up to the space left, so the socket never resizes the buffer under the ring.
+    size_t space = 0;
+    uint8_t *bytes = PacketWireStreamSpace(&stream, &space);
+    
+    [self.socket readDataWithTimeout:-1.0 buffer:self.buffer bufferOffset:(NSUInteger)(bytes - (uint8_t *)self.buffer.mutableBytes) maxLength:space tag:PacketReaderTag];
+}
+
+- (BOOL)socketDidReadDataOfLength:(NSUInteger)length handler:(void (^)(Packet *))handler {
+    PacketWireStreamCommit(&stream, length);
+    
+    self.handler = handler;
+    PacketWireStreamStatus status = PacketWireStreamDrain(&stream, PacketReaderHandleFrame, (__bridge void *)self, NULL);
+    self.handler = nil;
+    
+    if (status == PacketWireStreamMalformed) {
+        NSLog(@"Received a malformed packet header from %@.", self.socket.connectedHost);
+        return NO;
+        
+    } else if (status == PacketWireStreamTooLarge) {
+        NSLog(@"Received a packet header from %@ claiming more than %d bytes.", self.socket.connectedHost, PacketWireMaxBodyLength);
+        return NO;
+    }
+    
+    [self readNextBytes];
+    return YES;
+}
+
+#pragma mark - Benchmark
++ (void)benchmarkReadingWithPackets:(NSUInteger)packets {
+    // Sync pongs, the most frequent packet there is.
+    NSMutableData *frames = [NSMutableData new];
+    for (NSUInteger i = 0; i < packets; i++) {
+        Packet *packet = [[Packet alloc] initWithCommand:PacketCommandSyncPong type:PacketTypeControl action:PacketActionSync];
+        [packet setUInt64:i forField:PacketFieldTimeSent];
+        [packet setUInt64:i forField:PacketFieldTimeReceived];
+        
+        PacketWireHeader header = [packet wireHeader];
+        uint8_t headerBytes[PacketWireHeaderLength];
+        PacketWireEncodeHeader(&header, headerBytes);
+        
+        [frames appendBytes:headerBytes length:PacketWireHeaderLength];
+        [frames appendData:packet.data];
+    }
+    
+    // Two reads per packet first, then the reader. Each run keeps itself alive until it's done.
+    __block PacketReaderBenchmark *twoReads = [PacketReaderBenchmark new];
+    twoReads.packets = frames;
+    twoReads.packetCount = packets;
+    twoReads.usesReader = NO;
+    
+    [twoReads runWithCompletion:^(double twoReadsPerSecond) {
+        twoReads = nil;
+        
+        __block PacketReaderBenchmark *reader = [PacketReaderBenchmark new];
+        reader.packets = frames;
+        reader.packetCount = packets;
+        reader.usesReader = YES;
+        
+        [reader runWithCompletion:^(double readerPerSecond) {
+            reader = nil;
+            
+            NSLog(@"Packet reading benchmark, %lu sync pongs of %lu bytes. Two reads per packet: %.0f packets/s. Ring buffer: %.0f packets/s, %.1fx.", (unsigned long)packets, (unsigned long)(frames.length / MAX(packets, 1)), twoReadsPerSecond, readerPerSecond, readerPerSecond / MAX(twoReadsPerSecond, 1));
+        }];
+    }];
+}
+
+@end
+
+@implementation PacketReaderBenchmark
+
+- (void)runWithCompletion:(void (^)(double packetsPerSecond))completion {
+    self.completion = completion;
+    self.queue = dispatch_queue_create("Airly.PacketReader.Benchmark", DISPATCH_QUEUE_SERIAL);
+    self.listenSocket = [[GCDAsyncSocket alloc] initWithDelegate:self delegateQueue:self.queue];
+    self.writeSocket = [[GCDAsyncSocket alloc] initWithDelegate:self delegateQueue:self.queue];
+    
+    NSError *error = nil;
+    if (![self.listenSocket acceptOnInterface:@"127.0.0.1" port:0 error:&error] || ![self.writeSocket connectToHost:@"127.0.0.1" onPort:self.listenSocket.localPort error:&error]) {
+        NSLog(@"Can't open the benchmark's loopback connection: %@", error);
+        completion(0);
+    }
+}
+
+- (void)didReadPacket:(Packet *)packet {
+    self.packetsRead++;
+    if (self.packetsRead < self.packetCount) return;
+    
+    double time = (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - self.start) / 1e9;
+    
+    [self.writeSocket disconnect];
+    [self.readSocket disconnect];
+    [self.listenSocket disconnect];
+    
+    self.completion(self.packetCount / MAX(time, 1e-9));
+    self.completion = nil;
+}
+
+#pragma mark GCDAsyncSocketDelegate
+- (void)socket:(GCDAsyncSocket *)socket didAcceptNewSocket:(GCDAsyncSocket *)newSocket {
+    self.readSocket = newSocket;
+    self.start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    
+    if (self.usesReader) {
+        self.reader = [[PacketReader alloc] initWithSocket:newSocket];
+        [self.reader readNextBytes];
+        
+    } else {
+        [newSocket readDataToLength:PacketWireHeaderLength withTimeout:-1.0 tag:PacketReaderBenchmarkTagHeader];
+    }
+}
+
+- (void)socket:(GCDAsyncSocket *)socket didConnectToHost:(NSString *)host port:(uint16_t)port {
+    [socket writeData:self.packets withTimeout:-1.0 tag:0];
+}
+
+- (void)socket:(GCDAsyncSocket *)socket didReadData:(NSData *)data withTag:(long)tag {
+    if (tag == PacketReaderTag) {
+        [self.reader socketDidReadDataOfLength:data.length handler:^(Packet *packet) {
+            [self didReadPacket:packet];
+        }];
+        
+    } else if (tag == PacketReaderBenchmarkTagHeader) {
+        self.header = data;
+        
+        PacketWireHeader header;
+        PacketWireDecodeHeader(data.bytes, data.length, &header);
+        [socket readDataToLength:header.length withTimeout:-1.0 tag:PacketReaderBenchmarkTagBody];
+        
+    } else if (tag == PacketReaderBenchmarkTagBody) {
+        PacketWireHeader header;
+        PacketWireDecodeHeader(self.header.bytes, self.header.length, &header);
+        
+        [self didReadPacket:[[Packet alloc] initWithHeader:header body:data]];
+        [socket readDataToLength:PacketWireHeaderLength withTimeout:-1.0 tag:PacketReaderBenchmarkTagHeader];
+    }
+}
+
+@end
@@ -0,0 +1,64 @@
+//
+//  PacketScheduler.h
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@import CocoaAsyncSocket;
+#import "Packet.h"
+
+// Orders what goes out on one socket so control packets never wait behind file transfers.
+//
+// GCDAsyncSocket writes in the order it's given, so a pause sent during a transfer used to reach the peer after
+// every chunk queued before it. Control packets still go straight to the socket, bulk ones wait here and are
+// handed over one at a time, the next once the previous is written. The kernel's send buffer is capped to
+// PacketSchedulerSendBuffer and only takes more once less than PacketSchedulerUnsentLowWater of it is unsent, past
+// that the bulk stays queued here. Whatever the transfer's size, a control packet so only waits behind:
+//
+//   the bulk frame the link is carrying, its packet plus a 12 byte header and a 6 byte field header
+//   what's in flight, at most the send buffer
+//   PacketSchedulerUnsentLowWater unsent in the socket
+//   one more bulk frame, the socket takes a whole write once it's under the low water mark
+//   its own frame, 22 bytes for a ping
+//
+// which puts its expected latency at
+//
+//   (2 x largest bulk frame + in flight + PacketSchedulerUnsentLowWater + control frame) / link rate
+//
+// about 85ms for 64KB chunks on a 20Mbit/s link with the whole send buffer in flight. That's not a guarantee, the
+// sender or the receiver running late adds to it. Bulk packets between themselves keep their order.
+//
+// Benchmarks/PacketSchedulerBenchmark.c measures it on a paced loopback, 8MB in 64KB chunks at 20Mbit/s, where the
+// reader's 8KB receive buffer is what's in flight and 62ms is expected. On one core, over six runs, pings took 39ms
+// median and 54 to 70ms worst, against 3.4s worst written in order. The runs over 62ms carried 93 to 95% of the
+// link, the reader oversleeping its pacing. The unsent low water mark is what holds it, any send buffer from 16KB
+// to 256KB measured alike with it, and 64KB without it 82 to 92ms, as Linux doubles the size asked for and all of
+// it can sit unsent. 4KB unsent measured no better than 16KB, which leaves the link about 6ms of data while the
+// next chunk is handed over. The send buffer stays at 64KB for throughput: it caps what's in flight, and a 20ms
+// Wi-Fi round trip at 20Mbit/s is 50KB.
+//
+// Use a scheduler from the socket's delegate queue only, and forward it the socket's write completions.
+
+#define PacketSchedulerSendBuffer 65536// Covers a 20ms round trip at 20Mbit/s
+#define PacketSchedulerUnsentLowWater 16384// Writable again once this little is left unsent
+#define PacketSchedulerTagControl 10
+#define PacketSchedulerTagBulk 11
+
+@interface PacketScheduler : NSObject
+
+- (_Nonnull instancetype)initWithSocket:(GCDAsyncSocket * _Nonnull)socket;
+- (void)sendSegments:(NSArray <NSData *> * _Nonnull)segments priority:(PacketPriority)priority;
+- (BOOL)socketDidWriteDataWithTag:(long)tag;// NO if the write wasn't one of ours.
+
+@property (nonatomic, readonly) NSUInteger bulkBytesWaiting;// Not handed to the socket yet
+@property (nonatomic) BOOL interleaves;// Defaults to YES. NO writes everything in order, like before, for comparison.
+
+// Sends bulkBytes in 64KB bulk packets over a loopback connection whose reader is paced to linkBytesPerSecond,
+// with a control ping every 20ms, first in order and then interleaved. Logs each ping's delay.
++ (void)benchmarkControlLatencyWithBulkBytes:(NSUInteger)bulkBytes linkBytesPerSecond:(NSUInteger)linkBytesPerSecond;
+
+@end
@@ -0,0 +1,265 @@
+//
+//  PacketScheduler.m
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#import "PacketScheduler.h"
+
+// Frameworks
+#import <netinet/in.h>
+#import <netinet/tcp.h>
+#import <sys/socket.h>
+
+#define PacketSchedulerBenchmarkChunkSize 65536
+#define PacketSchedulerBenchmarkPingInterval 0.02
+#define PacketSchedulerBenchmarkTagHeader 0
+#define PacketSchedulerBenchmarkTagBody 1
+
+@interface PacketScheduler ()
+
+@property (weak, nonatomic) GCDAsyncSocket *socket;
+@property (strong, nonatomic) NSMutableArray <NSArray <NSData *> *> *bulkQueue;
+@property (nonatomic) BOOL bulkInSocket;// One bulk packet at most is in the socket's write queue
+@property (nonatomic, readwrite) NSUInteger bulkBytesWaiting;
+
+@end
+
+// A loopback connection, the writer side scheduled, the reader side paced to a link rate so the writer's
+// buffers fill up like they would over Wi-Fi.
+@interface PacketSchedulerBenchmark : NSObject <GCDAsyncSocketDelegate>
+
+@property (strong, nonatomic) dispatch_queue_t queue;
+@property (strong, nonatomic) GCDAsyncSocket *listenSocket;
+@property (strong, nonatomic) GCDAsyncSocket *readSocket;
+@property (strong, nonatomic) GCDAsyncSocket *writeSocket;
+@property (strong, nonatomic) PacketScheduler *scheduler;
+@property (strong, nonatomic) dispatch_source_t pingTimer;
+
+@property (nonatomic) BOOL interleaves;
+@property (nonatomic) NSUInteger bulkBytes;
+@property (nonatomic) NSUInteger bulkBytesRead;
+@property (nonatomic) NSUInteger linkBytesPerSecond;
+@property (nonatomic) PacketWireHeader header;// Of the packet being read
+@property (strong, nonatomic) NSMutableArray <NSNumber *> *latencies;// Of every ping, in ns
+@property (copy, nonatomic) void (^completion)(NSArray <NSNumber *> *latencies);
+
+- (void)runWithCompletion:(void (^)(NSArray <NSNumber *> *latencies))completion;
+
+@end
+
+@implementation PacketScheduler
+
+- (instancetype)initWithSocket:(GCDAsyncSocket *)socket {
+    self = [super init];
+    
+    if (self) {
+        self.socket = socket;
+        self.bulkQueue = [NSMutableArray new];
+        self.interleaves = YES;
+        
+        // Whatever the kernel holds goes out before a control packet written after it, keep that short.
+        [socket performBlock:^{
+            int sendBuffer = PacketSchedulerSendBuffer;
+            int lowWater = PacketSchedulerUnsentLowWater;
+            
+            if (setsockopt(socket.socketFD, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer)) != 0 || setsockopt(socket.socketFD, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowWater, sizeof(lowWater)) != 0) {
+                NSLog(@"Can't shrink the send buffer of %@, control packets may wait longer: %s", socket.connectedHost, strerror(errno));
+            }
+        }];
+    }
+    
+    return self;
+}
+
+- (void)sendSegments:(NSArray<NSData *> *)segments priority:(PacketPriority)priority {
+    if (priority == PacketPriorityControl || !self.interleaves) {
+        [self.socket writeSegments:segments withTimeout:-1.0 tag:PacketSchedulerTagControl];
+        return;
+    }
+    
+    [self.bulkQueue addObject:segments];
+    self.bulkBytesWaiting += [[segments valueForKeyPath:@"@sum.length"] unsignedIntegerValue];
+    
+    [self sendNextBulkPacket];
+}
+
+- (void)sendNextBulkPacket {
+    if (self.bulkInSocket || self.bulkQueue.count == 0) return;
+    
+    NSArray <NSData *> *segments = self.bulkQueue.firstObject;
+    [self.bulkQueue removeObjectAtIndex:0];
+    self.bulkBytesWaiting -= MIN(self.bulkBytesWaiting, [[segments valueForKeyPath:@"@sum.length"] unsignedIntegerValue]);
+    
+    self.bulkInSocket = YES;
+    [self.socket writeSegments:segments withTimeout:-1.0 tag:PacketSchedulerTagBulk];
+}
+
+- (BOOL)socketDidWriteDataWithTag:(long)tag {
+    if (tag == PacketSchedulerTagControl) return YES;
+    if (tag != PacketSchedulerTagBulk) return NO;
+    
+    self.bulkInSocket = NO;
+    [self sendNextBulkPacket];
+    
+    return YES;
+}
+
+#pragma mark - Benchmark
++ (void)benchmarkControlLatencyWithBulkBytes:(NSUInteger)bulkBytes linkBytesPerSecond:(NSUInteger)linkBytesPerSecond {
+    NSString *(^summary)(NSArray <NSNumber *> *) = ^NSString *(NSArray <NSNumber *> *latencies) {
+        NSArray <NSNumber *> *sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+        if (sorted.count == 0) return @"no pings through";
+        
+        double median = sorted[sorted.count / 2].doubleValue / 1e6;
+        double worst = sorted.lastObject.doubleValue / 1e6;
+        
+        return [NSString stringWithFormat:@"%lu pings, median %.1fms, worst %.1fms", (unsigned long)sorted.count, median, worst];
+    };
+    
+    // See PacketScheduler.h, with the whole send buffer in flight.
+    double chunkFrame = PacketWireHeaderLength + PacketWireMaxFieldHeaderLength + PacketSchedulerBenchmarkChunkSize;
+    double pingFrame = PacketWireHeaderLength + PacketWireMaxFieldHeaderLength + 8;
+    double expected = (2 * chunkFrame + PacketSchedulerSendBuffer + PacketSchedulerUnsentLowWater + pingFrame) / MAX(linkBytesPerSecond, 1) * 1000.0;
+    
+    // In order first, then interleaved. Each run keeps itself alive until it's done.
+    __block PacketSchedulerBenchmark *inOrder = [PacketSchedulerBenchmark new];
+    inOrder.bulkBytes = bulkBytes;
+    inOrder.linkBytesPerSecond = linkBytesPerSecond;
+    inOrder.interleaves = NO;
+    
+    [inOrder runWithCompletion:^(NSArray <NSNumber *> *inOrderLatencies) {
+        inOrder = nil;
+        
+        __block PacketSchedulerBenchmark *interleaved = [PacketSchedulerBenchmark new];
+        interleaved.bulkBytes = bulkBytes;
+        interleaved.linkBytesPerSecond = linkBytesPerSecond;
+        interleaved.interleaves = YES;
+        
+        [interleaved runWithCompletion:^(NSArray <NSNumber *> *interleavedLatencies) {
+            interleaved = nil;
+            
+            NSLog(@"Control latency benchmark, %luKB transfer at %.1fMB/s. In order: %@. Interleaved: %@, expected %.0fms.", (unsigned long)(bulkBytes / 1024), linkBytesPerSecond / 1e6, summary(inOrderLatencies), summary(interleavedLatencies), expected);
+        }];
+    }];
+}
+
+@end
+
+@implementation PacketSchedulerBenchmark
+
+- (void)runWithCompletion:(void (^)(NSArray <NSNumber *> *latencies))completion {
+    self.completion = completion;
+    self.latencies = [NSMutableArray new];
+    self.queue = dispatch_queue_create("Airly.PacketScheduler.Benchmark", DISPATCH_QUEUE_SERIAL);
+    self.listenSocket = [[GCDAsyncSocket alloc] initWithDelegate:self delegateQueue:self.queue];
+    self.writeSocket = [[GCDAsyncSocket alloc] initWithDelegate:self delegateQueue:self.queue];
+    
+    NSError *error = nil;
+    if (![self.listenSocket acceptOnInterface:@"127.0.0.1" port:0 error:&error] || ![self.writeSocket connectToHost:@"127.0.0.1" onPort:self.listenSocket.localPort error:&error]) {
+        NSLog(@"Can't open the benchmark's loopback connection: %@", error);
+        completion(@[]);
+    }
+}
+
+- (void)finish {
+    dispatch_source_cancel(self.pingTimer);
+    
+    [self.writeSocket disconnect];
+    [self.readSocket disconnect];
+    [self.listenSocket disconnect];
+    
+    self.completion(self.latencies);
+    self.completion = nil;
+}
+
+- (Packet *)pingPacket {
+    Packet *packet = [[Packet alloc] initWithCommand:PacketCommandSyncPing type:PacketTypeControl action:PacketActionSync];
+    [packet setUInt64:clock_gettime_nsec_np(CLOCK_UPTIME_RAW) forField:PacketFieldTimeSent];
+    
+    return packet;
+}
+
+- (void)sendPacket:(Packet *)packet {
+    PacketWireHeader header = [packet wireHeader];
+    uint8_t headerBytes[PacketWireHeaderLength];
+    PacketWireEncodeHeader(&header, headerBytes);
+    
+    NSArray <NSData *> *segments = [@[[NSData dataWithBytes:headerBytes length:PacketWireHeaderLength]] arrayByAddingObjectsFromArray:[packet bodySegments]];
+    [self.scheduler sendSegments:segments priority:packet.priority];
+}
+
+#pragma mark GCDAsyncSocketDelegate
+- (void)socket:(GCDAsyncSocket *)socket didAcceptNewSocket:(GCDAsyncSocket *)newSocket {
+    self.readSocket = newSocket;
+    [newSocket readDataToLength:PacketWireHeaderLength withTimeout:-1.0 tag:PacketSchedulerBenchmarkTagHeader];
+}
+
+// The whole transfer is queued at once, like a song handed over in one go, then pinged through.
+- (void)socket:(GCDAsyncSocket *)socket didConnectToHost:(NSString *)host port:(uint16_t)port {
+    self.scheduler = [[PacketScheduler alloc] initWithSocket:socket];
+    self.scheduler.interleaves = self.interleaves;
+    
+    NSData *chunk = [NSMutableData dataWithLength:PacketSchedulerBenchmarkChunkSize];
+    for (NSUInteger offset = 0; offset < self.bulkBytes; offset += PacketSchedulerBenchmarkChunkSize) {
+        Packet *packet = [[Packet alloc] initWithCommand:PacketCommandFileChunk type:PacketTypeFile action:PacketActionUnknown];
+        [packet setUInt64:offset forField:PacketFieldOffset];
+        [packet setData:chunk forField:PacketFieldFile];
+        packet.priority = PacketPriorityBulk;
+        
+        [self sendPacket:packet];
+    }
+    
+    __weak typeof(self) weakSelf = self;
+    self.pingTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.queue);
+    dispatch_source_set_timer(self.pingTimer, dispatch_time(DISPATCH_TIME_NOW, 0), (uint64_t)(PacketSchedulerBenchmarkPingInterval * NSEC_PER_SEC), NSEC_PER_MSEC);
+    dispatch_source_set_event_handler(self.pingTimer, ^{
+        [weakSelf sendPacket:[weakSelf pingPacket]];
+    });
+    dispatch_resume(self.pingTimer);
+}
+
+- (void)socket:(GCDAsyncSocket *)socket didWriteDataWithTag:(long)tag {
+    [self.scheduler socketDidWriteDataWithTag:tag];
+}
+
+// Reads one packet at a time, the next only once the link would have carried this one.
+- (void)socket:(GCDAsyncSocket *)socket didReadData:(NSData *)data withTag:(long)tag {
+    if (tag == PacketSchedulerBenchmarkTagHeader) {
+        PacketWireHeader header;
+        PacketWireDecodeHeader(data.bytes, data.length, &header);
+        self.header = header;
+        
+        if (header.length == 0) {
+            [self socket:socket didReadData:[NSData data] withTag:PacketSchedulerBenchmarkTagBody];
+            
+        } else {
+            [socket readDataToLength:header.length withTimeout:-1.0 tag:PacketSchedulerBenchmarkTagBody];
+        }
+        
+        return;
+    }
+    
+    Packet *packet = [[Packet alloc] initWithHeader:self.header body:data];
+    
+    if (packet.command == PacketCommandSyncPing) {
+        [self.latencies addObject:@(clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - [packet uint64ForField:PacketFieldTimeSent])];
+        
+    } else if (packet.command == PacketCommandFileChunk) {
+        self.bulkBytesRead += [packet dataForField:PacketFieldFile].length;
+    }
+    
+    if (self.bulkBytesRead >= self.bulkBytes) {
+        [self finish];
+        return;
+    }
+    
+    double delay = (double)(PacketWireHeaderLength + data.length) / MAX(self.linkBytesPerSecond, 1);
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.queue, ^{
+        [socket readDataToLength:PacketWireHeaderLength withTimeout:-1.0 tag:PacketSchedulerBenchmarkTagHeader];
+    });
+}
+
+@end
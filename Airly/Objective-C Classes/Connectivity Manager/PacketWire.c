@@ -0,0 +1,293 @@
+//
+//  PacketWire.c
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#include "PacketWire.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// MARK: - Little Endian
+static void PacketWireStore16(uint8_t *bytes, uint16_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+static void PacketWireStore32(uint8_t *bytes, uint32_t value) {
+    for (int i = 0; i < 4; i++) bytes[i] = (uint8_t)(value >> (8*i));
+}
+
+static void PacketWireStore64(uint8_t *bytes, uint64_t value) {
+    for (int i = 0; i < 8; i++) bytes[i] = (uint8_t)(value >> (8*i));
+}
+
+static uint16_t PacketWireLoad16(const uint8_t *bytes) {
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static uint32_t PacketWireLoad32(const uint8_t *bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) value |= (uint32_t)bytes[i] << (8*i);
+    
+    return value;
+}
+
+static uint64_t PacketWireLoad64(const uint8_t *bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) value |= (uint64_t)bytes[i] << (8*i);
+    
+    return value;
+}
+
+// MARK: - Encoding
+void PacketWireEncodeHeader(const PacketWireHeader *header, uint8_t bytes[PacketWireHeaderLength]) {
+    PacketWireStore16(&bytes[0], PacketWireMagic);
+    bytes[2] = header->version;
+    bytes[3] = (uint8_t)header->type;
+    bytes[4] = (uint8_t)header->action;
+    bytes[5] = header->flags;
+    PacketWireStore16(&bytes[6], header->command);
+    PacketWireStore32(&bytes[8], header->length);
+}
+
+static size_t PacketWireEncodeFixed(uint8_t *bytes, PacketField field, PacketFieldKind kind, uint64_t bits) {
+    bytes[0] = (uint8_t)field;
+    bytes[1] = (uint8_t)kind;
+    PacketWireStore64(&bytes[2], bits);
+    
+    return 10;
+}
+
+size_t PacketWireEncodeUInt64(uint8_t *bytes, PacketField field, uint64_t value) {
+    return PacketWireEncodeFixed(bytes, field, PacketFieldKindUInt64, value);
+}
+
+size_t PacketWireEncodeInt64(uint8_t *bytes, PacketField field, int64_t value) {
+    return PacketWireEncodeFixed(bytes, field, PacketFieldKindInt64, (uint64_t)value);
+}
+
+size_t PacketWireEncodeDouble(uint8_t *bytes, PacketField field, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    
+    return PacketWireEncodeFixed(bytes, field, PacketFieldKindDouble, bits);
+}
+
+size_t PacketWireEncodeBool(uint8_t *bytes, PacketField field, bool value) {
+    bytes[0] = (uint8_t)field;
+    bytes[1] = PacketFieldKindBool;
+    bytes[2] = value ? 1 : 0;
+    
+    return 3;
+}
+
+size_t PacketWireEncodeBytesHeader(uint8_t *bytes, PacketField field, uint32_t length) {
+    bytes[0] = (uint8_t)field;
+    bytes[1] = PacketFieldKindBytes;
+    PacketWireStore32(&bytes[2], length);
+    
+    return PacketWireMaxFieldHeaderLength;
+}
+
+// MARK: - Decoding
+bool PacketWireDecodeHeader(const uint8_t *bytes, size_t length, PacketWireHeader *header) {
+    if (length < PacketWireHeaderLength) return false;
+    if (PacketWireLoad16(&bytes[0]) != PacketWireMagic || bytes[2] > PacketWireVersion) return false;
+    
+    header->version = bytes[2];
+    header->type = (int8_t)bytes[3];
+    header->action = (int8_t)bytes[4];
+    header->flags = bytes[5];
+    header->command = PacketWireLoad16(&bytes[6]);
+    header->length = PacketWireLoad32(&bytes[8]);
+    
+    return true;
+}
+
+bool PacketWireDecodeFields(const uint8_t *body, size_t length, PacketWireFields *fields) {
+    size_t position = 0;
+    fields->count = 0;
+    
+    while (position < length) {
+        if (length - position < 2) return false;
+        
+        PacketWireField field = {.tag = body[position], .kind = body[position + 1]};
+        position += 2;
+        
+        switch (field.kind) {
+            case PacketFieldKindUInt64:
+            case PacketFieldKindInt64:
+            case PacketFieldKindDouble: {
+                if (length - position < 8) return false;
+                
+                uint64_t bits = PacketWireLoad64(&body[position]);
+                if (field.kind == PacketFieldKindDouble) {
+                    memcpy(&field.doubleValue, &bits, sizeof(bits));
+                    
+                } else {
+                    field.unsignedValue = bits;
+                }
+                
+                position += 8;
+                break;
+            }
+                
+            case PacketFieldKindBool:
+                if (length - position < 1) return false;
+                
+                field.boolValue = (body[position] != 0);
+                position += 1;
+                break;
+                
+            case PacketFieldKindBytes:
+                if (length - position < 4) return false;
+                
+                field.length = PacketWireLoad32(&body[position]);
+                position += 4;
+                
+                if (length - position < field.length) return false;
+                
+                field.bytes = &body[position];
+                position += field.length;
+                break;
+                
+            default:// A kind from a newer version has no known length, nothing after it can be read
+                return false;
+        }
+        
+        if (fields->count < PacketWireMaxFields) fields->fields[fields->count++] = field;
+    }
+    
+    return true;
+}
+
+const PacketWireField *PacketWireFieldsFind(const PacketWireFields *fields, PacketField field, PacketFieldKind kind) {
+    for (size_t i = 0; i < fields->count; i++) {
+        if (fields->fields[i].tag == field) return (fields->fields[i].kind == kind) ? &fields->fields[i] : NULL;
+    }
+    
+    return NULL;
+}
+
+// MARK: - Stream
+void PacketWireStreamInit(PacketWireStream *stream, uint8_t *bytes, size_t capacity, uint32_t maxBodyLength) {
+    memset(stream, 0, sizeof(*stream));
+    stream->bytes = bytes;
+    stream->capacity = capacity;
+    stream->maxBodyLength = maxBodyLength;
+}
+
+void PacketWireStreamFree(PacketWireStream *stream) {
+    free(stream->scratch);
+    stream->scratch = NULL;
+    stream->scratchCapacity = 0;
+}
+
+// Copies length bytes from offset past start, across the end of the buffer if need be.
+static void PacketWireStreamCopy(const PacketWireStream *stream, size_t offset, size_t length, uint8_t *destination) {
+    size_t position = (stream->start + offset) % stream->capacity;
+    size_t first = (length < stream->capacity - position) ? length : stream->capacity - position;
+    
+    memcpy(destination, stream->bytes + position, first);
+    memcpy(destination + first, stream->bytes, length - first);
+}
+
+void PacketWireStreamMove(PacketWireStream *stream, uint8_t *bytes, size_t capacity) {
+    if (stream->length > 0) PacketWireStreamCopy(stream, 0, stream->length, bytes);
+    
+    stream->bytes = bytes;
+    stream->capacity = capacity;
+    stream->start = 0;
+}
+
+uint8_t *PacketWireStreamSpace(const PacketWireStream *stream, size_t *length) {
+    size_t end = (stream->start + stream->length) % stream->capacity;
+    
+    if (stream->length == stream->capacity) {
+        *length = 0;
+        
+    } else if (end >= stream->start) {
+        *length = stream->capacity - end;
+        
+    } else {
+        *length = stream->start - end;
+    }
+    
+    return stream->bytes + end;
+}
+
+void PacketWireStreamCommit(PacketWireStream *stream, size_t length) {
+    stream->length += length;
+}
+
+size_t PacketWireStreamFrameLength(const PacketWireStream *stream) {
+    if (stream->length < PacketWireHeaderLength) return 0;
+    
+    uint8_t headerBytes[PacketWireHeaderLength];
+    PacketWireHeader header;
+    PacketWireStreamCopy(stream, 0, PacketWireHeaderLength, headerBytes);
+    
+    return PacketWireDecodeHeader(headerBytes, PacketWireHeaderLength, &header) ? PacketWireHeaderLength + (size_t)header.length : 0;
+}
+
+PacketWireStreamStatus PacketWireStreamDrain(PacketWireStream *stream, PacketWireFrameHandler handler, void *context, size_t *frames) {
+    PacketWireStreamStatus status = PacketWireStreamOK;
+    size_t count = 0;
+    
+    while (stream->length >= PacketWireHeaderLength) {
+        uint8_t headerBytes[PacketWireHeaderLength];
+        PacketWireHeader header;
+        PacketWireStreamCopy(stream, 0, PacketWireHeaderLength, headerBytes);
+        
+        if (!PacketWireDecodeHeader(headerBytes, PacketWireHeaderLength, &header)) {
+            status = PacketWireStreamMalformed;
+            break;
+        }
+        
+        if (header.length > stream->maxBodyLength) {
+            status = PacketWireStreamTooLarge;
+            break;
+        }
+        
+        size_t frameLength = PacketWireHeaderLength + (size_t)header.length;
+        if (stream->length < frameLength) break;
+        
+        // In place, or joined if it wraps.
+        size_t bodyStart = (stream->start + PacketWireHeaderLength) % stream->capacity;
+        const uint8_t *body = stream->bytes + bodyStart;
+        
+        if (header.length > stream->capacity - bodyStart) {
+            if (stream->scratchCapacity < header.length) {
+                uint8_t *scratch = realloc(stream->scratch, header.length);
+                if (!scratch) {
+                    status = PacketWireStreamTooLarge;
+                    break;
+                }
+                
+                stream->scratch = scratch;
+                stream->scratchCapacity = header.length;
+            }
+            
+            PacketWireStreamCopy(stream, PacketWireHeaderLength, header.length, stream->scratch);
+            body = stream->scratch;
+        }
+        
+        bool proceed = handler(context, &header, body);
+        
+        stream->start = (stream->start + frameLength) % stream->capacity;
+        stream->length -= frameLength;
+        count++;
+        
+        if (!proceed) break;
+    }
+    
+    // Empty, the next read gets the whole buffer in one piece.
+    if (stream->length == 0) stream->start = 0;
+    
+    if (frames) *frames = count;
+    return status;
+}
@@ -0,0 +1,168 @@
+//
+//  PacketWire.h
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#ifndef PacketWire_h
+#define PacketWire_h
+
+// Binary framing of every packet. A fixed header followed by a body of typed fields:
+//
+//   magic u16 | version u8 | type i8 | action i8 | flags u8 | command u16 | length u32   (12 bytes)
+//   field: tag u8 | kind u8 | value (u64, i64 and double are 8 bytes, bool 1, bytes u32 length + data)
+//
+// Everything is little endian. Decoding never allocates, fields point into the body they came from.
+// Plain C so it can be benchmarked and checked away from the sockets.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PacketWireMagic 0x5741// "AW"
+#define PacketWireVersion 1
+#define PacketWireHeaderLength 12
+#define PacketWireMaxFields 16// Fields past this are skipped
+#define PacketWireMaxFieldHeaderLength 6// Tag, kind and a bytes length
+#define PacketWireMaxBodyLength 4194304// A header claiming more is taken for garbage, nothing that long is sent
+
+typedef enum {
+    PacketCommandArchived = 0,// Body is an NSKeyedArchiver dictionary with a "command" key, for anything not typed yet
+    PacketCommandProbe,// Body is a raw SynactionProbe
+    PacketCommandSync,
+    PacketCommandSyncDone,
+    PacketCommandSyncQueued,
+    PacketCommandSyncChannel,
+    PacketCommandSyncReport,// A peer's sync quality, see -[Synaction syncReport]
+    PacketCommandSyncPing,
+    PacketCommandSyncPong,
+    PacketCommandPlay,
+    PacketCommandPause,
+    PacketCommandLoad,// Offers a song file, its bytes follow as FileChunk packets. See FileTransferManager.h
+    PacketCommandStatus,
+    PacketCommandGetSong,
+    PacketCommandFileChunk,
+    PacketCommandFileAck,
+    PacketCommandFileMulticastEnd,// The host multicast every chunk once, answer with what's missing
+    PacketCommandFilePrefetch,// Offers a queued song ahead of time, it goes to the cache without being played
+    PacketCommandCount,// Size of a dispatch table, keep last
+} PacketCommand;
+
+typedef enum {
+    PacketFieldTimeToExecute = 1,
+    PacketFieldPlaybackTime,
+    PacketFieldContinuousPlay,
+    PacketFieldTimeAtPlaybackTime,
+    PacketFieldSong,
+    PacketFieldIsSpotify,
+    PacketFieldFile,// A chunk of the file
+    PacketFieldSongItem,// Archived SongItem
+    PacketFieldTimeSent,
+    PacketFieldTimeReceived,
+    PacketFieldWindow,
+    PacketFieldPosition,
+    PacketFieldPort4,
+    PacketFieldPort6,
+    PacketFieldTransferID,
+    PacketFieldOffset,
+    PacketFieldLength,
+    PacketFieldChunkSize,
+    PacketFieldMissing,// Bitmap of chunks, bit i of byte i/8
+    PacketFieldContentHash,// SHA-256 of the file, keys the receivers' song cache
+    PacketFieldSampleCount,
+    PacketFieldMinRoundTripTime,
+    PacketFieldMedianRoundTripTime,
+    PacketFieldErrorBound,
+    PacketFieldDrift,
+    PacketFieldRoundTripTimeHistogram,// Bucket counts, u32 each
+    PacketFieldOffsetErrorHistogram,// Bucket counts, u32 each
+    PacketFieldRedundancy,// Multicast parity symbols per data symbol, see FileTransferFEC.h
+} PacketField;
+
+typedef enum {
+    PacketFieldKindUInt64 = 0,
+    PacketFieldKindInt64,
+    PacketFieldKindDouble,
+    PacketFieldKindBool,
+    PacketFieldKindBytes,
+} PacketFieldKind;
+
+typedef struct {
+    uint8_t version;
+    int8_t type;// PacketType
+    int8_t action;// PacketAction
+    uint8_t flags;
+    uint16_t command;// PacketCommand
+    uint32_t length;// Of the body
+} PacketWireHeader;
+
+typedef struct {
+    uint8_t tag;
+    uint8_t kind;
+    union {
+        uint64_t unsignedValue;
+        int64_t signedValue;
+        double doubleValue;
+        bool boolValue;
+    };
+    const uint8_t *bytes;// Bytes only, into the body
+    uint32_t length;
+} PacketWireField;
+
+typedef struct {
+    PacketWireField fields[PacketWireMaxFields];
+    size_t count;
+} PacketWireFields;
+
+// MARK: - Encoding
+void PacketWireEncodeHeader(const PacketWireHeader *header, uint8_t bytes[PacketWireHeaderLength]);
+
+// Each writes one field to bytes and returns its length. Bytes must fit PacketWireMaxFieldHeaderLength + 8,
+// a bytes field only writes its header, the data follows it.
+size_t PacketWireEncodeUInt64(uint8_t *bytes, PacketField field, uint64_t value);
+size_t PacketWireEncodeInt64(uint8_t *bytes, PacketField field, int64_t value);
+size_t PacketWireEncodeDouble(uint8_t *bytes, PacketField field, double value);
+size_t PacketWireEncodeBool(uint8_t *bytes, PacketField field, bool value);
+size_t PacketWireEncodeBytesHeader(uint8_t *bytes, PacketField field, uint32_t length);
+
+// MARK: - Decoding
+bool PacketWireDecodeHeader(const uint8_t *bytes, size_t length, PacketWireHeader *header);// False if too short, not ours or a newer version.
+bool PacketWireDecodeFields(const uint8_t *body, size_t length, PacketWireFields *fields);// False if a field runs past the body.
+
+const PacketWireField *PacketWireFieldsFind(const PacketWireFields *fields, PacketField field, PacketFieldKind kind);// NULL if missing or of another kind.
+
+// MARK: - Stream
+// Frames out of a byte stream, however the bytes come in. The caller reads straight into the free space of a ring
+// buffer it owns, commits what it read, and drains every complete frame in one pass. A frame is handed over in
+// place, unless it wraps around the end of the buffer, then it's joined in a scratch buffer first. A frame longer
+// than the buffer waits for the caller to move the stream to a larger one, see PacketWireStreamFrameLength.
+typedef struct {
+    uint8_t *bytes;
+    size_t capacity;
+    size_t start;// First byte not drained yet
+    size_t length;// Bytes not drained yet
+    uint32_t maxBodyLength;
+    uint8_t *scratch;// Owned, for frames that wrap
+    size_t scratchCapacity;
+} PacketWireStream;
+
+typedef enum {
+    PacketWireStreamOK = 0,
+    PacketWireStreamMalformed,// Not a header of ours, the stream is lost
+    PacketWireStreamTooLarge,// Over maxBodyLength
+} PacketWireStreamStatus;
+
+typedef bool (*PacketWireFrameHandler)(void *context, const PacketWireHeader *header, const uint8_t *body);// Body is only valid during the call. False stops the drain.
+
+void PacketWireStreamInit(PacketWireStream *stream, uint8_t *bytes, size_t capacity, uint32_t maxBodyLength);
+void PacketWireStreamFree(PacketWireStream *stream);// The scratch buffer, bytes stay the caller's.
+void PacketWireStreamMove(PacketWireStream *stream, uint8_t *bytes, size_t capacity);// To a new buffer, at least length long. What's pending is copied over.
+
+uint8_t *PacketWireStreamSpace(const PacketWireStream *stream, size_t *length);// Where to read next, length of it. 0 once full.
+void PacketWireStreamCommit(PacketWireStream *stream, size_t length);// That many bytes were read into the space.
+PacketWireStreamStatus PacketWireStreamDrain(PacketWireStream *stream, PacketWireFrameHandler handler, void *context, size_t *frames);
+size_t PacketWireStreamFrameLength(const PacketWireStream *stream);// Header and body of the next frame, 0 until its header is in.
+
+#endif /* PacketWire_h */
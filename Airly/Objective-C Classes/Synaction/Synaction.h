@@ -11,27 +11,66 @@
 
 // Managers
 #import "ConnectivityManager.h"
+#import "SynactionScheduler.h"
+#import "SynactionTelemetry.h"
+#import "SynactionClock.h"
+#import "SynactionEstimator.h"
+#import "SynactionCalibrationBarrier.h"
 
 #define CalibrationDoneNotificationName  @"CalibrationDone"
+#define SyncReportReceivedNotificationName  @"SyncReportReceived"// Host. The object is the peer's socket.
+#define CalibrationQueuedNotificationName  @"CalibrationQueued"// Peer. The host is calibrating others first, userInfo has our "position".
 
-typedef void(^ _Nullable calibrationBlock)(NSArray <GCDAsyncSocket *> * _Nullable peers);
+typedef NS_ENUM(NSInteger, SynactionCalibrationMode) {
+    SynactionCalibrationModeSerial = 0,// One archived ping at a time, until calibrationConfidence or maxNumberOfCalibrations.
+    SynactionCalibrationModeBurst,// Many fixed-size probes in flight, until calibrationConfidence or burstSize.
+};
 
 @interface Synaction : NSObject <ConnectivityManagerDelegate>
 
 + (instancetype _Nonnull)sharedManager;// Use this to get an instance of Synaction
 
-- (void)askPeersToCalculateOffset:(NSArray <GCDAsyncSocket*>* _Nonnull)peers;// Asks the peers to call -calculateTimeOffsetWithHost, when completed the block of -executeBlockWhenPeerCalibrates will be called on host.
+- (void)askPeersToCalculateOffset:(NSArray <GCDAsyncSocket*>* _Nonnull)peers;// Asks the peers to call -calculateTimeOffsetWithHost, when completed the block of -executeBlockWhenPeerCalibrates will be called on host. Only needed once per peer, drift tracking keeps them calibrated. At most maxConcurrentCalibrations at once, the rest wait in line.
 - (void)calculateTimeOffsetWithHost:(GCDAsyncSocket * _Nonnull)hostPeer;// Calculate the time difference in nanoseconds between us and the host device.
-- (uint64_t)currentTime;// Current clock time. If on host this is equal to currentNetworkTime
-- (uint64_t)currentNetworkTime;// The current host time adjusted for offset (offset = 0 if host).
-- (void)atExactTime:(uint64_t)val runBlock:(dispatch_block_t _Nonnull)block;// Run block at the exact host adjusted time val adjusted
-- (void)executeBlockWhenAllPeersCalibrate:(NSArray <GCDAsyncSocket *> * _Nonnull)peers block:(calibrationBlock)completionBlock;// Once EVERY peer in the array calibrates this will be called
-- (void)executeBlockWhenEachPeerCalibrates:(NSArray <GCDAsyncSocket *> * _Nonnull)peers block:(calibrationBlock)completionBlock;// FOR EACH peer in the array that calibrates this will be called
+- (uint64_t)currentTime;// Current time of clock, in nanoseconds. If on host this is equal to currentNetworkTime
+- (uint64_t)currentNetworkTime;// The current host time adjusted for offset and skew (both 0 if host).
+- (SynactionScheduledEvent * _Nonnull)atExactTime:(uint64_t)val runBlock:(dispatch_block_t _Nonnull)block;// Run block at the exact host adjusted time val, on the scheduler thread and never on main. Keep it to the timing critical work, hop to main for the player's bookkeeping and UI. Cancel the returned event to drop it.
+- (SynactionCalibrationBarrier * _Nonnull)executeBlockWhenAllPeersCalibrate:(NSArray <GCDAsyncSocket *> * _Nonnull)peers block:(calibrationBlock)completionBlock;// Once EVERY connected peer in the array calibrates this will be called, or with those that did after calibrationWaitTimeout. Cancel the returned barrier to drop it.
+- (SynactionCalibrationBarrier * _Nonnull)executeBlockWhenEachPeerCalibrates:(NSArray <GCDAsyncSocket *> * _Nonnull)peers block:(calibrationBlock)completionBlock;// FOR EACH peer in the array that calibrates this will be called. Cancel the returned barrier to drop it.
+- (SynactionSyncQuality)syncQuality;// Peer. RTT and offset error distributions over the recent probes, error bound and drift.
+- (uint64_t)estimatedDriftError;// Peer. How far the clock model has likely drifted since it was last checked, in nanoseconds.
+- (NSDictionary * _Nonnull)syncReport;// Peer. syncQuality as a dictionary, this is what gets reported to the host.
+- (NSDictionary * _Nullable)syncReportForPeer:(GCDAsyncSocket * _Nonnull)peer;// Host. The last report this peer sent, nil if none yet.
+- (NSArray <GCDAsyncSocket *> * _Nonnull)peersOutOfTolerance;// Host. Connected peers whose last reported error bound exceeds syncTolerance.
+- (void)benchmarkCalibrationWithHost:(GCDAsyncSocket * _Nonnull)hostPeer;// Runs a serial then a burst calibration and logs the time each took.
+- (void)benchmarkResponderUnderLoad:(NSTimeInterval)duration;// Host. Hogs the main thread for duration seconds and logs the probe turnaround meanwhile.
+- (void)benchmarkScheduler;// Schedules 200 events and logs the firing error percentiles and scheduler CPU time.
+- (void)benchmarkConvergenceWithJoins:(NSUInteger)joins;// Simulates joins over several link profiles with every calibration mode and estimator, logs accuracy and time to converge.
+- (void)benchmarkMassJoinWithPeers:(NSUInteger)peers;// Simulates that many peers joining at once against one host, with and without admission control.
 
 @property (strong, nonatomic) NSMutableSet <GCDAsyncSocket*> * _Nullable calibratedPeers;// Array of all peers that have already calibrated
-@property (nonatomic, readonly) uint64_t maxNumberOfCalibrations;// The number of calibrations to be used to calculate the averaga offset offset
+@property (nonatomic, readonly) uint64_t maxNumberOfCalibrations;// Most pings a serial calibration sends if it never gets confident.
+@property (nonatomic) SynactionCalibrationMode calibrationMode;// How the peer calibrates with the host. Defaults to burst.
+@property (nonatomic) SynactionEstimatorKind offsetEstimator;// How probe samples become an offset. Defaults to Kalman. Marzullo's bound never gets below the one way latency, it stops once its offset stays within calibrationConfidence for SynactionMarzulloSettleSamples samples.
+@property (nonatomic) uint64_t calibrationConfidence;// Calibration stops once the estimator's half-width is below this, in nanoseconds. Defaults to 100us.
+@property (nonatomic) NSUInteger burstSize;// Most probes sent in a burst calibration. Capped to SynactionMaxBurstSize.
+@property (nonatomic) NSUInteger burstWindow;// Maximum number of burst probes in flight at once.
+@property (nonatomic) NSUInteger trackingBurstSize;// Number of probes in each background drift tracking burst.
+@property (nonatomic) NSUInteger warmStartProbes;// Probes sent to verify the clock model cached from the last connection to the same host.
+@property (nonatomic) NSTimeInterval driftTrackingInterval;// Longest wait in seconds between background drift tracking bursts once calibrated, 0 disables.
+@property (nonatomic) uint64_t driftErrorBudget;// Drift, in nanoseconds, that may build up before a tracking burst runs. Defaults to 250us.
+@property (nonatomic) uint64_t syncTolerance;// Host. Largest acceptable peer error bound in nanoseconds. Defaults to 1ms.
+@property (nonatomic) NSTimeInterval calibrationWaitTimeout;// Host. Longest a calibration barrier waits, in seconds, 0 waits forever. Defaults to 30.
+@property (nonatomic) NSUInteger maxConcurrentCalibrations;// Host. Peers allowed to calibrate at once, the others wait their turn. Defaults to 4.
+@property (nonatomic) NSUInteger calibrationProbeBudget;// Host. Probes in flight across all calibrating peers, split evenly into their burst windows. Defaults to 32.
+@property (nonatomic, readonly) NSUInteger calibrationQueuePosition;// Peer. Our place in the host's calibration line, 0 when not waiting.
+@property (nonatomic, readonly) uint64_t lastCalibrationDuration;// Time the last calibration took, in nanoseconds. Only on peer.
 @property (nonatomic, readonly) uint64_t latencyWithHost;// The calculated latency between the peer and host. Only on peer.
-@property (nonatomic, readonly) int64_t hostTimeOffset;// The calculated offset between the peer and the host. Only on peer.
+@property (nonatomic, readonly) int64_t hostTimeOffset;// The calculated offset between the peer and the host at skewReferenceTime. Only on peer.
+@property (nonatomic, readonly) double hostTimeSkew;// Estimated rate of change of hostTimeOffset (ns per ns). Only on peer.
+@property (nonatomic) SynactionClockSource clockSource;// Backend of clock. Defaults to mach on Darwin. Switching resets the clock model, recalibrate after.
+@property (readonly, nonatomic) const SynactionNetworkClock * _Nonnull networkClock;// What -currentNetworkTime reads, lock-free. Hand it to code that can't call into Objective-C, like render callbacks.
+@property (readonly, nonatomic) SynactionClock * _Nonnull clock;// Every Synaction time comes from here. Advance it by hand when clockSource is virtual.
 @property (strong, nonatomic) ConnectivityManager * _Nonnull connectivityManager;// The accompanying connectivity manager.
 @property (readonly, nonatomic) BOOL isCalibrating;// Indicates wether we are currently calibrating with host.
 
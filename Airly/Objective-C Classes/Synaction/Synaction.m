@@ -7,20 +7,64 @@
 //
 
 #import "Synaction.h"
+#import "SynactionProbe.h"
+#import "SynactionCore.h"
+#import "SynactionSimulator.h"
+#import "SynactionClock.h"
+#import "SynactionTimingChannel.h"
+#import "SynactionScheduler.h"
 
 // Frameworks
 #import <AVFoundation/AVFoundation.h>
-#import <mach/mach_time.h>
+#import <libkern/OSByteOrder.h>
 
-@interface Synaction () {
-    double calculatedOffsets;
-    double totalCalculatedOffsets;
+#define SynactionWarmStartDefaultsKey @"SynactionWarmStart"// Cached clock models, keyed by host name
+#define SynactionWarmStartMaxHosts 8// Cached clock models kept, the least recently saved go first
+
+@interface Synaction () <SynactionTimingChannelDelegate> {
+    SynactionSerialEstimator serialEstimator;
+    
+    // Burst calibration state
+    SynactionBurst burst;
+    SynactionEstimator burstEstimator;
+    SynactionProbeSample burstSamples[SynactionMaxBurstSize];
+    uint64_t burstSampleTimes[SynactionMaxBurstSize];
+    BOOL burstIsTracking;
+    BOOL burstIsVerifying;// Checking a cached clock model, see -restoreWarmStartForHost:
+    uint64_t warmStartErrorBound;
+    uint64_t calibrationStartTime;
+    NSUInteger grantedBurstWindow;// Share of the host's probe budget, 0 if the host didn't say
+    
+    // Host. Peers calibrating or waiting to
+    SynactionAdmission admission;
+    uint32_t lastAdmissionID;
+    
+    // Clock model history
+    SynactionClockModel clockModel;
+    SynactionDriftMonitor driftMonitor;
+    
+    SynactionClock clocks[SynactionClockSourceVirtual + 1];// One per source, set up once and never rewritten
+    bool clockAvailable[SynactionClockSourceVirtual + 1];
+    _Atomic(SynactionClock *) activeClock;// Switched whole by -setClockSource:, so readers never see half a clock
+    SynactionNetworkClock networkClock;// Clock model as published to every thread, see -currentNetworkTime
+    NSUInteger trackingGeneration;
 }
 
-@property (nonatomic) int64_t hostTimeOffset;// Offset between this device and the host, in nanoseconds. 0 on host.
 @property (nonatomic) uint64_t latencyWithHost;// Calculated latency with host for one ping (one-way) based on offsetWithHost, in nanoseconds.
 @property (nonatomic) uint64_t maxNumberOfCalibrations;
 @property (nonatomic) BOOL isCalibrating;
+@property (nonatomic) uint64_t lastCalibrationDuration;
+@property (readonly, nonatomic) uint64_t skewReferenceTime;// Local time at which hostTimeOffset was last fitted.
+@property (strong, nonatomic) GCDAsyncSocket *burstHostPeer;
+@property (strong, nonatomic) SynactionScheduler *scheduler;// Fires the blocks of -atExactTime:runBlock:.
+@property (strong, nonatomic) SynactionTimingChannel *timingChannel;// UDP channel for probes, TCP is used until it is negotiated.
+@property (strong, nonatomic) SynactionTelemetry *telemetry;// Peer. Every probe sample, for syncQuality.
+@property (strong, nonatomic) NSMapTable <GCDAsyncSocket *, NSDictionary *> *peerSyncReports;// Host. Last report of each peer.
+@property (strong, nonatomic) NSMapTable <GCDAsyncSocket *, NSMutableSet <SynactionCalibrationBarrier *> *> *calibrationBarriers;// Host. Barriers waiting on each peer.
+@property (strong, nonatomic) NSMapTable <GCDAsyncSocket *, NSNumber *> *admissionIDs;// Host. Socket to its id in admission.
+@property (strong, nonatomic) NSMapTable <NSNumber *, GCDAsyncSocket *> *admissionSockets;// Host. And back.
+@property (strong, nonatomic) NSMapTable <GCDAsyncSocket *, NSData *> *probingPeerAddresses;// Host. Addresses the timing channel answers, kept past disconnect to take them back.
+@property (nonatomic) NSUInteger calibrationQueuePosition;
 
 @end
 
@@ -31,13 +75,42 @@
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
         sharedManager = [[self alloc] init];
+        for (SynactionClockSource source = SynactionClockSourceMach; source <= SynactionClockSourceVirtual; source++) {
+            sharedManager->clockAvailable[source] = SynactionClockInit(&sharedManager->clocks[source], source);
+        }
+        
+        SynactionClockSource defaultSource = (SynactionClockDefault())->source;
+        atomic_store(&sharedManager->activeClock, &sharedManager->clocks[defaultSource]);
+        SynactionNetworkClockInit(&sharedManager->networkClock, &sharedManager->clocks[defaultSource]);
         sharedManager.connectivityManager = [ConnectivityManager sharedManager];
         sharedManager.connectivityManager.synaction = sharedManager;
-        sharedManager.hostTimeOffset = 0;
-        sharedManager.maxNumberOfCalibrations = 5000;
+        [sharedManager registerPacketHandlers];
+        sharedManager.clockSource = defaultSource;
+        sharedManager.maxNumberOfCalibrations = SynactionEstimatorCapacity;
+        sharedManager.calibrationMode = SynactionCalibrationModeBurst;
+        sharedManager.offsetEstimator = SynactionEstimatorKalman;
+        sharedManager.calibrationConfidence = 100000;
+        sharedManager.burstSize = 128;
+        sharedManager.burstWindow = 16;
+        sharedManager.trackingBurstSize = 8;
+        sharedManager.warmStartProbes = 8;
+        sharedManager.driftTrackingInterval = 60;
+        sharedManager.driftErrorBudget = 250000;
         sharedManager.calibratedPeers = [NSMutableSet new];
-        sharedManager->calculatedOffsets = 0;
-        sharedManager->totalCalculatedOffsets = 0;
+        sharedManager.syncTolerance = 1000000;
+        sharedManager.telemetry = [SynactionTelemetry new];
+        sharedManager.peerSyncReports = [NSMapTable weakToStrongObjectsMapTable];
+        sharedManager.calibrationBarriers = [NSMapTable weakToStrongObjectsMapTable];
+        sharedManager.calibrationWaitTimeout = 30;
+        sharedManager.admissionIDs = [NSMapTable weakToStrongObjectsMapTable];
+        sharedManager.admissionSockets = [NSMapTable strongToWeakObjectsMapTable];
+        sharedManager.probingPeerAddresses = [NSMapTable weakToStrongObjectsMapTable];
+        SynactionAdmissionStart(&sharedManager->admission, 4, 32);
+        
+        __weak Synaction *weakSharedManager = sharedManager;
+        sharedManager.scheduler = [[SynactionScheduler alloc] initWithClock:^uint64_t{
+            return [weakSharedManager currentNetworkTime];
+        }];
     });
     
     return sharedManager;
@@ -45,65 +118,73 @@
 
 
 #pragma mark - Network Time Sync
-// Host
-- (void)executeBlockWhenAllPeersCalibrate:(NSArray <GCDAsyncSocket *> * _Nonnull)peers block:(calibrationBlock)completionBlock {
-    // Check if these peers already had the time to calibrate
-    if (self.calibratedPeers.count >= peers.count || (peers.count > self.connectivityManager.allSockets.count && peers.count > self.calibratedPeers.count)) {// Already calibrated
-        NSLog(@"Executing block for all peers calibrated, already calibrated!");
-        completionBlock(peers);
-        return;
-    }
-    
-    // They didn't calibrate. Register to receive notifications. Execute when all are calibrated.
-    __block id observer = [[NSNotificationCenter defaultCenter] addObserverForName:@"peerCalibrated" object:self.calibratedPeers queue:[NSOperationQueue mainQueue] usingBlock:^(NSNotification * _Nonnull notification) {
-        
-        __block BOOL executeBlock = YES;
-        
-        // Check that every object in peers is contained in calibratedPeers
-        [peers enumerateObjectsUsingBlock:^(GCDAsyncSocket * _Nonnull obj, NSUInteger idx, BOOL * _Nonnull stop) {
-            if (executeBlock) {// Make sure a NO doesn't get switched to a YES.
-                if ([self.connectivityManager.allSockets containsObject:obj]) {// Make sure this peer is still connected
-                    executeBlock = [self.calibratedPeers containsObject:obj];
-                }
-            }
-            
-            *stop = !executeBlock;// Stop if executeBlock is NO.
-        }];
-        
-        // Check if we should execute the block
-        if (executeBlock) {
-            completionBlock(peers);
-            [[NSNotificationCenter defaultCenter] removeObserver:observer];
-        }
-    }];
+// Host. The blocks run on the delegate queue, right when the syncDone that completes them arrives.
+- (SynactionCalibrationBarrier *)executeBlockWhenAllPeersCalibrate:(NSArray <GCDAsyncSocket *> * _Nonnull)peers block:(calibrationBlock)completionBlock {
+    return [self waitForPeersToCalibrate:peers mode:SynactionBarrierModeAll block:completionBlock];
+}
+
+- (SynactionCalibrationBarrier *)executeBlockWhenEachPeerCalibrates:(NSArray <GCDAsyncSocket *> * _Nonnull)peers block:(calibrationBlock)completionBlock {
+    return [self waitForPeersToCalibrate:peers mode:SynactionBarrierModeEach block:completionBlock];
 }
 
-- (void)executeBlockWhenEachPeerCalibrates:(NSArray <GCDAsyncSocket *> * _Nonnull)peers block:(calibrationBlock)completionBlock {
-    // Check if these peers already had the time to calibrate
-    __block NSMutableArray *peersMut = [peers mutableCopy];// Tracks which peers haven't calibrated yet and caused a notification
-    NSSet *peersSet = [NSSet setWithArray:peers];
+- (SynactionCalibrationBarrier *)waitForPeersToCalibrate:(NSArray <GCDAsyncSocket *> *)peers mode:(SynactionBarrierMode)mode block:(calibrationBlock)completionBlock {
+    SynactionCalibrationBarrier *barrier = [[SynactionCalibrationBarrier alloc] initWithPeers:peers mode:mode block:completionBlock];
     
-    for (GCDAsyncSocket *peer in peersSet) {
-        if ([self.calibratedPeers containsObject:peer]) {// Already calibrated
-            completionBlock(@[peer]);
-            [peersMut removeObject:peer];
+    // Unregister from whoever is still pending once it's done, nothing outlives its peers.
+    __weak Synaction *weakSelf = self;
+    barrier.finishHandler = ^(SynactionCalibrationBarrier *finishedBarrier) {
+        for (GCDAsyncSocket *peer in finishedBarrier.pendingPeers) {
+            [[weakSelf.calibrationBarriers objectForKey:peer] removeObject:finishedBarrier];
+        }
+    };
+    
+    // Settle the peers that already calibrated or are gone, then wait on the rest.
+    NSSet *connectedPeers = [NSSet setWithArray:self.connectivityManager.allSockets];
+    for (GCDAsyncSocket *peer in [barrier.pendingPeers copy]) {
+        if ([self.calibratedPeers containsObject:peer]) {
+            [barrier peerDidCalibrate:peer];
+            
+        } else if (![connectedPeers containsObject:peer]) {
+            [barrier peerDidDisconnect:peer];
         }
     }
+    [barrier finishIfNothingPending];
     
-    // They didn't. Register to receive notifications. Execute when each one is calibrated.
-    __block id observer = [[NSNotificationCenter defaultCenter] addObserverForName:@"peerCalibrated" object:self.calibratedPeers queue:[NSOperationQueue mainQueue] usingBlock:^(NSNotification * _Nonnull notification) {
-        for (GCDAsyncSocket *peer in peersSet) {
-            if ([self.calibratedPeers containsObject:peer] && [peersMut containsObject:peer]) {// Newly calibrated
-                completionBlock(@[peer]);
-                [peersMut removeObject:peer];
-            }
+    for (GCDAsyncSocket *peer in barrier.pendingPeers) {
+        NSMutableSet *barriers = [self.calibrationBarriers objectForKey:peer];
+        if (!barriers) {
+            barriers = [NSMutableSet new];
+            [self.calibrationBarriers setObject:barriers forKey:peer];
         }
         
-        // Unsubscribe when every one calibrates.
-        if (peersMut.count == 0) {
-            [[NSNotificationCenter defaultCenter] removeObserver:observer];
+        [barriers addObject:barrier];
+    }
+    
+    if (!barrier.isFinished && self.calibrationWaitTimeout > 0) {
+        __weak SynactionCalibrationBarrier *weakBarrier = barrier;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.calibrationWaitTimeout * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            [weakBarrier expire];
+        });
+    }
+    
+    return barrier;
+}
+
+// Host. Hands the peer's news to every barrier waiting on it.
+- (void)settleCalibrationBarriersForPeer:(GCDAsyncSocket *)peer calibrated:(BOOL)calibrated {
+    NSMutableSet <SynactionCalibrationBarrier *> *barriers = [self.calibrationBarriers objectForKey:peer];
+    if (!barriers) return;
+    
+    [self.calibrationBarriers removeObjectForKey:peer];
+    
+    for (SynactionCalibrationBarrier *barrier in barriers) {
+        if (calibrated) {
+            [barrier peerDidCalibrate:peer];
+            
+        } else {
+            [barrier peerDidDisconnect:peer];
         }
-    }];
+    }
 }
 
 - (void)askPeersToCalculateOffset:(NSArray <GCDAsyncSocket*>* _Nonnull)peers {
@@ -117,13 +198,22 @@
         [self.calibratedPeers removeObject:peerID];
     }
     
-    // Send the "sync" command to peers to trigger their offset calculations.
-    NSError *error;
-    NSData *payload = [NSKeyedArchiver archivedDataWithRootObject:@{@"command": @"sync"} requiringSecureCoding:FALSE error:&error];
-    if (error) NSLog(@"%@", error);
+    // Only a few peers calibrate at once, the rest are told where they are in line.
+    for (GCDAsyncSocket *peer in peers) {
+        NSNumber *admissionID = [self.admissionIDs objectForKey:peer];
+        if (!admissionID) {
+            admissionID = @(++lastAdmissionID);
+            [self.admissionIDs setObject:admissionID forKey:peer];
+            [self.admissionSockets setObject:peer forKey:admissionID];
+        }
+        
+        if (!SynactionAdmissionRequest(&admission, admissionID.unsignedIntValue)) {
+            NSLog(@"Calibration queue is full, %@ calibrates without waiting.", peer.connectedHost);
+            [self.connectivityManager sendPacket:[self syncPacketWithCommand:PacketCommandSync] toSockets:@[peer]];
+        }
+    }
     
-    Packet *packet = [[Packet alloc] initWithData:payload type:0 action:PacketActionSync];
-    [self.connectivityManager sendPacket:packet toSockets:peers];
+    [self admitWaitingPeers];
 }
 
 // Meant for peers.
@@ -134,10 +224,8 @@
         NSLog(@"Calibration request valid sending ping.");
         
         self.isCalibrating = YES;// Used to track the calibration
-        calculatedOffsets = 0;// Reset calculated offsets number
-        totalCalculatedOffsets = 0;
-        
-        NSError *error; // For archivers
+        SynactionSerialEstimatorStart(&serialEstimator, self.offsetEstimator, self.calibrationConfidence, self.maxNumberOfCalibrations, self.hostTimeOffset);// Reset calculated offsets
+        calibrationStartTime = [self currentTime];
         
         // Handle 0 calibrations
         if (self.maxNumberOfCalibrations == 0) {
@@ -146,194 +234,987 @@
             self.isCalibrating = NO;
             
             // Let the host know we calibrated
-            NSData *payload = [NSKeyedArchiver archivedDataWithRootObject:@{@"command": @"syncDone"} requiringSecureCoding:FALSE error:&error];
-            if (error) NSLog(@"%@", error);
-            
-            Packet *packet = [[Packet alloc] initWithData:payload type:0 action:PacketActionSync];
-            [self.connectivityManager sendPacket:packet toSockets:@[hostPeer]];
+            [self.connectivityManager sendPacket:[self syncPacketWithCommand:PacketCommandSyncDone] toSockets:@[hostPeer]];
             
             return;
         }
         
+        // Rejoining a host we calibrated with before, check the cached model instead of starting cold.
+        if ([self restoreWarmStartForHost:self.connectivityManager.hostName]) {
+            [self startVerificationBurstWithHost:hostPeer];
+            return;
+        }
+        
+        if (self.calibrationMode == SynactionCalibrationModeBurst) {
+            [self startBurstCalibrationWithHost:hostPeer];
+            return;
+        }
+        
         NSLog(@"Sending initial ping.");
         
         // Send a starting ping
-        NSDictionary *payloadDict = @{@"command": @"syncPing", @"timeSent": [NSNumber numberWithUnsignedLongLong:[self currentTime]]};
-        NSData *payload = [NSKeyedArchiver archivedDataWithRootObject:payloadDict requiringSecureCoding:FALSE error:&error];
-        if (error) NSLog(@"%@", error);
-        
-        Packet *packet = [[Packet alloc] initWithData:payload type:0 action:PacketActionSync];
+        Packet *packet = [self syncPacketWithCommand:PacketCommandSyncPing];
+        [packet setUInt64:[self currentTime] forField:PacketFieldTimeSent];
         [self.connectivityManager sendPacket:packet toSockets:@[hostPeer]];
     }
 }
 
-- (uint64_t)currentTime {// https://developer.apple.com/library/content/qa/qa1398/_index.html
-    uint64_t baseTime = mach_absolute_time();
+- (void)benchmarkCalibrationWithHost:(GCDAsyncSocket * _Nonnull)hostPeer {
+    if (self.isCalibrating) {
+        NSLog(@"Can't benchmark calibration while already calibrating.");
+        return;
+    }
+    
+    SynactionCalibrationMode originalMode = self.calibrationMode;
+    __block uint64_t serialDuration = 0;
+    
+    // Run the serial loop first, then a burst, and compare how long each took to converge.
+    __block id observer = [[NSNotificationCenter defaultCenter] addObserverForName:CalibrationDoneNotificationName object:self queue:[NSOperationQueue mainQueue] usingBlock:^(NSNotification * _Nonnull notification) {
+        if (self.calibrationMode == SynactionCalibrationModeSerial) {
+            serialDuration = self.lastCalibrationDuration;
+            self.calibrationMode = SynactionCalibrationModeBurst;
+            [self calculateTimeOffsetWithHost:hostPeer];
+            
+        } else {
+            NSLog(@"Calibration benchmark: serial %.2fms, burst %.2fms (%.1fx faster)", serialDuration/1000000.0, self.lastCalibrationDuration/1000000.0, (double)serialDuration/MAX(self.lastCalibrationDuration, 1));
+            
+            self.calibrationMode = originalMode;
+            [[NSNotificationCenter defaultCenter] removeObserver:observer];
+        }
+    }];
     
-    // Convert from ticks to nanoseconds:
-    static mach_timebase_info_data_t sTimebaseInfo;
-    if (sTimebaseInfo.denom == 0) {// Check if timebase is initialize
-        mach_timebase_info(&sTimebaseInfo);
+    self.calibrationMode = SynactionCalibrationModeSerial;
+    [self calculateTimeOffsetWithHost:hostPeer];
+}
+
+- (void)benchmarkResponderUnderLoad:(NSTimeInterval)duration {
+    if (!self.timingChannel.respondsToProbes) {
+        NSLog(@"No timing channel responder to benchmark, only available on host once a peer connected.");
+        return;
     }
     
-    uint64_t timeNanoSeconds = baseTime * sTimebaseInfo.numer / sTimebaseInfo.denom;
-    return (int64_t)timeNanoSeconds;
+    [self.timingChannel resetResponderStatistics];
+    
+    // Simulate heavy UI work (album art blur, SLColorArt) by hogging the main thread in 50ms slices.
+    uint64_t endTime = [self currentTime] + (uint64_t)(duration * NSEC_PER_SEC);
+    __block void (^hogMainThread)(void);
+    __block __weak void (^weakHogMainThread)(void);
+    weakHogMainThread = hogMainThread = ^{
+        uint64_t sliceEnd = [self currentTime] + 50 * NSEC_PER_MSEC;
+        while ([self currentTime] < sliceEnd) {}
+        
+        if ([self currentTime] < endTime) {
+            dispatch_async(dispatch_get_main_queue(), weakHogMainThread);
+            
+        } else {
+            SynactionResponderStatistics statistics = self.timingChannel.responderStatistics;
+            NSLog(@"Responder benchmark under %.1fs of main thread load: %llu probes, mean turnaround %.3fms, max %.3fms", duration, statistics.probesAnswered, statistics.probesAnswered ? statistics.totalTurnaround/(double)statistics.probesAnswered/1000000.0 : 0, statistics.maxTurnaround/1000000.0);
+        }
+    };
+    
+    dispatch_async(dispatch_get_main_queue(), hogMainThread);
 }
 
-- (uint64_t)currentNetworkTime {
-    return [self currentTime] - self.hostTimeOffset;
+- (void)benchmarkScheduler {
+    [self.scheduler runBenchmarkWithEventCount:200 completion:^(SynactionSchedulerStatistics statistics) {
+        NSLog(@"Scheduler benchmark: %llu events, firing error p50 %.1fus, p90 %.1fus, p99 %.1fus, max %.1fus, wake margin %.3fms, CPU time %.1fms", statistics.eventsFired, statistics.firingErrorP50/1000.0, statistics.firingErrorP90/1000.0, statistics.firingErrorP99/1000.0, statistics.firingErrorMax/1000.0, statistics.wakeMargin/1000000.0, statistics.cpuTime/1000000.0);
+    }];
 }
 
-- (void)atExactTime:(uint64_t)val runBlock:(dispatch_block_t _Nonnull)block {
-    if (val <= [self currentNetworkTime]) {// The value has already passed execute immediately.
-        block();
-        return;
-    }
+- (void)benchmarkConvergenceWithJoins:(NSUInteger)joins {
+    // Link profiles: latency, jitter, asymmetry, loss, skew, host turnaround.
+    static const SynactionLinkModel links[] = {
+        {1500000, 500000, 0, 0, 20e-6, 50000},
+        {3000000, 4000000, 0, 0.01, 20e-6, 50000},
+        {2000000, 500000, 1000000, 0, 20e-6, 50000},
+        {2000000, 1000000, 0, 0.1, 20e-6, 50000},
+        {2000000, 500000, 0, 0, 20e-6, 5000000},
+    };
+    NSArray *linkNames = @[@"Quiet LAN", @"Busy Wi-Fi", @"Asymmetric", @"Lossy", @"Slow host"];
+    
+    NSArray *estimatorNames = @[@"min RTT", @"Kalman", @"Marzullo"];
     
-    // Use the most accurate timing possible to trigger an event at the specified DTime.
-    // This is much more accurate than dispatch_after(...), which has a 10% "leeway" by default.
-    // However, this method will use battery faster as it avoids most timer coalescing.
-    // Use as little as necessary.
-    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, DISPATCH_TIMER_STRICT, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0));
-    dispatch_source_set_event_handler(timer, ^{
-        dispatch_source_cancel(timer); // one shot timer
-        while (val > [self currentNetworkTime]) {
-            sleep(0);
+    SynactionSimulationConfig serialConfig = {.calibration = SynactionSimulatedCalibrationSerial, .confidence = self.calibrationConfidence, .maxCalibrations = self.maxNumberOfCalibrations};
+    SynactionSimulationConfig burstConfig = {.calibration = SynactionSimulatedCalibrationBurst, .confidence = self.calibrationConfidence, .burstSize = self.burstSize, .burstWindow = self.burstWindow};
+    
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        for (NSUInteger i = 0; i < linkNames.count; i++) {
+            for (NSUInteger mode = 0; mode < 2; mode++) {
+                for (NSUInteger estimator = 0; estimator < estimatorNames.count; estimator++) {
+                    SynactionSimulationConfig config = mode ? burstConfig : serialConfig;
+                    config.estimator = (SynactionEstimatorKind)estimator;
+                    
+                    SynactionConvergenceReport report;
+                    SynactionSimulateJoins(&links[i], &config, joins, 42, &report);
+                    
+                    NSLog(@"Convergence benchmark %@ %@ %@: %zu/%zu failed, |error| p50 %.1fus p95 %.1fus max %.1fus, time p50 %.1fms p95 %.1fms, %.0f packets", linkNames[i], mode ? @"burst" : @"serial", estimatorNames[estimator], report.failures, report.joins, report.errorP50/1000.0, report.errorP95/1000.0, report.errorMax/1000.0, report.timeP50/1000000.0, report.timeP95/1000000.0, report.meanPacketsSent);
+                }
+            }
         }
-        block();
     });
+}
+
+- (void)benchmarkMassJoinWithPeers:(NSUInteger)peers {
+    static const SynactionLinkModel links[] = {
+        {1500000, 500000, 0, 0, 20e-6, 50000},
+        {3000000, 4000000, 0, 0.01, 20e-6, 50000},
+    };
+    NSArray *linkNames = @[@"Quiet LAN", @"Busy Wi-Fi"];
+    
+    SynactionSimulationConfig config = {.calibration = SynactionSimulatedCalibrationBurst, .estimator = self.offsetEstimator, .confidence = self.calibrationConfidence, .burstSize = self.burstSize, .burstWindow = self.burstWindow};
+    SynactionMassJoinConfig unlimited = {.peers = peers, .maxActive = peers, .probeBudget = peers * self.burstWindow};
+    SynactionMassJoinConfig admitted = {.peers = peers, .maxActive = self.maxConcurrentCalibrations, .probeBudget = self.calibrationProbeBudget};
     
-    // Now, we employ a dirty trick:
-    // Since even with DISPATCH_TIMER_STRICT there can be about 1ms of inaccuracy, we set the timer to
-    // fire 1.3ms too early, then we use an until(time) { sleep(); } loop to delay until the exact time
-    // that we wanted. This takes us from an accuracy of ~1ms to an accuracy of ~0.01ms, i.e. two orders
-    // of magnitude improvement. However, of course the downside is that this will block the main thread
-    // for 1.3ms.
-    dispatch_time_t at_time = dispatch_time(DISPATCH_TIME_NOW, val - [self currentNetworkTime] - 1300000);
-    dispatch_source_set_timer(timer, at_time, DISPATCH_TIME_FOREVER /*one shot*/, 0 /* minimal leeway */);
-    dispatch_resume(timer);
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        for (NSUInteger i = 0; i < linkNames.count; i++) {
+            for (NSUInteger limited = 0; limited < 2; limited++) {
+                SynactionConvergenceReport report;
+                SynactionSimulateMassJoin(&links[i], &config, limited ? &admitted : &unlimited, 42, &report);
+                
+                NSLog(@"Mass join benchmark %@ %@: %zu/%zu failed, |error| p50 %.1fus p95 %.1fus max %.1fus, time p50 %.1fms p95 %.1fms max %.1fms", linkNames[i], limited ? @"admitted" : @"all at once", report.failures, report.joins, report.errorP50/1000.0, report.errorP95/1000.0, report.errorMax/1000.0, report.timeP50/1000000.0, report.timeP95/1000000.0, report.timeMax/1000000.0);
+            }
+        }
+    });
 }
 
-- (void)didReceivePacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
-    int64_t timeReceived = (int64_t)[self currentTime];
-    NSError *error;
-    NSDictionary *payload = [NSKeyedUnarchiver unarchivedObjectOfClass:[NSDictionary class] fromData:packet.data error:&error];
-    if (error) NSLog(@"%@", error);
+#pragma mark - Admission
+// Host. Fills the free calibration slots, every admitted peer gets an equal share of the probe budget as its burst window.
+- (void)admitWaitingPeers {
+    uint32_t admitted[SynactionAdmissionCapacity];
+    size_t count = SynactionAdmissionPromote(&admission, [self currentTime], admitted, SynactionAdmissionCapacity);
     
-    // Check if the host is asking us to sync
-    if ([payload[@"command"] isEqualToString:@"sync"]) {
-        NSLog(@"Host asked us to sync.");
-        [self calculateTimeOffsetWithHost:socket];
-        
-        return;
-        
-    } else if ([payload[@"command"] isEqualToString:@"syncDone"]) {
-        NSLog(@"peer told us sync done");
+    for (size_t i = 0; i < count; i++) {
+        GCDAsyncSocket *peer = [self.admissionSockets objectForKey:@(admitted[i])];
+        if (!peer) continue;
         
-        [self.calibratedPeers addObject:socket];
-        [[NSNotificationCenter defaultCenter] postNotificationName:@"peerCalibrated" object:self.calibratedPeers userInfo:@{@"calibratedPeer": socket}];
-        
-        return;
+        Packet *packet = [self syncPacketWithCommand:PacketCommandSync];
+        [packet setUInt64:SynactionAdmissionWindow(&admission) forField:PacketFieldWindow];
+        [self.connectivityManager sendPacket:packet toSockets:@[peer]];
+    }
+    
+    // Everyone still waiting moved up.
+    for (size_t i = admission.active; i < admission.count; i++) {
+        GCDAsyncSocket *peer = [self.admissionSockets objectForKey:@(admission.peers[i])];
+        if (!peer) continue;
         
-    } else if ([payload[@"command"] isEqualToString:@"syncPing"]) {// This is done on the peer with which we are calculating the offset (Host).
-        NSMutableDictionary *payloadDict = [[NSMutableDictionary alloc] initWithDictionary:@{@"command": @"syncPong",
-                                                                                             @"timeReceived": [NSNumber numberWithUnsignedLongLong:timeReceived],
-                                                                                             @"timeSent": payload[@"timeSent"],
-        }];
+        Packet *packet = [self syncPacketWithCommand:PacketCommandSyncQueued];
+        [packet setUInt64:i - admission.active + 1 forField:PacketFieldPosition];
+        [self.connectivityManager sendPacket:packet toSockets:@[peer]];
+    }
+    
+    // A peer that never finishes shouldn't hold its slot forever.
+    if (count > 0) {
+        __weak Synaction *weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, SynactionAdmissionTimeout + NSEC_PER_SEC), dispatch_get_main_queue(), ^{
+            Synaction *strongSelf = weakSelf;
+            if (!strongSelf) return;
+            
+            size_t expired = SynactionAdmissionExpire(&strongSelf->admission, [strongSelf currentTime]);
+            if (expired > 0) {
+                NSLog(@"%zu peers took too long to calibrate, letting the next ones in.", expired);
+                [strongSelf admitWaitingPeers];
+            }
+        });
+    }
+}
+
+// Host. The peer is done calibrating or gone, its slot goes to the next one in line.
+- (void)finishAdmissionForPeer:(GCDAsyncSocket *)peer {
+    NSNumber *admissionID = [self.admissionIDs objectForKey:peer];
+    if (!admissionID) return;
+    
+    if (SynactionAdmissionFinish(&admission, admissionID.unsignedIntValue)) {
+        [self admitWaitingPeers];
+    }
+}
+
+- (Packet *)syncPacketWithCommand:(PacketCommand)command {
+    return [[Packet alloc] initWithCommand:command type:PacketTypeControl action:PacketActionSync];
+}
+
+- (NSUInteger)maxConcurrentCalibrations {
+    return admission.maxActive;
+}
+
+- (void)setMaxConcurrentCalibrations:(NSUInteger)maxConcurrentCalibrations {
+    admission.maxActive = MAX(maxConcurrentCalibrations, 1);
+}
+
+- (NSUInteger)calibrationProbeBudget {
+    return admission.probeBudget;
+}
+
+- (void)setCalibrationProbeBudget:(NSUInteger)calibrationProbeBudget {
+    admission.probeBudget = MAX(calibrationProbeBudget, 1);
+}
+
+#pragma mark - Burst Calibration
+// Peer. Fills the window with probes, every reply frees a slot for the next one.
+- (void)startBurstCalibrationWithHost:(GCDAsyncSocket *)hostPeer {
+    NSLog(@"Starting burst calibration.");
+    [self startBurstWithHost:hostPeer size:self.burstSize tracking:NO];
+}
+
+// Peer. A small background burst that only refines the clock model, commands keep flowing.
+- (void)startTrackingBurstWithHost:(GCDAsyncSocket *)hostPeer {
+    [self startBurstWithHost:hostPeer size:self.trackingBurstSize tracking:YES];
+}
+
+// Peer. A handful of probes to check a cached clock model, all in flight at once so it takes one round trip.
+- (void)startVerificationBurstWithHost:(GCDAsyncSocket *)hostPeer {
+    [self startBurstWithHost:hostPeer size:self.warmStartProbes tracking:NO];
+    burstIsVerifying = YES;
+}
+
+- (void)startBurstWithHost:(GCDAsyncSocket *)hostPeer size:(NSUInteger)size tracking:(BOOL)tracking {
+    self.burstHostPeer = hostPeer;
+    burstIsTracking = tracking;
+    burstIsVerifying = NO;
+    NSUInteger window = (grantedBurstWindow > 0) ? MIN(self.burstWindow, grantedBurstWindow) : self.burstWindow;
+    SynactionBurstStart(&burst, size, window, (self.timingChannel.hostAddress != nil), [self currentTime]);
+    SynactionEstimatorStart(&burstEstimator, self.offsetEstimator);
+    
+    for (NSUInteger i = 0; i < burst.window; i++) {
+        [self sendBurstProbeToHost:hostPeer];
+    }
+    
+    [self scheduleBurstWatchdog:burst.identifier];
+}
+
+- (void)sendBurstProbeToHost:(GCDAsyncSocket *)hostPeer {
+    SynactionProbe probe;
+    if (!SynactionBurstNextProbe(&burst, [self currentTime], &probe)) return;
+    
+    if (self.timingChannel.hostAddress) {
+        [self.timingChannel sendProbe:&probe toAddress:self.timingChannel.hostAddress];
         
-        NSError *error;
-        NSData *payload = [NSKeyedArchiver archivedDataWithRootObject:payloadDict requiringSecureCoding:FALSE error:&error];
-        if (error) NSLog(@"%@", error);
+    } else {
+        Packet *packet = [[Packet alloc] initWithData:[NSData dataWithBytes:&probe length:sizeof(probe)] type:PacketTypeControl action:PacketActionSync];
+        packet.command = PacketCommandProbe;
+        [self.connectivityManager sendPacket:packet toSockets:@[hostPeer]];
+    }
+}
+
+// Finish with whatever samples arrived if the host goes quiet, or start over if none ever did.
+- (void)scheduleBurstWatchdog:(uint16_t)identifier {
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 500 * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+        if (identifier != self->burst.identifier || !self.burstHostPeer) return;
         
-        // Speakers are only connected to the host.
-        Packet *packet = [[Packet alloc] initWithData:payload type:0 action:PacketActionSync];
-        [self.connectivityManager sendPacket:packet toSockets:@[socket]];
+        SynactionBurstWatchdogAction action = SynactionBurstCheckWatchdog(&self->burst, [self currentTime]);
         
-        return;
+        if (action == SynactionBurstWatchdogFinish) {
+            NSLog(@"Burst stalled, finishing with %u samples.", self->burst.samplesReceived);
+            [self finishBurst];
+            
+        } else if (action == SynactionBurstWatchdogRestart) {
+            if (self->burstIsTracking) {// Try again on the next tracking tick
+                self.burstHostPeer = nil;
+                [self scheduleDriftTracking];
+                
+            } else {
+                NSLog(@"Burst calibration took too long. Repeating.");
+                
+                // UDP may be filtered on this network, fall back to the TCP stream.
+                if (self.timingChannel.hostAddress) {
+                    NSLog(@"No probe replies over the timing channel, falling back to TCP.");
+                    [self.timingChannel disconnectFromHost];
+                }
+                
+                if (self->burstIsVerifying) {// Don't trust the cached model without a check, start cold
+                    [self discardWarmStartForHost:self.connectivityManager.hostName];
+                    [self resetClockModel];
+                    self.isCalibrating = NO;
+                    [self calculateTimeOffsetWithHost:self.burstHostPeer];
+                    return;
+                }
+                
+                [self startBurstCalibrationWithHost:self.burstHostPeer];
+            }
+            
+        } else {
+            [self scheduleBurstWatchdog:identifier];
+        }
+    });
+}
+
+// Host. Stamp and bounce the probe straight back over the stream it came in on.
+- (void)replyToProbe:(SynactionProbe)probe receivedAt:(uint64_t)timeReceived fromSocket:(GCDAsyncSocket *)socket {
+    probe.timeHostReceived = timeReceived;
+    probe.timeHostSent = [self currentTime];
+    
+    Packet *packet = [[Packet alloc] initWithData:[NSData dataWithBytes:&probe length:sizeof(probe)] type:PacketTypeControl action:PacketActionSync];
+    packet.command = PacketCommandProbe;
+    [self.connectivityManager sendPacket:packet toSockets:@[socket]];
+}
+
+// Peer.
+- (void)handleProbeReply:(SynactionProbe)probe receivedAt:(uint64_t)timeReceived {
+    if (!self.burstHostPeer) return;
+    
+    bool sendNextProbe;
+    SynactionBurstReplyResult result = SynactionBurstHandleReply(&burst, &probe, timeReceived, &sendNextProbe);
+    
+    // Stop as soon as the estimate is tight enough, a clean link needs far fewer probes than burstSize.
+    SynactionProbeSample sample;
+    uint64_t sampleTime;
+    if (result != SynactionBurstReplyIgnored && SynactionBurstFinalSample(&burst, &probe, &sample, &sampleTime)) {
+        SynactionEstimatorAddSample(&burstEstimator, sample, sampleTime);
         
-        // This is done on the person who callled calculateTimeOffsetWithHost (Player).
-    } else if ([payload[@"command"] isEqualToString:@"syncPong"]) {
+        SynactionEstimate estimate = SynactionEstimatorCurrent(&burstEstimator);
+        if (SynactionEstimateIsConfident(&estimate, self.calibrationConfidence)) {
+            result = SynactionBurstReplyComplete;
+        }
+    }
+    
+    if (result == SynactionBurstReplyComplete) {
+        [self finishBurst];
         
-        // Calculate the offset and add it to the calculated offsets.
-        uint64_t timePingSent = ((NSNumber*)payload[@"timeSent"]).unsignedLongLongValue;
-        uint64_t timeHostReceivedPing = ((NSNumber*)payload[@"timeReceived"]).unsignedLongLongValue;
+    } else if (sendNextProbe) {
+        [self sendBurstProbeToHost:self.burstHostPeer];
+    }
+}
+
+- (void)finishBurst {
+    burst.isActive = false;
+    
+    size_t count = SynactionBurstCollectSamples(&burst, burstSamples, burstSampleTimes);
+    for (size_t i = 0; i < count; i++) {
+        [self.telemetry recordSample:burstSamples[i] atTime:burstSampleTimes[i]];
+    }
+    
+    // No follow-up ever came, fall back to the replies' own send times.
+    if (burstEstimator.samplesSeen == 0) {
+        for (size_t i = 0; i < count; i++) {
+            SynactionEstimatorAddSample(&burstEstimator, burstSamples[i], burstSampleTimes[i]);
+        }
+    }
+    
+    SynactionEstimate estimate = SynactionEstimatorCurrent(&burstEstimator);
+    
+    // How far off the model was tells how soon the next tracking burst is needed.
+    if (burstIsTracking) {
+        int64_t predictedOffset = [self hostTimeOffsetAtTime:burst.lastActivityTime];
+        SynactionDriftMonitorAddMeasurement(&driftMonitor, predictedOffset, estimate.offset, burst.lastActivityTime);
         
-        //uint64_t latencyWithHost = (timeReceived - timePingSent)/2;// Calculates the estimated latency for one way travel
+        if (llabs(estimate.offset - predictedOffset) > SynactionDriftResetError) {
+            NSLog(@"Clock moved %.3fms away from the model, refitting from scratch.", llabs(estimate.offset - predictedOffset)/1000000.0);
+            SynactionClockModelReset(&clockModel);
+        }
+    }
+    
+    // Either side rebooted or slept since the model was cached, it is worthless. Calibrate cold.
+    if (burstIsVerifying) {
+        uint64_t mismatch = (uint64_t)llabs(estimate.offset - [self hostTimeOffsetAtTime:burst.lastActivityTime]);
         
-        // If this calculation doesn't meet our error margin (2s), restart.
-        if (((int64_t)[self currentTime] - (int64_t)timePingSent) > 2000000000) {
-            NSLog(@"Calibration took too long. Repeating.");
-            NSDictionary *payloadDict = @{@"command": @"syncPing", @"timeSent": [NSNumber numberWithUnsignedLongLong:timeReceived]};
-            NSError *error;
-            NSData *payload = [NSKeyedArchiver archivedDataWithRootObject:payloadDict requiringSecureCoding:FALSE error:&error];
-            if (error) NSLog(@"%@", error);
+        if (mismatch > MAX(self.syncTolerance, warmStartErrorBound)) {
+            NSLog(@"Cached clock model is off by %.3fms, calibrating from scratch.", mismatch/1000000.0);
             
-            Packet *packet = [[Packet alloc] initWithData:payload type:0 action:PacketActionSync];
-            [self.connectivityManager sendPacket:packet toSockets:@[socket]];
+            GCDAsyncSocket *hostPeer = self.burstHostPeer;
+            self.burstHostPeer = nil;
             
+            [self discardWarmStartForHost:self.connectivityManager.hostName];
+            [self resetClockModel];
+            self.isCalibrating = NO;
+            [self calculateTimeOffsetWithHost:hostPeer];
             return;
         }
         
-        int64_t calculatedOffset = ((int64_t)[self currentTime] + (int64_t)timePingSent - (2*(int64_t)timeHostReceivedPing))/2;
+        NSLog(@"Cached clock model verified, off by %.3fms.", mismatch/1000000.0);
+    }
+    
+    self.latencyWithHost = (uint64_t)MAX(estimate.minRoundTripTime/2, 0);
+    [self addClockSampleWithOffset:estimate.offset atTime:burst.lastActivityTime];
+    
+    NSLog(@"Burst done with offset %lld (+-%lluns) skew %.3fppm from %zu of %zu samples, %zu rejected, min RTT %lldns.", self.hostTimeOffset, estimate.halfWidth, self.hostTimeSkew*1e6, estimate.samplesUsed, count, estimate.samplesRejected, estimate.minRoundTripTime);
+    
+    GCDAsyncSocket *hostPeer = self.burstHostPeer;
+    self.burstHostPeer = nil;
+    
+    if (!burstIsTracking) {
+        [self completeCalibrationWithHost:hostPeer];
         
-        totalCalculatedOffsets += calculatedOffset;
-        calculatedOffsets += 1;
+    } else {
+        [self sendSyncReportToHost:hostPeer];
+        [self scheduleDriftTracking];
+    }
+}
+
+#pragma mark - Warm Start
+// Peer. Remembers the clock model so a reconnect to the same host only has to verify it.
+- (void)saveWarmStartForHost:(NSString *)hostName {
+    if (!hostName || clockModel.count == 0 || self.isCalibrating) return;
+    
+    // Oldest first, the ring wraps once full.
+    NSMutableArray <NSNumber *> *times = [NSMutableArray new];
+    NSMutableArray <NSNumber *> *offsets = [NSMutableArray new];
+    size_t oldest = (clockModel.count < SynactionMaxClockSamples) ? 0 : clockModel.index;
+    
+    for (size_t i = 0; i < clockModel.count; i++) {
+        SynactionClockSample sample = clockModel.samples[(oldest + i) % SynactionMaxClockSamples];
+        [times addObject:[NSNumber numberWithUnsignedLongLong:sample.localTime]];
+        [offsets addObject:[NSNumber numberWithLongLong:sample.offset]];
+    }
+    
+    NSDictionary *warmStart = @{@"times": times,
+                                @"offsets": offsets,
+                                @"errorBound": [NSNumber numberWithUnsignedLongLong:[self syncQuality].errorBound],
+                                @"clockSource": [NSNumber numberWithInteger:self.clockSource],
+                                @"savedAt": [NSDate date],
+    };
+    
+    NSMutableDictionary *warmStarts = [[[NSUserDefaults standardUserDefaults] dictionaryForKey:SynactionWarmStartDefaultsKey] mutableCopy] ?: [NSMutableDictionary new];
+    warmStarts[hostName] = warmStart;
+    
+    // Hosts we haven't seen in a while make room for this one.
+    while (warmStarts.count > SynactionWarmStartMaxHosts) {
+        NSString *oldestHostName = [[warmStarts keysSortedByValueUsingComparator:^NSComparisonResult(NSDictionary *a, NSDictionary *b) {
+            return [(a[@"savedAt"] ?: [NSDate distantPast]) compare:(b[@"savedAt"] ?: [NSDate distantPast])];
+        }] firstObject];
         
-        NSLog(@"Calculated calibration. Total: %f", calculatedOffsets);
+        [warmStarts removeObjectForKey:oldestHostName];
+    }
+    
+    [[NSUserDefaults standardUserDefaults] setObject:warmStarts forKey:SynactionWarmStartDefaultsKey];
+}
+
+// Peer. The cached model failed its check, so the next calibration with this host has to start cold.
+- (void)discardWarmStartForHost:(NSString *)hostName {
+    if (!hostName) return;
+    
+    NSMutableDictionary *warmStarts = [[[NSUserDefaults standardUserDefaults] dictionaryForKey:SynactionWarmStartDefaultsKey] mutableCopy];
+    if (!warmStarts[hostName]) return;
+    
+    [warmStarts removeObjectForKey:hostName];
+    [[NSUserDefaults standardUserDefaults] setObject:warmStarts forKey:SynactionWarmStartDefaultsKey];
+}
+
+// Peer. Seeds an empty clock model with what we had the last time we were connected to this host.
+- (BOOL)restoreWarmStartForHost:(NSString *)hostName {
+    if (!hostName || clockModel.count > 0) return NO;
+    
+    NSDictionary *warmStart = [[NSUserDefaults standardUserDefaults] dictionaryForKey:SynactionWarmStartDefaultsKey][hostName];
+    if (!warmStart || ((NSNumber *)warmStart[@"clockSource"]).integerValue != self.clockSource) return NO;
+    
+    NSArray <NSNumber *> *times = warmStart[@"times"];
+    NSArray <NSNumber *> *offsets = warmStart[@"offsets"];
+    if (times.count == 0 || times.count != offsets.count) return NO;
+    
+    for (NSUInteger i = 0; i < times.count; i++) {
+        [self addClockSampleWithOffset:offsets[i].longLongValue atTime:times[i].unsignedLongLongValue];
+    }
+    
+    warmStartErrorBound = ((NSNumber *)warmStart[@"errorBound"]).unsignedLongLongValue;
+    NSLog(@"Warm starting with %@ from %lu cached samples, offset %lld.", hostName, (unsigned long)times.count, self.hostTimeOffset);
+    
+    return YES;
+}
+
+#pragma mark - Timing Channel
+// Host. Open the UDP channel on first use and tell the new peer where it is.
+- (void)offerTimingChannelToPeer:(GCDAsyncSocket *)peer {
+    if (!self.timingChannel) {
+        SynactionTimingChannel *timingChannel = [[SynactionTimingChannel alloc] initWithDelegate:self];
+        
+        NSError *error;
+        if (![timingChannel openWithError:&error]) {
+            return;// Peers will stay on TCP
+        }
         
-        // If the calibration is accurate enough just end it.
-        BOOL doneCalibrating = false;
-        double newOffset = totalCalculatedOffsets/calculatedOffsets;
+        timingChannel.respondsToProbes = YES;
+        self.timingChannel = timingChannel;
+    }
+    
+    // The channel only answers connected peers.
+    NSData *address = peer.connectedAddress;
+    if (!address) return;
+    
+    [self.timingChannel allowProbesFromAddress:address];
+    [self.probingPeerAddresses setObject:address forKey:peer];
+    
+    Packet *packet = [self syncPacketWithCommand:PacketCommandSyncChannel];
+    [packet setUInt64:self.timingChannel.localPort4 forField:PacketFieldPort4];
+    [packet setUInt64:self.timingChannel.localPort6 forField:PacketFieldPort6];
+    [self.connectivityManager sendPacket:packet toSockets:@[peer]];
+}
+
+// Peer. The host told us its UDP ports, probe it there from now on.
+- (void)acceptTimingChannelFromHost:(GCDAsyncSocket *)hostPeer port4:(uint16_t)port4 port6:(uint16_t)port6 {
+    NSData *hostAddress = hostPeer.connectedAddress;
+    if (!hostAddress) return;
+    
+    if (!self.timingChannel) {
+        SynactionTimingChannel *timingChannel = [[SynactionTimingChannel alloc] initWithDelegate:self];
         
-        if (fabs(newOffset-self.hostTimeOffset) <= 500) {
-            doneCalibrating = true;
-            NSLog(@"prematurely ended calibration because accurate enough with difference old/new: %f", fabs(newOffset-self.hostTimeOffset));
+        NSError *error;
+        if (![timingChannel openWithError:&error]) {
+            return;// Stay on TCP
         }
-        NSLog(@"Got diff old/new: %f", fabs(newOffset-self.hostTimeOffset));
         
-        self.hostTimeOffset = newOffset;
+        self.timingChannel = timingChannel;
+    }
+    
+    [self.timingChannel connectToHostAtAddress:hostAddress port4:port4 port6:port6];
+}
+
+// Peer. Probes sent to the host are answered by the channel's responder, only replies reach us. Anything not
+// from the host's own address and port is dropped, it would be an offset sample anyone on the network could forge.
+- (void)timingChannel:(SynactionTimingChannel *)channel didReceiveProbe:(SynactionProbe)probe receivedAt:(uint64_t)timeReceived fromAddress:(NSData *)address {
+    NSData *hostAddress = channel.hostAddress;
+    if (probe.timeHostSent == 0 || !hostAddress) return;
+    
+    if ([GCDAsyncUdpSocket portFromAddress:address] != [GCDAsyncUdpSocket portFromAddress:hostAddress] || ![[GCDAsyncUdpSocket hostFromAddress:address] isEqualToString:[GCDAsyncUdpSocket hostFromAddress:hostAddress]]) {
+        return;
+    }
+    
+    [self handleProbeReply:probe receivedAt:timeReceived];
+}
+
+#pragma mark - Clock Model
+// Peer. Records one offset measurement and refits offset + skew by least squares over the recent history.
+- (void)addClockSampleWithOffset:(int64_t)offset atTime:(uint64_t)localTime {
+    SynactionClockModelAddSample(&clockModel, offset, localTime);
+    [self publishClockModelWithOffset:clockModel.offset skew:clockModel.skew referenceTime:clockModel.referenceTime];
+}
+
+- (void)resetClockModel {
+    [self.telemetry reset];
+    SynactionClockModelReset(&clockModel);
+    SynactionDriftMonitorReset(&driftMonitor);
+    [self publishClockModelWithOffset:0 skew:0 referenceTime:0];
+}
+
+// The only way the clock model reaches -currentNetworkTime, the scheduler and the render callback. All three
+// values change together, readers on other threads never see half of an update.
+- (void)publishClockModelWithOffset:(int64_t)offset skew:(double)skew referenceTime:(uint64_t)referenceTime {
+    SynactionNetworkClockModel model = {.clock = atomic_load(&activeClock), .offset = offset, .skew = skew, .referenceTime = referenceTime};
+    SynactionNetworkClockPublish(&networkClock, &model);
+}
+
+- (int64_t)hostTimeOffset {
+    return SynactionNetworkClockRead(&networkClock).offset;
+}
+
+- (double)hostTimeSkew {
+    return SynactionNetworkClockRead(&networkClock).skew;
+}
+
+- (uint64_t)skewReferenceTime {
+    return SynactionNetworkClockRead(&networkClock).referenceTime;
+}
+
+// Offset from the host at a given local time, extrapolated with the estimated skew.
+- (int64_t)hostTimeOffsetAtTime:(uint64_t)localTime {
+    SynactionNetworkClockModel model = SynactionNetworkClockRead(&networkClock);
+    return SynactionNetworkClockModelOffsetAtTime(&model, localTime);
+}
+
+// Peer. Probes the host in the background once the model may have drifted by driftErrorBudget. Commands keep
+// flowing meanwhile, so this replaces recalibrating on pauses and joins.
+- (void)scheduleDriftTracking {
+    NSUInteger generation = ++trackingGeneration;
+    if (self.driftTrackingInterval <= 0) return;
+    
+    uint64_t interval = SynactionDriftMonitorNextCheckInterval(&driftMonitor, self.driftErrorBudget, (uint64_t)(self.driftTrackingInterval * NSEC_PER_SEC));
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), dispatch_get_main_queue(), ^{
+        if (generation != self->trackingGeneration) return;
         
-        // If calculation is done notify the host.
-        if (calculatedOffsets >= self.maxNumberOfCalibrations || doneCalibrating) {
-            NSLog(@"Calibration done with maximum number of calibrations, informing host.");
-            
-            // Let the host know we calibrated
-            NSError *error;
-            NSData *payload = [NSKeyedArchiver archivedDataWithRootObject:@{@"command": @"syncDone"} requiringSecureCoding:FALSE error:&error];
-            if (error) NSLog(@"%@", error);
-            
-            Packet *packet = [[Packet alloc] initWithData:payload type:0 action:PacketActionSync];
-            [self.connectivityManager sendPacket:packet toSockets:@[socket]];
-            
-            // Update the bool
-            self.isCalibrating = NO;
-            
-            // Post the calibration done notification
-            [[NSNotificationCenter defaultCenter] postNotificationName:CalibrationDoneNotificationName object:self];
-            
-        } else {
-            // Send another calibration request.
-            NSDictionary *payloadDict = @{@"command": @"syncPing", @"timeSent": [NSNumber numberWithUnsignedLongLong:[self currentTime]]};
-            NSError *error;
-            NSData *payload = [NSKeyedArchiver archivedDataWithRootObject:payloadDict requiringSecureCoding:FALSE error:&error];
-            if (error) NSLog(@"%@", error);
-            
-            Packet *packet = [[Packet alloc] initWithData:payload type:0 action:PacketActionSync];
-            [self.connectivityManager sendPacket:packet toSockets:@[socket]];
+        GCDAsyncSocket *hostPeer = self.connectivityManager.hostSocket;
+        if (!hostPeer) return;// Disconnected, calibration will restart tracking
+        
+        if (self.isCalibrating || self.burstHostPeer) {// Busy, look again later
+            [self scheduleDriftTracking];
+            return;
+        }
+        
+        [self startTrackingBurstWithHost:hostPeer];// Reschedules once it finishes
+    });
+}
+
+// Peer. Lets the host know we calibrated.
+- (void)completeCalibrationWithHost:(GCDAsyncSocket *)hostPeer {
+    self.lastCalibrationDuration = [self currentTime] - calibrationStartTime;
+    NSLog(@"Calibration took %.2fms.", self.lastCalibrationDuration/1000000.0);
+    
+    driftMonitor.lastMeasurementTime = self.skewReferenceTime;
+    
+    [self.connectivityManager sendPacket:[self syncPacketWithCommand:PacketCommandSyncDone] toSockets:@[hostPeer]];
+    
+    [self sendSyncReportToHost:hostPeer];
+    
+    // Update the bool
+    self.isCalibrating = NO;
+    
+    // Keep refining the clock model in the background
+    [self scheduleDriftTracking];
+    
+    // Post the calibration done notification
+    [[NSNotificationCenter defaultCenter] postNotificationName:CalibrationDoneNotificationName object:self];
+}
+
+#pragma mark - Telemetry
+- (uint64_t)estimatedDriftError {
+    return SynactionDriftMonitorErrorAtTime(&driftMonitor, [self currentTime]);
+}
+
+static int compareRoundTripTimes(const void *a, const void *b) {
+    uint64_t roundTripTimeA = *(const uint64_t *)a;
+    uint64_t roundTripTimeB = *(const uint64_t *)b;
+    
+    return (roundTripTimeA > roundTripTimeB) - (roundTripTimeA < roundTripTimeB);
+}
+
+- (SynactionSyncQuality)syncQuality {
+    SynactionSyncQuality quality = {0};
+    quality.drift = self.hostTimeSkew * 1e6;
+    
+    SynactionTelemetrySample samples[SynactionTelemetryCapacity];
+    NSUInteger count = [self.telemetry copyRecentSamples:samples maxCount:SynactionTelemetryCapacity];
+    quality.sampleCount = count;
+    if (count == 0) return quality;
+    
+    // The true offset lies within RTT/2 of each sample's offset, so the model is off by at most
+    // |model - sample| + RTT/2 for every sample. The tightest of those is the bound.
+    uint64_t roundTripTimes[SynactionTelemetryCapacity];
+    uint64_t errorBound = UINT64_MAX;
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        uint64_t roundTripTime = (uint64_t)MAX(samples[i].roundTripTime, 0);
+        uint64_t offsetError = (uint64_t)llabs(samples[i].offset - [self hostTimeOffsetAtTime:samples[i].localTime]);
+        
+        roundTripTimes[i] = roundTripTime;
+        quality.roundTripTimeHistogram[SynactionTelemetryBucketForValue(roundTripTime)] += 1;
+        quality.offsetErrorHistogram[SynactionTelemetryBucketForValue(offsetError)] += 1;
+        errorBound = MIN(errorBound, offsetError + roundTripTime/2);
+    }
+    
+    qsort(roundTripTimes, count, sizeof(uint64_t), compareRoundTripTimes);
+    quality.minRoundTripTime = roundTripTimes[0];
+    quality.medianRoundTripTime = roundTripTimes[count/2];
+    quality.errorBound = errorBound + [self estimatedDriftError];// The samples are in the past, add what drifted since
+    
+    return quality;
+}
+
+// Histograms go over the wire as little endian u32 bucket counts.
+static NSData *SynactionHistogramData(const uint32_t histogram[SynactionTelemetryBucketCount]) {
+    uint32_t buckets[SynactionTelemetryBucketCount];
+    for (NSUInteger bucket = 0; bucket < SynactionTelemetryBucketCount; bucket++) buckets[bucket] = OSSwapHostToLittleInt32(histogram[bucket]);
+    
+    return [NSData dataWithBytes:buckets length:sizeof(buckets)];
+}
+
+static NSArray <NSNumber *> *SynactionHistogramArray(NSData *data) {
+    NSMutableArray *histogram = [NSMutableArray arrayWithCapacity:SynactionTelemetryBucketCount];
+    const uint8_t *bytes = data.bytes;
+    
+    for (NSUInteger bucket = 0; bucket < SynactionTelemetryBucketCount; bucket++) {
+        uint32_t count = 0;
+        if ((bucket + 1) * sizeof(uint32_t) <= data.length) count = OSReadLittleInt32(bytes, bucket * sizeof(uint32_t));
+        [histogram addObject:[NSNumber numberWithUnsignedInt:count]];
+    }
+    
+    return histogram;
+}
+
+- (NSDictionary *)syncReport {
+    SynactionSyncQuality quality = [self syncQuality];
+    
+    NSMutableArray *roundTripTimeHistogram = [NSMutableArray arrayWithCapacity:SynactionTelemetryBucketCount];
+    NSMutableArray *offsetErrorHistogram = [NSMutableArray arrayWithCapacity:SynactionTelemetryBucketCount];
+    for (NSUInteger bucket = 0; bucket < SynactionTelemetryBucketCount; bucket++) {
+        [roundTripTimeHistogram addObject:[NSNumber numberWithUnsignedInt:quality.roundTripTimeHistogram[bucket]]];
+        [offsetErrorHistogram addObject:[NSNumber numberWithUnsignedInt:quality.offsetErrorHistogram[bucket]]];
+    }
+    
+    return @{@"sampleCount": [NSNumber numberWithUnsignedInteger:quality.sampleCount],
+             @"minRoundTripTime": [NSNumber numberWithUnsignedLongLong:quality.minRoundTripTime],
+             @"medianRoundTripTime": [NSNumber numberWithUnsignedLongLong:quality.medianRoundTripTime],
+             @"errorBound": [NSNumber numberWithUnsignedLongLong:quality.errorBound],
+             @"drift": [NSNumber numberWithDouble:quality.drift],
+             @"roundTripTimeHistogram": roundTripTimeHistogram,
+             @"offsetErrorHistogram": offsetErrorHistogram,
+    };
+}
+
+// Peer. Sent after every calibration and tracking burst, so the host sees each listener's quality as it changes.
+- (void)sendSyncReportToHost:(GCDAsyncSocket *)hostPeer {
+    if (!hostPeer) return;
+    
+    SynactionSyncQuality quality = [self syncQuality];
+    
+    Packet *packet = [[Packet alloc] initWithCommand:PacketCommandSyncReport type:PacketTypeControl action:PacketActionSync];
+    [packet setUInt64:quality.sampleCount forField:PacketFieldSampleCount];
+    [packet setUInt64:quality.minRoundTripTime forField:PacketFieldMinRoundTripTime];
+    [packet setUInt64:quality.medianRoundTripTime forField:PacketFieldMedianRoundTripTime];
+    [packet setUInt64:quality.errorBound forField:PacketFieldErrorBound];
+    [packet setDouble:quality.drift forField:PacketFieldDrift];
+    [packet setData:SynactionHistogramData(quality.roundTripTimeHistogram) forField:PacketFieldRoundTripTimeHistogram];
+    [packet setData:SynactionHistogramData(quality.offsetErrorHistogram) forField:PacketFieldOffsetErrorHistogram];
+    [self.connectivityManager sendPacket:packet toSockets:@[hostPeer]];
+}
+
+- (NSDictionary *)syncReportForPeer:(GCDAsyncSocket *)peer {
+    return [self.peerSyncReports objectForKey:peer];
+}
+
+- (NSArray <GCDAsyncSocket *> *)peersOutOfTolerance {
+    NSMutableArray *peers = [NSMutableArray new];
+    
+    for (GCDAsyncSocket *peer in self.connectivityManager.allSockets) {
+        NSDictionary *report = [self.peerSyncReports objectForKey:peer];
+        if (report && ((NSNumber *)report[@"errorBound"]).unsignedLongLongValue > self.syncTolerance) {
+            [peers addObject:peer];
         }
+    }
+    
+    return peers;
+}
+
+#pragma mark - Clock
+- (uint64_t)currentTime {
+    return SynactionClockNow(atomic_load(&activeClock));
+}
+
+- (void)setClockSource:(SynactionClockSource)clockSource {
+    if (clockSource < SynactionClockSourceMach || clockSource > SynactionClockSourceVirtual || !clockAvailable[clockSource]) {
+        NSLog(@"Clock source %ld isn't available, keeping %ld.", (long)clockSource, (long)_clockSource);
+        return;
+    }
+    
+    _clockSource = clockSource;
+    SynactionClockSetVirtualTime(&clocks[clockSource], 0);
+    atomic_store(&activeClock, &clocks[clockSource]);
+    
+    // Offsets measured against the old clock mean nothing against the new one. Readers of the network clock
+    // switch over with the reset, together with the zeroed model.
+    [self resetClockModel];
+}
+
+- (SynactionClock *)clock {
+    return atomic_load(&activeClock);
+}
+
+- (uint64_t)currentNetworkTime {
+    return SynactionNetworkClockNow(&networkClock);
+}
+
+- (const SynactionNetworkClock *)networkClock {
+    return &networkClock;
+}
+
+- (SynactionScheduledEvent *)atExactTime:(uint64_t)val runBlock:(dispatch_block_t _Nonnull)block {
+    // The scheduler thread sleeps until a learned margin before val, then spins the rest of the way.
+    // Deadlines stay in network time so a clock model refit before val still moves the firing time.
+    return [self.scheduler scheduleBlock:block atTime:val];
+}
+
+#pragma mark - Packet Handlers
+// Sync traffic is only meant for us, each command goes straight to its handler.
+- (void)registerPacketHandlers {
+    __weak Synaction *weakSelf = self;
+    ConnectivityManager *connectivityManager = self.connectivityManager;
+    
+    [connectivityManager registerCommand:PacketCommandProbe handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleProbePacket:packet fromSocket:socket];
+    }];
+    
+    [connectivityManager registerCommand:PacketCommandSyncChannel handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleSyncChannelPacket:packet fromSocket:socket];
+    }];
+    
+    [connectivityManager registerCommand:PacketCommandSync handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleSyncPacket:packet fromSocket:socket];
+    }];
+    
+    [connectivityManager registerCommand:PacketCommandSyncQueued handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleSyncQueuedPacket:packet fromSocket:socket];
+    }];
+    
+    [connectivityManager registerCommand:PacketCommandSyncDone handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleSyncDonePacket:packet fromSocket:socket];
+    }];
+    
+    [connectivityManager registerCommand:PacketCommandSyncReport handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleSyncReportPacket:packet fromSocket:socket];
+    }];
+    
+    [connectivityManager registerCommand:PacketCommandSyncPing handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleSyncPingPacket:packet fromSocket:socket];
+    }];
+    
+    [connectivityManager registerCommand:PacketCommandSyncPong handler:^(Packet *packet, GCDAsyncSocket *socket) {
+        [weakSelf handleSyncPongPacket:packet fromSocket:socket];
+    }];
+}
+
+// Burst probes are raw fixed-size records.
+- (void)handleProbePacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    uint64_t timeReceived = [self currentTime];
+    
+    SynactionProbe probe;
+    if (!SynactionProbeFromBytes(packet.data.bytes, packet.data.length, &probe)) return;
+    
+    if (probe.timeHostSent == 0) {
+        [self replyToProbe:probe receivedAt:timeReceived fromSocket:socket];
+        
+    } else {
+        [self handleProbeReply:probe receivedAt:timeReceived];
+    }
+}
+
+// Peer. The host is telling us about its timing channel.
+- (void)handleSyncChannelPacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    NSLog(@"Host offered a timing channel.");
+    [self acceptTimingChannelFromHost:socket port4:(uint16_t)[packet uint64ForField:PacketFieldPort4] port6:(uint16_t)[packet uint64ForField:PacketFieldPort6]];
+}
+
+// Peer. The host is asking us to sync.
+- (void)handleSyncPacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    NSLog(@"Host asked us to sync.");
+    grantedBurstWindow = (NSUInteger)[packet uint64ForField:PacketFieldWindow];
+    self.calibrationQueuePosition = 0;
+    [self calculateTimeOffsetWithHost:socket];
+}
+
+// Peer. The host is busy calibrating others, we're in line.
+- (void)handleSyncQueuedPacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    self.calibrationQueuePosition = (NSUInteger)[packet uint64ForField:PacketFieldPosition];
+    NSLog(@"Waiting to calibrate, position %lu.", (unsigned long)self.calibrationQueuePosition);
+    
+    [[NSNotificationCenter defaultCenter] postNotificationName:CalibrationQueuedNotificationName object:self userInfo:@{@"position": @(self.calibrationQueuePosition)}];
+}
+
+// Host.
+- (void)handleSyncDonePacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    NSLog(@"peer told us sync done");
+    
+    [self finishAdmissionForPeer:socket];
+    [self.calibratedPeers addObject:socket];
+    [self settleCalibrationBarriersForPeer:socket calibrated:YES];
+}
+
+// Host.
+- (void)handleSyncReportPacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    if (![packet hasField:PacketFieldErrorBound]) return;
+    
+    // Same keys as -syncReport, for whoever reads the notification.
+    uint64_t errorBound = [packet uint64ForField:PacketFieldErrorBound];
+    NSDictionary *payload = @{@"sampleCount": [NSNumber numberWithUnsignedLongLong:[packet uint64ForField:PacketFieldSampleCount]],
+                              @"minRoundTripTime": [NSNumber numberWithUnsignedLongLong:[packet uint64ForField:PacketFieldMinRoundTripTime]],
+                              @"medianRoundTripTime": [NSNumber numberWithUnsignedLongLong:[packet uint64ForField:PacketFieldMedianRoundTripTime]],
+                              @"errorBound": [NSNumber numberWithUnsignedLongLong:errorBound],
+                              @"drift": [NSNumber numberWithDouble:[packet doubleForField:PacketFieldDrift]],
+                              @"roundTripTimeHistogram": SynactionHistogramArray([packet dataForField:PacketFieldRoundTripTimeHistogram]),
+                              @"offsetErrorHistogram": SynactionHistogramArray([packet dataForField:PacketFieldOffsetErrorHistogram]),
+    };
+    
+    [self.peerSyncReports setObject:payload forKey:socket];
+    
+    if (errorBound > self.syncTolerance) {
+        NSLog(@"Peer %@ is out of sync tolerance, error bound %.3fms.", socket.connectedHost, errorBound/1000000.0);
+    }
+    
+    [[NSNotificationCenter defaultCenter] postNotificationName:SyncReportReceivedNotificationName object:socket userInfo:payload];
+}
+
+// This is done on the peer with which we are calculating the offset (Host).
+- (void)handleSyncPingPacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    uint64_t timeReceived = [self currentTime];
+    
+    Packet *pong = [self syncPacketWithCommand:PacketCommandSyncPong];
+    [pong setUInt64:timeReceived forField:PacketFieldTimeReceived];
+    [pong setUInt64:[packet uint64ForField:PacketFieldTimeSent] forField:PacketFieldTimeSent];
+    
+    // Speakers are only connected to the host.
+    [self.connectivityManager sendPacket:pong toSockets:@[socket]];
+}
+
+// This is done on the person who callled calculateTimeOffsetWithHost (Player).
+- (void)handleSyncPongPacket:(Packet *)packet fromSocket:(GCDAsyncSocket *)socket {
+    uint64_t timeReceived = [self currentTime];
+    
+    // Calculate the offset and add it to the calculated offsets.
+    uint64_t timePingSent = [packet uint64ForField:PacketFieldTimeSent];
+    uint64_t timeHostReceivedPing = [packet uint64ForField:PacketFieldTimeReceived];
+    
+    SynactionProbeSample sample;
+    SynactionSerialPongResult result = SynactionSerialEstimatorAddPong(&serialEstimator, timePingSent, timeHostReceivedPing, timeReceived, &sample);
+    
+    // If this calculation doesn't meet our error margin (2s), restart.
+    if (result == SynactionSerialPongRetry) {
+        NSLog(@"Calibration took too long. Repeating.");
+        Packet *ping = [self syncPacketWithCommand:PacketCommandSyncPing];
+        [ping setUInt64:timeReceived forField:PacketFieldTimeSent];
+        [self.connectivityManager sendPacket:ping toSockets:@[socket]];
         
         return;
     }
+    
+    // Serial pongs don't carry the host turnaround, so this RTT includes it.
+    [self.telemetry recordSample:sample atTime:timeReceived];
+    
+    NSLog(@"Calculated calibration. Total: %llu, diff old/new: %lld", serialEstimator.calibrations, llabs(serialEstimator.offset - self.hostTimeOffset));
+    
+    [self publishClockModelWithOffset:serialEstimator.offset skew:self.hostTimeSkew referenceTime:timeReceived];
+    
+    // If calculation is done notify the host.
+    if (result == SynactionSerialPongDone) {
+        NSLog(@"Calibration done, informing host.");
+        
+        [self addClockSampleWithOffset:serialEstimator.offset atTime:timeReceived];
+        [self completeCalibrationWithHost:socket];
+        
+    } else {
+        // Send another calibration request.
+        Packet *ping = [self syncPacketWithCommand:PacketCommandSyncPing];
+        [ping setUInt64:[self currentTime] forField:PacketFieldTimeSent];
+        [self.connectivityManager sendPacket:ping toSockets:@[socket]];
+    }
+}
+
+#pragma mark - ConnectivityManagerDelegate
+- (void)socket:(GCDAsyncSocket *)socket didAcceptNewSocket:(GCDAsyncSocket *)newSocket {
+    [self offerTimingChannelToPeer:newSocket];
 }
 
 - (void)socketDidDisconnect:(GCDAsyncSocket *)socket withError:(NSError *)error {
     // Remove any reference to this socket
     if (socket) {
         [self.calibratedPeers removeObject:socket];
+        [self.peerSyncReports removeObjectForKey:socket];
+        [self settleCalibrationBarriersForPeer:socket calibrated:NO];
+        
+        NSNumber *admissionID = [self.admissionIDs objectForKey:socket];
+        if (admissionID) {
+            [self finishAdmissionForPeer:socket];
+            [self.admissionSockets removeObjectForKey:admissionID];
+            [self.admissionIDs removeObjectForKey:socket];
+        }
+        
+        NSData *probingAddress = [self.probingPeerAddresses objectForKey:socket];
+        if (probingAddress) {
+            [self.timingChannel disallowProbesFromAddress:probingAddress];
+            [self.probingPeerAddresses removeObjectForKey:socket];
+        }
     }
     
+    // Peer. Keep the clock model for when we reconnect to the same host.
+    [self saveWarmStartForHost:self.connectivityManager.hostName];
+    
     self.isCalibrating = NO;
-    self.hostTimeOffset = 0;
+    self.burstHostPeer = nil;
+    self.calibrationQueuePosition = 0;
+    grantedBurstWindow = 0;
+    trackingGeneration += 1;
+    
+    // A peer's channel goes with its host, even once it fell back to TCP. The host keeps its open for the other peers.
+    if (self.timingChannel && (!self.timingChannel.respondsToProbes || self.connectivityManager.allSockets.count == 0)) {
+        [self.timingChannel close];
+        self.timingChannel = nil;
+        [self.probingPeerAddresses removeAllObjects];
+    }
+    [self resetClockModel];
 }
 
 @end
@@ -0,0 +1,41 @@
+//
+//  SynactionAudioStream.h
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// Frameworks
+#import <Foundation/Foundation.h>
+
+// Frameworks & Librairies
+#import "bass.h"
+#import "SynactionClock.h"
+
+// Output stream that is always running and switches between silence and the song at an exact sample.
+// The switch sample is computed from the network time inside the render callback, so start alignment is
+// bounded by one sample period rather than by the scheduling and buffering jitter of BASS_ChannelPlay.
+// The callback reads the network time from a lock-free snapshot and never seeks, skipping ahead after a late
+// start is handed to a seek queue while the callback renders silence.
+typedef BOOL(^SynactionAudioStreamAvailability)(uint64_t offset, uint64_t length);// Wether those bytes of the file are in. Called on the audio thread, must not block.
+
+@interface SynactionAudioStream : NSObject
+
+- (_Nullable instancetype)initWithFileAtPath:(NSString * _Nonnull)path networkClock:(const SynactionNetworkClock * _Nonnull)networkClock;// networkClock must outlive the stream, see -[Synaction networkClock].
+- (_Nullable instancetype)initWithGrowingFileAtPath:(NSString * _Nonnull)path availability:(SynactionAudioStreamAvailability _Nonnull)availability networkClock:(const SynactionNetworkClock * _Nonnull)networkClock;// A file still being received, at its full length. Where the song reads bytes that aren't in yet it renders silence, then skips ahead so it stays in sync.
+
+- (void)startAtTime:(uint64_t)time;// The first song sample is heard at network time time. If time already passed the song starts where it would have been by now.
+- (void)stopAtTime:(uint64_t)time;// Silence from network time time on.
+- (void)start;// Song from the next rendered buffer.
+- (void)stop;// Silence from the next rendered buffer.
+- (void)free;// Frees both BASS channels, the stream is unusable afterwards.
+
+@property (readonly, nonatomic) HSTREAM decodeChannel;// The song. Seek, position and length go through this channel.
+@property (readonly, nonatomic) HSTREAM outputChannel;// The running output stream.
+@property (nonatomic) uint64_t outputLatency;// Time from render to speaker, in nanoseconds. Set from the audio session.
+@property (readonly, nonatomic) BOOL isPlaying;// Wether the song (not silence) is being rendered.
+@property (readonly, nonatomic) BOOL isStarved;// Growing file only. Playing, but waiting on bytes that aren't in yet.
+@property (readonly, nonatomic) uint64_t fileReadPosition;// Where in the file the song reads next. Prioritize receiving from there.
+
+@end
@@ -0,0 +1,305 @@
+//
+//  SynactionAudioStream.m
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#import "SynactionAudioStream.h"
+
+// Frameworks
+#import <stdatomic.h>
+
+#define SynactionAudioStreamNoSwitch 0
+#define SynactionAudioStreamImmediately 1// Switch at the next rendered frame, without catching up
+#define SynactionAudioStreamAnchorGain 32// The frame zero estimate moves 1/32 of the way per render callback
+#define SynactionAudioStreamReadAhead 131072// Bytes of a growing file that must be in past the read position before decoding from it
+
+// Everything the render callback touches. Times are network nanoseconds.
+typedef struct {
+    HSTREAM decodeChannel;
+    DWORD frequency;
+    DWORD frameSize;// Bytes per frame, 32 bit float samples
+    const SynactionNetworkClock *networkClock;
+    __unsafe_unretained dispatch_source_t seekSource;// Seeks the decode channel off the audio thread
+    __unsafe_unretained SynactionAudioStreamAvailability availability;// NULL for a complete file
+    _Atomic uint64_t outputLatency;
+    _Atomic uint64_t startTime;
+    _Atomic uint64_t stopTime;
+    _Atomic bool isPlaying;
+    _Atomic bool isStarved;
+    _Atomic int64_t framesToSkip;// Song frames the seek queue still has to skip
+    _Atomic bool isSeeking;// The decode channel belongs to the seek queue, render silence
+    int64_t framesStarved;// Rendered as silence while waiting on a growing file. Audio thread only
+    int64_t framesRendered;// Audio thread only
+    int64_t frameZeroTime;// When frame 0 of the output stream was (or would have been) heard. Audio thread only
+} SynactionAudioStreamState;
+
+static inline int64_t SynactionAudioStreamFrameAtTime(const SynactionAudioStreamState *state, uint64_t time) {
+    return ((int64_t)time - state->frameZeroTime) * (int64_t)state->frequency / (int64_t)NSEC_PER_SEC;
+}
+
+// Moves the song ahead by frames, to line up with the other devices after rendering silence. A seek can read
+// the file, so the audio thread only asks for it. Until the seek queue is done the song renders as silence,
+// and those frames are skipped too.
+static void SynactionAudioStreamSkip(SynactionAudioStreamState *state, int64_t frames) {
+    atomic_fetch_add(&state->framesToSkip, frames);
+    
+    if (!atomic_exchange(&state->isSeeking, true)) {
+        dispatch_source_merge_data(state->seekSource, 1);
+    }
+}
+
+// Seek queue. Only ever runs while the audio thread stays off the decode channel.
+static void SynactionAudioStreamSeek(SynactionAudioStreamState *state) {
+    int64_t frames = atomic_exchange(&state->framesToSkip, 0);
+    
+    if (frames > 0) {
+        QWORD songPosition = BASS_ChannelGetPosition(state->decodeChannel, BASS_POS_BYTE);
+        BASS_ChannelSetPosition(state->decodeChannel, songPosition + (QWORD)(frames * state->frameSize), BASS_POS_BYTE);
+    }
+    
+    atomic_store(&state->isSeeking, false);
+}
+
+// Wether the bytes the decoder reads next are in the file yet.
+static BOOL SynactionAudioStreamHasData(SynactionAudioStreamState *state) {
+    if (!state->availability) return YES;
+    
+    QWORD filePosition = BASS_StreamGetFilePosition(state->decodeChannel, BASS_FILEPOS_CURRENT);
+    return state->availability(filePosition, SynactionAudioStreamReadAhead);
+}
+
+// Decodes up to frames frames into bytes, pads with silence at the end of the song. Returns NO once the song ended.
+static BOOL SynactionAudioStreamDecode(SynactionAudioStreamState *state, uint8_t *bytes, int64_t frames) {
+    // A growing file may not have what comes next yet. Silence meanwhile, then skip what was missed like a late start.
+    if (state->framesStarved > 0 && !atomic_load(&state->isSeeking) && SynactionAudioStreamHasData(state)) {
+        SynactionAudioStreamSkip(state, state->framesStarved);
+        state->framesStarved = 0;
+    }
+    
+    // Still catching up, the song falls behind by these frames as well. Skips that came in after the seek
+    // queue looked are picked up here.
+    if (atomic_load(&state->isSeeking) || atomic_load(&state->framesToSkip) > 0) {
+        memset(bytes, 0, (size_t)(frames * state->frameSize));
+        SynactionAudioStreamSkip(state, frames);
+        return YES;
+    }
+    
+    if (!SynactionAudioStreamHasData(state)) {
+        memset(bytes, 0, (size_t)(frames * state->frameSize));
+        state->framesStarved += frames;
+        atomic_store(&state->isStarved, true);
+        return YES;
+    }
+    
+    atomic_store(&state->isStarved, false);
+    
+    DWORD length = (DWORD)(frames * state->frameSize);
+    DWORD decoded = BASS_ChannelGetData(state->decodeChannel, bytes, length);
+    if (decoded == (DWORD)-1) decoded = 0;
+    
+    if (decoded < length) {
+        memset(bytes + decoded, 0, length - decoded);
+        return NO;
+    }
+    
+    return YES;
+}
+
+static DWORD CALLBACK SynactionAudioStreamProc(HSTREAM handle, void *buffer, DWORD length, void *user) {
+    SynactionAudioStreamState *state = user;
+    int64_t frames = length / state->frameSize;
+    uint8_t *bytes = buffer;
+    
+    // The first frame of this buffer is heard outputLatency from now. Smooth the implied frame zero time so
+    // callback jitter averages out, while still following the audio clock against the network clock.
+    int64_t frameZeroTime = (int64_t)(SynactionNetworkClockNow(state->networkClock) + atomic_load(&state->outputLatency)) - state->framesRendered * (int64_t)NSEC_PER_SEC / (int64_t)state->frequency;
+    if (state->framesRendered == 0) {
+        state->frameZeroTime = frameZeroTime;
+        
+    } else {
+        state->frameZeroTime += (frameZeroTime - state->frameZeroTime)/SynactionAudioStreamAnchorGain;
+    }
+    
+    int64_t written = 0;
+    while (written < frames) {
+        int64_t position = state->framesRendered + written;
+        bool isPlaying = atomic_load(&state->isPlaying);
+        uint64_t switchTime = atomic_load(isPlaying ? &state->stopTime : &state->startTime);
+        
+        int64_t switchFrame = INT64_MAX;
+        if (switchTime == SynactionAudioStreamImmediately) {
+            switchFrame = position;
+            
+        } else if (switchTime != SynactionAudioStreamNoSwitch) {
+            switchFrame = SynactionAudioStreamFrameAtTime(state, switchTime);
+        }
+        
+        // Render up to the switch frame in the current state.
+        int64_t run = MIN(frames - written, MAX(switchFrame - position, 0));
+        if (run > 0) {
+            if (!isPlaying) {
+                memset(bytes + written * state->frameSize, 0, (size_t)(run * state->frameSize));
+                
+            } else if (!SynactionAudioStreamDecode(state, bytes + written * state->frameSize, run)) {
+                atomic_store(&state->isPlaying, false);// Song ended
+            }
+            
+            written += run;
+            continue;
+        }
+        
+        // Switch exactly at this frame.
+        if (isPlaying) {
+            atomic_store(&state->stopTime, SynactionAudioStreamNoSwitch);
+            atomic_store(&state->isPlaying, false);
+            
+        } else {
+            // A start we were late for skips the song ahead so it lines up with the other devices.
+            int64_t framesLate = (switchTime == SynactionAudioStreamImmediately) ? 0 : position - switchFrame;
+            if (framesLate > 0) {
+                SynactionAudioStreamSkip(state, framesLate);
+            }
+            
+            state->framesStarved = 0;
+            atomic_store(&state->startTime, SynactionAudioStreamNoSwitch);
+            atomic_store(&state->isPlaying, true);
+        }
+    }
+    
+    state->framesRendered += frames;
+    
+    return length;
+}
+
+@interface SynactionAudioStream () {
+    SynactionAudioStreamState state;
+}
+
+@property (copy, nonatomic) SynactionAudioStreamAvailability availability;// Keeps the block state points to alive
+@property (strong, nonatomic) dispatch_queue_t seekQueue;
+@property (strong, nonatomic) dispatch_source_t seekSource;// Same
+@property (nonatomic) HSTREAM decodeChannel;
+@property (nonatomic) HSTREAM outputChannel;
+
+@end
+
+@implementation SynactionAudioStream
+
+- (instancetype)initWithFileAtPath:(NSString *)path networkClock:(const SynactionNetworkClock *)networkClock {
+    return [self initWithFileAtPath:path availability:nil networkClock:networkClock];
+}
+
+- (instancetype)initWithGrowingFileAtPath:(NSString *)path availability:(SynactionAudioStreamAvailability)availability networkClock:(const SynactionNetworkClock *)networkClock {
+    return [self initWithFileAtPath:path availability:availability networkClock:networkClock];
+}
+
+- (instancetype)initWithFileAtPath:(NSString *)path availability:(SynactionAudioStreamAvailability)availability networkClock:(const SynactionNetworkClock *)networkClock {
+    self = [super init];
+    
+    if (self) {
+        // A prescan would read the whole file, missing parts included.
+        DWORD flags = BASS_STREAM_DECODE | BASS_SAMPLE_FLOAT | (availability ? 0 : BASS_STREAM_PRESCAN);
+        
+        self.decodeChannel = BASS_StreamCreateFile(false, path.fileSystemRepresentation, 0, 0, flags);
+        if (!self.decodeChannel) {
+            NSLog(@"Failed to create decode channel for render stream: %d", BASS_ErrorGetCode());
+            return nil;
+        }
+        
+        BASS_CHANNELINFO info;
+        BASS_ChannelGetInfo(self.decodeChannel, &info);
+        
+        self.availability = availability;
+        state.decodeChannel = self.decodeChannel;
+        state.frequency = info.freq;
+        state.frameSize = info.chans * sizeof(float);
+        state.networkClock = networkClock;
+        state.availability = self.availability;
+        
+        // The block only holds on to state, which lives as long as we do. -free drains the queue first.
+        SynactionAudioStreamState *statePointer = &state;
+        self.seekQueue = dispatch_queue_create("Synaction.AudioStream.Seek", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, 0));
+        self.seekSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, self.seekQueue);
+        dispatch_source_set_event_handler(self.seekSource, ^{
+            SynactionAudioStreamSeek(statePointer);
+        });
+        dispatch_resume(self.seekSource);
+        state.seekSource = self.seekSource;
+        
+        // The output stream runs from now on, silent until -startAtTime:. No buffering so the render
+        // callback runs straight from the device callback and outputLatency is the whole delay.
+        self.outputChannel = BASS_StreamCreate(info.freq, info.chans, BASS_SAMPLE_FLOAT, SynactionAudioStreamProc, &state);
+        if (!self.outputChannel) {
+            NSLog(@"Failed to create render stream: %d", BASS_ErrorGetCode());
+            dispatch_source_cancel(self.seekSource);
+            BASS_StreamFree(self.decodeChannel);
+            return nil;
+        }
+        
+        BASS_ChannelSetAttribute(self.outputChannel, BASS_ATTRIB_NOBUFFER, 1);
+        BASS_ChannelPlay(self.outputChannel, false);
+    }
+    
+    return self;
+}
+
+- (void)startAtTime:(uint64_t)time {
+    atomic_store(&state.stopTime, SynactionAudioStreamNoSwitch);// The latest command wins
+    atomic_store(&state.startTime, MAX(time, SynactionAudioStreamImmediately + 1));
+}
+
+- (void)stopAtTime:(uint64_t)time {
+    atomic_store(&state.startTime, SynactionAudioStreamNoSwitch);
+    atomic_store(&state.stopTime, MAX(time, SynactionAudioStreamImmediately + 1));
+}
+
+- (void)start {
+    atomic_store(&state.stopTime, SynactionAudioStreamNoSwitch);
+    atomic_store(&state.startTime, SynactionAudioStreamImmediately);
+}
+
+- (void)stop {
+    atomic_store(&state.startTime, SynactionAudioStreamNoSwitch);
+    atomic_store(&state.stopTime, SynactionAudioStreamImmediately);
+}
+
+- (void)free {
+    BASS_StreamFree(self.outputChannel);// Stops the render callback before state goes away
+    
+    // Then any seek it asked for, before the decode channel goes.
+    dispatch_source_cancel(self.seekSource);
+    dispatch_sync(self.seekQueue, ^{});
+    
+    BASS_StreamFree(self.decodeChannel);
+    self.outputChannel = 0;
+    self.decodeChannel = 0;
+}
+
+- (void)dealloc {
+    if (self.outputChannel) [self free];
+}
+
+- (void)setOutputLatency:(uint64_t)outputLatency {
+    atomic_store(&state.outputLatency, outputLatency);
+}
+
+- (uint64_t)outputLatency {
+    return atomic_load(&state.outputLatency);
+}
+
+- (BOOL)isPlaying {
+    return atomic_load(&state.isPlaying);
+}
+
+- (BOOL)isStarved {
+    return atomic_load(&state.isStarved);
+}
+
+- (uint64_t)fileReadPosition {
+    return BASS_StreamGetFilePosition(self.decodeChannel, BASS_FILEPOS_CURRENT);
+}
+
+@end
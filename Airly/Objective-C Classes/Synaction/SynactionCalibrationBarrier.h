@@ -0,0 +1,40 @@
+//
+//  SynactionCalibrationBarrier.h
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// Frameworks
+#import <Foundation/Foundation.h>
+
+@class GCDAsyncSocket;
+
+typedef void(^ _Nullable calibrationBlock)(NSArray <GCDAsyncSocket *> * _Nullable peers);
+
+typedef NS_ENUM(NSInteger, SynactionBarrierMode) {
+    SynactionBarrierModeAll = 0,// The block runs once, with every peer that calibrated, when none are left pending.
+    SynactionBarrierModeEach,// The block runs for every peer as it calibrates.
+};
+
+// Host. Waits on a set of peers to calibrate. Keeps a count of pending peers, so each calibration is one
+// set removal and a decrement however many peers or barriers there are. Disconnected peers stop being
+// waited on, and after the timeout an All barrier runs with whoever made it. Not thread safe, use it on
+// the connectivity manager's delegate queue.
+@interface SynactionCalibrationBarrier : NSObject
+
+- (instancetype _Nonnull)initWithPeers:(NSArray <GCDAsyncSocket *> * _Nonnull)peers mode:(SynactionBarrierMode)mode block:(calibrationBlock)block;
+
+- (void)peerDidCalibrate:(GCDAsyncSocket * _Nonnull)peer;
+- (void)peerDidDisconnect:(GCDAsyncSocket * _Nonnull)peer;
+- (void)finishIfNothingPending;// For a barrier that started out with no peers to wait on.
+- (void)expire;// Timed out. An All barrier runs its block with the peers that calibrated so far.
+- (void)cancel;// The block never runs.
+
+@property (readonly, nonatomic) NSSet <GCDAsyncSocket *> * _Nonnull pendingPeers;
+@property (readonly, nonatomic) NSUInteger pendingCount;
+@property (readonly, nonatomic) BOOL isFinished;// Ran, expired or cancelled.
+@property (copy, nonatomic) void(^ _Nullable finishHandler)(SynactionCalibrationBarrier * _Nonnull barrier);// Called once when it finishes, so the owner can drop it.
+
+@end
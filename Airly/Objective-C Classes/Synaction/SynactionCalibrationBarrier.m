@@ -0,0 +1,97 @@
+//
+//  SynactionCalibrationBarrier.m
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#import "SynactionCalibrationBarrier.h"
+
+@interface SynactionCalibrationBarrier ()
+
+@property (strong, nonatomic) NSMutableSet <GCDAsyncSocket *> *pending;
+@property (strong, nonatomic) NSMutableArray <GCDAsyncSocket *> *calibrated;// All mode only
+@property (copy, nonatomic) calibrationBlock block;
+@property (nonatomic) SynactionBarrierMode mode;
+@property (nonatomic) BOOL isFinished;
+
+@end
+
+@implementation SynactionCalibrationBarrier
+
+- (instancetype)initWithPeers:(NSArray <GCDAsyncSocket *> *)peers mode:(SynactionBarrierMode)mode block:(calibrationBlock)block {
+    self = [super init];
+    
+    if (self) {
+        _pending = [NSMutableSet setWithArray:peers];
+        _calibrated = [NSMutableArray arrayWithCapacity:(mode == SynactionBarrierModeAll) ? _pending.count : 0];
+        _block = block;
+        _mode = mode;
+    }
+    
+    return self;
+}
+
+- (void)peerDidCalibrate:(GCDAsyncSocket *)peer {
+    if (self.isFinished || ![self.pending containsObject:peer]) return;
+    [self.pending removeObject:peer];
+    
+    if (self.mode == SynactionBarrierModeEach) {
+        if (self.block) self.block(@[peer]);
+        
+    } else {
+        [self.calibrated addObject:peer];
+    }
+    
+    if (self.pending.count == 0) [self finishRunningBlock:(self.mode == SynactionBarrierModeAll)];
+}
+
+- (void)peerDidDisconnect:(GCDAsyncSocket *)peer {
+    if (self.isFinished || ![self.pending containsObject:peer]) return;
+    [self.pending removeObject:peer];
+    
+    if (self.pending.count == 0) [self finishRunningBlock:(self.mode == SynactionBarrierModeAll)];
+}
+
+- (void)finishIfNothingPending {
+    if (self.isFinished || self.pending.count > 0) return;
+    
+    [self finishRunningBlock:(self.mode == SynactionBarrierModeAll)];
+}
+
+- (void)expire {
+    if (self.isFinished) return;
+    
+    NSLog(@"Gave up waiting on %lu peers to calibrate.", (unsigned long)self.pending.count);
+    [self finishRunningBlock:(self.mode == SynactionBarrierModeAll)];
+}
+
+- (void)cancel {
+    if (self.isFinished) return;
+    
+    [self finishRunningBlock:NO];
+}
+
+- (void)finishRunningBlock:(BOOL)runBlock {
+    self.isFinished = YES;
+    
+    // The owner unregisters us from the peers still pending, so clear them after.
+    if (self.finishHandler) self.finishHandler(self);
+    self.finishHandler = nil;
+    [self.pending removeAllObjects];
+    
+    calibrationBlock block = self.block;
+    self.block = nil;
+    if (runBlock && block) block(self.calibrated);
+}
+
+- (NSSet <GCDAsyncSocket *> *)pendingPeers {
+    return self.pending;
+}
+
+- (NSUInteger)pendingCount {
+    return self.pending.count;
+}
+
+@end
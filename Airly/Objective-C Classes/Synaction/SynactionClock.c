@@ -0,0 +1,184 @@
+//
+//  SynactionClock.c
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#if !defined(__APPLE__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L// clock_gettime under strict C
+#endif
+
+#include "SynactionClock.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+static SynactionClock SynactionDefaultClock;
+#ifdef __APPLE__
+static SynactionClock SynactionMachClock;
+#endif
+static pthread_once_t SynactionClocksOnce = PTHREAD_ONCE_INIT;
+
+static void SynactionClockSetRatio(SynactionClock *clock, uint64_t numerator, uint64_t denominator) {
+    clock->wholeNanoseconds = numerator / denominator;
+    clock->fractionNanoseconds = ((numerator % denominator) << 32) / denominator;
+}
+
+bool SynactionClockInit(SynactionClock *clock, SynactionClockSource source) {
+    clock->source = source;
+    atomic_store(&clock->virtualTime, 0);
+    SynactionClockSetRatio(clock, 1, 1);
+    
+    switch (source) {
+        case SynactionClockSourceMach: {
+#ifdef __APPLE__
+            mach_timebase_info_data_t timebase;
+            if (mach_timebase_info(&timebase) != KERN_SUCCESS || timebase.denom == 0) return false;
+            
+            SynactionClockSetRatio(clock, timebase.numer, timebase.denom);
+            return true;
+#else
+            return false;
+#endif
+        }
+            
+        case SynactionClockSourceMonotonicRaw: {
+#ifdef CLOCK_MONOTONIC_RAW
+            struct timespec time;
+            return clock_gettime(CLOCK_MONOTONIC_RAW, &time) == 0;
+#else
+            return false;
+#endif
+        }
+            
+        case SynactionClockSourceVirtual:
+            return true;
+    }
+    
+    return false;
+}
+
+static void SynactionClockInitShared(void) {
+#ifdef __APPLE__
+    SynactionClockInit(&SynactionMachClock, SynactionClockSourceMach);
+    SynactionClockInit(&SynactionDefaultClock, SynactionClockSourceMach);
+#else
+    SynactionClockInit(&SynactionDefaultClock, SynactionClockSourceMonotonicRaw);
+#endif
+}
+
+const SynactionClock *SynactionClockDefault(void) {
+    pthread_once(&SynactionClocksOnce, SynactionClockInitShared);
+    return &SynactionDefaultClock;
+}
+
+const SynactionClock *SynactionClockMach(void) {
+#ifdef __APPLE__
+    pthread_once(&SynactionClocksOnce, SynactionClockInitShared);
+    return &SynactionMachClock;
+#else
+    return NULL;
+#endif
+}
+
+uint64_t SynactionClockReadTicks(const SynactionClock *clock) {
+    switch (clock->source) {
+        case SynactionClockSourceMach:
+#ifdef __APPLE__
+            return mach_absolute_time();
+#else
+            return 0;
+#endif
+            
+        case SynactionClockSourceMonotonicRaw: {
+#ifdef CLOCK_MONOTONIC_RAW
+            struct timespec time;
+            clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+            return (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_nsec;
+#else
+            return 0;
+#endif
+        }
+            
+        case SynactionClockSourceVirtual:
+            return atomic_load_explicit(&((SynactionClock *)clock)->virtualTime, memory_order_acquire);
+    }
+    
+    return 0;
+}
+
+void SynactionClockSetVirtualTime(SynactionClock *clock, uint64_t time) {
+    atomic_store_explicit(&clock->virtualTime, time, memory_order_release);
+}
+
+void SynactionClockAdvanceVirtualTime(SynactionClock *clock, uint64_t nanoseconds) {
+    atomic_fetch_add_explicit(&clock->virtualTime, nanoseconds, memory_order_acq_rel);
+}
+
+// MARK: - Network Time
+void SynactionNetworkClockInit(SynactionNetworkClock *networkClock, const SynactionClock *clock) {
+    atomic_init(&networkClock->sequence, 0);
+    atomic_init(&networkClock->clock, clock);
+    atomic_init(&networkClock->offset, 0);
+    atomic_init(&networkClock->skew, 0);
+    atomic_init(&networkClock->referenceTime, 0);
+}
+
+void SynactionNetworkClockPublish(SynactionNetworkClock *networkClock, const SynactionNetworkClockModel *model) {
+    uint64_t skew;
+    memcpy(&skew, &model->skew, sizeof(skew));
+    
+    uint32_t sequence = atomic_load_explicit(&networkClock->sequence, memory_order_relaxed);
+    atomic_store_explicit(&networkClock->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);// Readers see the odd sequence before any new field
+    
+    atomic_store_explicit(&networkClock->clock, model->clock, memory_order_relaxed);
+    atomic_store_explicit(&networkClock->offset, model->offset, memory_order_relaxed);
+    atomic_store_explicit(&networkClock->skew, skew, memory_order_relaxed);
+    atomic_store_explicit(&networkClock->referenceTime, model->referenceTime, memory_order_relaxed);
+    
+    atomic_store_explicit(&networkClock->sequence, sequence + 2, memory_order_release);
+}
+
+SynactionNetworkClockModel SynactionNetworkClockRead(const SynactionNetworkClock *networkClock) {
+    SynactionNetworkClock *shared = (SynactionNetworkClock *)networkClock;
+    SynactionNetworkClockModel model;
+    uint32_t before, after;
+    
+    do {
+        before = atomic_load_explicit(&shared->sequence, memory_order_acquire);
+        
+        model.clock = atomic_load_explicit(&shared->clock, memory_order_relaxed);
+        model.offset = atomic_load_explicit(&shared->offset, memory_order_relaxed);
+        uint64_t skew = atomic_load_explicit(&shared->skew, memory_order_relaxed);
+        model.referenceTime = atomic_load_explicit(&shared->referenceTime, memory_order_relaxed);
+        memcpy(&model.skew, &skew, sizeof(skew));
+        
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&shared->sequence, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    
+    return model;
+}
+
+int64_t SynactionNetworkClockModelOffsetAtTime(const SynactionNetworkClockModel *model, uint64_t localTime) {
+    if (model->skew == 0) return model->offset;
+    
+    double elapsed = (double)((int64_t)localTime - (int64_t)model->referenceTime);
+    return model->offset + (int64_t)llround(elapsed*model->skew);
+}
+
+uint64_t SynactionNetworkClockNow(const SynactionNetworkClock *networkClock) {
+    SynactionNetworkClockModel model = SynactionNetworkClockRead(networkClock);
+    uint64_t localTime = SynactionClockNow(model.clock);
+    
+    return localTime - (uint64_t)SynactionNetworkClockModelOffsetAtTime(&model, localTime);
+}
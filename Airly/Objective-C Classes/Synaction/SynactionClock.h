@@ -0,0 +1,79 @@
+//
+//  SynactionClock.h
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#ifndef SynactionClock_h
+#define SynactionClock_h
+
+// Monotonic clock behind Synaction. The tick to nanosecond ratio is turned into fixed point once at
+// init, reading the clock is then one read and at most two multiplies, with no overflow on long uptimes.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+typedef enum {
+    SynactionClockSourceMach = 0,// mach_absolute_time, Darwin only
+    SynactionClockSourceMonotonicRaw,// clock_gettime(CLOCK_MONOTONIC_RAW)
+    SynactionClockSourceVirtual,// Only moves when told to, for simulations and tests
+} SynactionClockSource;
+
+typedef struct {
+    SynactionClockSource source;
+    uint64_t wholeNanoseconds;// Integer part of nanoseconds per tick
+    uint64_t fractionNanoseconds;// Fractional part of nanoseconds per tick, in 1/2^32
+    _Atomic uint64_t virtualTime;// Nanoseconds, virtual source only
+} SynactionClock;
+
+bool SynactionClockInit(SynactionClock *clock, SynactionClockSource source);// False if the source isn't available here.
+const SynactionClock *SynactionClockDefault(void);// Mach on Darwin, CLOCK_MONOTONIC_RAW elsewhere.
+const SynactionClock *SynactionClockMach(void);// Converts mach ticks stamped by the kernel. NULL off Darwin.
+
+uint64_t SynactionClockReadTicks(const SynactionClock *clock);
+void SynactionClockSetVirtualTime(SynactionClock *clock, uint64_t time);
+void SynactionClockAdvanceVirtualTime(SynactionClock *clock, uint64_t nanoseconds);
+
+// The fraction error is under 2^-32 ns per tick, a rate error far below any crystal's.
+static inline uint64_t SynactionClockTicksToNanoseconds(const SynactionClock *clock, uint64_t ticks) {
+    if (clock->fractionNanoseconds == 0) return ticks * clock->wholeNanoseconds;
+    
+    uint64_t high = ticks >> 32;
+    uint64_t low = ticks & 0xFFFFFFFF;
+    
+    return ticks * clock->wholeNanoseconds + high * clock->fractionNanoseconds + ((low * clock->fractionNanoseconds) >> 32);
+}
+
+static inline uint64_t SynactionClockNow(const SynactionClock *clock) {
+    return SynactionClockTicksToNanoseconds(clock, SynactionClockReadTicks(clock));
+}
+
+// MARK: - Network Time
+// Host time as seen from a peer: a local clock corrected by the clock model's offset and skew. Published
+// from one thread at a time and read from any, audio render callbacks included, without locks. Readers
+// retry the rare read a publish overlapped, so they never mix a new offset with an old skew.
+typedef struct {
+    _Atomic uint32_t sequence;// Odd while a publish is in progress
+    _Atomic(const SynactionClock *) clock;
+    _Atomic int64_t offset;// Local minus host, at referenceTime
+    _Atomic uint64_t skew;// Bits of a double, ns per ns
+    _Atomic uint64_t referenceTime;
+} SynactionNetworkClock;
+
+typedef struct {
+    const SynactionClock *clock;
+    int64_t offset;
+    double skew;
+    uint64_t referenceTime;
+} SynactionNetworkClockModel;
+
+void SynactionNetworkClockInit(SynactionNetworkClock *networkClock, const SynactionClock *clock);// Offset and skew 0.
+void SynactionNetworkClockPublish(SynactionNetworkClock *networkClock, const SynactionNetworkClockModel *model);
+SynactionNetworkClockModel SynactionNetworkClockRead(const SynactionNetworkClock *networkClock);
+int64_t SynactionNetworkClockModelOffsetAtTime(const SynactionNetworkClockModel *model, uint64_t localTime);
+uint64_t SynactionNetworkClockNow(const SynactionNetworkClock *networkClock);// Host time, in nanoseconds.
+
+#endif /* SynactionClock_h */
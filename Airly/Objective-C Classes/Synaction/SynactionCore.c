@@ -0,0 +1,325 @@
+//
+//  SynactionCore.c
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#include "SynactionCore.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define SynactionMin(a, b) (((a) < (b)) ? (a) : (b))
+#define SynactionMax(a, b) (((a) > (b)) ? (a) : (b))
+
+// MARK: - Burst
+void SynactionBurstStart(SynactionBurst *burst, size_t size, size_t window, bool expectsFollowUps, uint64_t now) {
+    burst->identifier += 1;
+    burst->target = (uint16_t)SynactionMax(SynactionMin(size, SynactionMaxBurstSize), 1);
+    burst->window = (uint16_t)SynactionMax(SynactionMin(window, burst->target), 1);
+    burst->probesSent = 0;
+    burst->samplesReceived = 0;
+    burst->followUpsReceived = 0;
+    burst->expectsFollowUps = expectsFollowUps;
+    burst->isActive = true;
+    burst->lastActivityTime = now;
+    memset(burst->replyTimes, 0, sizeof(burst->replyTimes));
+    memset(burst->earlyFollowUps, 0, sizeof(burst->earlyFollowUps));
+}
+
+bool SynactionBurstNextProbe(SynactionBurst *burst, uint64_t now, SynactionProbe *probe) {
+    if (!burst->isActive || burst->probesSent >= burst->target) return false;
+    
+    memset(probe, 0, sizeof(SynactionProbe));
+    probe->magic = SynactionProbeMagic;
+    probe->sequence = burst->probesSent;
+    probe->burst = burst->identifier;
+    probe->timeSent = now;
+    
+    burst->probesSent += 1;
+    
+    return true;
+}
+
+SynactionBurstReplyResult SynactionBurstHandleReply(SynactionBurst *burst, const SynactionProbe *probe, uint64_t timeReceived, bool *sendNextProbe) {
+    *sendNextProbe = false;
+    
+    if (!burst->isActive || probe->burst != burst->identifier || probe->sequence >= burst->target) {
+        return SynactionBurstReplyIgnored;// Late reply from a previous burst
+    }
+    
+    SynactionProbe *reply = &burst->replies[probe->sequence];
+    
+    if (probe->magic == SynactionProbeFollowUpMagic) {
+        if (reply->magic == SynactionProbeFollowUpMagic && burst->replyTimes[probe->sequence] != 0) return SynactionBurstReplyIgnored;// Duplicate
+        
+        if (burst->replyTimes[probe->sequence] == 0) {// Overtook its reply, keep it until the reply is in
+            if (burst->earlyFollowUps[probe->sequence] != 0) return SynactionBurstReplyIgnored;
+            burst->earlyFollowUps[probe->sequence] = probe->timeHostSent;
+            
+        } else {
+            reply->timeHostSent = probe->timeHostSent;
+            reply->magic = SynactionProbeFollowUpMagic;// Mark as precise
+            burst->followUpsReceived += 1;
+        }
+        
+    } else {
+        if (burst->replyTimes[probe->sequence] != 0) return SynactionBurstReplyIgnored;// Duplicate
+        
+        *reply = *probe;
+        burst->replyTimes[probe->sequence] = timeReceived;
+        burst->samplesReceived += 1;
+        
+        if (burst->earlyFollowUps[probe->sequence] != 0) {
+            reply->timeHostSent = burst->earlyFollowUps[probe->sequence];
+            reply->magic = SynactionProbeFollowUpMagic;
+            burst->followUpsReceived += 1;
+        }
+        
+        // Every reply frees a slot in the window for the next probe.
+        *sendNextProbe = (burst->probesSent < burst->target);
+    }
+    
+    burst->lastActivityTime = timeReceived;
+    
+    // Wait for the follow-ups too, the watchdog finishes without the stragglers.
+    if (burst->samplesReceived >= burst->target && (!burst->expectsFollowUps || burst->followUpsReceived >= burst->target)) {
+        burst->isActive = false;
+        return SynactionBurstReplyComplete;
+    }
+    
+    return SynactionBurstReplyAccepted;
+}
+
+SynactionBurstWatchdogAction SynactionBurstCheckWatchdog(const SynactionBurst *burst, uint64_t now) {
+    if (!burst->isActive) return SynactionBurstWatchdogWait;
+    
+    uint64_t quietTime = now - burst->lastActivityTime;
+    
+    if (burst->samplesReceived > 0 && quietTime > SynactionBurstQuietTimeout) return SynactionBurstWatchdogFinish;
+    if (burst->samplesReceived == 0 && quietTime > SynactionBurstRestartTimeout) return SynactionBurstWatchdogRestart;
+    
+    return SynactionBurstWatchdogWait;
+}
+
+size_t SynactionBurstCollectSamples(const SynactionBurst *burst, SynactionProbeSample *samples, uint64_t *sampleTimes) {
+    size_t count = 0;
+    for (uint16_t sequence = 0; sequence < burst->target; sequence++) {
+        if (burst->replyTimes[sequence] == 0) continue;
+        
+        samples[count] = SynactionProbeSampleMake(&burst->replies[sequence], burst->replyTimes[sequence]);
+        if (sampleTimes) sampleTimes[count] = burst->replyTimes[sequence];
+        count += 1;
+    }
+    
+    return count;
+}
+
+bool SynactionBurstFinalSample(const SynactionBurst *burst, const SynactionProbe *probe, SynactionProbeSample *sample, uint64_t *sampleTime) {
+    if (probe->burst != burst->identifier || probe->sequence >= burst->target) return false;
+    
+    // With follow-ups the reply's t3 is only a guess, the sample is final once the follow-up fixed it, whichever
+    // of the two came last. Without, the reply itself completes it.
+    const SynactionProbe *reply = &burst->replies[probe->sequence];
+    if (burst->replyTimes[probe->sequence] == 0) return false;
+    if (burst->expectsFollowUps ? reply->magic != SynactionProbeFollowUpMagic : probe->magic != SynactionProbeMagic) return false;
+    
+    *sample = SynactionProbeSampleMake(reply, burst->replyTimes[probe->sequence]);
+    *sampleTime = burst->replyTimes[probe->sequence];
+    
+    return true;
+}
+
+// MARK: - Serial
+void SynactionSerialEstimatorStart(SynactionSerialEstimator *estimator, SynactionEstimatorKind kind, uint64_t confidence, uint64_t maxCalibrations, int64_t currentOffset) {
+    SynactionEstimatorStart(&estimator->estimator, kind);
+    estimator->confidence = confidence;
+    estimator->maxCalibrations = maxCalibrations;
+    estimator->calibrations = 0;
+    estimator->offset = currentOffset;
+}
+
+SynactionSerialPongResult SynactionSerialEstimatorAddPong(SynactionSerialEstimator *estimator, uint64_t timePingSent, uint64_t timeHostReceived, uint64_t timeReceived, SynactionProbeSample *sample) {
+    // If this calculation doesn't meet our error margin (2s), restart.
+    if ((int64_t)timeReceived - (int64_t)timePingSent > SynactionSerialRetryTimeout) return SynactionSerialPongRetry;
+    
+    // The pong carries no host send time, the host turnaround is taken as zero.
+    SynactionProbeSample pongSample;
+    pongSample.offset = ((int64_t)timeReceived + (int64_t)timePingSent - (2*(int64_t)timeHostReceived))/2;
+    pongSample.roundTripTime = (int64_t)(timeReceived - timePingSent);
+    if (sample) *sample = pongSample;
+    
+    SynactionEstimatorAddSample(&estimator->estimator, pongSample, timeReceived);
+    estimator->calibrations += 1;
+    
+    // Stop as soon as the estimate is tight enough, a clean link needs far fewer pings than a noisy one.
+    SynactionEstimate estimate = SynactionEstimatorCurrent(&estimator->estimator);
+    estimator->offset = estimate.offset;
+    
+    if (SynactionEstimateIsConfident(&estimate, estimator->confidence) || estimator->calibrations >= estimator->maxCalibrations) return SynactionSerialPongDone;
+    
+    return SynactionSerialPongContinue;
+}
+
+// MARK: - Clock Model
+void SynactionClockModelReset(SynactionClockModel *model) {
+    model->count = 0;
+    model->index = 0;
+    model->offset = 0;
+    model->skew = 0;
+    model->referenceTime = 0;
+}
+
+void SynactionClockModelAddSample(SynactionClockModel *model, int64_t offset, uint64_t localTime) {
+    model->samples[model->index] = (SynactionClockSample){.localTime = localTime, .offset = offset};
+    model->index = (model->index + 1) % SynactionMaxClockSamples;
+    model->count = SynactionMin(model->count + 1, SynactionMaxClockSamples);
+    
+    // Regress against the newest sample so doubles keep nanosecond precision.
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    double minX = 0;
+    for (size_t i = 0; i < model->count; i++) {
+        double x = (double)((int64_t)model->samples[i].localTime - (int64_t)localTime);
+        double y = (double)(model->samples[i].offset - offset);
+        sumX += x; sumY += y; sumXX += x*x; sumXY += x*y;
+        minX = SynactionMin(minX, x);
+    }
+    
+    double n = (double)model->count;
+    double denominator = n*sumXX - sumX*sumX;
+    double skew = 0;
+    
+    // Need a few samples spread over at least a few seconds before the slope means anything.
+    if (model->count >= 3 && -minX >= 5e9 && denominator > 0) {
+        skew = (n*sumXY - sumX*sumY)/denominator;
+        skew = SynactionMax(SynactionMin(skew, SynactionMaxClockSkew), -SynactionMaxClockSkew);
+    }
+    
+    double intercept = (sumY - skew*sumX)/n;
+    
+    model->skew = skew;
+    model->referenceTime = localTime;
+    model->offset = offset + (int64_t)llround(intercept);
+}
+
+int64_t SynactionClockModelOffsetAtTime(const SynactionClockModel *model, uint64_t localTime) {
+    if (model->skew == 0) return model->offset;
+    
+    double elapsed = (double)((int64_t)localTime - (int64_t)model->referenceTime);
+    return model->offset + (int64_t)llround(elapsed*model->skew);
+}
+
+// MARK: - Drift
+void SynactionDriftMonitorReset(SynactionDriftMonitor *monitor) {
+    monitor->rate = SynactionDriftInitialRate;
+    monitor->lastMeasurementTime = 0;
+}
+
+void SynactionDriftMonitorAddMeasurement(SynactionDriftMonitor *monitor, int64_t predictedOffset, int64_t measuredOffset, uint64_t localTime) {
+    if (monitor->lastMeasurementTime != 0 && localTime > monitor->lastMeasurementTime) {
+        double elapsed = (double)(localTime - monitor->lastMeasurementTime);
+        double rate = fabs((double)(measuredOffset - predictedOffset))/elapsed;
+        
+        // Follow increases at once, decay slowly so one lucky burst doesn't stretch the interval.
+        monitor->rate = (rate > monitor->rate) ? rate : (monitor->rate*3 + rate)/4;
+    }
+    
+    monitor->lastMeasurementTime = localTime;
+}
+
+uint64_t SynactionDriftMonitorErrorAtTime(const SynactionDriftMonitor *monitor, uint64_t localTime) {
+    if (monitor->lastMeasurementTime == 0 || localTime <= monitor->lastMeasurementTime) return 0;
+    
+    return (uint64_t)(monitor->rate*(double)(localTime - monitor->lastMeasurementTime));
+}
+
+uint64_t SynactionDriftMonitorNextCheckInterval(const SynactionDriftMonitor *monitor, uint64_t errorBudget, uint64_t maxInterval) {
+    if (monitor->rate <= 0) return maxInterval;
+    
+    double interval = (double)errorBudget/monitor->rate;
+    if (interval > (double)maxInterval) return maxInterval;
+    
+    return SynactionMax((uint64_t)interval, SynactionDriftMinInterval);
+}
+
+// MARK: - Admission
+void SynactionAdmissionStart(SynactionAdmission *admission, size_t maxActive, size_t probeBudget) {
+    admission->count = 0;
+    admission->active = 0;
+    admission->maxActive = SynactionMax(maxActive, 1);
+    admission->probeBudget = SynactionMax(probeBudget, 1);
+}
+
+static size_t SynactionAdmissionIndex(const SynactionAdmission *admission, uint32_t peer) {
+    for (size_t i = 0; i < admission->count; i++) {
+        if (admission->peers[i] == peer) return i;
+    }
+    
+    return SIZE_MAX;
+}
+
+static void SynactionAdmissionRemove(SynactionAdmission *admission, size_t index) {
+    if (index < admission->active) admission->active -= 1;
+    
+    admission->count -= 1;
+    memmove(&admission->peers[index], &admission->peers[index + 1], (admission->count - index) * sizeof(uint32_t));
+    memmove(&admission->admittedTimes[index], &admission->admittedTimes[index + 1], (admission->count - index) * sizeof(uint64_t));
+}
+
+bool SynactionAdmissionRequest(SynactionAdmission *admission, uint32_t peer) {
+    if (SynactionAdmissionIndex(admission, peer) != SIZE_MAX) return true;// Already in line
+    if (admission->count >= SynactionAdmissionCapacity) return false;
+    
+    admission->peers[admission->count] = peer;
+    admission->admittedTimes[admission->count] = 0;
+    admission->count += 1;
+    
+    return true;
+}
+
+bool SynactionAdmissionFinish(SynactionAdmission *admission, uint32_t peer) {
+    size_t index = SynactionAdmissionIndex(admission, peer);
+    if (index == SIZE_MAX) return false;
+    
+    SynactionAdmissionRemove(admission, index);
+    
+    return true;
+}
+
+size_t SynactionAdmissionPromote(SynactionAdmission *admission, uint64_t now, uint32_t *admitted, size_t maxAdmitted) {
+    size_t promoted = 0;
+    
+    while (admission->active < admission->maxActive && admission->active < admission->count && promoted < maxAdmitted) {
+        admission->admittedTimes[admission->active] = now;
+        admitted[promoted++] = admission->peers[admission->active];
+        admission->active += 1;
+    }
+    
+    return promoted;
+}
+
+size_t SynactionAdmissionExpire(SynactionAdmission *admission, uint64_t now) {
+    size_t expired = 0;
+    
+    for (size_t i = admission->active; i > 0; i--) {
+        if (now - admission->admittedTimes[i - 1] > SynactionAdmissionTimeout) {
+            SynactionAdmissionRemove(admission, i - 1);
+            expired += 1;
+        }
+    }
+    
+    return expired;
+}
+
+size_t SynactionAdmissionPosition(const SynactionAdmission *admission, uint32_t peer) {
+    size_t index = SynactionAdmissionIndex(admission, peer);
+    if (index == SIZE_MAX) return SIZE_MAX;
+    
+    return (index < admission->active) ? 0 : index - admission->active + 1;
+}
+
+size_t SynactionAdmissionWindow(const SynactionAdmission *admission) {
+    return SynactionMax(admission->probeBudget/admission->maxActive, 1);
+}
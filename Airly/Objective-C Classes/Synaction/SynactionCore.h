@@ -0,0 +1,142 @@
+//
+//  SynactionCore.h
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#ifndef SynactionCore_h
+#define SynactionCore_h
+
+// Portable part of Synaction: the serial calibration, the burst probe state machine and the clock model.
+// Plain C with no Foundation or socket dependency, so it can be driven by the network simulator as
+// well as by the Synaction class. All times are nanoseconds.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "SynactionProbe.h"
+#include "SynactionEstimator.h"
+
+#define SynactionMaxClockSamples 32// Offset measurements kept for the skew regression
+#define SynactionMaxClockSkew 0.0005// 500ppm, anything larger is a bad fit rather than a crystal
+#define SynactionBurstQuietTimeout 500000000// A burst with samples finishes after 500ms without replies
+#define SynactionBurstRestartTimeout 2000000000// A burst without a single sample restarts after 2s
+#define SynactionSerialRetryTimeout 2000000000// A serial pong older than 2s is discarded and the ping resent
+#define SynactionDriftInitialRate 20e-6// Assumed drift until a tracking burst measured it, a typical crystal mismatch
+#define SynactionDriftMinInterval 1000000000// Never check drift more often than every second
+#define SynactionDriftResetError 5000000// A tracking burst this far from the model means the clock jumped, refit from scratch
+#define SynactionAdmissionCapacity 256// Peers calibrating or waiting to at once
+#define SynactionAdmissionTimeout 10000000000// A calibrating peer that hasn't finished after 10s gives up its slot
+
+// MARK: - Burst
+typedef enum {
+    SynactionBurstReplyIgnored = 0,// Stale, duplicate or out of range
+    SynactionBurstReplyAccepted,
+    SynactionBurstReplyComplete,// Every reply (and follow-up if expected) is in
+} SynactionBurstReplyResult;
+
+typedef enum {
+    SynactionBurstWatchdogWait = 0,
+    SynactionBurstWatchdogFinish,// Finish with the samples we have
+    SynactionBurstWatchdogRestart,// Not a single reply, give up on this burst
+} SynactionBurstWatchdogAction;
+
+typedef struct {
+    SynactionProbe replies[SynactionMaxBurstSize];// Indexed by sequence
+    uint64_t replyTimes[SynactionMaxBurstSize];// When each reply reached us, 0 if it hasn't
+    uint64_t earlyFollowUps[SynactionMaxBurstSize];// t3 of follow-ups that overtook their reply, 0 if none
+    uint16_t identifier;// Replies from an older burst are dropped
+    uint16_t target;
+    uint16_t window;
+    uint16_t probesSent;
+    uint16_t samplesReceived;
+    uint16_t followUpsReceived;
+    bool expectsFollowUps;// Probes went over the timing channel, the host will send two-step follow-ups
+    bool isActive;
+    uint64_t lastActivityTime;
+} SynactionBurst;
+
+void SynactionBurstStart(SynactionBurst *burst, size_t size, size_t window, bool expectsFollowUps, uint64_t now);
+bool SynactionBurstNextProbe(SynactionBurst *burst, uint64_t now, SynactionProbe *probe);// False once every probe of the burst went out.
+SynactionBurstReplyResult SynactionBurstHandleReply(SynactionBurst *burst, const SynactionProbe *probe, uint64_t timeReceived, bool *sendNextProbe);
+SynactionBurstWatchdogAction SynactionBurstCheckWatchdog(const SynactionBurst *burst, uint64_t now);
+size_t SynactionBurstCollectSamples(const SynactionBurst *burst, SynactionProbeSample *samples, uint64_t *sampleTimes);// sampleTimes may be NULL.
+bool SynactionBurstFinalSample(const SynactionBurst *burst, const SynactionProbe *probe, SynactionProbeSample *sample, uint64_t *sampleTime);// True if probe, just handled, completed its sample.
+
+// MARK: - Serial
+typedef enum {
+    SynactionSerialPongRetry = 0,// Too old, resend the ping
+    SynactionSerialPongContinue,// Send another ping
+    SynactionSerialPongDone,
+} SynactionSerialPongResult;
+
+// The original one-ping-at-a-time calibration. Stops once the estimator is confident, or after maxCalibrations.
+typedef struct {
+    SynactionEstimator estimator;
+    uint64_t confidence;// Target half-width, in nanoseconds
+    uint64_t maxCalibrations;
+    uint64_t calibrations;
+    int64_t offset;
+} SynactionSerialEstimator;
+
+void SynactionSerialEstimatorStart(SynactionSerialEstimator *estimator, SynactionEstimatorKind kind, uint64_t confidence, uint64_t maxCalibrations, int64_t currentOffset);
+SynactionSerialPongResult SynactionSerialEstimatorAddPong(SynactionSerialEstimator *estimator, uint64_t timePingSent, uint64_t timeHostReceived, uint64_t timeReceived, SynactionProbeSample *sample);
+
+// MARK: - Clock Model
+typedef struct {
+    uint64_t localTime;
+    int64_t offset;
+} SynactionClockSample;
+
+// Least squares fit of offset and skew over the recent offset measurements.
+typedef struct {
+    SynactionClockSample samples[SynactionMaxClockSamples];
+    size_t count;
+    size_t index;
+    int64_t offset;// At referenceTime
+    double skew;// ns per ns
+    uint64_t referenceTime;
+} SynactionClockModel;
+
+void SynactionClockModelReset(SynactionClockModel *model);
+void SynactionClockModelAddSample(SynactionClockModel *model, int64_t offset, uint64_t localTime);
+int64_t SynactionClockModelOffsetAtTime(const SynactionClockModel *model, uint64_t localTime);
+
+// MARK: - Drift
+// How fast the clock model goes stale. Every tracking burst compares what the model predicted with what it
+// measured, which gives the drift the model fails to capture. The next burst runs when that drift will have
+// used up the error budget, so a stable link is probed rarely and a drifting one often.
+typedef struct {
+    double rate;// Unexplained drift, ns per ns
+    uint64_t lastMeasurementTime;// 0 before the first measurement
+} SynactionDriftMonitor;
+
+void SynactionDriftMonitorReset(SynactionDriftMonitor *monitor);
+void SynactionDriftMonitorAddMeasurement(SynactionDriftMonitor *monitor, int64_t predictedOffset, int64_t measuredOffset, uint64_t localTime);
+uint64_t SynactionDriftMonitorErrorAtTime(const SynactionDriftMonitor *monitor, uint64_t localTime);// Drift accumulated since the last measurement.
+uint64_t SynactionDriftMonitorNextCheckInterval(const SynactionDriftMonitor *monitor, uint64_t errorBudget, uint64_t maxInterval);
+
+// MARK: - Admission
+// Host. Lets a few peers calibrate at a time so a mass join doesn't bury the host in probes, the rest wait
+// in arrival order. Every calibrating peer gets the same share of the probe budget as its burst window.
+typedef struct {
+    uint32_t peers[SynactionAdmissionCapacity];// The first active are calibrating, then the waiting ones in order
+    uint64_t admittedTimes[SynactionAdmissionCapacity];
+    size_t count;
+    size_t active;
+    size_t maxActive;
+    size_t probeBudget;// Probes in flight the host takes across every calibrating peer
+} SynactionAdmission;
+
+void SynactionAdmissionStart(SynactionAdmission *admission, size_t maxActive, size_t probeBudget);
+bool SynactionAdmissionRequest(SynactionAdmission *admission, uint32_t peer);// Queues the peer, false if full. Call Promote after.
+bool SynactionAdmissionFinish(SynactionAdmission *admission, uint32_t peer);// Done or gone. False if unknown. Call Promote after.
+size_t SynactionAdmissionPromote(SynactionAdmission *admission, uint64_t now, uint32_t *admitted, size_t maxAdmitted);// Fills free slots, returns how many peers were let in.
+size_t SynactionAdmissionExpire(SynactionAdmission *admission, uint64_t now);// Drops peers calibrating for too long, returns how many.
+size_t SynactionAdmissionPosition(const SynactionAdmission *admission, uint32_t peer);// 0 if calibrating, 1 if next, SIZE_MAX if unknown.
+size_t SynactionAdmissionWindow(const SynactionAdmission *admission);// Burst window for each calibrating peer.
+
+#endif /* SynactionCore_h */
@@ -0,0 +1,265 @@
+//
+//  SynactionEstimator.c
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#include "SynactionEstimator.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SynactionEstimatorZ 1.96// 95% two sided
+#define SynactionKalmanInitialSkewVariance 1e-8// (100ppm)^2
+#define SynactionKalmanSkewNoise 1e-25// Skew random walk, about 0.1ppm per 100s
+#define SynactionKalmanGate 25.0// Reject samples whose innovation is over 5 sigma
+#define SynactionKalmanMinQueuing 100000.0// Floor for the measurement noise, timestamping is never perfect
+
+// MARK: - Min RTT
+static int compareSamplesByRoundTripTime(const void *a, const void *b) {
+    int64_t rttA = ((const SynactionProbeSample *)a)->roundTripTime;
+    int64_t rttB = ((const SynactionProbeSample *)b)->roundTripTime;
+    
+    return (rttA > rttB) - (rttA < rttB);
+}
+
+static SynactionEstimate SynactionMinRoundTripTimeEstimate(const SynactionEstimator *estimator) {
+    SynactionEstimate estimate = {.halfWidth = UINT64_MAX, .minRoundTripTime = estimator->minRoundTripTime, .settling = UINT64_MAX};
+    if (estimator->count == 0) return estimate;
+    
+    SynactionProbeSample sorted[SynactionEstimatorCapacity];
+    memcpy(sorted, estimator->samples, estimator->count * sizeof(SynactionProbeSample));
+    qsort(sorted, estimator->count, sizeof(SynactionProbeSample), compareSamplesByRoundTripTime);
+    
+    // The best eighth, but at least a few so the spread means something.
+    size_t bestCount = estimator->count/8;
+    if (bestCount < 4) bestCount = (estimator->count < 4) ? estimator->count : 4;
+    
+    double mean = 0;
+    for (size_t i = 0; i < bestCount; i++) {
+        mean += (double)(sorted[i].offset - sorted[0].offset);
+    }
+    mean /= bestCount;
+    
+    double variance = 0;
+    for (size_t i = 0; i < bestCount; i++) {
+        double deviation = (double)(sorted[i].offset - sorted[0].offset) - mean;
+        variance += deviation*deviation;
+    }
+    
+    estimate.offset = sorted[0].offset + (int64_t)llround(mean);
+    estimate.samplesUsed = bestCount;
+    estimate.samplesRejected = estimator->samplesSeen - bestCount;
+    
+    if (bestCount >= 2) {
+        double standardError = sqrt(variance/(bestCount - 1)/bestCount);
+        estimate.halfWidth = (uint64_t)ceil(SynactionEstimatorZ * standardError);
+    }
+    
+    return estimate;
+}
+
+// MARK: - Kalman
+static void SynactionKalmanAddSample(SynactionEstimator *estimator, SynactionProbeSample sample, uint64_t localTime, int64_t previousMinRoundTripTime) {
+    // Queuing is what makes a sample asymmetric, so its error is within half the RTT above the best seen.
+    double queuing = fmax((double)(sample.roundTripTime - estimator->minRoundTripTime), SynactionKalmanMinQueuing);
+    double measurementNoise = queuing*queuing/12.0;// Uniform over +-queuing/2
+    
+    if (estimator->kalmanUsed == 0) {
+        double roundTripTime = fmax((double)sample.roundTripTime, SynactionKalmanMinQueuing);
+        
+        estimator->baseOffset = sample.offset;
+        estimator->lastTime = localTime;
+        estimator->state[0] = 0;
+        estimator->state[1] = 0;
+        estimator->covariance[0][0] = roundTripTime*roundTripTime/12.0;// All we know is the offset is within +-RTT/2
+        estimator->covariance[0][1] = 0;
+        estimator->covariance[1][0] = 0;
+        estimator->covariance[1][1] = SynactionKalmanInitialSkewVariance;
+        estimator->kalmanUsed = 1;
+        return;
+    }
+    
+    // Predict: the offset moves with the skew, the skew wanders slowly.
+    double dt = (double)((int64_t)localTime - (int64_t)estimator->lastTime);
+    if (dt < 0) dt = 0;
+    estimator->lastTime = localTime;
+    
+    double (*P)[2] = estimator->covariance;
+    double q = SynactionKalmanSkewNoise;
+    
+    estimator->state[0] += estimator->state[1]*dt;
+    P[0][0] += 2*dt*P[0][1] + dt*dt*P[1][1] + q*dt*dt*dt/3;
+    P[0][1] += dt*P[1][1] + q*dt*dt/2;
+    P[1][0] = P[0][1];
+    P[1][1] += q*dt;
+    
+    // A new best RTT means every earlier sample queued more than we thought, so was trusted too much.
+    bool isNewMinimum = (sample.roundTripTime < previousMinRoundTripTime);
+    if (isNewMinimum) {
+        double floorDrop = (double)(previousMinRoundTripTime - sample.roundTripTime);
+        P[0][0] += floorDrop*floorDrop/12.0;
+    }
+    
+    // Update, unless the sample is way off what we expect (a power save spike, a retransmission).
+    // The least queued sample so far is never an outlier.
+    double innovation = (double)(sample.offset - estimator->baseOffset) - estimator->state[0];
+    double innovationVariance = P[0][0] + measurementNoise;
+    
+    if (!isNewMinimum && estimator->kalmanUsed >= 3 && innovation*innovation > SynactionKalmanGate*innovationVariance) {
+        estimator->kalmanRejected += 1;
+        return;
+    }
+    
+    double gain0 = P[0][0]/innovationVariance;
+    double gain1 = P[0][1]/innovationVariance;
+    
+    estimator->state[0] += gain0*innovation;
+    estimator->state[1] += gain1*innovation;
+    
+    double P00 = P[0][0], P01 = P[0][1];
+    P[0][0] = (1 - gain0)*P00;
+    P[0][1] = (1 - gain0)*P01;
+    P[1][0] = P[0][1];
+    P[1][1] -= gain1*P01;
+    
+    estimator->kalmanUsed += 1;
+}
+
+static SynactionEstimate SynactionKalmanEstimate(const SynactionEstimator *estimator) {
+    SynactionEstimate estimate = {.halfWidth = UINT64_MAX, .minRoundTripTime = estimator->minRoundTripTime, .settling = UINT64_MAX};
+    if (estimator->kalmanUsed == 0) return estimate;
+    
+    estimate.offset = estimator->baseOffset + (int64_t)llround(estimator->state[0]);
+    estimate.skew = estimator->state[1];
+    estimate.samplesUsed = estimator->kalmanUsed;
+    estimate.samplesRejected = estimator->kalmanRejected;
+    if (estimator->kalmanUsed >= 2) estimate.halfWidth = (uint64_t)ceil(SynactionEstimatorZ * sqrt(estimator->covariance[0][0]));
+    
+    return estimate;
+}
+
+// MARK: - Marzullo
+typedef struct {
+    int64_t value;
+    int type;// -1 opens an interval, +1 closes one, so opens sort first on ties
+} SynactionIntervalEdge;
+
+static int compareIntervalEdges(const void *a, const void *b) {
+    const SynactionIntervalEdge *edgeA = a;
+    const SynactionIntervalEdge *edgeB = b;
+    
+    if (edgeA->value != edgeB->value) return (edgeA->value > edgeB->value) - (edgeA->value < edgeB->value);
+    return edgeA->type - edgeB->type;
+}
+
+// The true offset is inside every sample's interval, so the region covered by the most intervals holds it.
+// Only the oldest count samples are used. Returns how many intervals cover the region.
+static size_t SynactionMarzulloIntersect(const SynactionEstimator *estimator, size_t count, int64_t *start, int64_t *end) {
+    SynactionIntervalEdge edges[2*SynactionEstimatorCapacity];
+    size_t oldest = (estimator->count < SynactionEstimatorCapacity) ? 0 : estimator->index;
+    
+    for (size_t i = 0; i < count; i++) {
+        const SynactionProbeSample *sample = &estimator->samples[(oldest + i) % SynactionEstimatorCapacity];
+        int64_t halfRoundTripTime = (sample->roundTripTime > 0) ? sample->roundTripTime/2 : 0;
+        
+        edges[2*i] = (SynactionIntervalEdge){.value = sample->offset - halfRoundTripTime, .type = -1};
+        edges[2*i + 1] = (SynactionIntervalEdge){.value = sample->offset + halfRoundTripTime, .type = 1};
+    }
+    
+    qsort(edges, 2*count, sizeof(SynactionIntervalEdge), compareIntervalEdges);
+    
+    size_t open = 0, best = 0;
+    for (size_t i = 0; i < 2*count; i++) {
+        if (edges[i].type == -1) {
+            open += 1;
+            
+            if (open > best) {
+                best = open;
+                *start = edges[i].value;
+                *end = edges[i + 1].value;// The next edge closes this region, there is always one after an open
+            }
+            
+        } else {
+            open -= 1;
+        }
+    }
+    
+    return best;
+}
+
+// The offset lies in the region most intervals agree on, so half that region's width bounds the error of its
+// midpoint. It can't shrink below the path's one way latency, the bound is only as good as the path, so it can't
+// tell when to stop. Its edges only move when a sample beats the least queued one each way, so once the midpoint
+// sat still for SynactionMarzulloSettleSamples more samples it has what the path gives.
+static SynactionEstimate SynactionMarzulloEstimate(const SynactionEstimator *estimator) {
+    SynactionEstimate estimate = {.halfWidth = UINT64_MAX, .minRoundTripTime = estimator->minRoundTripTime, .settling = UINT64_MAX};
+    if (estimator->count == 0) return estimate;
+    
+    int64_t start = 0, end = 0;
+    size_t best = SynactionMarzulloIntersect(estimator, estimator->count, &start, &end);
+    
+    estimate.offset = start + (end - start)/2;
+    estimate.samplesUsed = best;
+    estimate.samplesRejected = estimator->samplesSeen - best;
+    estimate.halfWidth = (uint64_t)(end - start - (end - start)/2);
+    
+    if (estimator->count >= SynactionMarzulloSettleSamples + SynactionEstimatorMinSamples) {
+        int64_t earlierStart = 0, earlierEnd = 0;
+        SynactionMarzulloIntersect(estimator, estimator->count - SynactionMarzulloSettleSamples, &earlierStart, &earlierEnd);
+        
+        int64_t movement = estimate.offset - (earlierStart + (earlierEnd - earlierStart)/2);
+        estimate.settling = (uint64_t)llabs(movement);
+    }
+    
+    return estimate;
+}
+
+// MARK: - Estimator
+void SynactionEstimatorStart(SynactionEstimator *estimator, SynactionEstimatorKind kind) {
+    estimator->kind = kind;
+    estimator->count = 0;
+    estimator->index = 0;
+    estimator->samplesSeen = 0;
+    estimator->minRoundTripTime = INT64_MAX;
+    estimator->kalmanUsed = 0;
+    estimator->kalmanRejected = 0;
+}
+
+void SynactionEstimatorAddSample(SynactionEstimator *estimator, SynactionProbeSample sample, uint64_t localTime) {
+    int64_t previousMinRoundTripTime = estimator->minRoundTripTime;
+    
+    estimator->samplesSeen += 1;
+    if (sample.roundTripTime < estimator->minRoundTripTime) estimator->minRoundTripTime = sample.roundTripTime;
+    
+    if (estimator->kind == SynactionEstimatorKalman) {
+        SynactionKalmanAddSample(estimator, sample, localTime, previousMinRoundTripTime);
+        return;
+    }
+    
+    estimator->samples[estimator->index] = sample;
+    estimator->index = (estimator->index + 1) % SynactionEstimatorCapacity;
+    if (estimator->count < SynactionEstimatorCapacity) estimator->count += 1;
+}
+
+SynactionEstimate SynactionEstimatorCurrent(const SynactionEstimator *estimator) {
+    switch (estimator->kind) {
+        case SynactionEstimatorKalman:
+            return SynactionKalmanEstimate(estimator);
+            
+        case SynactionEstimatorMarzullo:
+            return SynactionMarzulloEstimate(estimator);
+            
+        case SynactionEstimatorMinRoundTripTime:
+            break;
+    }
+    
+    return SynactionMinRoundTripTimeEstimate(estimator);
+}
+
+bool SynactionEstimateIsConfident(const SynactionEstimate *estimate, uint64_t halfWidth) {
+    return (estimate->samplesUsed + estimate->samplesRejected) >= SynactionEstimatorMinSamples && (estimate->halfWidth <= halfWidth || estimate->settling <= halfWidth);
+}
@@ -0,0 +1,63 @@
+//
+//  SynactionEstimator.h
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#ifndef SynactionEstimator_h
+#define SynactionEstimator_h
+
+// Offset estimators fed one probe sample at a time. Each one reports how sure it is, so calibration
+// can stop once the estimate is good enough rather than after a fixed number of probes.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "SynactionProbe.h"
+
+#define SynactionEstimatorCapacity 256// Most recent samples kept by the min-RTT and Marzullo estimators
+#define SynactionEstimatorMinSamples 8// Never stop on fewer samples than this
+#define SynactionMarzulloSettleSamples 32// Marzullo stops once this many samples in a row left its offset in place
+
+typedef enum {
+    SynactionEstimatorMinRoundTripTime = 0,// Mean offset of the lowest RTT eighth, the queuing-free samples
+    SynactionEstimatorKalman,// Offset and skew tracker, samples weighted by their RTT and gated on their innovation
+    SynactionEstimatorMarzullo,// Intersection of the [offset - RTT/2, offset + RTT/2] intervals most samples agree on. Never tighter than the one way latency, stops once settled instead
+} SynactionEstimatorKind;
+
+typedef struct {
+    int64_t offset;
+    uint64_t halfWidth;// 95% confidence half-width (min-RTT, Kalman) or half the intersection (Marzullo), UINT64_MAX if unknown
+    size_t samplesUsed;
+    size_t samplesRejected;// Outliers the estimator left out
+    int64_t minRoundTripTime;
+    double skew;// Kalman only, 0 otherwise
+    uint64_t settling;// Marzullo only, how far the offset moved over the last SynactionMarzulloSettleSamples samples. UINT64_MAX otherwise
+} SynactionEstimate;
+
+typedef struct {
+    SynactionEstimatorKind kind;
+    SynactionProbeSample samples[SynactionEstimatorCapacity];
+    size_t count;
+    size_t index;
+    size_t samplesSeen;
+    int64_t minRoundTripTime;
+    
+    // Kalman state, relative to the first sample so doubles keep nanosecond precision
+    int64_t baseOffset;
+    uint64_t lastTime;
+    double state[2];// Offset, skew
+    double covariance[2][2];
+    size_t kalmanUsed;
+    size_t kalmanRejected;
+} SynactionEstimator;
+
+void SynactionEstimatorStart(SynactionEstimator *estimator, SynactionEstimatorKind kind);
+void SynactionEstimatorAddSample(SynactionEstimator *estimator, SynactionProbeSample sample, uint64_t localTime);
+SynactionEstimate SynactionEstimatorCurrent(const SynactionEstimator *estimator);
+bool SynactionEstimateIsConfident(const SynactionEstimate *estimate, uint64_t halfWidth);// Enough samples and a tight enough interval, or for Marzullo an offset settled within it.
+
+#endif /* SynactionEstimator_h */
@@ -0,0 +1,53 @@
+//
+//  SynactionProbe.h
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#ifndef SynactionProbe_h
+#define SynactionProbe_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define SynactionProbeMagic 0x504E5953 // "SYNP"
+#define SynactionProbeFollowUpMagic 0x464E5953 // "SYNF", carries the precise timeHostSent of an earlier reply
+#define SynactionMaxBurstSize 256
+
+// Fixed-size timing probe exchanged during burst calibration. Sent raw, not archived.
+// All times are in nanoseconds of the clock of the device that wrote them.
+typedef struct __attribute__((packed)) {
+    uint32_t magic;// SynactionProbeMagic or SynactionProbeFollowUpMagic
+    uint16_t sequence;// Index of the probe in the current burst
+    uint16_t burst;// Identifies the burst, replies from an older burst are dropped
+    uint64_t timeSent;// t1: peer clock when the probe left the peer
+    uint64_t timeHostReceived;// t2: host clock when the probe reached the host
+    uint64_t timeHostSent;// t3: host clock when the reply left the host
+} SynactionProbe;
+
+// One completed probe round trip, as seen by the peer.
+typedef struct {
+    int64_t offset;// Peer clock minus host clock, in nanoseconds
+    int64_t roundTripTime;// Network round trip excluding host turnaround, in nanoseconds
+} SynactionProbeSample;
+
+static inline bool SynactionProbeFromBytes(const void *bytes, size_t length, SynactionProbe *probe) {
+    if (length != sizeof(SynactionProbe)) return false;
+
+    memcpy(probe, bytes, sizeof(SynactionProbe));
+    return probe->magic == SynactionProbeMagic || probe->magic == SynactionProbeFollowUpMagic;
+}
+
+// t4 is the peer clock when the reply reached the peer.
+static inline SynactionProbeSample SynactionProbeSampleMake(const SynactionProbe *probe, uint64_t timeReceived) {
+    SynactionProbeSample sample;
+    sample.offset = (((int64_t)probe->timeSent - (int64_t)probe->timeHostReceived) + ((int64_t)timeReceived - (int64_t)probe->timeHostSent))/2;
+    sample.roundTripTime = ((int64_t)timeReceived - (int64_t)probe->timeSent) - ((int64_t)probe->timeHostSent - (int64_t)probe->timeHostReceived);
+
+    return sample;
+}
+
+#endif /* SynactionProbe_h */
@@ -0,0 +1,48 @@
+//
+//  SynactionScheduler.h
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// Frameworks
+#import <Foundation/Foundation.h>
+
+typedef uint64_t(^ _Nonnull SynactionSchedulerClock)(void);
+
+typedef struct {
+    uint64_t eventsFired;
+    int64_t firingErrorP50;// Fired time minus deadline, in nanoseconds, over the recent events
+    int64_t firingErrorP90;
+    int64_t firingErrorP99;
+    int64_t firingErrorMax;
+    uint64_t wakeMargin;// Current early-wake margin, in nanoseconds
+    uint64_t cpuTime;// CPU time used by the scheduler thread, in nanoseconds
+} SynactionSchedulerStatistics;
+
+// Handle to a scheduled block.
+@interface SynactionScheduledEvent : NSObject
+
+@property (readonly, nonatomic) uint64_t deadline;// In the scheduler's clock
+@property (readonly, atomic) BOOL isCancelled;
+@property (readonly, atomic) BOOL hasFired;
+
+- (void)cancel;// No-op if the event already fired.
+
+@end
+
+// Runs blocks at exact deadlines from a single high-priority thread. The thread sleeps until shortly
+// before the next deadline, then spins the rest of the way. The early-wake margin is learned from a
+// histogram of how late the sleeps actually wake up. Blocks run on the scheduler thread, even once their deadline
+// already passed, keep them short and dispatch anything touching UIKit or non thread-safe state to main.
+@interface SynactionScheduler : NSObject
+
+- (_Nonnull instancetype)initWithClock:(SynactionSchedulerClock)clock;
+
+- (SynactionScheduledEvent * _Nonnull)scheduleBlock:(dispatch_block_t _Nonnull)block atTime:(uint64_t)deadline;
+- (void)runBenchmarkWithEventCount:(NSUInteger)count completion:(void(^ _Nonnull)(SynactionSchedulerStatistics statistics))completion;// Schedules count events 5-50ms apart and reports the statistics once they all fired.
+
+@property (readonly, nonatomic) SynactionSchedulerStatistics statistics;
+
+@end
@@ -0,0 +1,297 @@
+//
+//  SynactionScheduler.m
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#import "SynactionScheduler.h"
+
+// Frameworks
+#import <time.h>
+
+#define SynactionSchedulerInitialMargin 1300000// The old hardcoded margin, used until the histogram fills
+#define SynactionSchedulerMinMargin 100000
+#define SynactionSchedulerMaxMargin 5000000
+#define SynactionSchedulerBucketWidth 10000// 10us histogram buckets
+#define SynactionSchedulerBucketCount (SynactionSchedulerMaxMargin/SynactionSchedulerBucketWidth)
+#define SynactionSchedulerMinWakeSamples 32
+#define SynactionSchedulerBatchWindow 20000// Events due within 20us of each other fire together
+#define SynactionSchedulerErrorHistory 1024
+
+@interface SynactionScheduledEvent ()
+
+@property (nonatomic) uint64_t deadline;
+@property (copy, nonatomic) dispatch_block_t _Nullable block;
+@property (atomic) BOOL isCancelled;
+@property (atomic) BOOL hasFired;
+
+@end
+
+@implementation SynactionScheduledEvent
+
+- (void)cancel {
+    self.isCancelled = YES;
+}
+
+@end
+
+@interface SynactionScheduler () {
+    // Wake-up latency histogram, drives the early-wake margin
+    uint32_t wakeHistogram[SynactionSchedulerBucketCount];
+    uint32_t wakeSamples;
+    
+    // Recent firing errors for the percentiles
+    int64_t firingErrors[SynactionSchedulerErrorHistory];
+    NSUInteger firingErrorIndex;
+    uint64_t eventsFired;
+    uint64_t cpuTime;
+}
+
+@property (copy, nonatomic) SynactionSchedulerClock clock;
+@property (strong, nonatomic) NSCondition *condition;
+@property (strong, nonatomic) NSMutableArray<SynactionScheduledEvent *> *events;// Min-heap on deadline
+@property (strong, nonatomic) NSThread *thread;
+@property (nonatomic) uint64_t wakeMargin;
+
+@end
+
+@implementation SynactionScheduler
+
+- (instancetype)initWithClock:(SynactionSchedulerClock)clock {
+    self = [super init];
+    
+    if (self) {
+        self.clock = clock;
+        self.condition = [NSCondition new];
+        self.events = [NSMutableArray new];
+        self.wakeMargin = SynactionSchedulerInitialMargin;
+        
+        self.thread = [[NSThread alloc] initWithTarget:self selector:@selector(run) object:nil];
+        self.thread.name = @"Synaction.Scheduler";
+        self.thread.qualityOfService = NSQualityOfServiceUserInteractive;
+        [self.thread start];
+    }
+    
+    return self;
+}
+
+- (SynactionScheduledEvent *)scheduleBlock:(dispatch_block_t)block atTime:(uint64_t)deadline {
+    SynactionScheduledEvent *event = [SynactionScheduledEvent new];
+    event.deadline = deadline;
+    event.block = block;
+    
+    [self.condition lock];
+    [self pushEvent:event];
+    [self.condition signal];// The new event may be the earliest one
+    [self.condition unlock];
+    
+    return event;
+}
+
+#pragma mark - Heap
+- (void)pushEvent:(SynactionScheduledEvent *)event {
+    [self.events addObject:event];
+    
+    NSUInteger index = self.events.count - 1;
+    while (index > 0) {
+        NSUInteger parent = (index - 1)/2;
+        if (self.events[parent].deadline <= event.deadline) break;
+        
+        [self.events exchangeObjectAtIndex:index withObjectAtIndex:parent];
+        index = parent;
+    }
+}
+
+- (SynactionScheduledEvent *)popEvent {
+    SynactionScheduledEvent *top = self.events[0];
+    SynactionScheduledEvent *last = self.events.lastObject;
+    [self.events removeLastObject];
+    
+    if (self.events.count == 0) return top;
+    
+    self.events[0] = last;
+    NSUInteger index = 0;
+    NSUInteger count = self.events.count;
+    
+    while (YES) {
+        NSUInteger smallest = index;
+        NSUInteger left = 2*index + 1;
+        NSUInteger right = left + 1;
+        
+        if (left < count && self.events[left].deadline < self.events[smallest].deadline) smallest = left;
+        if (right < count && self.events[right].deadline < self.events[smallest].deadline) smallest = right;
+        if (smallest == index) break;
+        
+        [self.events exchangeObjectAtIndex:index withObjectAtIndex:smallest];
+        index = smallest;
+    }
+    
+    return top;
+}
+
+#pragma mark - Thread
+- (void)run {
+    [self.condition lock];
+    
+    while (YES) {
+        // Drop cancelled events from the front so they never cause a wake-up.
+        while (self.events.count > 0 && self.events[0].isCancelled) {
+            [self popEvent].block = nil;
+        }
+        
+        if (self.events.count == 0) {
+            [self.condition wait];
+            continue;
+        }
+        
+        uint64_t deadline = self.events[0].deadline;
+        uint64_t now = self.clock();
+        
+        if (deadline > now + self.wakeMargin) {
+            // Sleep until margin before the deadline, then learn how late we actually woke.
+            uint64_t wakeTime = deadline - self.wakeMargin;
+            BOOL timedOut = ![self.condition waitUntilDate:[NSDate dateWithTimeIntervalSinceNow:(wakeTime - now)/(double)NSEC_PER_SEC]];
+            
+            if (timedOut) {
+                uint64_t wokeAt = self.clock();
+                [self recordWakeLatency:(wokeAt > wakeTime) ? wokeAt - wakeTime : 0];
+            }
+            
+            continue;// Re-check, a signal may have brought in an earlier event
+        }
+        
+        // Close enough, spin the rest of the way without the lock so callers can still schedule.
+        [self.condition unlock];
+        while (self.clock() < deadline) {}
+        [self.condition lock];
+        
+        // Fire everything due now as one batch.
+        NSMutableArray<SynactionScheduledEvent *> *batch = [NSMutableArray new];
+        uint64_t batchEnd = self.clock() + SynactionSchedulerBatchWindow;
+        while (self.events.count > 0 && self.events[0].deadline <= batchEnd) {
+            [batch addObject:[self popEvent]];
+        }
+        
+        [self.condition unlock];
+        
+        for (SynactionScheduledEvent *event in batch) {
+            if (event.isCancelled) {
+                event.block = nil;
+                continue;
+            }
+            
+            // Late arrivals are spun for individually so batching never fires anything early.
+            while (self.clock() < event.deadline) {}
+            
+            uint64_t firedAt = self.clock();
+            event.hasFired = YES;
+            event.block();
+            event.block = nil;
+            
+            [self recordFiringError:(int64_t)(firedAt - event.deadline)];
+        }
+        
+        struct timespec threadTime;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &threadTime);
+        
+        [self.condition lock];
+        cpuTime = (uint64_t)threadTime.tv_sec * NSEC_PER_SEC + (uint64_t)threadTime.tv_nsec;
+    }
+}
+
+#pragma mark - Statistics
+// Called with the lock held.
+- (void)recordWakeLatency:(uint64_t)latency {
+    NSUInteger bucket = MIN(latency/SynactionSchedulerBucketWidth, SynactionSchedulerBucketCount - 1);
+    wakeHistogram[bucket] += 1;
+    wakeSamples += 1;
+    
+    if (wakeSamples < SynactionSchedulerMinWakeSamples) return;
+    
+    // Margin = 99th percentile of wake latency plus one bucket of headroom.
+    uint32_t target = (uint32_t)ceil(wakeSamples * 0.99);
+    uint32_t seen = 0;
+    NSUInteger percentileBucket = 0;
+    for (; percentileBucket < SynactionSchedulerBucketCount; percentileBucket++) {
+        seen += wakeHistogram[percentileBucket];
+        if (seen >= target) break;
+    }
+    
+    uint64_t margin = (percentileBucket + 2) * SynactionSchedulerBucketWidth;
+    self.wakeMargin = MAX(MIN(margin, SynactionSchedulerMaxMargin), SynactionSchedulerMinMargin);
+    
+    // Age the histogram so the margin follows changing conditions (thermal state, background).
+    if (wakeSamples >= 4096) {
+        wakeSamples = 0;
+        for (NSUInteger i = 0; i < SynactionSchedulerBucketCount; i++) {
+            wakeHistogram[i] /= 2;
+            wakeSamples += wakeHistogram[i];
+        }
+    }
+}
+
+- (void)recordFiringError:(int64_t)error {
+    [self.condition lock];
+    firingErrors[firingErrorIndex] = error;
+    firingErrorIndex = (firingErrorIndex + 1) % SynactionSchedulerErrorHistory;
+    eventsFired += 1;
+    [self.condition unlock];
+}
+
+static int compareFiringErrors(const void *a, const void *b) {
+    int64_t errorA = *(const int64_t *)a;
+    int64_t errorB = *(const int64_t *)b;
+    
+    return (errorA > errorB) - (errorA < errorB);
+}
+
+- (SynactionSchedulerStatistics)statistics {
+    SynactionSchedulerStatistics statistics = {0};
+    int64_t errors[SynactionSchedulerErrorHistory];
+    
+    [self.condition lock];
+    NSUInteger count = (NSUInteger)MIN(eventsFired, SynactionSchedulerErrorHistory);
+    memcpy(errors, firingErrors, count * sizeof(int64_t));
+    statistics.eventsFired = eventsFired;
+    statistics.wakeMargin = self.wakeMargin;
+    statistics.cpuTime = cpuTime;
+    [self.condition unlock];
+    
+    if (count == 0) return statistics;
+    
+    qsort(errors, count, sizeof(int64_t), compareFiringErrors);
+    statistics.firingErrorP50 = errors[count/2];
+    statistics.firingErrorP90 = errors[MIN(count*90/100, count - 1)];
+    statistics.firingErrorP99 = errors[MIN(count*99/100, count - 1)];
+    statistics.firingErrorMax = errors[count - 1];
+    
+    return statistics;
+}
+
+- (void)runBenchmarkWithEventCount:(NSUInteger)count completion:(void (^)(SynactionSchedulerStatistics))completion {
+    SynactionSchedulerStatistics before = self.statistics;
+    
+    __block NSUInteger remaining = count;
+    uint64_t deadline = self.clock();
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        deadline += (5 + arc4random_uniform(46)) * NSEC_PER_MSEC;
+        
+        [self scheduleBlock:^{
+            remaining -= 1;// Only touched on the scheduler thread
+            if (remaining > 0) return;
+            
+            SynactionSchedulerStatistics statistics = self.statistics;
+            statistics.eventsFired -= before.eventsFired;
+            statistics.cpuTime -= before.cpuTime;
+            
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(statistics);
+            });
+        } atTime:deadline];
+    }
+}
+
+@end
@@ -0,0 +1,507 @@
+//
+//  SynactionSimulator.c
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#include "SynactionSimulator.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SynactionSimulatorMaxInFlight 4096
+#define SynactionSimulatorRetransmitTimeout 200000000
+#define SynactionSimulatorWatchdogInterval 500000000
+#define SynactionSimulatorMaxRestarts 5
+#define SynactionSimulatorTimeLimit 60000000000ULL
+
+typedef enum {
+    SynactionSimulatedPacketToHost = 0,
+    SynactionSimulatedPacketToPeer,
+} SynactionSimulatedDirection;
+
+typedef struct {
+    uint64_t arrival;// Simulated (host) time
+    SynactionSimulatedDirection direction;
+    uint32_t peer;// Mass joins only
+    SynactionProbe probe;// Serial pings reuse the probe layout, timeHostSent stays 0
+} SynactionSimulatedPacket;
+
+typedef struct {
+    const SynactionLinkModel *link;
+    uint64_t random;
+    uint64_t startTime;
+    int64_t initialOffset;
+    SynactionSimulatedPacket inFlight[SynactionSimulatorMaxInFlight];
+    size_t inFlightCount;
+    size_t packetsSent;
+} SynactionSimulation;
+
+// MARK: - Helpers
+static uint64_t SynactionSimulationRandom(SynactionSimulation *simulation) {// splitmix64
+    uint64_t z = (simulation->random += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    
+    return z ^ (z >> 31);
+}
+
+static double SynactionSimulationUniform(SynactionSimulation *simulation) {// (0, 1]
+    return ((SynactionSimulationRandom(simulation) >> 11) + 1) * (1.0/9007199254740992.0);
+}
+
+// The peer's clock at simulated time t.
+static uint64_t SynactionSimulationPeerTime(const SynactionSimulation *simulation, uint64_t t) {
+    double elapsed = (double)(t - simulation->startTime);
+    return (uint64_t)((int64_t)t + simulation->initialOffset + (int64_t)llround(elapsed*simulation->link->skew));
+}
+
+static int64_t SynactionSimulationTrueOffset(const SynactionSimulation *simulation, uint64_t t) {
+    return (int64_t)SynactionSimulationPeerTime(simulation, t) - (int64_t)t;
+}
+
+// Returns false if the datagram was dropped.
+static bool SynactionSimulationSend(SynactionSimulation *simulation, uint64_t t, SynactionSimulatedDirection direction, uint32_t peer, const SynactionProbe *probe, bool reliable) {
+    const SynactionLinkModel *link = simulation->link;
+    simulation->packetsSent += 1;
+    
+    uint64_t delay = link->latency;
+    if (direction == SynactionSimulatedPacketToPeer) delay = (uint64_t)((int64_t)delay + link->asymmetry);
+    if (link->jitter > 0) delay += (uint64_t)(-log(SynactionSimulationUniform(simulation)) * (double)link->jitter);
+    
+    while (SynactionSimulationUniform(simulation) <= link->loss) {
+        if (!reliable) return false;
+        delay += SynactionSimulatorRetransmitTimeout;
+    }
+    
+    if (simulation->inFlightCount >= SynactionSimulatorMaxInFlight) return false;
+    
+    SynactionSimulatedPacket *packet = &simulation->inFlight[simulation->inFlightCount++];
+    packet->arrival = t + delay;
+    packet->direction = direction;
+    packet->peer = peer;
+    packet->probe = *probe;
+    
+    return true;
+}
+
+// Removes and returns the packet that arrives first, if it arrives by limit.
+static bool SynactionSimulationNextPacket(SynactionSimulation *simulation, uint64_t limit, SynactionSimulatedPacket *packet) {
+    if (simulation->inFlightCount == 0) return false;
+    
+    size_t earliest = 0;
+    for (size_t i = 1; i < simulation->inFlightCount; i++) {
+        if (simulation->inFlight[i].arrival < simulation->inFlight[earliest].arrival) earliest = i;
+    }
+    
+    if (simulation->inFlight[earliest].arrival > limit) return false;
+    
+    *packet = simulation->inFlight[earliest];
+    simulation->inFlight[earliest] = simulation->inFlight[--simulation->inFlightCount];
+    
+    return true;
+}
+
+// The host stamps t2 when it gets to the packet and t3 when it answers.
+static void SynactionSimulationAnswerAt(SynactionSimulation *simulation, const SynactionSimulatedPacket *packet, uint64_t timeHostReceived, bool stampHostSent, bool reliable) {
+    SynactionProbe reply = packet->probe;
+    uint64_t timeHostSent = timeHostReceived + simulation->link->hostTurnaround;
+    
+    reply.timeHostReceived = timeHostReceived;
+    if (stampHostSent) reply.timeHostSent = timeHostSent;
+    
+    SynactionSimulationSend(simulation, timeHostSent, SynactionSimulatedPacketToPeer, packet->peer, &reply, reliable);
+}
+
+static void SynactionSimulationAnswer(SynactionSimulation *simulation, const SynactionSimulatedPacket *packet, bool stampHostSent, bool reliable) {
+    SynactionSimulationAnswerAt(simulation, packet, packet->arrival, stampHostSent, reliable);
+}
+
+static SynactionJoinResult SynactionSimulationFinish(const SynactionSimulation *simulation, uint64_t t, int64_t offset) {
+    SynactionJoinResult result = {0};
+    result.converged = true;
+    result.error = offset - SynactionSimulationTrueOffset(simulation, t);
+    result.timeToConverge = t - simulation->startTime;
+    result.packetsSent = simulation->packetsSent;
+    
+    return result;
+}
+
+// MARK: - Joins
+static SynactionJoinResult SynactionSimulateBurstJoin(SynactionSimulation *simulation, const SynactionSimulationConfig *config) {
+    static _Thread_local SynactionBurst burst;// Too large for some thread stacks
+    static _Thread_local SynactionProbeSample samples[SynactionMaxBurstSize];
+    static _Thread_local SynactionEstimator estimator;
+    memset(&burst, 0, sizeof(burst));
+    SynactionEstimatorStart(&estimator, config->estimator);
+    
+    uint64_t t = simulation->startTime;
+    uint64_t nextWatchdog = t + SynactionSimulatorWatchdogInterval;
+    size_t restarts = 0;
+    SynactionProbe probe;
+    
+    SynactionBurstStart(&burst, config->burstSize, config->burstWindow, false, SynactionSimulationPeerTime(simulation, t));
+    for (size_t i = 0; i < burst.window && SynactionBurstNextProbe(&burst, SynactionSimulationPeerTime(simulation, t), &probe); i++) {
+        SynactionSimulationSend(simulation, t, SynactionSimulatedPacketToHost, 0, &probe, false);
+    }
+    
+    while (t - simulation->startTime < SynactionSimulatorTimeLimit) {
+        SynactionSimulatedPacket packet;
+        
+        if (!SynactionSimulationNextPacket(simulation, nextWatchdog, &packet)) {
+            t = nextWatchdog;
+            nextWatchdog += SynactionSimulatorWatchdogInterval;
+            
+            SynactionBurstWatchdogAction action = SynactionBurstCheckWatchdog(&burst, SynactionSimulationPeerTime(simulation, t));
+            if (action == SynactionBurstWatchdogFinish) break;
+            
+            if (action == SynactionBurstWatchdogRestart) {
+                if (++restarts > SynactionSimulatorMaxRestarts) return (SynactionJoinResult){.converged = false, .packetsSent = simulation->packetsSent};
+                
+                SynactionEstimatorStart(&estimator, config->estimator);
+                SynactionBurstStart(&burst, config->burstSize, config->burstWindow, false, SynactionSimulationPeerTime(simulation, t));
+                for (size_t i = 0; i < burst.window && SynactionBurstNextProbe(&burst, SynactionSimulationPeerTime(simulation, t), &probe); i++) {
+                    SynactionSimulationSend(simulation, t, SynactionSimulatedPacketToHost, 0, &probe, false);
+                }
+            }
+            
+            continue;
+        }
+        
+        t = packet.arrival;
+        
+        if (packet.direction == SynactionSimulatedPacketToHost) {
+            SynactionSimulationAnswer(simulation, &packet, true, false);
+            continue;
+        }
+        
+        bool sendNextProbe;
+        SynactionBurstReplyResult result = SynactionBurstHandleReply(&burst, &packet.probe, SynactionSimulationPeerTime(simulation, t), &sendNextProbe);
+        
+        if (sendNextProbe && SynactionBurstNextProbe(&burst, SynactionSimulationPeerTime(simulation, t), &probe)) {
+            SynactionSimulationSend(simulation, t, SynactionSimulatedPacketToHost, 0, &probe, false);
+        }
+        
+        SynactionProbeSample sample;
+        uint64_t sampleTime;
+        if (result != SynactionBurstReplyIgnored && SynactionBurstFinalSample(&burst, &packet.probe, &sample, &sampleTime)) {
+            SynactionEstimatorAddSample(&estimator, sample, sampleTime);
+            
+            SynactionEstimate estimate = SynactionEstimatorCurrent(&estimator);
+            if (SynactionEstimateIsConfident(&estimate, config->confidence)) break;
+        }
+        
+        if (result == SynactionBurstReplyComplete) break;
+    }
+    
+    if (estimator.samplesSeen == 0) {
+        size_t count = SynactionBurstCollectSamples(&burst, samples, NULL);
+        for (size_t i = 0; i < count; i++) {
+            SynactionEstimatorAddSample(&estimator, samples[i], SynactionSimulationPeerTime(simulation, t));
+        }
+    }
+    
+    if (estimator.samplesSeen == 0) return (SynactionJoinResult){.converged = false, .packetsSent = simulation->packetsSent};
+    
+    SynactionEstimate estimate = SynactionEstimatorCurrent(&estimator);
+    return SynactionSimulationFinish(simulation, t, estimate.offset);
+}
+
+static SynactionJoinResult SynactionSimulateSerialJoin(SynactionSimulation *simulation, const SynactionSimulationConfig *config) {
+    static _Thread_local SynactionSerialEstimator estimator;
+    SynactionSerialEstimatorStart(&estimator, config->estimator, config->confidence, config->maxCalibrations, 0);
+    
+    uint64_t t = simulation->startTime;
+    SynactionProbe ping = {.magic = SynactionProbeMagic, .timeSent = SynactionSimulationPeerTime(simulation, t)};
+    SynactionSimulationSend(simulation, t, SynactionSimulatedPacketToHost, 0, &ping, true);
+    
+    SynactionSimulatedPacket packet;
+    while (SynactionSimulationNextPacket(simulation, UINT64_MAX, &packet)) {
+        t = packet.arrival;
+        if (t - simulation->startTime >= SynactionSimulatorTimeLimit) break;
+        
+        if (packet.direction == SynactionSimulatedPacketToHost) {
+            SynactionSimulationAnswer(simulation, &packet, false, true);
+            continue;
+        }
+        
+        uint64_t timeReceived = SynactionSimulationPeerTime(simulation, t);
+        SynactionSerialPongResult result = SynactionSerialEstimatorAddPong(&estimator, packet.probe.timeSent, packet.probe.timeHostReceived, timeReceived, NULL);
+        if (result == SynactionSerialPongDone) return SynactionSimulationFinish(simulation, t, estimator.offset);
+        
+        ping.timeSent = timeReceived;
+        SynactionSimulationSend(simulation, t, SynactionSimulatedPacketToHost, 0, &ping, true);
+    }
+    
+    return (SynactionJoinResult){.converged = false, .packetsSent = simulation->packetsSent};
+}
+
+SynactionJoinResult SynactionSimulateJoin(const SynactionLinkModel *link, const SynactionSimulationConfig *config, uint64_t seed) {
+    static _Thread_local SynactionSimulation simulation;
+    memset(&simulation, 0, sizeof(simulation));
+    
+    simulation.link = link;
+    simulation.random = seed;
+    simulation.startTime = 1000000000000000ULL + SynactionSimulationRandom(&simulation) % 1000000000000ULL;
+    simulation.initialOffset = (int64_t)(SynactionSimulationRandom(&simulation) % 2000000000ULL) - 1000000000;// Within a second either way
+    
+    if (config->calibration == SynactionSimulatedCalibrationBurst) return SynactionSimulateBurstJoin(&simulation, config);
+    
+    return SynactionSimulateSerialJoin(&simulation, config);
+}
+
+// MARK: - Report
+static int compareUnsigned(const void *a, const void *b) {
+    uint64_t valueA = *(const uint64_t *)a;
+    uint64_t valueB = *(const uint64_t *)b;
+    
+    return (valueA > valueB) - (valueA < valueB);
+}
+
+static void SynactionConvergenceReportFill(SynactionConvergenceReport *report, const SynactionJoinResult *results, size_t joins) {
+    memset(report, 0, sizeof(SynactionConvergenceReport));
+    report->joins = joins;
+    
+    uint64_t *errors = malloc(joins * sizeof(uint64_t));
+    uint64_t *times = malloc(joins * sizeof(uint64_t));
+    if (!errors || !times) {
+        free(errors);
+        free(times);
+        return;
+    }
+    
+    size_t converged = 0;
+    double totalError = 0;
+    double totalPackets = 0;
+    
+    for (size_t join = 0; join < joins; join++) {
+        totalPackets += results[join].packetsSent;
+        
+        if (!results[join].converged) {
+            report->failures += 1;
+            continue;
+        }
+        
+        errors[converged] = (uint64_t)llabs(results[join].error);
+        times[converged] = results[join].timeToConverge;
+        totalError += errors[converged];
+        converged += 1;
+    }
+    
+    report->meanPacketsSent = joins ? totalPackets/joins : 0;
+    
+    if (converged > 0) {
+        qsort(errors, converged, sizeof(uint64_t), compareUnsigned);
+        qsort(times, converged, sizeof(uint64_t), compareUnsigned);
+        
+        report->meanAbsoluteError = totalError/converged;
+        report->errorP50 = errors[converged/2];
+        report->errorP95 = errors[converged*95/100];
+        report->errorMax = errors[converged - 1];
+        report->timeP50 = times[converged/2];
+        report->timeP95 = times[converged*95/100];
+        report->timeMax = times[converged - 1];
+    }
+    
+    free(errors);
+    free(times);
+}
+
+void SynactionSimulateJoins(const SynactionLinkModel *link, const SynactionSimulationConfig *config, size_t joins, uint64_t seed, SynactionConvergenceReport *report) {
+    SynactionJoinResult *results = malloc(joins * sizeof(SynactionJoinResult));
+    if (!results) {
+        memset(report, 0, sizeof(SynactionConvergenceReport));
+        return;
+    }
+    
+    for (size_t join = 0; join < joins; join++) {
+        results[join] = SynactionSimulateJoin(link, config, seed + join * 0x9E3779B97F4A7C15ULL);
+    }
+    
+    SynactionConvergenceReportFill(report, results, joins);
+    free(results);
+}
+
+// MARK: - Mass Join
+typedef struct {
+    SynactionBurst burst;
+    SynactionEstimator estimator;
+    int64_t initialOffset;
+    bool isCalibrating;
+    size_t restarts;
+} SynactionSimulatedPeer;
+
+typedef struct {
+    SynactionSimulation *simulation;
+    const SynactionSimulationConfig *config;
+    SynactionSimulatedPeer *peers;
+    SynactionJoinResult *results;
+    SynactionAdmission admission;
+    size_t peersDone;
+} SynactionMassJoin;
+
+static uint64_t SynactionMassJoinPeerTime(const SynactionMassJoin *massJoin, uint32_t peer, uint64_t t) {
+    const SynactionSimulation *simulation = massJoin->simulation;
+    double elapsed = (double)(t - simulation->startTime);
+    
+    return (uint64_t)((int64_t)t + massJoin->peers[peer].initialOffset + (int64_t)llround(elapsed*simulation->link->skew));
+}
+
+static void SynactionMassJoinStartBurst(SynactionMassJoin *massJoin, uint32_t peer, uint64_t t) {
+    SynactionSimulatedPeer *simulatedPeer = &massJoin->peers[peer];
+    uint64_t peerTime = SynactionMassJoinPeerTime(massJoin, peer, t);
+    SynactionProbe probe;
+    
+    simulatedPeer->isCalibrating = true;
+    SynactionBurstStart(&simulatedPeer->burst, massJoin->config->burstSize, SynactionAdmissionWindow(&massJoin->admission), false, peerTime);
+    SynactionEstimatorStart(&simulatedPeer->estimator, massJoin->config->estimator);
+    
+    while (SynactionBurstNextProbe(&simulatedPeer->burst, peerTime, &probe) && simulatedPeer->burst.probesSent <= simulatedPeer->burst.window) {
+        SynactionSimulationSend(massJoin->simulation, t, SynactionSimulatedPacketToHost, peer, &probe, false);
+    }
+}
+
+static void SynactionMassJoinAdmit(SynactionMassJoin *massJoin, uint64_t t) {
+    uint32_t admitted[SynactionAdmissionCapacity];
+    size_t count = SynactionAdmissionPromote(&massJoin->admission, t, admitted, SynactionAdmissionCapacity);
+    
+    for (size_t i = 0; i < count; i++) {
+        SynactionMassJoinStartBurst(massJoin, admitted[i], t);
+    }
+}
+
+static void SynactionMassJoinFinishPeer(SynactionMassJoin *massJoin, uint32_t peer, uint64_t t, bool converged) {
+    SynactionSimulation *simulation = massJoin->simulation;
+    SynactionSimulatedPeer *simulatedPeer = &massJoin->peers[peer];
+    SynactionJoinResult *result = &massJoin->results[peer];
+    
+    simulatedPeer->isCalibrating = false;
+    simulatedPeer->burst.isActive = false;
+    massJoin->peersDone += 1;
+    
+    SynactionEstimate estimate = SynactionEstimatorCurrent(&simulatedPeer->estimator);
+    result->converged = converged && (simulatedPeer->estimator.samplesSeen > 0);
+    result->timeToConverge = t - simulation->startTime;
+    
+    if (result->converged) {
+        int64_t trueOffset = (int64_t)SynactionMassJoinPeerTime(massJoin, peer, t) - (int64_t)t;
+        result->error = estimate.offset - trueOffset;
+    }
+    
+    SynactionAdmissionFinish(&massJoin->admission, peer);
+    SynactionMassJoinAdmit(massJoin, t);
+}
+
+void SynactionSimulateMassJoin(const SynactionLinkModel *link, const SynactionSimulationConfig *config, const SynactionMassJoinConfig *massJoinConfig, uint64_t seed, SynactionConvergenceReport *report) {
+    static _Thread_local SynactionSimulation simulation;
+    memset(&simulation, 0, sizeof(simulation));
+    memset(report, 0, sizeof(SynactionConvergenceReport));
+    
+    size_t peers = (massJoinConfig->peers < SynactionAdmissionCapacity) ? massJoinConfig->peers : SynactionAdmissionCapacity;
+    
+    SynactionMassJoin massJoin = {0};
+    massJoin.simulation = &simulation;
+    massJoin.config = config;
+    massJoin.peers = calloc(peers, sizeof(SynactionSimulatedPeer));
+    massJoin.results = calloc(peers, sizeof(SynactionJoinResult));
+    if (!massJoin.peers || !massJoin.results) {
+        free(massJoin.peers);
+        free(massJoin.results);
+        return;
+    }
+    
+    simulation.link = link;
+    simulation.random = seed;
+    simulation.startTime = 1000000000000000ULL + SynactionSimulationRandom(&simulation) % 1000000000000ULL;
+    
+    // Everyone asks at once.
+    SynactionAdmissionStart(&massJoin.admission, massJoinConfig->maxActive, massJoinConfig->probeBudget);
+    for (uint32_t peer = 0; peer < peers; peer++) {
+        massJoin.peers[peer].initialOffset = (int64_t)(SynactionSimulationRandom(&simulation) % 2000000000ULL) - 1000000000;
+        SynactionAdmissionRequest(&massJoin.admission, peer);
+    }
+    
+    uint64_t t = simulation.startTime;
+    uint64_t nextWatchdog = t + SynactionSimulatorWatchdogInterval;
+    uint64_t hostFreeTime = t;// The host answers one packet at a time
+    SynactionMassJoinAdmit(&massJoin, t);
+    
+    while (massJoin.peersDone < peers && t - simulation.startTime < SynactionSimulatorTimeLimit) {
+        SynactionSimulatedPacket packet;
+        
+        if (!SynactionSimulationNextPacket(&simulation, nextWatchdog, &packet)) {
+            t = nextWatchdog;
+            nextWatchdog += SynactionSimulatorWatchdogInterval;
+            
+            for (uint32_t peer = 0; peer < peers; peer++) {
+                SynactionSimulatedPeer *simulatedPeer = &massJoin.peers[peer];
+                if (!simulatedPeer->isCalibrating) continue;
+                
+                SynactionBurstWatchdogAction action = SynactionBurstCheckWatchdog(&simulatedPeer->burst, SynactionMassJoinPeerTime(&massJoin, peer, t));
+                
+                if (action == SynactionBurstWatchdogFinish) {
+                    SynactionMassJoinFinishPeer(&massJoin, peer, t, true);
+                    
+                } else if (action == SynactionBurstWatchdogRestart) {
+                    if (++simulatedPeer->restarts > SynactionSimulatorMaxRestarts) {
+                        SynactionMassJoinFinishPeer(&massJoin, peer, t, false);
+                        
+                    } else {
+                        SynactionMassJoinStartBurst(&massJoin, peer, t);
+                    }
+                }
+            }
+            
+            continue;
+        }
+        
+        t = packet.arrival;
+        
+        if (packet.direction == SynactionSimulatedPacketToHost) {
+            uint64_t timeHostReceived = (t > hostFreeTime) ? t : hostFreeTime;
+            hostFreeTime = timeHostReceived + link->hostTurnaround;
+            
+            SynactionSimulationAnswerAt(&simulation, &packet, timeHostReceived, true, false);
+            continue;
+        }
+        
+        SynactionSimulatedPeer *simulatedPeer = &massJoin.peers[packet.peer];
+        if (!simulatedPeer->isCalibrating) continue;
+        
+        uint64_t peerTime = SynactionMassJoinPeerTime(&massJoin, packet.peer, t);
+        bool sendNextProbe;
+        SynactionBurstReplyResult result = SynactionBurstHandleReply(&simulatedPeer->burst, &packet.probe, peerTime, &sendNextProbe);
+        
+        SynactionProbeSample sample;
+        uint64_t sampleTime;
+        if (result != SynactionBurstReplyIgnored && SynactionBurstFinalSample(&simulatedPeer->burst, &packet.probe, &sample, &sampleTime)) {
+            SynactionEstimatorAddSample(&simulatedPeer->estimator, sample, sampleTime);
+            
+            SynactionEstimate estimate = SynactionEstimatorCurrent(&simulatedPeer->estimator);
+            if (SynactionEstimateIsConfident(&estimate, config->confidence)) result = SynactionBurstReplyComplete;
+        }
+        
+        if (result == SynactionBurstReplyComplete) {
+            SynactionMassJoinFinishPeer(&massJoin, packet.peer, t, true);
+            continue;
+        }
+        
+        SynactionProbe probe;
+        if (sendNextProbe && SynactionBurstNextProbe(&simulatedPeer->burst, peerTime, &probe)) {
+            SynactionSimulationSend(&simulation, t, SynactionSimulatedPacketToHost, packet.peer, &probe, false);
+        }
+    }
+    
+    // Peers still calibrating ran out of time and count as failures. Packets are shared out evenly.
+    for (uint32_t peer = 0; peer < peers; peer++) {
+        massJoin.results[peer].packetsSent = simulation.packetsSent/peers;
+    }
+    
+    SynactionConvergenceReportFill(report, massJoin.results, peers);
+    
+    free(massJoin.peers);
+    free(massJoin.results);
+}
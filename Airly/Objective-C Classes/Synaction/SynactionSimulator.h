@@ -0,0 +1,75 @@
+//
+//  SynactionSimulator.h
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#ifndef SynactionSimulator_h
+#define SynactionSimulator_h
+
+// Deterministic discrete event simulation of peers joining a host over a modelled link. Drives the
+// same SynactionCore state machines and estimators the app uses, so estimator changes can be compared
+// without devices. The same seed always gives the same result.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "SynactionCore.h"
+
+typedef struct {
+    uint64_t latency;// Base one way delay, in nanoseconds
+    uint64_t jitter;// Mean of the exponential queuing delay added to every packet, in nanoseconds
+    int64_t asymmetry;// Extra delay on the host to peer direction only, in nanoseconds
+    double loss;// Per packet. Datagrams are dropped, stream packets are retransmitted after 200ms
+    double skew;// Peer clock rate error against the host, e.g. 20e-6 for 20ppm
+    uint64_t hostTurnaround;// Time the host takes to answer, in nanoseconds
+} SynactionLinkModel;
+
+typedef enum {
+    SynactionSimulatedCalibrationSerial = 0,// Archived pings over the stream, one at a time
+    SynactionSimulatedCalibrationBurst,// Probes over the timing channel datagrams
+} SynactionSimulatedCalibration;
+
+typedef struct {
+    SynactionSimulatedCalibration calibration;
+    SynactionEstimatorKind estimator;
+    uint64_t confidence;// Target half-width the calibration stops at, in nanoseconds
+    size_t burstSize;// Upper bound, the burst ends early once confident
+    size_t burstWindow;
+    uint64_t maxCalibrations;// Serial only
+} SynactionSimulationConfig;
+
+typedef struct {
+    size_t peers;// All join at once
+    size_t maxActive;// Peers the host lets calibrate at once, peers for no admission control
+    size_t probeBudget;// Probes in flight across every calibrating peer, split evenly as burst windows
+} SynactionMassJoinConfig;
+
+typedef struct {
+    bool converged;// False if the join gave up (too many restarts, or a minute of simulated time)
+    int64_t error;// Estimated offset minus true offset when calibration finished, in nanoseconds
+    uint64_t timeToConverge;// In nanoseconds
+    size_t packetsSent;
+} SynactionJoinResult;
+
+typedef struct {
+    size_t joins;
+    size_t failures;
+    double meanAbsoluteError;
+    uint64_t errorP50, errorP95, errorMax;// |error|, in nanoseconds
+    uint64_t timeP50, timeP95, timeMax;// Time to converge, in nanoseconds
+    double meanPacketsSent;
+} SynactionConvergenceReport;
+
+SynactionJoinResult SynactionSimulateJoin(const SynactionLinkModel *link, const SynactionSimulationConfig *config, uint64_t seed);
+void SynactionSimulateJoins(const SynactionLinkModel *link, const SynactionSimulationConfig *config, size_t joins, uint64_t seed, SynactionConvergenceReport *report);
+
+// Burst calibration only. The host answers one probe at a time, hostTurnaround each, so probes queue up
+// at the host when too many peers calibrate together. Every peer is one join of the report, timed from
+// the moment they all asked.
+void SynactionSimulateMassJoin(const SynactionLinkModel *link, const SynactionSimulationConfig *config, const SynactionMassJoinConfig *massJoin, uint64_t seed, SynactionConvergenceReport *report);
+
+#endif /* SynactionSimulator_h */
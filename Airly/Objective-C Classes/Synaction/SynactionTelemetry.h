@@ -0,0 +1,52 @@
+//
+//  SynactionTelemetry.h
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// Frameworks
+#import <Foundation/Foundation.h>
+
+// Frameworks & Librairies
+#import "SynactionProbe.h"
+
+#define SynactionTelemetryCapacity 512// Probe samples kept, a power of two
+#define SynactionTelemetryBucketCount 10
+
+// Upper edges of the histogram buckets, in nanoseconds. The last bucket is open ended.
+extern const uint64_t SynactionTelemetryBucketEdges[SynactionTelemetryBucketCount - 1];
+
+typedef struct {
+    uint64_t localTime;// Peer clock when the sample completed
+    int64_t offset;
+    int64_t roundTripTime;
+} SynactionTelemetrySample;
+
+typedef struct {
+    NSUInteger sampleCount;
+    uint64_t minRoundTripTime;
+    uint64_t medianRoundTripTime;
+    uint64_t errorBound;// The current offset estimate is within this of the true offset, in nanoseconds
+    double drift;// Estimated skew against the host, in ppm
+    uint32_t roundTripTimeHistogram[SynactionTelemetryBucketCount];
+    uint32_t offsetErrorHistogram[SynactionTelemetryBucketCount];// |sample offset - model offset at the sample's time|
+} SynactionSyncQuality;
+
+static inline NSUInteger SynactionTelemetryBucketForValue(uint64_t value) {
+    NSUInteger bucket = 0;
+    while (bucket < SynactionTelemetryBucketCount - 1 && value >= SynactionTelemetryBucketEdges[bucket]) bucket++;
+    
+    return bucket;
+}
+
+// Single producer ring buffer of probe samples. The producer never blocks and readers never lock:
+// a reader copies the ring and then drops whatever the producer may have overwritten meanwhile.
+@interface SynactionTelemetry : NSObject
+
+- (void)recordSample:(SynactionProbeSample)sample atTime:(uint64_t)localTime;// Producer only
+- (NSUInteger)copyRecentSamples:(SynactionTelemetrySample * _Nonnull)samples maxCount:(NSUInteger)maxCount;// Any thread. Newest last.
+- (void)reset;// Producer only
+
+@end
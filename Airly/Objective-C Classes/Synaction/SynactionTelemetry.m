@@ -0,0 +1,60 @@
+//
+//  SynactionTelemetry.m
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#import "SynactionTelemetry.h"
+
+// Frameworks
+#import <stdatomic.h>
+
+const uint64_t SynactionTelemetryBucketEdges[SynactionTelemetryBucketCount - 1] = {
+    50000, 100000, 200000, 500000, 1000000, 2000000, 5000000, 10000000, 20000000,
+};
+
+@interface SynactionTelemetry () {
+    SynactionTelemetrySample samples[SynactionTelemetryCapacity];
+    _Atomic uint64_t samplesWritten;// Total ever recorded, the next slot is samplesWritten % capacity
+}
+
+@end
+
+@implementation SynactionTelemetry
+
+- (void)recordSample:(SynactionProbeSample)sample atTime:(uint64_t)localTime {
+    uint64_t index = atomic_load_explicit(&samplesWritten, memory_order_relaxed);
+    samples[index % SynactionTelemetryCapacity] = (SynactionTelemetrySample){.localTime = localTime, .offset = sample.offset, .roundTripTime = sample.roundTripTime};
+    
+    atomic_store_explicit(&samplesWritten, index + 1, memory_order_release);
+}
+
+- (NSUInteger)copyRecentSamples:(SynactionTelemetrySample *)copies maxCount:(NSUInteger)maxCount {
+    uint64_t end = atomic_load_explicit(&samplesWritten, memory_order_acquire);
+    uint64_t start = end - MIN(end, (uint64_t)MIN(maxCount, SynactionTelemetryCapacity));
+    
+    for (uint64_t index = start; index < end; index++) {
+        copies[index - start] = samples[index % SynactionTelemetryCapacity];
+    }
+    
+    // Anything at or below written - capacity may have been overwritten (or half written) while we copied.
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t written = atomic_load_explicit(&samplesWritten, memory_order_relaxed);
+    uint64_t firstIntact = (written >= SynactionTelemetryCapacity) ? written - SynactionTelemetryCapacity + 1 : 0;
+    
+    if (firstIntact <= start) return (NSUInteger)(end - start);
+    if (firstIntact >= end) return 0;
+    
+    NSUInteger dropped = (NSUInteger)(firstIntact - start);
+    memmove(copies, copies + dropped, (size_t)(end - firstIntact) * sizeof(SynactionTelemetrySample));
+    
+    return (NSUInteger)(end - firstIntact);
+}
+
+- (void)reset {
+    atomic_store_explicit(&samplesWritten, 0, memory_order_release);
+}
+
+@end
@@ -0,0 +1,55 @@
+//
+//  SynactionTimingChannel.h
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// Frameworks
+#import <Foundation/Foundation.h>
+
+// Frameworks & Librairies
+@import CocoaAsyncSocket;
+#import "SynactionProbe.h"
+
+@class SynactionTimingChannel;
+
+// Host responder turnaround, from kernel receive of a probe to its reply leaving.
+typedef struct {
+    uint64_t probesAnswered;
+    uint64_t totalTurnaround;// In nanoseconds
+    uint64_t maxTurnaround;// In nanoseconds
+} SynactionResponderStatistics;
+
+@protocol SynactionTimingChannelDelegate <NSObject>
+
+- (uint64_t)currentTime;// Clock used to stamp probes. Called off the main thread.
+- (void)timingChannel:(SynactionTimingChannel * _Nonnull)channel didReceiveProbe:(SynactionProbe)probe receivedAt:(uint64_t)timeReceived fromAddress:(NSData * _Nonnull)address;// Called on the main queue. Not called for probes answered by the responder.
+
+@end
+
+// A UDP side channel for sync probes so they never queue behind file transfers on the TCP stream.
+// Probes are read with recvmsg on a dedicated queue and stamped with the kernel receive time when the
+// socket supports SO_TIMESTAMP_MONOTONIC or SO_TIMESTAMP, otherwise with the time they were read.
+@interface SynactionTimingChannel : NSObject
+
+@property (nonatomic, weak) id<SynactionTimingChannelDelegate> _Nullable delegate;
+@property (readonly, nonatomic) uint16_t localPort4;// Bound IPv4 port, 0 if not bound.
+@property (readonly, nonatomic) uint16_t localPort6;// Bound IPv6 port, 0 if not bound.
+@property (readonly, strong, nonatomic) NSData * _Nullable hostAddress;// Where probes go when on a peer. nil on host.
+@property (atomic) BOOL respondsToProbes;// Host. Answer probes (reply + follow-up) on the receive queue without touching the main thread. Only from allowed addresses, an answer is two datagrams.
+@property (readonly, nonatomic) SynactionResponderStatistics responderStatistics;
+
+- (_Nonnull instancetype)initWithDelegate:(id<SynactionTimingChannelDelegate> _Nonnull)delegate;
+
+- (BOOL)openWithError:(NSError * _Nullable * _Nullable)error;// Binds to any free port and starts receiving.
+- (void)connectToHostAtAddress:(NSData * _Nonnull)tcpAddress port4:(uint16_t)port4 port6:(uint16_t)port6;// Peer. Uses the host's TCP address with its negotiated UDP port.
+- (void)disconnectFromHost;// Peer. Stop sending probes over UDP, callers fall back to TCP.
+- (uint64_t)sendProbe:(const SynactionProbe * _Nonnull)probe toAddress:(NSData * _Nonnull)address;// Returns the delegate clock right after the datagram was handed to the kernel, 0 on failure.
+- (void)allowProbesFromAddress:(NSData * _Nonnull)address;// Host. Answer probes from this TCP peer's IP, any port. Counted, once per call.
+- (void)disallowProbesFromAddress:(NSData * _Nonnull)address;// Host. Undoes one -allowProbesFromAddress:.
+- (void)resetResponderStatistics;
+- (void)close;
+
+@end
@@ -0,0 +1,311 @@
+//
+//  SynactionTimingChannel.m
+//  Synaction
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+#import "SynactionTimingChannel.h"
+
+// Frameworks
+#import <netinet/in.h>
+#import <sys/socket.h>
+#import <sys/time.h>
+#import <unistd.h>
+
+// Frameworks & Librairies
+#import "SynactionClock.h"
+
+#define SynactionMaxPacketAge 1000000000// Kernel stamps older than 1s mean the wall clock stepped, ignore them
+
+@interface SynactionTimingChannel () <GCDAsyncUdpSocketDelegate>
+
+@property (strong, nonatomic) GCDAsyncUdpSocket *udpSocket;
+@property (strong, nonatomic) NSData * _Nullable hostAddress;
+@property (strong, nonatomic) dispatch_queue_t receiveQueue;
+@property (strong, nonatomic) NSMutableArray<dispatch_source_t> *receiveSources;
+@property (nonatomic) int socket4FD;// Our own duplicates, closed once their read source is cancelled
+@property (nonatomic) int socket6FD;
+@property (nonatomic) SynactionResponderStatistics statistics;// Only touched on receiveQueue
+@property (strong, nonatomic) NSCountedSet <NSString *> *peerHosts;// Host. IPs of connected peers, only touched on receiveQueue
+
+@end
+
+// How long the datagram sat in the socket buffer according to the kernel, 0 when there is no stamp.
+static uint64_t SynactionPacketAge(struct msghdr *message) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(message); cmsg != NULL; cmsg = CMSG_NXTHDR(message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) continue;
+        
+#ifdef SCM_TIMESTAMP_MONOTONIC
+        if (cmsg->cmsg_type == SCM_TIMESTAMP_MONOTONIC) {
+            uint64_t kernelTicks;
+            memcpy(&kernelTicks, CMSG_DATA(cmsg), sizeof(kernelTicks));
+            
+            const SynactionClock *machClock = SynactionClockMach();
+            uint64_t ticks = SynactionClockReadTicks(machClock);
+            if (ticks <= kernelTicks) return 0;
+            
+            uint64_t age = SynactionClockTicksToNanoseconds(machClock, ticks - kernelTicks);
+            return age < SynactionMaxPacketAge ? age : 0;
+        }
+#endif
+        
+        if (cmsg->cmsg_type == SCM_TIMESTAMP) {
+            struct timeval kernelTime, now;
+            memcpy(&kernelTime, CMSG_DATA(cmsg), sizeof(kernelTime));
+            gettimeofday(&now, NULL);
+            
+            int64_t age = ((int64_t)now.tv_sec - kernelTime.tv_sec) * 1000000000 + ((int64_t)now.tv_usec - kernelTime.tv_usec) * 1000;
+            return (age > 0 && age < SynactionMaxPacketAge) ? (uint64_t)age : 0;
+        }
+    }
+    
+    return 0;
+}
+
+@implementation SynactionTimingChannel
+
+- (instancetype)initWithDelegate:(id<SynactionTimingChannelDelegate>)delegate {
+    self = [super init];
+    
+    if (self) {
+        self.delegate = delegate;
+        self.udpSocket = [[GCDAsyncUdpSocket alloc] initWithDelegate:self delegateQueue:dispatch_get_main_queue()];
+        self.receiveQueue = dispatch_queue_create("Synaction.TimingChannel", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, 0));
+        self.receiveSources = [NSMutableArray new];
+        self.peerHosts = [NSCountedSet new];
+        self.socket4FD = -1;
+        self.socket6FD = -1;
+    }
+    
+    return self;
+}
+
+- (BOOL)openWithError:(NSError **)error {
+    if (![self.udpSocket bindToPort:0 error:error]) {
+        NSLog(@"Unable to bind timing channel. Error %@", error ? *error : nil);
+        return NO;
+    }
+    
+    // GCDAsyncUdpSocket only owns the sockets, we read them ourselves to get at the control messages. It closes
+    // its descriptors on its own queue, so we read and send on duplicates that live as long as our read sources.
+    [self.udpSocket performBlock:^{
+        int socket4FD = [self.udpSocket socket4FD];
+        int socket6FD = [self.udpSocket socket6FD];
+        self.socket4FD = (socket4FD != -1) ? dup(socket4FD) : -1;
+        self.socket6FD = (socket6FD != -1) ? dup(socket6FD) : -1;
+    }];
+    
+    [self startReceivingOnSocket:self.socket4FD];
+    [self startReceivingOnSocket:self.socket6FD];
+    
+    NSLog(@"Opened timing channel on ports %hu/%hu.", self.localPort4, self.localPort6);
+    return YES;
+}
+
+- (uint16_t)localPort4 {
+    return [self.udpSocket localPort_IPv4];
+}
+
+- (uint16_t)localPort6 {
+    return [self.udpSocket localPort_IPv6];
+}
+
+- (void)connectToHostAtAddress:(NSData *)tcpAddress port4:(uint16_t)port4 port6:(uint16_t)port6 {
+    NSMutableData *address = [tcpAddress mutableCopy];
+    
+    // Same host, different port.
+    if ([GCDAsyncUdpSocket isIPv4Address:address] && port4 != 0) {
+        ((struct sockaddr_in *)address.mutableBytes)->sin_port = htons(port4);
+        
+    } else if ([GCDAsyncUdpSocket isIPv6Address:address] && port6 != 0) {
+        ((struct sockaddr_in6 *)address.mutableBytes)->sin6_port = htons(port6);
+        
+    } else {
+        NSLog(@"Host has no timing channel for this address family, staying on TCP.");
+        return;
+    }
+    
+    self.hostAddress = address;
+    NSLog(@"Timing channel will probe %@:%hu", [GCDAsyncUdpSocket hostFromAddress:address], [GCDAsyncUdpSocket portFromAddress:address]);
+}
+
+- (void)disconnectFromHost {
+    self.hostAddress = nil;
+}
+
+- (void)allowProbesFromAddress:(NSData *)address {
+    NSString *host = [GCDAsyncUdpSocket hostFromAddress:address];
+    if (!host) return;
+    
+    dispatch_async(self.receiveQueue, ^{
+        [self.peerHosts addObject:host];
+    });
+}
+
+- (void)disallowProbesFromAddress:(NSData *)address {
+    NSString *host = [GCDAsyncUdpSocket hostFromAddress:address];
+    if (!host) return;
+    
+    dispatch_async(self.receiveQueue, ^{
+        [self.peerHosts removeObject:host];
+    });
+}
+
+- (uint64_t)sendProbe:(const SynactionProbe *)probe toAddress:(NSData *)address {
+    int socketFD = [GCDAsyncUdpSocket isIPv4Address:address] ? self.socket4FD : self.socket6FD;
+    return [self sendProbe:probe onSocket:socketFD toSocketAddress:address.bytes length:(socklen_t)address.length];
+}
+
+- (uint64_t)sendProbe:(const SynactionProbe *)probe onSocket:(int)socketFD toSocketAddress:(const struct sockaddr *)address length:(socklen_t)length {
+    if (socketFD == -1) return 0;
+    
+    ssize_t result = sendto(socketFD, probe, sizeof(SynactionProbe), 0, address, length);
+    uint64_t timeSent = [self.delegate currentTime];
+    
+    if (result != sizeof(SynactionProbe)) {
+        NSLog(@"Timing channel failed to send probe: %s", strerror(errno));
+        return 0;
+    }
+    
+    return timeSent;
+}
+
+- (void)close {
+    self.hostAddress = nil;
+    
+    // Each descriptor is closed by its source's cancel handler, after any read in progress is done with it.
+    for (dispatch_source_t source in self.receiveSources) {
+        dispatch_source_cancel(source);
+    }
+    [self.receiveSources removeAllObjects];
+    
+    [self.udpSocket close];
+    self.socket4FD = -1;
+    self.socket6FD = -1;
+}
+
+#pragma mark - Receiving
+- (void)startReceivingOnSocket:(int)socketFD {
+    if (socketFD == -1) return;
+    
+    // Prefer the monotonic stamp, it is in the same timebase as mach_absolute_time.
+    int on = 1;
+#ifdef SO_TIMESTAMP_MONOTONIC
+    if (setsockopt(socketFD, SOL_SOCKET, SO_TIMESTAMP_MONOTONIC, &on, sizeof(on)) != 0)
+#endif
+    if (setsockopt(socketFD, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) != 0) {
+        NSLog(@"No kernel timestamps on timing channel, stamping at read time.");
+    }
+    
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, socketFD, 0, self.receiveQueue);
+    
+    __weak SynactionTimingChannel *weakSelf = self;
+    dispatch_source_set_event_handler(source, ^{
+        [weakSelf receiveFromSocket:socketFD];
+    });
+    
+    dispatch_source_set_cancel_handler(source, ^{
+        close(socketFD);
+    });
+    
+    dispatch_resume(source);
+    [self.receiveSources addObject:source];
+}
+
+// Drains every datagram waiting on the socket. Runs on receiveQueue.
+- (void)receiveFromSocket:(int)socketFD {
+    id<SynactionTimingChannelDelegate> delegate = self.delegate;
+    if (!delegate) return;
+    
+    while (YES) {
+        uint8_t buffer[sizeof(SynactionProbe)];
+        struct sockaddr_storage from;
+        char control[CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(uint64_t))];
+        
+        struct iovec iov = {.iov_base = buffer, .iov_len = sizeof(buffer)};
+        struct msghdr message = {0};
+        message.msg_name = &from;
+        message.msg_namelen = sizeof(from);
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        
+        ssize_t length = recvmsg(socketFD, &message, 0);
+        uint64_t timeRead = [delegate currentTime];
+        
+        if (length < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) NSLog(@"Timing channel read failed: %s", strerror(errno));
+            if (errno != EINTR) return;
+            continue;
+        }
+        
+        SynactionProbe probe;
+        if (message.msg_flags & MSG_TRUNC || !SynactionProbeFromBytes(buffer, (size_t)length, &probe)) {
+            continue;// Not ours
+        }
+        
+        uint64_t timeReceived = timeRead - SynactionPacketAge(&message);
+        NSData *address = [NSData dataWithBytes:&from length:message.msg_namelen];
+        
+        // Only peers get answers, the host would otherwise reflect two datagrams for each one anyone sends it.
+        if (self.respondsToProbes && probe.magic == SynactionProbeMagic && probe.timeHostSent == 0) {
+            NSString *host = [GCDAsyncUdpSocket hostFromAddress:address];
+            if (host && [self.peerHosts containsObject:host]) {
+                [self answerProbe:probe receivedAt:timeReceived onSocket:socketFD toSocketAddress:(struct sockaddr *)&from length:message.msg_namelen];
+            }
+            
+            continue;
+        }
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [delegate timingChannel:self didReceiveProbe:probe receivedAt:timeReceived fromAddress:address];
+        });
+    }
+}
+
+#pragma mark - Responder
+// Host. Two-step reply straight from the receive queue: the reply carries an estimated timeHostSent and
+// the follow-up the time the reply actually left, so the main thread never sits between t2 and t3.
+- (void)answerProbe:(SynactionProbe)probe receivedAt:(uint64_t)timeReceived onSocket:(int)socketFD toSocketAddress:(const struct sockaddr *)address length:(socklen_t)length {
+    probe.timeHostReceived = timeReceived;
+    probe.timeHostSent = [self.delegate currentTime];
+    
+    uint64_t timeSent = [self sendProbe:&probe onSocket:socketFD toSocketAddress:address length:length];
+    if (timeSent == 0) return;
+    
+    probe.magic = SynactionProbeFollowUpMagic;
+    probe.timeHostSent = timeSent;
+    [self sendProbe:&probe onSocket:socketFD toSocketAddress:address length:length];
+    
+    SynactionResponderStatistics statistics = self.statistics;
+    uint64_t turnaround = timeSent - timeReceived;
+    statistics.probesAnswered += 1;
+    statistics.totalTurnaround += turnaround;
+    statistics.maxTurnaround = MAX(statistics.maxTurnaround, turnaround);
+    self.statistics = statistics;
+}
+
+- (SynactionResponderStatistics)responderStatistics {
+    __block SynactionResponderStatistics statistics;
+    dispatch_sync(self.receiveQueue, ^{
+        statistics = self.statistics;
+    });
+    
+    return statistics;
+}
+
+- (void)resetResponderStatistics {
+    dispatch_async(self.receiveQueue, ^{
+        self.statistics = (SynactionResponderStatistics){0};
+    });
+}
+
+#pragma mark - GCDAsyncUdpSocketDelegate
+- (void)udpSocketDidClose:(GCDAsyncUdpSocket *)sock withError:(NSError *)error {
+    if (error) NSLog(@"Timing channel closed: %@", error);
+}
+
+@end
@@ -15,10 +15,14 @@ class ApplePlayerManager: NSObject, PlayerManager {
     
     public var shouldPlay = true
     public var channel: HSTREAM = 0
+    public var renderStream: SynactionAudioStream? = nil// Receivers only. Always running, switches to the song at an exact sample. channel is its decode channel.
     
     private let session: AVAudioSession = AVAudioSession.sharedInstance()
     private var currentSongIndex: Int = 0
     private var songItems: [SongItem] = []
+    private var queueGeneration: Int = 0// Bumped by each new queue, exports of an older one never land
+    private var exporters: [Int: AVAssetExportSession] = [:]// Running, by queue index
+    private var exportCompletions: [Int: [(URL?) -> Void]] = [:]// Of the running exports, a second request joins the first
     
     var isSpotify: Bool {
         return false
@@ -51,6 +55,11 @@ class ApplePlayerManager: NSObject, PlayerManager {
     }
 
     func isPlaying(completion: @escaping (Bool) -> Void) {
+        if let renderStream = self.renderStream {
+            completion(renderStream.isPlaying)
+            return
+        }
+        
         completion((BASS_ChannelIsActive(self.channel) == DWORD(BASS_ACTIVE_PLAYING)))
     }
     
@@ -73,8 +82,23 @@ class ApplePlayerManager: NSObject, PlayerManager {
     }
     
     func play(completion: @escaping (Bool) -> Void) {
+        self.startAudio()
+        self.didStartPlaying(completion: completion)
+    }
+    
+    // Only starts the audio, safe from any thread. A timed play calls this on the scheduler thread, then didStartPlaying on main.
+    func startAudio() {
         // Play at default rate
-        BASS_ChannelPlay(self.channel, false)
+        if let renderStream = self.renderStream {
+            renderStream.start()
+            
+        } else {
+            BASS_ChannelPlay(self.channel, false)
+        }
+    }
+    
+    // Main queue. Tells everyone and keeps track of the song's end once the audio started.
+    func didStartPlaying(completion: @escaping (Bool) -> Void) {
         NotificationCenter.default.post(name: PlayerPlayedNotificationName, object: self)
         
         self.currentPlaybackTime { time in
@@ -88,7 +112,62 @@ class ApplePlayerManager: NSObject, PlayerManager {
     }
     
     func pause(completion: @escaping (Bool) -> Void) {
-        BASS_ChannelPause(self.channel)
+        self.stopAudio()
+        self.didPause(completion: completion)
+    }
+    
+    // Only stops the audio, safe from any thread. A timed pause calls this on the scheduler thread, then didPause on main.
+    func stopAudio() {
+        if let renderStream = self.renderStream {
+            renderStream.stop()
+            
+        } else {
+            BASS_ChannelPause(self.channel)
+        }
+    }
+    
+    // Main queue.
+    func didPause(completion: @escaping (Bool) -> Void) {
+        NotificationCenter.default.post(name: PlayerPausedNotificationName, object: self)
+        
+        self.shouldPlay = false
+        
+        completion(true)
+    }
+    
+    // Render stream only. The first sample is heard at the network time time, no scheduler involved.
+    func play(atNetworkTime time: UInt64, completion: @escaping (Bool) -> Void) {
+        guard let renderStream = self.renderStream else {
+            completion(false)
+            return
+        }
+        
+        renderStream.outputLatency = UInt64((self.session.outputLatency + self.session.ioBufferDuration) * 1000000000.0)
+        renderStream.start(atTime: time)
+        NotificationCenter.default.post(name: PlayerPlayedNotificationName, object: self)
+        
+        let currentNetworkTime: UInt64 = Synaction.sharedManager().currentNetworkTime()
+        let timeUntilStart: TimeInterval = (time > currentNetworkTime) ? TimeInterval(time - currentNetworkTime)/1000000000.0 : 0
+        
+        self.currentPlaybackTime { playbackTime in
+            let timeRemainingInSong = BASS_ChannelBytes2Seconds(self.channel, BASS_ChannelGetLength(self.channel, DWORD(BASS_POS_BYTE))) - playbackTime
+            self.perform(#selector(self.playerDidFinishPlaying(notification:)), with: nil, afterDelay: timeRemainingInSong + timeUntilStart)
+            
+            self.shouldPlay = true
+            
+            completion(true)
+        }
+    }
+    
+    // Render stream only. Silence from the network time time on.
+    func pause(atNetworkTime time: UInt64, completion: @escaping (Bool) -> Void) {
+        guard let renderStream = self.renderStream else {
+            completion(false)
+            return
+        }
+        
+        renderStream.outputLatency = UInt64((self.session.outputLatency + self.session.ioBufferDuration) * 1000000000.0)
+        renderStream.stop(atTime: time)
         NotificationCenter.default.post(name: PlayerPausedNotificationName, object: self)
         
         self.shouldPlay = false
@@ -104,7 +183,7 @@ class ApplePlayerManager: NSObject, PlayerManager {
         }
         
         self.exportCurrentSongToFile {
-            BASS_ChannelStop(self.channel)
+            self.freeChannel()
             self.channel = BASS_StreamCreateFile(false, URL(string: self.currentSongFilePath)!.path, 0, 0, DWORD(BASS_STREAM_PRESCAN))
             
             if self.shouldPlay {
@@ -124,7 +203,7 @@ class ApplePlayerManager: NSObject, PlayerManager {
         }
         
         self.exportCurrentSongToFile {
-            BASS_ChannelStop(self.channel)
+            self.freeChannel()
             self.channel = BASS_StreamCreateFile(false, URL(string: self.currentSongFilePath)!.path, 0, 0, DWORD(BASS_STREAM_PRESCAN))
             
             if (self.shouldPlay) {
@@ -145,17 +224,24 @@ class ApplePlayerManager: NSObject, PlayerManager {
     func loadQueueFromItems(songItems: [SongItem]) {
         self.songItems = songItems// Save the media items.
         currentSongIndex = 0
+        self.currentSongFilePath = ApplePlayerManager.exportedSongFilePath(at: 0)// Never the receivers' cache
+        
+        // Exports are by position in the queue, a new queue starts over. Those still running were of the old one.
+        self.queueGeneration += 1
+        self.exporters.values.forEach { $0.cancelExport() }
+        self.exporters.removeAll()
+        self.exportCompletions.removeAll()
+        ApplePlayerManager.removeExportedSongs(where: { _ in true })
         
         if (self.songItems.count == 0) {
             print("Empty queue: deleting song file and stopping channel.")
-            try? FileManager.default.removeItem(at: URL(string: self.currentSongFilePath)!)
-            BASS_ChannelStop(self.channel)
+            self.freeChannel()
             
             return
         }
         
         self.exportCurrentSongToFile {
-            BASS_ChannelStop(self.channel)
+            self.freeChannel()
             self.channel = BASS_StreamCreateFile(false, URL(string: self.currentSongFilePath)!.path, 0, 0, DWORD(BASS_STREAM_PRESCAN))
             BASS_ChannelSetAttribute(self.channel, DWORD(BASS_ATTRIB_NOBUFFER), 1);
 
@@ -171,14 +257,29 @@ class ApplePlayerManager: NSObject, PlayerManager {
         return self.session.outputLatency
     }
     
-    public var currentSongFilePath: String! {
+    public var currentSongFilePath: String! = ApplePlayerManager.exportedSongFilePath(at: 0)// Receivers point it at the song in their cache
+    
+    // Each queued song is exported to its own file, so the ones coming up can be exported ahead of time.
+    private static func exportedSongFilePath(at index: Int) -> String {
         // Get the path for the song
         let tempPath: URL = NSURL.fileURL(withPath: NSTemporaryDirectory())
-        let songURL: URL = tempPath.appendingPathComponent("song.caf", isDirectory: false)
+        let songURL: URL = tempPath.appendingPathComponent("song-\(index).caf", isDirectory: false)
         
         return songURL.absoluteString
     }
     
+    private static func removeExportedSongs(where shouldRemove: (Int) -> Bool) {
+        let tempPath: String = NSTemporaryDirectory()
+        
+        for name in (try? FileManager.default.contentsOfDirectory(atPath: tempPath)) ?? [] {
+            guard name.hasPrefix("song-"), name.hasSuffix(".caf"), let index = Int(name.dropFirst(5).dropLast(4)), shouldRemove(index) else {
+                continue
+            }
+            
+            try? FileManager.default.removeItem(atPath: (tempPath as NSString).appendingPathComponent(name))
+        }
+    }
+    
     public var currentPlaybackTime: TimeInterval {
         return BASS_ChannelBytes2Seconds(self.channel, BASS_ChannelGetPosition(self.channel, DWORD(BASS_POS_BYTE)))
     }
@@ -188,9 +289,54 @@ class ApplePlayerManager: NSObject, PlayerManager {
         self.songItems.append(songItem)
         currentSongIndex = 0
         
+        if let path = songItem.path {
+            self.currentSongFilePath = path
+        }
+        
+        self.freeChannel()
+        
+        // Receivers render through a stream that is already running, so the start lands on an exact sample.
+        self.renderStream = SynactionAudioStream(fileAtPath: URL(string: self.currentSongFilePath)!.path, networkClock: Synaction.sharedManager().networkClock)
+        
+        if let renderStream = self.renderStream {
+            renderStream.outputLatency = UInt64((self.session.outputLatency + self.session.ioBufferDuration) * 1000000000.0)
+            self.channel = renderStream.decodeChannel
+            
+        } else {
+            self.channel = BASS_StreamCreateFile(false, URL(string: self.currentSongFilePath)!.path, 0, 0, DWORD(BASS_STREAM_PRESCAN))
+            BASS_ChannelSetAttribute(self.channel, DWORD(BASS_ATTRIB_NOBUFFER), 1)
+        }
+    }
+    
+    // Receivers only. Plays the song from a file still being received, see SynactionAudioStream.
+    public func loadSong(songItem: SongItem, growingFileAtPath path: String, availability: @escaping SynactionAudioStreamAvailability) -> Bool {
+        self.freeChannel()
+        
+        guard let renderStream = SynactionAudioStream(growingFileAtPath: path, availability: availability, networkClock: Synaction.sharedManager().networkClock) else {
+            return false
+        }
+        
+        self.songItems.removeAll()
+        self.songItems.append(songItem)
+        currentSongIndex = 0
+        self.currentSongFilePath = URL(fileURLWithPath: path).absoluteString
+        
+        renderStream.outputLatency = UInt64((self.session.outputLatency + self.session.ioBufferDuration) * 1000000000.0)
+        self.renderStream = renderStream
+        self.channel = renderStream.decodeChannel
+        
+        return true
+    }
+    
+    private func freeChannel() {
+        if let renderStream = self.renderStream {
+            renderStream.free()
+            self.renderStream = nil
+            self.channel = 0
+            return
+        }
+        
         BASS_ChannelStop(self.channel)
-        self.channel = BASS_StreamCreateFile(false, URL(string: self.currentSongFilePath)!.path, 0, 0, DWORD(BASS_STREAM_PRESCAN))
-        BASS_ChannelSetAttribute(self.channel, DWORD(BASS_ATTRIB_NOBUFFER), 1)
     }
 
     @objc private func playerDidFinishPlaying(notification: Notification?) {
@@ -213,14 +359,6 @@ class ApplePlayerManager: NSObject, PlayerManager {
     }
     
     public func exportCurrentSongToFile(completionHandler: @escaping () -> Void) {
-        // Delete old song
-        do {
-            try FileManager.default.removeItem(at: URL(string: self.currentSongFilePath)!)
-            
-        } catch {
-            print("Failed to delete old song for export. Error: \(error)")
-        }
-        
         // If no new song return.
         if (currentSongIndex >= self.songItems.count || self.songItems.count < 1) {
             print("Error exporting file, invalid song index.")
@@ -228,18 +366,92 @@ class ApplePlayerManager: NSObject, PlayerManager {
             return
         }
         
-        // Export the current song to a file and send the file to the peer
-        let currentSongAsset: AVAsset = self.songItems[currentSongIndex].avItem!.asset
-        let exporter: AVAssetExportSession = AVAssetExportSession.init(asset: currentSongAsset, presetName: AVAssetExportPresetPassthrough)!
-        exporter.outputFileType = convertToOptionalAVFileType("com.apple.coreaudio-format")
-        exporter.outputURL = URL(string: self.currentSongFilePath)!
+        // Keep the one before for skipping back, and whatever was exported ahead.
+        let index: Int = currentSongIndex
+        ApplePlayerManager.removeExportedSongs(where: { $0 < index - 1 })
+        
+        self.currentSongFilePath = ApplePlayerManager.exportedSongFilePath(at: index)
         
         print("Exporting current song host")
         
+        self.exportSong(at: index) { _ in
+            NotificationCenter.default.post(name: PlayerSongChangedNotificationName, object: self)
+            completionHandler()
+        }
+    }
+    
+    // Exports the next count songs of the queue one after the other, skipping those already exported. Completion
+    // gets their files in queue order.
+    public func exportUpcomingSongs(count: Int, completion: @escaping ([URL]) -> Void) {
+        let indexes: [Int] = Array((currentSongIndex + 1)..<min(currentSongIndex + 1 + max(count, 0), self.songItems.count))
+        var urls: [URL] = []
+        
+        func exportNext(_ remaining: ArraySlice<Int>) {
+            guard let index = remaining.first else {
+                completion(urls)
+                return
+            }
+            
+            self.exportSong(at: index) { url in
+                if let url = url {
+                    urls.append(url)
+                }
+                
+                exportNext(remaining.dropFirst())
+            }
+        }
+        
+        exportNext(indexes[...])
+    }
+    
+    // Exports once, to a side file first so a half written export is never taken for a finished one. One export
+    // per song at a time, a request while it runs waits on it. One finishing for a queue since replaced is dropped,
+    // its song isn't the one at that index any more.
+    private func exportSong(at index: Int, completion: @escaping (URL?) -> Void) {
+        let songURL: URL = URL(string: ApplePlayerManager.exportedSongFilePath(at: index))!
+        
+        if FileManager.default.fileExists(atPath: songURL.path) {
+            completion(songURL)
+            return
+        }
+        
+        if self.exportCompletions[index] != nil {
+            self.exportCompletions[index]?.append(completion)
+            return
+        }
+        
+        guard index < self.songItems.count, let asset = self.songItems[index].avItem?.asset, let exporter = AVAssetExportSession(asset: asset, presetName: AVAssetExportPresetPassthrough) else {
+            completion(nil)
+            return
+        }
+        
+        // Side files are per queue too, a cancelled export may still be writing its own.
+        let generation: Int = self.queueGeneration
+        let exportURL: URL = songURL.deletingPathExtension().appendingPathExtension("export-\(generation).caf")
+        try? FileManager.default.removeItem(at: exportURL)
+        
+        exporter.outputFileType = convertToOptionalAVFileType("com.apple.coreaudio-format")
+        exporter.outputURL = exportURL
+        self.exporters[index] = exporter
+        self.exportCompletions[index] = [completion]
+        
         exporter.exportAsynchronously {
             DispatchQueue.main.async {
-                NotificationCenter.default.post(name: PlayerSongChangedNotificationName, object: self)
-                completionHandler()
+                guard generation == self.queueGeneration else {
+                    try? FileManager.default.removeItem(at: exportURL)
+                    return
+                }
+                
+                self.exporters.removeValue(forKey: index)
+                let completions: [(URL?) -> Void] = self.exportCompletions.removeValue(forKey: index) ?? []
+                
+                if exporter.status != .completed || (try? FileManager.default.moveItem(at: exportURL, to: songURL)) == nil {
+                    print("Error exporting song \(index): \(String(describing: exporter.error))")
+                    completions.forEach { $0(nil) }
+                    return
+                }
+                
+                completions.forEach { $0(songURL) }
             }
         }
     }
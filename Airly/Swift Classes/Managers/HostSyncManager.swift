@@ -14,8 +14,11 @@ class HostSyncManager: NSObject, ConnectivityManagerDelegate {
     
     let connectivityManager:ConnectivityManager! = ConnectivityManager.shared()
     let synaction:Synaction! = Synaction.sharedManager()
+    let fileTransferManager:FileTransferManager! = FileTransferManager.shared()
     public var broadcastViewController: BroadcastViewController?
     private var playerManager: PlayerManager?
+    private var songBarrier: SynactionCalibrationBarrier?// Holds the current song until every peer calibrated
+    public var prefetchCount: Int = 2// Queued songs sent ahead to the peers, 0 to only send the current one
     
     static let sharedManager = HostSyncManager()
     override private init() {//This prevents others from using the default '()' initializer for this class
@@ -30,7 +33,18 @@ class HostSyncManager: NSObject, ConnectivityManagerDelegate {
         // Register for notifications
         NotificationCenter.default.addObserver(self, selector: #selector(self.sendCurrentSong(notification:)), name: PlayerSongChangedNotificationName, object: nil)
         NotificationCenter.default.addObserver(self, selector: #selector(self.sendPlayCommand(notification:)), name: PlayerPlayedNotificationName, object: nil)
-        NotificationCenter.default.addObserver(self, selector: #selector(self.sendPauseCommand(calibrate:)), name: PlayerPausedNotificationName, object: nil)
+        NotificationCenter.default.addObserver(self, selector: #selector(self.sendPauseCommand(notification:)), name: PlayerPausedNotificationName, object: nil)
+        NotificationCenter.default.addObserver(self, selector: #selector(self.updateNumberOfClients(notification:)), name: NSNotification.Name(rawValue: SyncReportReceivedNotificationName), object: nil)
+        
+        // Route the peers' requests here
+        self.connectivityManager.registerCommand(PacketCommandStatus) { [weak self] (packet, socket) in
+            self?.handleStatusRequest()
+        }
+        
+        self.connectivityManager.registerCommand(PacketCommandGetSong) { [weak self] (packet, socket) in
+            print("A peer requested the song. Sending.")
+            self?.sendCurrentSong(notification: nil)// It will handle sending player state
+        }
     }
     
     @objc public func sendPlayCommand(notification: Notification?) {
@@ -49,17 +63,14 @@ class HostSyncManager: NSObject, ConnectivityManagerDelegate {
                 
                 self.playerManager!.currentPlaybackTime { playbackTime in
                     self.playerManager!.isPlaying { isPlaying in
-                        let dictionaryPayload = ["command": "play",
-                                                 "timeToExecute": timeToExecute,
-                                                 "playbackTime": playbackTime,
-                                                 "continuousPlay": isPlaying,
-                                                 "timeAtPlaybackTime": deviceTimeAtPlaybackTime,
-                                                 "song": songItem!.title!,
-                                                 "isSpotify": self.playerManager!.isSpotify
-                        ] as [String : Any]
+                        let packet: Packet = Packet.init(command: PacketCommandPlay, type: PacketTypeControl, action: PacketActionPlay)
+                        packet.setUInt64(timeToExecute, forField: PacketFieldTimeToExecute)
+                        packet.setDouble(playbackTime, forField: PacketFieldPlaybackTime)
+                        packet.setBool(isPlaying, forField: PacketFieldContinuousPlay)
+                        packet.setUInt64(deviceTimeAtPlaybackTime, forField: PacketFieldTimeAtPlaybackTime)
+                        packet.setString(songItem!.title!, forField: PacketFieldSong)
+                        packet.setBool(self.playerManager!.isSpotify, forField: PacketFieldIsSpotify)
                         
-                        let payloadData = try! NSKeyedArchiver.archivedData(withRootObject: dictionaryPayload, requiringSecureCoding: false)
-                        let packet: Packet = Packet.init(data: payloadData, type: PacketTypeControl, action: PacketActionPlay)
                         self.synaction.connectivityManager.send(packet, to: self.connectivityManager.allSockets as! [GCDAsyncSocket])
                     }
                 }
@@ -67,7 +78,8 @@ class HostSyncManager: NSObject, ConnectivityManagerDelegate {
         }
     }
     
-    @objc public func sendPauseCommand(calibrate: Bool)  {
+    // Peers track their own drift in the background, a pause never waits on a recalibration.
+    @objc public func sendPauseCommand(notification: Notification?)  {
         print("Sending pause command.")
         
         self.playerManager = self.broadcastViewController!.playerManager!
@@ -75,20 +87,12 @@ class HostSyncManager: NSObject, ConnectivityManagerDelegate {
         let timeToExecute = self.synaction.currentTime()
         
         self.playerManager!.currentSong { songItem in
-            let dictionaryPayload = ["command": "pause",
-                                     "timeToExecute": timeToExecute,
-                                     "song": songItem!.title!,
-                                     "isSpotify": self.playerManager!.isSpotify
-            ] as [String : Any]
+            let packet: Packet = Packet.init(command: PacketCommandPause, type: PacketTypeControl, action: PacketActionPlay)
+            packet.setUInt64(timeToExecute, forField: PacketFieldTimeToExecute)
+            packet.setString(songItem!.title!, forField: PacketFieldSong)
+            packet.setBool(self.playerManager!.isSpotify, forField: PacketFieldIsSpotify)
             
-            let payloadData = try! NSKeyedArchiver.archivedData(withRootObject: dictionaryPayload, requiringSecureCoding: false)
-            let packet: Packet = Packet.init(data: payloadData, type: PacketTypeControl, action: PacketActionPlay)
             self.synaction.connectivityManager.send(packet, to: self.connectivityManager.allSockets as! [GCDAsyncSocket])
-            
-            if (calibrate) {
-                print("Asking peers to calibrate after pause")
-                self.synaction.askPeers(toCalculateOffset: self.connectivityManager.allSockets as! [GCDAsyncSocket])
-            }
         }
     }
     
@@ -98,14 +102,11 @@ class HostSyncManager: NSObject, ConnectivityManagerDelegate {
         self.playerManager = self.broadcastViewController!.playerManager!
         
         // Pause command
-        self.sendPauseCommand(calibrate: false)
+        self.sendPauseCommand(notification: nil)
         
         // Send the file
         self.playerManager!.currentSong { songItem in
             
-            let fileData = try? Data.init(contentsOf: URL(string: songItem!.path!)!)
-            
-            print("Building current song packet with song data: \(String(describing: fileData))")
             // TODO
 //            var songItemNoAV = SongItem()
 //            songItemNoAV.title = songItem?.title
@@ -113,50 +114,91 @@ class HostSyncManager: NSObject, ConnectivityManagerDelegate {
 //            songItemNoAV.image = songItem?.image
 //            songItemNoAV.avItem = nil // Can't encode AVAsset
             
-            let payloadDict: [String : Any] = ["command": "load", "file": fileData ?? NSData(), "songItem": songItem!]  as [String : Any]
-            let packet: Packet = try! Packet.init(data: NSKeyedArchiver.archivedData(withRootObject: payloadDict, requiringSecureCoding: false), type: PacketTypeFile, action: PacketActionUnknown)
+            // The song item is the one field that stays archived, it carries the artwork.
+            // The file itself follows in chunks, read from disk as each peer is ready for them.
+            let packet: Packet = Packet.init(command: PacketCommandLoad, type: PacketTypeFile, action: PacketActionUnknown)
+            packet.setData(try! NSKeyedArchiver.archivedData(withRootObject: songItem!, requiringSecureCoding: false), forField: PacketFieldSongItem)
+            packet.setBool(self.playerManager!.isSpotify, forField: PacketFieldIsSpotify)
+            
+            let fileURL: URL? = URL(string: songItem!.path!)
             
-            self.synaction.executeBlock(whenAllPeersCalibrate: self.connectivityManager.allSockets as! [GCDAsyncSocket], block: { (sockets) in
-                print("Sending current song: \(payloadDict)")
-                self.connectivityManager.send(packet, to: self.connectivityManager.allSockets as! [GCDAsyncSocket])
+            // A newer song replaces one still waiting on calibrations.
+            self.songBarrier?.cancel()
+            self.songBarrier = self.synaction.executeBlock(whenAllPeersCalibrate: self.connectivityManager.allSockets as! [GCDAsyncSocket], block: { (sockets) in
+                print("Sending current song: \(songItem!.title ?? "")")
+                
+                let peers: [GCDAsyncSocket] = self.connectivityManager.allSockets as! [GCDAsyncSocket]
+                if let fileURL = fileURL, fileURL.isFileURL {
+                    self.fileTransferManager.sendFile(at: fileURL, withOffer: packet, to: peers)
+                    self.prefetchUpcomingSongs()
+                    
+                } else {// Spotify tracks are only a URI
+                    self.connectivityManager.send(packet, to: peers)
+                }
             })
         }
     }
     
+    // The next songs in the queue are exported and sent while this one plays, behind everything else. When one
+    // comes up the peers already have it, and only its offer goes out.
+    private func prefetchUpcomingSongs() {
+        guard let applePlayerManager = self.playerManager as? ApplePlayerManager, self.prefetchCount > 0 else {
+            return
+        }
+        
+        applePlayerManager.exportUpcomingSongs(count: self.prefetchCount) { urls in
+            let peers: [GCDAsyncSocket] = self.connectivityManager.allSockets as! [GCDAsyncSocket]
+            
+            for url in urls {
+                print("Prefetching upcoming song: \(url.lastPathComponent)")
+                self.fileTransferManager.prefetchFile(at: url, to: peers)
+            }
+        }
+    }
+    
     func socket(_ socket: GCDAsyncSocket, didAcceptNewSocket newSocket: GCDAsyncSocket) {
         // Update UI
-        self.broadcastViewController!.numberOfClientsLabel.text = (self.connectivityManager.allSockets.count == 1) ? "to 1 person" : "to \(self.connectivityManager.allSockets.count) people"
+        self.updateNumberOfClients(notification: nil)
         
+        // Only a new peer calibrates fully, from then on it tracks drift on its own.
         print("Socket connected, asking to calibrate")
         self.synaction.askPeers(toCalculateOffset: [newSocket] )
     }
     
     func socketDidDisconnect(_ socket: GCDAsyncSocket, withError error: Error) {
+        // Its partial file stays on the peer, a reconnect resumes from there
+        self.fileTransferManager.cancelTransfer(to: socket)
+        
         // Update UI
-        self.broadcastViewController!.numberOfClientsLabel.text = "to \(self.connectivityManager.allSockets.count) people"
+        self.updateNumberOfClients(notification: nil)
     }
     
-    func didReceive(_ packet: Packet, from socket: GCDAsyncSocket) {
-        let payloadDict: Dictionary<String,Any?> = try! NSKeyedUnarchiver.unarchiveTopLevelObjectWithData(packet.data!) as! Dictionary
-        let command: String! = payloadDict["command"] as? String
+    // Shows how many listeners there are, and how many of them reported a sync error over tolerance.
+    @objc func updateNumberOfClients(notification: Notification?) {
+        let numberOfClients: Int = self.connectivityManager.allSockets.count
+        var text: String = (numberOfClients == 1) ? "to 1 person" : "to \(numberOfClients) people"
         
-        if (command == "status") {// Send our current status to this peer
-            print("A peer requested host status. Sending.")
-            
-            self.playerManager = self.broadcastViewController!.playerManager!
-            
-            self.playerManager!.isPlaying { isPlaying in
-                if isPlaying {
-                    self.sendPlayCommand(notification: nil)
-                    
-                } else {
-                    self.sendPauseCommand(calibrate: false)
-                }
+        let peersOutOfTolerance: [GCDAsyncSocket] = self.synaction.peersOutOfTolerance()
+        if peersOutOfTolerance.count > 0 {
+            text += " (\(peersOutOfTolerance.count) out of sync)"
+        }
+        
+        self.broadcastViewController?.numberOfClientsLabel.text = text
+    }
+    
+    // A peer asked for our state, resend it to everyone
+    func handleStatusRequest() {
+        print("A peer requested host status. Sending.")
+        
+        self.playerManager = self.broadcastViewController!.playerManager!
+        
+        self.playerManager!.isPlaying { isPlaying in
+            if isPlaying {
+                self.sendPlayCommand(notification: nil)
+                
+            } else {
+                self.sendPauseCommand(notification: nil)
             }
-            
-        } else if (command == "getSong") {
-            print("A peer requested the song. Sending.")
-            self.sendCurrentSong(notification: nil)// It will handle sending player state
         }
     }
 }
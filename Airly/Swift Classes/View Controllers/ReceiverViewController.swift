@@ -21,12 +21,14 @@ class ReceiverViewController: UIViewController, ConnectivityManagerDelegate {
     let blurImageView:UIImageView! = UIImageView.init()
     let connectivityManager:ConnectivityManager! = ConnectivityManager.shared()
     let synaction:Synaction! = Synaction.sharedManager()
+    let fileTransferManager:FileTransferManager! = FileTransferManager.shared()
 
     var playerManager:PlayerManager? = nil
     var lastReceivedHostPlaybackTime: UInt64 = 0
     var lastReceivedHostSongPlaybackTime: TimeInterval = 0
-    var lastReceivedTimeToExecute: UInt64 = 0
+    var pendingPlaybackEvent: SynactionScheduledEvent? = nil// Scheduled play or pause, a newer command replaces it
     var currentSongItem: SongItem? = nil
+    var transferPriorityTimer: Timer? = nil// While playing a song still being received, asks for the part being played first
     
     override func viewDidLoad() {
         super.viewDidLoad()
@@ -36,6 +38,19 @@ class ReceiverViewController: UIViewController, ConnectivityManagerDelegate {
         // Set the delegate
         self.connectivityManager.delegate = self
         
+        // Route the host's commands here
+        self.connectivityManager.registerCommand(PacketCommandPlay) { [weak self] (packet, socket) in
+            self?.handlePlayPacket(packet)
+        }
+        
+        self.connectivityManager.registerCommand(PacketCommandPause) { [weak self] (packet, socket) in
+            self?.handlePausePacket(packet)
+        }
+        
+        self.connectivityManager.registerCommand(PacketCommandLoad) { [weak self] (packet, socket) in
+            self?.handleLoadPacket(packet, from: socket)
+        }
+        
         // Register for player notifications
         NotificationCenter.default.addObserver(self, selector: #selector(self.updateInterface(notification:)), name: PlayerSongChangedNotificationName, object: nil)
         NotificationCenter.default.addObserver(self, selector: #selector(self.requestHostState(notification:)), name:NSNotification.Name(rawValue: CalibrationDoneNotificationName), object: nil)
@@ -85,6 +100,13 @@ class ReceiverViewController: UIViewController, ConnectivityManagerDelegate {
         self.connectivityManager.stopBonjour()
         self.connectivityManager.disconnectSockets()
         
+        // Stop handling the host's commands
+        self.connectivityManager.registerCommand(PacketCommandPlay, handler: nil)
+        self.connectivityManager.registerCommand(PacketCommandPause, handler: nil)
+        self.connectivityManager.registerCommand(PacketCommandLoad, handler: nil)
+        self.fileTransferManager.cancelReceiving()
+        self.transferPriorityTimer?.invalidate()
+        
         //Stop Playing
         self.playerManager!.pause { _ in}
         self.playerManager!.loadQueueFromItems(songItems: [])
@@ -126,12 +148,12 @@ class ReceiverViewController: UIViewController, ConnectivityManagerDelegate {
     }
     
     //MARK: - Communication
-    func didReceive(_ packet: Packet, from socket: GCDAsyncSocket) {
-        let payloadDict: Dictionary<String,Any?> = try! NSKeyedUnarchiver.unarchiveTopLevelObjectWithData(packet.data!) as! Dictionary
-        let command: String! = payloadDict["command"] as? String
-        self.playerManager = (payloadDict["isSpotify"] as! Bool) ? SpotifyPlayerManager.sharedManager : ApplePlayerManager.sharedManager
+    // Picks the player the host uses. Returns false if we must authorize Spotify first.
+    func selectPlayerManager(for packet: Packet) -> Bool {
+        let isSpotify: Bool = packet.bool(forField: PacketFieldIsSpotify)
+        self.playerManager = isSpotify ? SpotifyPlayerManager.sharedManager : ApplePlayerManager.sharedManager
         
-        if (payloadDict["isSpotify"] as! Bool) {
+        if (isSpotify) {
             DispatchQueue.main.async {
                 let dialogMessage = UIAlertController(title: "Log in to Spotify", message: "Your host is using Spotify to listen to music. Listeners like you are required to authorize Airly to connect to your Spotify Premium account.", preferredStyle: .alert)
                 
@@ -152,99 +174,178 @@ class ReceiverViewController: UIViewController, ConnectivityManagerDelegate {
                 self.present(dialogMessage, animated: true, completion: nil)
             }
             
+            return false
+        }
+        
+        return true
+    }
+    
+    func handlePlayPacket(_ packet: Packet) {
+        guard self.selectPlayerManager(for: packet) else {
             return
         }
         
-        print("Received packet with command: \(String(describing: command))")
+        print("Received play command.")
+        
+        // Save the values for next play
+        lastReceivedHostPlaybackTime = packet.uint64(forField: PacketFieldTimeAtPlaybackTime)
+        lastReceivedHostSongPlaybackTime = packet.double(forField: PacketFieldPlaybackTime)
         
-        if  (command == "play") {// Play command
-            print("Received play command.")
+        let continuousPlay: Bool = packet.bool(forField: PacketFieldContinuousPlay)
+        
+        if (continuousPlay) {// Host is playing
+            print("Executing play as continuous command.")
             
-            // Save the values for next play
-            lastReceivedHostPlaybackTime = (payloadDict["timeAtPlaybackTime"] as! UInt64)
-            lastReceivedHostSongPlaybackTime = (payloadDict["playbackTime"] as! TimeInterval)
+            self.pendingPlaybackEvent?.cancel()
+            self.playerManager!.play(completion: {_ in})// Play locally
             
-            let continuousPlay: Bool = payloadDict["continuousPlay"] as! Bool
+            // Seek to adjusted song time
+            self.playerManager!.seekToTimeInSeconds(time: self.adjustedSongTimeForHost(), completion: { (success) in
+                if !success {
+                    print("Failed to seek for continuous play.")
+                }
+            })
             
-            if (continuousPlay) {// Host is playing
-                print("Executing play as continuous command.")
-                
-                self.playerManager!.play(completion: {_ in})// Play locally
-                
-                // Seek to adjusted song time
-                self.playerManager!.seekToTimeInSeconds(time: self.adjustedSongTimeForHost(), completion: { (success) in
-                    if !success {
-                        print("Failed to seek for continuous play.")
-                    }
-                })
-                
-            } else {// Play in sync
-                print("Executing play as start-stop command.")
-                
-                let timeToExecute: UInt64 = (payloadDict["timeToExecute"] as! UInt64)// Get the time to execute
-                
-                // Play at exact time
-                self.synaction.atExactTime(timeToExecute, run: {
-                    self.playerManager!.play(completion: {_ in})// Play locally
-                })
+        } else {// Play in sync
+            print("Executing play as start-stop command.")
+            
+            let timeToExecute: UInt64 = packet.uint64(forField: PacketFieldTimeToExecute)// Get the time to execute
+            
+            let playbackTime: TimeInterval = packet.double(forField: PacketFieldPlaybackTime)
+            let applePlayerManager = self.playerManager as? ApplePlayerManager
+            let rendersAtExactSample: Bool = (applePlayerManager?.renderStream != nil)
+            
+            // Seek to the playback time first, a late render start skips ahead from there.
+            // The render stream already accounts for the output latency.
+            let seekTime: TimeInterval = rendersAtExactSample ? playbackTime : (playbackTime+self.playerManager!.outputLatency)
+            self.playerManager!.seekToTimeInSeconds(time: seekTime, completion: { (success) in
+                if !success {
+                    print("Failed to seek for sync play.")
+                }
+            })
+            
+            // Play at exact time
+            self.pendingPlaybackEvent?.cancel()
+            
+            if rendersAtExactSample {
+                applePlayerManager!.play(atNetworkTime: timeToExecute, completion: {_ in})
                 
-                // Seek to the playback time
-                let playbackTime: TimeInterval = (payloadDict["playbackTime"] as! TimeInterval)
-                self.playerManager!.seekToTimeInSeconds(time: (playbackTime+self.playerManager!.outputLatency), completion: { (success) in
-                    if !success {
-                        print("Failed to seek for sync play.")
+            } else {
+                let playerManager: PlayerManager = self.playerManager!
+                self.pendingPlaybackEvent = self.synaction.atExactTime(timeToExecute, run: {
+                    // Scheduler thread, only the audio starts here. The player's bookkeeping and the UI follow on main.
+                    if let applePlayerManager = playerManager as? ApplePlayerManager {
+                        applePlayerManager.startAudio()
+                        DispatchQueue.main.async {
+                            applePlayerManager.didStartPlaying(completion: {_ in})
+                        }
+                        
+                    } else {
+                        DispatchQueue.main.async {
+                            playerManager.play(completion: {_ in})// Play locally
+                        }
                     }
                 })
             }
+        }
+    }
+    
+    func handlePausePacket(_ packet: Packet) {
+        guard self.selectPlayerManager(for: packet) else {
+            return
+        }
+        
+        print("Received pause command.")
+        
+        let timeToExecute: UInt64 = packet.uint64(forField: PacketFieldTimeToExecute)
+        
+        self.pendingPlaybackEvent?.cancel()
+        
+        if let applePlayerManager = self.playerManager as? ApplePlayerManager, applePlayerManager.renderStream != nil {
+            applePlayerManager.pause(atNetworkTime: timeToExecute, completion: {_ in})
             
-        } else if (command == "pause") {
-            print("Received pause command.")
+        } else {
+            let playerManager: PlayerManager = self.playerManager!
+            self.pendingPlaybackEvent = self.synaction.atExactTime(timeToExecute, run: {
+                // Scheduler thread, see handlePlayPacket.
+                if let applePlayerManager = playerManager as? ApplePlayerManager {
+                    applePlayerManager.stopAudio()
+                    DispatchQueue.main.async {
+                        applePlayerManager.didPause(completion: {_ in})
+                    }
+                    
+                } else {
+                    DispatchQueue.main.async {
+                        playerManager.pause(completion: {_ in})// Pause locally
+                    }
+                }
+            })
+        }
+    }
+    
+    func handleLoadPacket(_ packet: Packet, from socket: GCDAsyncSocket) {
+        guard self.selectPlayerManager(for: packet) else {
+            return
+        }
+        
+        print("Received load command.")
+        
+        if let songItemData = packet.data(forField: PacketFieldSongItem) {
+            self.currentSongItem = try? NSKeyedUnarchiver.unarchiveTopLevelObjectWithData(songItemData) as? SongItem
+        }
+        self.updateInterface(notification: nil)
+        
+        // The file arrives in chunks after the offer. Once it can be opened we play from it as it fills in,
+        // with the host sending the part being played first.
+        var loadedProgressively: Bool = false
+        self.transferPriorityTimer?.invalidate()
+        
+        self.fileTransferManager.receiveFile(forOffer: packet, from: socket, playable: { (partialURL, length, availability) in
+            guard let applePlayerManager = self.playerManager as? ApplePlayerManager, let songItem = self.currentSongItem else {
+                return
+            }
             
-            if self.synaction.isCalibrating {
-                lastReceivedTimeToExecute = (payloadDict["timeToExecute"] as! UInt64)
+            loadedProgressively = applePlayerManager.loadSong(songItem: songItem, growingFileAtPath: partialURL.path, availability: availability)
+            if !loadedProgressively {
+                print("Can't play the song before it's received, waiting for all of it.")
                 return
             }
             
-            let timeToExecute: UInt64 = (payloadDict["timeToExecute"] as! UInt64)
+            print("Loaded partly received song into player.")
             
-            self.synaction.atExactTime(timeToExecute, run: {
-                self.playerManager!.pause(completion: {_ in})// Play locally
+            self.transferPriorityTimer = Timer.scheduledTimer(withTimeInterval: 0.25, repeats: true, block: { [weak self] _ in
+                if let renderStream = applePlayerManager.renderStream {
+                    self?.fileTransferManager.prioritizeOffset(renderStream.fileReadPosition)
+                }
             })
             
-        } else if (command == "load") {
-            print("Received load command.")
+            self.requestHostState(notification:  nil)
             
-            self.currentSongItem = payloadDict["songItem"] as? SongItem
-            self.updateInterface(notification: nil)
+        }, completion: { (receivedURL, error) in
+            self.transferPriorityTimer?.invalidate()
             
-            let fileData: Data = payloadDict["file"] as! Data
+            guard let receivedURL = receivedURL, let songItem = self.currentSongItem else {
+                print("Error receiving song: \(String(describing: error))")
+                return
+            }
             
-            self.playerManager!.currentSong(completion: { songItem in
-                do {
-                    try FileManager.default.removeItem(at: URL(string: (songItem?.path)!)!)
-                    print("Deleted old song file.")
-                    
-                } catch {
-                    print("Error deleting old song: \(error)")
-                }
-                
-                do {
-                    try fileData.write(to: URL(string: (songItem?.path)!)!)
-                    print("Wrote new song to file.")
-                                        
-                    self.playerManager!.loadSong(songItem: songItem!)
-                    print("Loaded song into player.")
-                    
-                    self.requestHostState(notification:  nil)
-                    
-                } catch {
-                    print("Error writing song data to file: \(error)")
-                }
-            })
+            // Songs are played from the cache they were received into, the host's path means nothing here.
+            songItem.path = receivedURL.absoluteString
             
-        } else {
-            print("Received unparsed command & payload: [\(String(describing: command))] \(payloadDict)")
-        }
+            if loadedProgressively {
+                (self.playerManager as? ApplePlayerManager)?.currentSongFilePath = songItem.path
+                return
+            }
+            
+            self.playerManager!.loadSong(songItem: songItem)
+            print("Loaded song into player.")
+            
+            self.requestHostState(notification:  nil)
+        })
+    }
+    
+    func didReceive(_ packet: Packet, from socket: GCDAsyncSocket) {
+        print("Received unparsed command: [\(packet.command.rawValue)]")
     }
     
     func socketDidDisconnect(_ socket: GCDAsyncSocket, withError error: Error) {
@@ -268,16 +369,14 @@ class ReceiverViewController: UIViewController, ConnectivityManagerDelegate {
     @objc public func requestHostState(notification: Notification?) {// Ask the host to send us the song if we don't have it, otherwise it's state (play/pause)
         self.playerManager!.currentSong { songItem in
             if (songItem == nil) {
-                let payloadDict: [String : Any] = ["command": "getSong"]  as [String : Any]
-                let packet: Packet = try! Packet.init(data: NSKeyedArchiver.archivedData(withRootObject: payloadDict, requiringSecureCoding: false), type: PacketTypeFile, action: PacketActionUnknown)
+                let packet: Packet = Packet.init(command: PacketCommandGetSong, type: PacketTypeFile, action: PacketActionUnknown)
                 
                 print("Asking host to send us the song")
                 self.connectivityManager.send(packet, to: [self.connectivityManager.hostSocket!])
                 return
             }
             
-            let payloadDict: [String : Any] = ["command": "status"]  as [String : Any]
-            let packet: Packet = try! Packet.init(data: NSKeyedArchiver.archivedData(withRootObject: payloadDict, requiringSecureCoding: false), type: PacketTypeFile, action: PacketActionUnknown)
+            let packet: Packet = Packet.init(command: PacketCommandStatus, type: PacketTypeFile, action: PacketActionUnknown)
             
             print("Asking host to send us their status")
             self.connectivityManager.send(packet, to: [self.connectivityManager.hostSocket!])
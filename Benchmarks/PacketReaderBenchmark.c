@@ -0,0 +1,247 @@
+//
+//  PacketReaderBenchmark.c
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// Host run of +[PacketReader benchmarkReadingWithPackets:], same packets with plain sockets so the framing can be
+// measured without a device:
+//
+//   PacketReaderBenchmark [packets]
+//
+// Sync pongs are written back to back over a loopback connection and read back, first with two reads per packet,
+// a header then its body, then through a PacketWireStream ring taking whatever the socket has. Both decode the
+// fields and copy the body out, like a Packet does, so what differs is the reads. GCDAsyncSocket adds a dispatch
+// and a delegate call per read on top of the system call, which this leaves out.
+
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include "PacketWire.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PacketReaderBenchmarkDefaultPackets 1000000
+#define PacketReaderBenchmarkCapacity 131072// PacketReaderDefaultCapacity
+#define PacketReaderBenchmarkRuns 3
+
+typedef struct {
+    int socket;
+    const uint8_t *bytes;
+    size_t length;
+} PacketReaderBenchmarkWriter;
+
+typedef struct {
+    size_t packets;
+    size_t reads;
+    uint64_t checksum;// Keeps the decoding from being optimized out
+} PacketReaderBenchmarkCount;
+
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    
+    return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+}
+
+static void *writePackets(void *context) {
+    PacketReaderBenchmarkWriter *writer = context;
+    size_t written = 0;
+    
+    while (written < writer->length) {
+        ssize_t count = send(writer->socket, writer->bytes + written, writer->length - written, 0);
+        if (count <= 0) break;
+        
+        written += (size_t)count;
+    }
+    
+    return NULL;
+}
+
+static bool openLoopback(int *writeSocket, int *readSocket) {
+    int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    
+    if (bind(listenSocket, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listenSocket, 1) != 0 || getsockname(listenSocket, (struct sockaddr *)&address, &addressLength) != 0) {
+        close(listenSocket);
+        return false;
+    }
+    
+    *writeSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(*writeSocket, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(*writeSocket);
+        close(listenSocket);
+        return false;
+    }
+    
+    *readSocket = accept(listenSocket, NULL, NULL);
+    close(listenSocket);
+    
+    return *readSocket >= 0;
+}
+
+// What a Packet does with a frame: decode its fields and keep a copy of the body.
+static void handlePacket(PacketReaderBenchmarkCount *count, const PacketWireHeader *header, const uint8_t *body) {
+    PacketWireFields fields;
+    uint8_t *copy = malloc(header->length ? header->length : 1);
+    memcpy(copy, body, header->length);
+    
+    if (PacketWireDecodeFields(copy, header->length, &fields)) {
+        const PacketWireField *sent = PacketWireFieldsFind(&fields, PacketFieldTimeSent, PacketFieldKindUInt64);
+        if (sent) count->checksum += sent->unsignedValue;
+    }
+    
+    free(copy);
+    count->packets++;
+}
+
+static bool handleFrame(void *context, const PacketWireHeader *header, const uint8_t *body) {
+    handlePacket(context, header, body);
+    
+    return true;
+}
+
+static bool readFully(int socket, uint8_t *bytes, size_t length, size_t *reads) {
+    while (length > 0) {
+        ssize_t count = recv(socket, bytes, length, 0);
+        if (count <= 0) return false;
+        
+        (*reads)++;
+        bytes += count;
+        length -= (size_t)count;
+    }
+    
+    return true;
+}
+
+static void readTwicePerPacket(int socket, size_t packets, PacketReaderBenchmarkCount *count) {
+    uint8_t headerBytes[PacketWireHeaderLength], body[256];
+    
+    while (count->packets < packets) {
+        PacketWireHeader header;
+        if (!readFully(socket, headerBytes, PacketWireHeaderLength, &count->reads) || !PacketWireDecodeHeader(headerBytes, PacketWireHeaderLength, &header) || header.length > sizeof(body)) return;
+        if (!readFully(socket, body, header.length, &count->reads)) return;
+        
+        handlePacket(count, &header, body);
+    }
+}
+
+static void readThroughStream(int socket, size_t packets, PacketReaderBenchmarkCount *count) {
+    uint8_t *buffer = malloc(PacketReaderBenchmarkCapacity);
+    PacketWireStream stream;
+    PacketWireStreamInit(&stream, buffer, PacketReaderBenchmarkCapacity, PacketWireMaxBodyLength);
+    
+    while (count->packets < packets) {
+        size_t space = 0;
+        uint8_t *bytes = PacketWireStreamSpace(&stream, &space);
+        ssize_t length = recv(socket, bytes, space, 0);
+        if (length <= 0) break;
+        
+        count->reads++;
+        PacketWireStreamCommit(&stream, (size_t)length);
+        if (PacketWireStreamDrain(&stream, handleFrame, count, NULL) != PacketWireStreamOK) break;
+    }
+    
+    PacketWireStreamFree(&stream);
+    free(buffer);
+}
+
+static double run(bool usesStream, const uint8_t *frames, size_t length, size_t packets, PacketReaderBenchmarkCount *count) {
+    int writeSocket, readSocket;
+    if (!openLoopback(&writeSocket, &readSocket)) {
+        fprintf(stderr, "Can't open the benchmark's loopback connection: %s\n", strerror(errno));
+        return 0;
+    }
+    
+    PacketReaderBenchmarkWriter writer = {writeSocket, frames, length};
+    pthread_t thread;
+    
+    uint64_t start = now();
+    pthread_create(&thread, NULL, writePackets, &writer);
+    
+    if (usesStream) {
+        readThroughStream(readSocket, packets, count);
+        
+    } else {
+        readTwicePerPacket(readSocket, packets, count);
+    }
+    
+    double time = (now() - start) / 1e9;
+    
+    pthread_join(thread, NULL);
+    close(writeSocket);
+    close(readSocket);
+    
+    return count->packets / (time > 1e-9 ? time : 1e-9);
+}
+
+int main(int argc, char *argv[]) {
+    size_t packets = (argc > 1) ? strtoul(argv[1], NULL, 10) : PacketReaderBenchmarkDefaultPackets;
+    if (packets == 0) {
+        fprintf(stderr, "usage: %s [packets]\n", argv[0]);
+        return 1;
+    }
+    
+    // Sync pongs, the most frequent packet there is.
+    uint8_t frame[PacketWireHeaderLength + 2 * (PacketWireMaxFieldHeaderLength + 8)];
+    size_t bodyLength = PacketWireEncodeUInt64(frame + PacketWireHeaderLength, PacketFieldTimeSent, 0);
+    bodyLength += PacketWireEncodeUInt64(frame + PacketWireHeaderLength + bodyLength, PacketFieldTimeReceived, 0);
+    size_t frameLength = PacketWireHeaderLength + bodyLength;
+    
+    uint8_t *frames = malloc(packets * frameLength);
+    for (size_t i = 0; i < packets; i++) {
+        uint8_t *bytes = frames + i * frameLength;
+        PacketWireHeader header = {PacketWireVersion, 0, 0, 0, PacketCommandSyncPong, (uint32_t)bodyLength};
+        PacketWireEncodeHeader(&header, bytes);
+        
+        size_t offset = PacketWireHeaderLength;
+        offset += PacketWireEncodeUInt64(bytes + offset, PacketFieldTimeSent, i);
+        PacketWireEncodeUInt64(bytes + offset, PacketFieldTimeReceived, i);
+    }
+    
+    printf("Packet reading benchmark, %zu sync pongs of %zu bytes over loopback, best of %d.\n\n", packets, frameLength, PacketReaderBenchmarkRuns);
+    printf("%-24s %14s %14s\n", "Reads", "packets/s", "packets/read");
+    
+    double perSecond[2] = {0, 0};
+    for (int usesStream = 0; usesStream < 2; usesStream++) {
+        double reads = 0;
+        
+        for (int i = 0; i < PacketReaderBenchmarkRuns; i++) {
+            PacketReaderBenchmarkCount count = {0, 0, 0};
+            double rate = run(usesStream, frames, packets * frameLength, packets, &count);
+            
+            if (count.packets != packets) {
+                fprintf(stderr, "Read %zu packets of %zu.\n", count.packets, packets);
+                free(frames);
+                return 1;
+            }
+            
+            if (rate > perSecond[usesStream]) {
+                perSecond[usesStream] = rate;
+                reads = (double)packets / count.reads;
+            }
+        }
+        
+        printf("%-24s %14.0f %14.1f\n", usesStream ? "Ring buffer" : "Two per packet", perSecond[usesStream], reads);
+    }
+    
+    printf("\nRing buffer: %.1fx.\n", perSecond[1] / (perSecond[0] > 0 ? perSecond[0] : 1));
+    free(frames);
+    
+    return 0;
+}
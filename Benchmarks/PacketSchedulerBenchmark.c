@@ -0,0 +1,324 @@
+//
+//  PacketSchedulerBenchmark.c
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// Host run of +[PacketScheduler benchmarkControlLatencyWithBulkBytes:linkBytesPerSecond:], same setup with plain
+// sockets so the send buffer sizes can be measured without a device:
+//
+//   PacketSchedulerBenchmark [bulk MB] [link bytes/s]
+//
+// A loopback connection whose reader takes one packet at a time, paced to the link rate, with a receive buffer
+// as small as the kernel allows so it's the sender's buffers being measured. The whole transfer is queued at once
+// in 64KB chunks and a control ping sent every 20ms, then each ping's delay is taken as it's read. Bulk packets
+// are handed to the socket's write queue one at a time like PacketScheduler does, control ones straight away.
+//
+// Each row with a fixed send buffer also prints the latency PacketScheduler.h expects from its buffers, taken
+// from what the kernel reports it gave. The reader's sleeps overshoot, and on a busy machine by enough to show as
+// a link column under 100%, which comes on top of it.
+
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include "PacketWire.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PacketSchedulerBenchmarkDefaultBulkMB 8
+#define PacketSchedulerBenchmarkDefaultLinkRate 2500000// 20Mbit/s
+#define PacketSchedulerBenchmarkChunkSize 65536
+#define PacketSchedulerBenchmarkPingInterval 20000000// 20ms
+#define PacketSchedulerBenchmarkReceiveBuffer 4096// The kernel rounds it up to its minimum
+#define PacketSchedulerBenchmarkMaxPings 4096
+#define PacketSchedulerBenchmarkPingLength (PacketWireHeaderLength + PacketWireMaxFieldHeaderLength + 8)
+
+typedef struct {
+    const char *name;
+    bool interleaves;
+    int sendBuffer;// 0 leaves the kernel's default, which autotunes
+    int unsentLowWater;// 0 leaves it unset
+} PacketSchedulerBenchmarkConfig;
+
+// The app's settings are PacketSchedulerSendBuffer and PacketSchedulerUnsentLowWater, the row marked below.
+static const PacketSchedulerBenchmarkConfig configs[] = {
+    {"in order, default buffers", false, 0, 0},
+    {"interleaved, default buffers", true, 0, 0},
+    {"interleaved, 16KB, 16KB unsent", true, 16384, 16384},
+    {"interleaved, 32KB, 16KB unsent", true, 32768, 16384},
+    {"interleaved, 64KB", true, 65536, 0},
+    {"interleaved, 64KB, 4KB unsent", true, 65536, 4096},
+    {"interleaved, 64KB, 16KB unsent *", true, 65536, 16384},
+    {"interleaved, 64KB, 64KB unsent", true, 65536, 65536},
+    {"interleaved, 128KB, 16KB unsent", true, 131072, 16384},
+    {"interleaved, 256KB, 16KB unsent", true, 262144, 16384},
+};
+
+typedef struct {
+    const uint8_t *bytes;
+    size_t length;
+    size_t written;
+    bool bulk;
+    uint8_t ping[PacketSchedulerBenchmarkPingLength];
+} PacketSchedulerBenchmarkWrite;
+
+typedef struct {
+    int socket;
+    size_t bulkBytes;
+    double linkBytesPerSecond;
+    uint64_t latencies[PacketSchedulerBenchmarkMaxPings];
+    size_t latencyCount;
+    atomic_bool done;// Every bulk byte is in
+    uint64_t doneAt;
+} PacketSchedulerBenchmarkReader;
+
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    
+    return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+}
+
+static bool readFully(int socket, uint8_t *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t count = recv(socket, bytes, length, 0);
+        if (count <= 0) return false;
+        
+        bytes += count;
+        length -= (size_t)count;
+    }
+    
+    return true;
+}
+
+// Reads one packet at a time, the next only once the link would have carried this one. Once the transfer is in,
+// reads the pings left behind it unpaced until the writer closes.
+static void *readPackets(void *context) {
+    PacketSchedulerBenchmarkReader *reader = context;
+    uint8_t *body = malloc(PacketSchedulerBenchmarkChunkSize + 64);
+    size_t bulkRead = 0;
+    
+    while (true) {
+        uint8_t headerBytes[PacketWireHeaderLength];
+        PacketWireHeader header;
+        if (!readFully(reader->socket, headerBytes, PacketWireHeaderLength) || !PacketWireDecodeHeader(headerBytes, PacketWireHeaderLength, &header) || header.length > PacketSchedulerBenchmarkChunkSize + 64) break;
+        if (!readFully(reader->socket, body, header.length)) break;
+        
+        PacketWireFields fields;
+        if (!PacketWireDecodeFields(body, header.length, &fields)) break;
+        
+        if (header.command == PacketCommandSyncPing) {
+            const PacketWireField *sent = PacketWireFieldsFind(&fields, PacketFieldTimeSent, PacketFieldKindUInt64);
+            if (sent && reader->latencyCount < PacketSchedulerBenchmarkMaxPings) reader->latencies[reader->latencyCount++] = now() - sent->unsignedValue;
+            
+        } else if (header.command == PacketCommandFileChunk) {
+            const PacketWireField *file = PacketWireFieldsFind(&fields, PacketFieldFile, PacketFieldKindBytes);
+            if (file) bulkRead += file->length;
+        }
+        
+        if (bulkRead >= reader->bulkBytes) {
+            if (!atomic_load(&reader->done)) {
+                reader->doneAt = now();
+                atomic_store(&reader->done, true);
+            }
+            
+            continue;
+        }
+        
+        double delay = (PacketWireHeaderLength + header.length) / reader->linkBytesPerSecond;
+        struct timespec pause = {(time_t)delay, (long)((delay - (time_t)delay) * 1e9)};
+        nanosleep(&pause, NULL);
+    }
+    
+    if (!atomic_load(&reader->done)) {// The stream broke first
+        reader->doneAt = now();
+        atomic_store(&reader->done, true);
+    }
+    free(body);
+    
+    return NULL;
+}
+
+static int compareLatencies(const void *a, const void *b) {
+    uint64_t left = *(const uint64_t *)a, right = *(const uint64_t *)b;
+    
+    return (left > right) - (left < right);
+}
+
+static bool openLoopback(int *writeSocket, int *readSocket) {
+    int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    int receiveBuffer = PacketSchedulerBenchmarkReceiveBuffer;
+    setsockopt(listenSocket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));// Inherited by the accepted socket
+    
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    
+    if (bind(listenSocket, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listenSocket, 1) != 0 || getsockname(listenSocket, (struct sockaddr *)&address, &addressLength) != 0) {
+        close(listenSocket);
+        return false;
+    }
+    
+    *writeSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(*writeSocket, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(*writeSocket);
+        close(listenSocket);
+        return false;
+    }
+    
+    *readSocket = accept(listenSocket, NULL, NULL);
+    close(listenSocket);
+    
+    return *readSocket >= 0;
+}
+
+static void runConfig(const PacketSchedulerBenchmarkConfig *config, size_t bulkBytes, double linkBytesPerSecond, const uint8_t *chunkFrame, size_t chunkFrameLength) {
+    int writeSocket, readSocket;
+    if (!openLoopback(&writeSocket, &readSocket)) {
+        fprintf(stderr, "Can't open the benchmark's loopback connection: %s\n", strerror(errno));
+        return;
+    }
+    
+    int one = 1;
+    setsockopt(writeSocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (config->sendBuffer > 0) setsockopt(writeSocket, SOL_SOCKET, SO_SNDBUF, &config->sendBuffer, sizeof(config->sendBuffer));
+#ifdef TCP_NOTSENT_LOWAT
+    if (config->unsentLowWater > 0) setsockopt(writeSocket, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &config->unsentLowWater, sizeof(config->unsentLowWater));
+#endif
+
+    int sendBuffer = 0, receiveBuffer = 0;
+    socklen_t optionLength = sizeof(int);
+    getsockopt(writeSocket, SOL_SOCKET, SO_SNDBUF, &sendBuffer, &optionLength);
+    optionLength = sizeof(int);
+    getsockopt(readSocket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, &optionLength);
+    
+    PacketSchedulerBenchmarkReader *reader = calloc(1, sizeof(*reader));
+    reader->socket = readSocket;
+    reader->bulkBytes = bulkBytes;
+    reader->linkBytesPerSecond = linkBytesPerSecond;
+    atomic_init(&reader->done, false);
+    
+    pthread_t thread;
+    pthread_create(&thread, NULL, readPackets, reader);
+    
+    // The socket's write queue, what GCDAsyncSocket would hold. In order it takes the whole transfer up front.
+    size_t chunks = (bulkBytes + PacketSchedulerBenchmarkChunkSize - 1) / PacketSchedulerBenchmarkChunkSize;
+    size_t capacity = chunks + PacketSchedulerBenchmarkMaxPings;
+    PacketSchedulerBenchmarkWrite *writes = calloc(capacity, sizeof(*writes));
+    size_t head = 0, tail = 0, bulkWaiting = chunks;
+    
+    do {
+        writes[tail++] = (PacketSchedulerBenchmarkWrite){.bytes = chunkFrame, .length = chunkFrameLength, .bulk = true};
+        bulkWaiting--;
+    } while (bulkWaiting > 0 && !config->interleaves);
+    
+    // Pings until the transfer is in, then what's still queued is flushed.
+    uint64_t start = now(), nextPing = start;
+    while (!atomic_load(&reader->done) || head < tail) {
+        uint64_t time = now();
+        if (!atomic_load(&reader->done) && time >= nextPing && tail < capacity) {
+            PacketSchedulerBenchmarkWrite *write = &writes[tail++];
+            size_t length = PacketWireEncodeUInt64(write->ping + PacketWireHeaderLength, PacketFieldTimeSent, time);
+            PacketWireHeader header = {PacketWireVersion, 0, 0, 0, PacketCommandSyncPing, (uint32_t)length};
+            PacketWireEncodeHeader(&header, write->ping);
+            
+            write->bytes = write->ping;
+            write->length = PacketWireHeaderLength + length;
+            nextPing += PacketSchedulerBenchmarkPingInterval;
+        }
+        
+        while (head < tail) {
+            PacketSchedulerBenchmarkWrite *write = &writes[head];
+            ssize_t count = send(writeSocket, write->bytes + write->written, write->length - write->written, MSG_DONTWAIT);
+            if (count <= 0) break;
+            
+            write->written += (size_t)count;
+            if (write->written < write->length) continue;
+            
+            head++;
+            
+            // The scheduler hands over the next bulk packet once the previous one is written.
+            if (write->bulk && config->interleaves && bulkWaiting > 0) {
+                writes[tail++] = (PacketSchedulerBenchmarkWrite){.bytes = chunkFrame, .length = chunkFrameLength, .bulk = true};
+                bulkWaiting--;
+            }
+        }
+        
+        uint64_t wait = (nextPing > now()) ? (nextPing - now()) / 1000000 : 0;
+        struct pollfd poller = {writeSocket, (head < tail) ? POLLOUT : 0, 0};
+        poll(&poller, 1, (int)wait + 1);
+    }
+    
+    shutdown(writeSocket, SHUT_WR);
+    pthread_join(thread, NULL);
+    double elapsed = (reader->doneAt - start) / 1e9;
+    
+    close(writeSocket);
+    close(readSocket);
+    
+    qsort(reader->latencies, reader->latencyCount, sizeof(uint64_t), compareLatencies);
+    double median = reader->latencyCount ? reader->latencies[reader->latencyCount / 2] / 1e6 : 0;
+    double p99 = reader->latencyCount ? reader->latencies[reader->latencyCount * 99 / 100] / 1e6 : 0;
+    double worst = reader->latencyCount ? reader->latencies[reader->latencyCount - 1] / 1e6 : 0;
+    
+    // Loopback acks what the reader's buffer takes, so that's what's in flight. The socket holds back at the low
+    // water mark, or at the whole send buffer without one.
+    char expected[16] = "-";
+    if (config->interleaves && config->sendBuffer > 0) {
+        int heldBack = (config->unsentLowWater > 0 && config->unsentLowWater < sendBuffer) ? config->unsentLowWater : sendBuffer;
+        double bytes = 2.0 * chunkFrameLength + receiveBuffer + heldBack + PacketSchedulerBenchmarkPingLength;
+        snprintf(expected, sizeof(expected), "%.1fms", bytes / linkBytesPerSecond * 1000.0);
+    }
+    
+    printf("%-34s %8d %6d %6zu %9.1fms %9.1fms %9.1fms %11s %7.0f%%\n", config->name, sendBuffer, receiveBuffer, reader->latencyCount, median, p99, worst, expected, bulkBytes / elapsed / linkBytesPerSecond * 100.0);
+    
+    free(writes);
+    free(reader);
+}
+
+int main(int argc, char *argv[]) {
+    size_t bulkMB = (argc > 1) ? strtoul(argv[1], NULL, 10) : PacketSchedulerBenchmarkDefaultBulkMB;
+    double linkBytesPerSecond = (argc > 2) ? strtod(argv[2], NULL) : PacketSchedulerBenchmarkDefaultLinkRate;
+    if (bulkMB == 0 || linkBytesPerSecond <= 0) {
+        fprintf(stderr, "usage: %s [bulk MB] [link bytes/s]\n", argv[0]);
+        return 1;
+    }
+    
+    signal(SIGPIPE, SIG_IGN);
+    
+    // One FileChunk frame, sent over and over.
+    size_t chunkFrameLength = PacketWireHeaderLength + PacketWireMaxFieldHeaderLength + PacketSchedulerBenchmarkChunkSize;
+    uint8_t *chunkFrame = calloc(1, chunkFrameLength);
+    size_t fieldLength = PacketWireEncodeBytesHeader(chunkFrame + PacketWireHeaderLength, PacketFieldFile, PacketSchedulerBenchmarkChunkSize);
+    chunkFrameLength = PacketWireHeaderLength + fieldLength + PacketSchedulerBenchmarkChunkSize;
+    PacketWireHeader header = {PacketWireVersion, 0, 0, 0, PacketCommandFileChunk, (uint32_t)(fieldLength + PacketSchedulerBenchmarkChunkSize)};
+    PacketWireEncodeHeader(&header, chunkFrame);
+    
+    printf("Control latency benchmark, %zuMB transfer in 64KB chunks at %.2fMB/s, a ping every 20ms.\n", bulkMB, linkBytesPerSecond / 1e6);
+    printf("Expected, (2 chunk frames + RCVBUF + unsent low water or SNDBUF + ping frame) / link rate, before scheduling delays.\n\n");
+    printf("%-34s %8s %6s %6s %11s %11s %11s %11s %8s\n", "Policy", "SNDBUF", "RCVBUF", "pings", "median", "p99", "worst", "expected", "link");
+    
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        runConfig(&configs[i], bulkMB * 1048576, linkBytesPerSecond, chunkFrame, chunkFrameLength);
+    }
+    
+    free(chunkFrame);
+    
+    return 0;
+}
@@ -0,0 +1,76 @@
+//
+//  SynactionBenchmark.c
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// Host run of -[Synaction benchmarkConvergenceWithJoins:] and -benchmarkMassJoinWithPeers:, same link
+// profiles and the app's default settings, so estimator and admission changes can be measured without a device:
+//
+//   SynactionBenchmark [joins] [peers]
+
+#include "SynactionSimulator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SynactionBenchmarkDefaultJoins 200
+#define SynactionBenchmarkDefaultPeers 100
+#define SynactionBenchmarkSeed 42
+
+// Link profiles: latency, jitter, asymmetry, loss, skew, host turnaround.
+static const SynactionLinkModel links[] = {
+    {1500000, 500000, 0, 0, 20e-6, 50000},
+    {3000000, 4000000, 0, 0.01, 20e-6, 50000},
+    {2000000, 500000, 1000000, 0, 20e-6, 50000},
+    {2000000, 1000000, 0, 0.1, 20e-6, 50000},
+    {2000000, 500000, 0, 0, 20e-6, 5000000},
+};
+static const char *linkNames[] = {"Quiet LAN", "Busy Wi-Fi", "Asymmetric", "Lossy", "Slow host"};
+static const char *estimatorNames[] = {"min RTT", "Kalman", "Marzullo"};
+
+int main(int argc, char *argv[]) {
+    size_t joins = (argc > 1) ? strtoul(argv[1], NULL, 10) : SynactionBenchmarkDefaultJoins;
+    size_t peers = (argc > 2) ? strtoul(argv[2], NULL, 10) : SynactionBenchmarkDefaultPeers;
+    if (joins == 0 || peers == 0) {
+        fprintf(stderr, "usage: %s [joins] [peers]\n", argv[0]);
+        return 1;
+    }
+    
+    // Synaction's defaults, see +[Synaction sharedManager].
+    SynactionSimulationConfig serialConfig = {.calibration = SynactionSimulatedCalibrationSerial, .confidence = 100000, .maxCalibrations = SynactionEstimatorCapacity};
+    SynactionSimulationConfig burstConfig = {.calibration = SynactionSimulatedCalibrationBurst, .confidence = 100000, .burstSize = 128, .burstWindow = 16};
+    SynactionMassJoinConfig unlimited = {.peers = peers, .maxActive = peers, .probeBudget = peers * burstConfig.burstWindow};
+    SynactionMassJoinConfig admitted = {.peers = peers, .maxActive = 4, .probeBudget = 32};
+    
+    for (size_t i = 0; i < sizeof(links)/sizeof(links[0]); i++) {
+        for (int mode = 0; mode < 2; mode++) {
+            for (size_t estimator = 0; estimator < sizeof(estimatorNames)/sizeof(estimatorNames[0]); estimator++) {
+                SynactionSimulationConfig config = mode ? burstConfig : serialConfig;
+                config.estimator = (SynactionEstimatorKind)estimator;
+                
+                SynactionConvergenceReport report;
+                SynactionSimulateJoins(&links[i], &config, joins, SynactionBenchmarkSeed, &report);
+                
+                printf("Convergence %-10s %-6s %-8s: %zu/%zu failed, |error| p50 %.1fus p95 %.1fus max %.1fus, time p50 %.1fms p95 %.1fms, %.0f packets\n", linkNames[i], mode ? "burst" : "serial", estimatorNames[estimator], report.failures, report.joins, report.errorP50/1000.0, report.errorP95/1000.0, report.errorMax/1000.0, report.timeP50/1000000.0, report.timeP95/1000000.0, report.meanPacketsSent);
+            }
+        }
+    }
+    
+    // Every peer asks at once, like a party joining a host that just started playing.
+    SynactionSimulationConfig massJoinConfig = burstConfig;
+    massJoinConfig.estimator = SynactionEstimatorKalman;
+    
+    for (size_t i = 0; i < 2; i++) {
+        for (int limited = 0; limited < 2; limited++) {
+            SynactionConvergenceReport report;
+            SynactionSimulateMassJoin(&links[i], &massJoinConfig, limited ? &admitted : &unlimited, SynactionBenchmarkSeed, &report);
+            
+            printf("Mass join %zu %-10s %-11s: %zu/%zu failed, |error| p50 %.1fus p95 %.1fus max %.1fus, time p50 %.1fms p95 %.1fms max %.1fms\n", peers, linkNames[i], limited ? "admitted" : "all at once", report.failures, report.joins, report.errorP50/1000.0, report.errorP95/1000.0, report.errorMax/1000.0, report.timeP50/1000000.0, report.timeP95/1000000.0, report.timeMax/1000000.0);
+        }
+    }
+    
+    return 0;
+}
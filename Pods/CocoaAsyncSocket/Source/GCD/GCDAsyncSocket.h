@@ -658,6 +658,13 @@ typedef NS_ENUM(NSInteger, GCDAsyncSocketError) {
 **/
 - (void)writeData:(NSData *)data withTimeout:(NSTimeInterval)timeout tag:(long)tag;
 
+/**
+ * Writes the segments back to back, as if they were one buffer, with writev() instead of a copy into one.
+ * The segments are retained, not copied, so the same array may be handed to several sockets. Don't mutate them.
+ * Over TLS the segments are joined into one buffer first.
+**/
+- (void)writeSegments:(NSArray<NSData *> *)segments withTimeout:(NSTimeInterval)timeout tag:(long)tag;
+
 /**
  * Returns progress of the current write, from 0.0 to 1.0, or NaN if no current write (use isnan() to check).
  * The parameters "tag", "done" and "total" will be filled in if they aren't NULL.
@@ -108,6 +108,11 @@ static const int logLevel = GCDAsyncSocketLogLevel;
 **/
 #define SOCKET_NULL -1
 
+/**
+ * Most segments handed to a single writev() call, the rest go out on the next pass.
+**/
+#define GCDAsyncSocketMaxWriteSegments 16
+
 
 NSString *const GCDAsyncSocketException = @"GCDAsyncSocketException";
 NSString *const GCDAsyncSocketErrorDomain = @"GCDAsyncSocketErrorDomain";
@@ -803,11 +808,15 @@ enum GCDAsyncSocketConfig
 {
   @public
 	NSData *buffer;
+	NSArray<NSData *> *segments; // Scatter-gather writes only, buffer stays nil unless TLS needs it contiguous
+	NSUInteger length;
 	NSUInteger bytesDone;
 	long tag;
 	NSTimeInterval timeout;
 }
 - (id)initWithData:(NSData *)d timeout:(NSTimeInterval)t tag:(long)i;
+- (id)initWithSegments:(NSArray<NSData *> *)s timeout:(NSTimeInterval)t tag:(long)i;
+- (void)flattenSegments;
 @end
 
 @implementation GCDAsyncWritePacket
@@ -817,6 +826,7 @@ enum GCDAsyncSocketConfig
 	if((self = [super init]))
 	{
 		buffer = d; // Retain not copy. For performance as documented in header file.
+		length = [d length];
 		bytesDone = 0;
 		timeout = t;
 		tag = i;
@@ -824,6 +834,37 @@ enum GCDAsyncSocketConfig
 	return self;
 }
 
+- (id)initWithSegments:(NSArray<NSData *> *)s timeout:(NSTimeInterval)t tag:(long)i
+{
+	if((self = [super init]))
+	{
+		segments = s; // Retained, the segments may be shared with writes on other sockets.
+		length = 0;
+		for (NSData *segment in s)
+		{
+			length += [segment length];
+		}
+		bytesDone = 0;
+		timeout = t;
+		tag = i;
+	}
+	return self;
+}
+
+- (void)flattenSegments
+{
+	if (segments == nil) return;
+	
+	NSMutableData *flattened = [NSMutableData dataWithCapacity:length];
+	for (NSData *segment in segments)
+	{
+		[flattened appendData:segment];
+	}
+	
+	buffer = flattened;
+	segments = nil;
+}
+
 
 @end
 
@@ -5855,6 +5896,23 @@ enum GCDAsyncSocketConfig
 	// as the queue might get released without the block completing.
 }
 
+- (void)writeSegments:(NSArray<NSData *> *)segments withTimeout:(NSTimeInterval)timeout tag:(long)tag
+{
+	GCDAsyncWritePacket *packet = [[GCDAsyncWritePacket alloc] initWithSegments:segments timeout:timeout tag:tag];
+	if (packet->length == 0) return;
+	
+	dispatch_async(socketQueue, ^{ @autoreleasepool {
+		
+		LogTrace();
+		
+        if ((self->flags & kSocketStarted) && !(self->flags & kForbidReadsWrites))
+		{
+            [self->writeQueue addObject:packet];
+			[self maybeDequeueWrite];
+		}
+	}});
+}
+
 - (float)progressOfWriteReturningTag:(long *)tagPtr bytesDone:(NSUInteger *)donePtr total:(NSUInteger *)totalPtr
 {
 	__block float result = 0.0F;
@@ -5874,7 +5932,7 @@ enum GCDAsyncSocketConfig
 		else
 		{
             NSUInteger done = self->currentWrite->bytesDone;
-            NSUInteger total = [self->currentWrite->buffer length];
+            NSUInteger total = self->currentWrite->length;
 			
             if (tagPtr != NULL)   *tagPtr = self->currentWrite->tag;
 			if (donePtr != NULL)  *donePtr = done;
@@ -6042,6 +6100,9 @@ enum GCDAsyncSocketConfig
 	
 	if (flags & kSocketSecure)
 	{
+		// The TLS writers want one contiguous buffer
+		[currentWrite flattenSegments];
+		
 		if ([self usingCFStreamForTLS])
 		{
 			#if TARGET_OS_IPHONE
@@ -6220,18 +6281,52 @@ enum GCDAsyncSocketConfig
 		
 		int socketFD = (socket4FD != SOCKET_NULL) ? socket4FD : (socket6FD != SOCKET_NULL) ? socket6FD : socketUN;
 		
-		const uint8_t *buffer = (const uint8_t *)[currentWrite->buffer bytes] + currentWrite->bytesDone;
+		ssize_t result;
 		
-		NSUInteger bytesToWrite = [currentWrite->buffer length] - currentWrite->bytesDone;
-		
-		if (bytesToWrite > SIZE_MAX) // NSUInteger may be bigger than size_t (write param 3)
+		if (currentWrite->segments)
+		{
+			// Scatter-gather, straight from the segments past what was already written
+			
+			struct iovec iov[GCDAsyncSocketMaxWriteSegments];
+			int iovCount = 0;
+			NSUInteger skip = currentWrite->bytesDone;
+			
+			for (NSData *segment in currentWrite->segments)
+			{
+				NSUInteger segmentLength = [segment length];
+				
+				if (skip >= segmentLength)
+				{
+					skip -= segmentLength;
+					continue;
+				}
+				
+				if (iovCount == GCDAsyncSocketMaxWriteSegments) break;
+				
+				iov[iovCount].iov_base = (void *)((const uint8_t *)[segment bytes] + skip);
+				iov[iovCount].iov_len = (size_t)(segmentLength - skip);
+				iovCount++;
+				skip = 0;
+			}
+			
+			result = writev(socketFD, iov, iovCount);
+			LogVerbose(@"wrote %d segments to socket = %zd", iovCount, result);
+		}
+		else
 		{
-			bytesToWrite = SIZE_MAX;
+			const uint8_t *buffer = (const uint8_t *)[currentWrite->buffer bytes] + currentWrite->bytesDone;
+			
+			NSUInteger bytesToWrite = [currentWrite->buffer length] - currentWrite->bytesDone;
+			
+			if (bytesToWrite > SIZE_MAX) // NSUInteger may be bigger than size_t (write param 3)
+			{
+				bytesToWrite = SIZE_MAX;
+			}
+			
+			result = write(socketFD, buffer, (size_t)bytesToWrite);
+			LogVerbose(@"wrote to socket = %zd", result);
 		}
 		
-		ssize_t result = write(socketFD, buffer, (size_t)bytesToWrite);
-		LogVerbose(@"wrote to socket = %zd", result);
-		
 		// Check results
 		if (result < 0)
 		{
@@ -6280,7 +6375,7 @@ enum GCDAsyncSocketConfig
 		LogVerbose(@"currentWrite->bytesDone = %lu", (unsigned long)currentWrite->bytesDone);
 		
 		// Is packet done?
-		done = (currentWrite->bytesDone == [currentWrite->buffer length]);
+		done = (currentWrite->bytesDone == currentWrite->length);
 	}
 	
 	if (done)
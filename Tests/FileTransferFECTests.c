@@ -0,0 +1,171 @@
+//
+//  FileTransferFECTests.c
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// Random chunks, random redundancy, random erasures: any k of the k + m symbols have to give the chunk back.
+
+#include "FileTransferFEC.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TestSeed 42
+#define TestRounds 500
+#define TestMaxChunkLength 65536
+
+static int failures = 0;
+
+#define check(condition, ...) do { \
+    if (!(condition)) { \
+        failures++; \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } \
+} while (0)
+
+static uint64_t randomState = TestSeed;
+
+static uint64_t randomNext(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    
+    return randomState;
+}
+
+static size_t randomBelow(size_t bound) {
+    return (size_t)(randomNext() % bound);
+}
+
+// Encodes a chunk, loses symbols at random, keeps exactly k in a random order and rebuilds from them.
+static void testRoundTrip(size_t chunkLength, double redundancy) {
+    size_t k = FileTransferFECDataSymbols(chunkLength);
+    size_t m = FileTransferFECParitySymbols(k, redundancy);
+    size_t symbolLength = FileTransferFECSymbolLength(chunkLength, k);
+    
+    check(k >= 1 && k + m <= FileTransferFECMaxSymbols && symbolLength <= FileTransferFECMaxPayload, "bad layout k %zu m %zu symbol %zu for %zu bytes", k, m, symbolLength, chunkLength);
+    check(k * symbolLength >= chunkLength, "%zu symbols of %zu can't hold %zu bytes", k, symbolLength, chunkLength);
+    
+    uint8_t *chunk = calloc(k, symbolLength);
+    uint8_t *encoded = malloc((k + m) * symbolLength);
+    for (size_t i = 0; i < chunkLength; i++) chunk[i] = (uint8_t)randomNext();
+    
+    const uint8_t *data[FileTransferFECMaxSymbols];
+    for (size_t j = 0; j < k; j++) {
+        data[j] = chunk + j * symbolLength;
+        memcpy(encoded + j * symbolLength, data[j], symbolLength);
+    }
+    
+    for (size_t p = k; p < k + m; p++) FileTransferFECEncode(data, k, symbolLength, p, encoded + p * symbolLength);
+    
+    // Shuffle the symbol indices, the first k survive.
+    uint8_t order[FileTransferFECMaxSymbols];
+    for (size_t i = 0; i < k + m; i++) order[i] = (uint8_t)i;
+    for (size_t i = k + m - 1; i > 0; i--) {
+        size_t j = randomBelow(i + 1);
+        uint8_t swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+    
+    uint8_t *received = malloc(k * symbolLength);
+    uint8_t *symbols[FileTransferFECMaxSymbols];
+    uint8_t indices[FileTransferFECMaxSymbols];
+    for (size_t i = 0; i < k; i++) {
+        memcpy(received + i * symbolLength, encoded + order[i] * symbolLength, symbolLength);
+        symbols[i] = received + i * symbolLength;
+        indices[i] = order[i];
+    }
+    
+    uint8_t *scratch = malloc(k * k);
+    check(FileTransferFECDecode(symbols, indices, k, symbolLength, scratch), "decode failed, k %zu m %zu", k, m);
+    
+    for (size_t j = 0; j < k; j++) {
+        if (memcmp(symbols[j], data[j], symbolLength) != 0) {
+            check(0, "data symbol %zu of %zu wrong after decode, m %zu", j, k, m);
+            break;
+        }
+    }
+    
+    free(scratch);
+    free(received);
+    free(encoded);
+    free(chunk);
+}
+
+static void testRejectsBadIndices(void) {
+    size_t k = 4, symbolLength = 16;
+    uint8_t storage[4][16] = {{0}};
+    uint8_t *symbols[4] = {storage[0], storage[1], storage[2], storage[3]};
+    uint8_t scratch[16];
+    
+    uint8_t repeated[4] = {0, 1, 1, 5};
+    check(!FileTransferFECDecode(symbols, repeated, k, symbolLength, scratch), "decoded with a repeated index");
+    
+    uint8_t outOfRange[4] = {0, 1, 2, FileTransferFECMaxSymbols};
+    check(!FileTransferFECDecode(symbols, outOfRange, k, symbolLength, scratch), "decoded with an index past the code");
+}
+
+static void testHeaderRoundTrip(void) {
+    FileTransferFECHeader header = {.k = 48, .symbol = 52, .chunk = 1234, .transferID = 0x0123456789ABCDEFULL, .chunkLength = 65536};
+    uint8_t bytes[FileTransferFECHeaderLength];
+    FileTransferFECEncodeHeader(&header, bytes);
+    
+    FileTransferFECHeader decoded;
+    check(FileTransferFECDecodeHeader(bytes, sizeof(bytes), &decoded), "header didn't decode");
+    check(decoded.k == header.k && decoded.symbol == header.symbol && decoded.chunk == header.chunk && decoded.transferID == header.transferID && decoded.chunkLength == header.chunkLength, "header changed on the way");
+    check(!FileTransferFECDecodeHeader(bytes, sizeof(bytes) - 1, &decoded), "short header decoded");
+    
+    bytes[0] ^= 0xFF;
+    check(!FileTransferFECDecodeHeader(bytes, sizeof(bytes), &decoded), "header without the magic decoded");
+}
+
+// The longest chunk multicast takes still goes out in datagrams under the MTU, with all the parity asked for.
+static void testMaxChunkLength(double redundancy) {
+    size_t chunkLength = FileTransferFECMaxChunkLength(redundancy);
+    size_t k = FileTransferFECDataSymbols(chunkLength);
+    size_t m = FileTransferFECParitySymbols(k, redundancy);
+    size_t wanted = (size_t)(k * redundancy + 0.999);
+    
+    check(FileTransferFECSymbolLength(chunkLength, k) <= FileTransferFECMaxPayload, "%zu byte chunk at redundancy %.2f has %zu byte symbols", chunkLength, redundancy, FileTransferFECSymbolLength(chunkLength, k));
+    check(m >= wanted, "%zu byte chunk at redundancy %.2f gets %zu parity symbols of %zu", chunkLength, redundancy, m, wanted);
+    
+    testRoundTrip(chunkLength, redundancy);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) randomState = strtoull(argv[1], NULL, 10) | 1;
+    
+    testHeaderRoundTrip();
+    testRejectsBadIndices();
+    
+    // The edges, then anything.
+    testRoundTrip(1, 0.1);
+    testRoundTrip(FileTransferFECMaxPayload, 0.1);
+    testRoundTrip(FileTransferFECMaxPayload + 1, 0.5);
+    testRoundTrip(TestMaxChunkLength, 1.0);
+    
+    testMaxChunkLength(0.1);
+    testMaxChunkLength(1.0);
+    for (size_t round = 0; round < 20; round++) {
+        testMaxChunkLength((double)randomBelow(300) / 100.0);
+    }
+    
+    for (size_t round = 0; round < TestRounds; round++) {
+        testRoundTrip(1 + randomBelow(TestMaxChunkLength), (double)randomBelow(100) / 100.0);
+    }
+    
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    
+    printf("FEC tests passed\n");
+    return 0;
+}
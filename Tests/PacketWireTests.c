@@ -0,0 +1,261 @@
+//
+//  PacketWireTests.c
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// Random packets framed back to back, read back through a PacketWireStream in random sized reads the way
+// PacketReader does: a small ring, frames wrapping around its end, and a larger one for frames that don't fit.
+
+#include "PacketWire.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TestSeed 42
+#define TestFrames 2000
+#define TestInitialCapacity 4096// Small, so frames wrap and some need a larger buffer
+#define TestMaxBytesField 100000
+
+static int failures = 0;
+
+#define check(condition, ...) do { \
+    if (!(condition)) { \
+        failures++; \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } \
+} while (0)
+
+static uint64_t randomState = TestSeed;
+
+static uint64_t randomNext(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    
+    return randomState;
+}
+
+static size_t randomBelow(size_t bound) {
+    return (size_t)(randomNext() % bound);
+}
+
+typedef struct {
+    uint8_t *bytes;// Every frame, back to back
+    size_t length;
+    size_t capacity;
+    size_t *frameStarts;
+    size_t frameCount;
+} TestWire;
+
+static void wireAppend(TestWire *wire, const void *bytes, size_t length) {
+    if (wire->length + length > wire->capacity) {
+        while (wire->length + length > wire->capacity) wire->capacity = wire->capacity ? wire->capacity * 2 : 65536;
+        wire->bytes = realloc(wire->bytes, wire->capacity);
+    }
+    
+    memcpy(wire->bytes + wire->length, bytes, length);
+    wire->length += length;
+}
+
+// A frame of random fields, mostly small like control packets, sometimes a large bytes field like a chunk.
+static void wireAppendRandomFrame(TestWire *wire) {
+    uint8_t body[PacketWireMaxFields * (PacketWireMaxFieldHeaderLength + 8) + TestMaxBytesField];
+    size_t length = 0;
+    size_t fields = randomBelow(PacketWireMaxFields + 1);
+    
+    for (size_t i = 0; i < fields; i++) {
+        PacketField field = (PacketField)(1 + randomBelow(PacketFieldRedundancy));
+        
+        switch (randomBelow(5)) {
+            case 0: length += PacketWireEncodeUInt64(body + length, field, randomNext()); break;
+            case 1: length += PacketWireEncodeInt64(body + length, field, (int64_t)randomNext()); break;
+            case 2: length += PacketWireEncodeDouble(body + length, field, (double)randomNext() / 3.0); break;
+            case 3: length += PacketWireEncodeBool(body + length, field, randomNext() & 1); break;
+                
+            default: {
+                size_t bytesLength = randomBelow(8) ? randomBelow(64) : randomBelow(TestMaxBytesField);
+                if (length + PacketWireMaxFieldHeaderLength + bytesLength > sizeof(body)) break;
+                
+                length += PacketWireEncodeBytesHeader(body + length, field, (uint32_t)bytesLength);
+                for (size_t j = 0; j < bytesLength; j++) body[length++] = (uint8_t)randomNext();
+                break;
+            }
+        }
+    }
+    
+    PacketWireHeader header = {.version = PacketWireVersion, .type = (int8_t)randomBelow(3), .action = (int8_t)randomBelow(3), .command = (uint16_t)randomBelow(PacketCommandCount), .length = (uint32_t)length};
+    uint8_t headerBytes[PacketWireHeaderLength];
+    PacketWireEncodeHeader(&header, headerBytes);
+    
+    wire->frameStarts = realloc(wire->frameStarts, (wire->frameCount + 1) * sizeof(size_t));
+    wire->frameStarts[wire->frameCount++] = wire->length;
+    
+    wireAppend(wire, headerBytes, PacketWireHeaderLength);
+    wireAppend(wire, body, length);
+}
+
+typedef struct {
+    const TestWire *wire;
+    size_t frame;// Next one expected
+    size_t stopAfter;// Handler says stop once this many came in, SIZE_MAX never
+} TestReader;
+
+static bool handleFrame(void *context, const PacketWireHeader *header, const uint8_t *body) {
+    TestReader *reader = context;
+    const TestWire *wire = reader->wire;
+    
+    if (reader->frame >= wire->frameCount) {
+        check(0, "more frames than were sent");
+        return false;
+    }
+    
+    const uint8_t *expected = wire->bytes + wire->frameStarts[reader->frame];
+    PacketWireHeader expectedHeader;
+    PacketWireDecodeHeader(expected, PacketWireHeaderLength, &expectedHeader);
+    
+    check(header->command == expectedHeader.command && header->type == expectedHeader.type && header->action == expectedHeader.action && header->length == expectedHeader.length, "frame %zu header changed", reader->frame);
+    check(header->length == expectedHeader.length && memcmp(body, expected + PacketWireHeaderLength, header->length) == 0, "frame %zu body changed", reader->frame);
+    
+    PacketWireFields fields;
+    check(PacketWireDecodeFields(body, header->length, &fields), "frame %zu fields didn't decode", reader->frame);
+    
+    reader->frame++;
+    return reader->frame < reader->stopAfter;
+}
+
+// Reads the wire in pieces of up to maxRead bytes, growing the ring like PacketReader.
+static void testSplitReads(const TestWire *wire, size_t maxRead) {
+    size_t capacity = TestInitialCapacity;
+    uint8_t *buffer = malloc(capacity);
+    PacketWireStream stream;
+    PacketWireStreamInit(&stream, buffer, capacity, PacketWireMaxBodyLength);
+    
+    TestReader reader = {.wire = wire, .stopAfter = SIZE_MAX};
+    size_t position = 0;
+    
+    while (position < wire->length) {
+        size_t frameLength = PacketWireStreamFrameLength(&stream);
+        if (frameLength > stream.capacity) {
+            while (capacity < frameLength) capacity *= 2;
+            
+            uint8_t *larger = malloc(capacity);
+            PacketWireStreamMove(&stream, larger, capacity);
+            free(buffer);
+            buffer = larger;
+        }
+        
+        size_t space = 0;
+        uint8_t *bytes = PacketWireStreamSpace(&stream, &space);
+        if (space == 0) {
+            check(0, "stream full at %zu without a frame to drain", position);
+            break;
+        }
+        
+        size_t length = 1 + randomBelow(maxRead);
+        if (length > space) length = space;
+        if (length > wire->length - position) length = wire->length - position;
+        
+        memcpy(bytes, wire->bytes + position, length);
+        position += length;
+        PacketWireStreamCommit(&stream, length);
+        
+        check(PacketWireStreamDrain(&stream, handleFrame, &reader, NULL) == PacketWireStreamOK, "drain failed at %zu", position);
+    }
+    
+    check(reader.frame == wire->frameCount, "%zu of %zu frames read with reads up to %zu", reader.frame, wire->frameCount, maxRead);
+    check(stream.length == 0, "%zu bytes left over", stream.length);
+    
+    PacketWireStreamFree(&stream);
+    free(buffer);
+}
+
+// A handler that stops keeps the rest for the next drain.
+static void testStoppedDrainResumes(const TestWire *wire) {
+    size_t count = (wire->frameCount < 20) ? wire->frameCount - 1 : 20;
+    size_t bytes = wire->frameStarts[count];// The first count frames, whole
+    
+    uint8_t *buffer = malloc(bytes);
+    PacketWireStream stream;
+    PacketWireStreamInit(&stream, buffer, bytes, PacketWireMaxBodyLength);
+    
+    size_t space = 0;
+    memcpy(PacketWireStreamSpace(&stream, &space), wire->bytes, bytes);
+    PacketWireStreamCommit(&stream, bytes);
+    
+    TestReader reader = {.wire = wire};
+    for (size_t i = 0; i < count; i++) {
+        size_t frames = 0;
+        reader.stopAfter = reader.frame + 1;
+        PacketWireStreamDrain(&stream, handleFrame, &reader, &frames);
+        
+        check(frames == 1, "a stopped drain handed over %zu frames", frames);
+    }
+    
+    check(reader.frame == count && stream.length == 0, "%zu of %zu frames read one drain at a time", reader.frame, count);
+    
+    PacketWireStreamFree(&stream);
+    free(buffer);
+}
+
+static void testBadHeaders(void) {
+    uint8_t buffer[64];
+    PacketWireStream stream;
+    size_t space = 0;
+    
+    // Not ours.
+    PacketWireStreamInit(&stream, buffer, sizeof(buffer), PacketWireMaxBodyLength);
+    memset(PacketWireStreamSpace(&stream, &space), 0xAB, PacketWireHeaderLength);
+    PacketWireStreamCommit(&stream, PacketWireHeaderLength);
+    check(PacketWireStreamDrain(&stream, handleFrame, NULL, NULL) == PacketWireStreamMalformed, "garbage header not malformed");
+    
+    // Claims more than anything we send.
+    PacketWireHeader header = {.version = PacketWireVersion, .command = PacketCommandFileChunk, .length = PacketWireMaxBodyLength + 1};
+    PacketWireStreamInit(&stream, buffer, sizeof(buffer), PacketWireMaxBodyLength);
+    PacketWireEncodeHeader(&header, PacketWireStreamSpace(&stream, &space));
+    PacketWireStreamCommit(&stream, PacketWireHeaderLength);
+    check(PacketWireStreamDrain(&stream, handleFrame, NULL, NULL) == PacketWireStreamTooLarge, "oversized header not too large");
+    
+    // A newer version we can't read.
+    uint8_t bytes[PacketWireHeaderLength];
+    header.length = 0;
+    PacketWireEncodeHeader(&header, bytes);
+    bytes[2] = PacketWireVersion + 1;
+    check(!PacketWireDecodeHeader(bytes, sizeof(bytes), &header), "newer version decoded");
+    
+    // A bytes field running past the body.
+    uint8_t body[PacketWireMaxFieldHeaderLength + 4];
+    size_t length = PacketWireEncodeBytesHeader(body, PacketFieldFile, 5);
+    PacketWireFields fields;
+    check(!PacketWireDecodeFields(body, length + 4, &fields), "truncated bytes field decoded");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) randomState = strtoull(argv[1], NULL, 10) | 1;
+    
+    TestWire wire = {0};
+    for (size_t i = 0; i < TestFrames; i++) wireAppendRandomFrame(&wire);
+    
+    testBadHeaders();
+    testSplitReads(&wire, 1);
+    testSplitReads(&wire, 7);
+    testSplitReads(&wire, 1500);
+    testSplitReads(&wire, 65536);
+    testStoppedDrainResumes(&wire);
+    
+    free(wire.bytes);
+    free(wire.frameStarts);
+    
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    
+    printf("PacketWire tests passed\n");
+    return 0;
+}
@@ -0,0 +1,196 @@
+//
+//  SynactionEstimatorTests.c
+//  Airly
+//
+//  Created by Georges Kanaan on 17/10/2026.
+//  Copyright © 2026 Georges Kanaan. All rights reserved.
+//
+
+// When each estimator says it's confident enough to stop calibrating, and that the estimate is right when it does.
+
+#include "SynactionEstimator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define TestSeed 42
+#define TestTrueOffset 123456789// Peer minus host, in nanoseconds
+#define TestConfidence 100000// The app's default, see +[Synaction sharedManager]
+
+static int failures = 0;
+
+#define check(condition, ...) do { \
+    if (!(condition)) { \
+        failures++; \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } \
+} while (0)
+
+static uint64_t randomState = TestSeed;
+
+static double randomUniform(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    
+    return (double)(randomState >> 11) / (double)(1ULL << 53);
+}
+
+// A probe over a symmetric path: latency each way plus exponential queuing on either leg.
+static SynactionProbeSample sampleWithQueuing(int64_t latency, double meanQueuing) {
+    int64_t there = latency + (int64_t)(-meanQueuing * log(1 - randomUniform()));
+    int64_t back = latency + (int64_t)(-meanQueuing * log(1 - randomUniform()));
+    
+    // t2 - t1 = there - offset, t4 - t3 = back + offset
+    return (SynactionProbeSample){.offset = TestTrueOffset + (there - back)/2, .roundTripTime = there + back};
+}
+
+static void testNeverConfidentOnFewSamples(void) {
+    for (SynactionEstimatorKind kind = SynactionEstimatorMinRoundTripTime; kind <= SynactionEstimatorMarzullo; kind++) {
+        SynactionEstimator estimator;
+        SynactionEstimatorStart(&estimator, kind);
+        
+        SynactionEstimate estimate = SynactionEstimatorCurrent(&estimator);
+        check(!SynactionEstimateIsConfident(&estimate, UINT64_MAX - 1), "kind %d confident with no samples", kind);
+        
+        // Perfect samples, yet not enough of them.
+        for (size_t i = 0; i < SynactionEstimatorMinSamples - 1; i++) {
+            SynactionEstimatorAddSample(&estimator, (SynactionProbeSample){.offset = TestTrueOffset, .roundTripTime = 1000000}, i * 1000000);
+            estimate = SynactionEstimatorCurrent(&estimator);
+            check(!SynactionEstimateIsConfident(&estimate, UINT64_MAX - 1), "kind %d confident after %zu samples", kind, i + 1);
+        }
+    }
+}
+
+static void testMinRoundTripTimeStopsOnQuietLink(void) {
+    SynactionEstimator estimator;
+    SynactionEstimatorStart(&estimator, SynactionEstimatorMinRoundTripTime);
+    
+    size_t samples = 0;
+    SynactionEstimate estimate;
+    do {
+        SynactionEstimatorAddSample(&estimator, sampleWithQueuing(1500000, 20000), samples * 1000000);
+        estimate = SynactionEstimatorCurrent(&estimator);
+        samples++;
+    } while (!SynactionEstimateIsConfident(&estimate, TestConfidence) && samples < SynactionEstimatorCapacity);
+    
+    check(SynactionEstimateIsConfident(&estimate, TestConfidence), "min RTT never confident on a quiet link");
+    check(samples < 64, "min RTT took %zu samples on a quiet link", samples);
+    check(llabs(estimate.offset - TestTrueOffset) < 3 * TestConfidence, "min RTT stopped %lldns off", (long long)(estimate.offset - TestTrueOffset));
+}
+
+// One power save spike mustn't drag the estimate or keep the interval wide.
+static void testMinRoundTripTimeIgnoresSpike(void) {
+    SynactionEstimator estimator;
+    SynactionEstimatorStart(&estimator, SynactionEstimatorMinRoundTripTime);
+    
+    for (size_t i = 0; i < 32; i++) {
+        SynactionProbeSample sample = {.offset = TestTrueOffset, .roundTripTime = 2000000};
+        if (i == 5) sample = (SynactionProbeSample){.offset = TestTrueOffset + 50000000, .roundTripTime = 100000000};
+        
+        SynactionEstimatorAddSample(&estimator, sample, i * 1000000);
+    }
+    
+    SynactionEstimate estimate = SynactionEstimatorCurrent(&estimator);
+    check(estimate.offset == TestTrueOffset, "spike moved min RTT to %lld", (long long)(estimate.offset - TestTrueOffset));
+    check(SynactionEstimateIsConfident(&estimate, TestConfidence), "spike kept min RTT from stopping");
+}
+
+static void testKalmanStopsAndTracksSkew(void) {
+    SynactionEstimator estimator;
+    SynactionEstimatorStart(&estimator, SynactionEstimatorKalman);
+    
+    double skew = 20e-6;
+    size_t samples = 0;
+    SynactionEstimate estimate;
+    uint64_t time = 0;
+    do {
+        time = samples * 10000000;
+        SynactionProbeSample sample = sampleWithQueuing(1500000, 200000);
+        sample.offset += (int64_t)(skew * time);
+        
+        SynactionEstimatorAddSample(&estimator, sample, time);
+        estimate = SynactionEstimatorCurrent(&estimator);
+        samples++;
+    } while (!SynactionEstimateIsConfident(&estimate, TestConfidence) && samples < 1000);
+    
+    int64_t trueOffset = TestTrueOffset + (int64_t)(skew * time);
+    check(SynactionEstimateIsConfident(&estimate, TestConfidence), "Kalman never confident");
+    check(llabs(estimate.offset - trueOffset) < 3 * TestConfidence, "Kalman stopped %lldns off", (long long)(estimate.offset - trueOffset));
+}
+
+// The half-width is the intersection itself. It can't get under the one way latency, however many samples agree.
+static void testMarzulloBoundIsTheIntersection(void) {
+    SynactionEstimator estimator;
+    SynactionEstimatorStart(&estimator, SynactionEstimatorMarzullo);
+    
+    for (size_t i = 0; i < SynactionEstimatorCapacity; i++) {
+        SynactionEstimatorAddSample(&estimator, sampleWithQueuing(1000000, 300000), i * 1000000);
+        
+        SynactionEstimate estimate = SynactionEstimatorCurrent(&estimator);
+        check(estimate.halfWidth + 1 >= 1000000, "Marzullo half-width %llu under the latency", (unsigned long long)estimate.halfWidth);
+        check(llabs(estimate.offset - TestTrueOffset) <= (long long)estimate.halfWidth, "Marzullo %lldns off with a bound of %llu", (long long)(estimate.offset - TestTrueOffset), (unsigned long long)estimate.halfWidth);
+    }
+    
+    // A target looser than the path stops it.
+    SynactionEstimate estimate = SynactionEstimatorCurrent(&estimator);
+    check(SynactionEstimateIsConfident(&estimate, 2000000), "Marzullo not confident at 2ms with a %llu bound", (unsigned long long)estimate.halfWidth);
+}
+
+// With the bound stuck at the latency it stops on the offset holding still instead, well before the sample cap.
+static void testMarzulloStopsOnceSettled(void) {
+    SynactionEstimator estimator;
+    SynactionEstimatorStart(&estimator, SynactionEstimatorMarzullo);
+    
+    size_t samples = 0;
+    SynactionEstimate estimate;
+    do {
+        SynactionEstimatorAddSample(&estimator, sampleWithQueuing(1000000, 300000), samples * 1000000);
+        estimate = SynactionEstimatorCurrent(&estimator);
+        samples++;
+    } while (!SynactionEstimateIsConfident(&estimate, TestConfidence) && samples < SynactionEstimatorCapacity);
+    
+    check(samples >= SynactionMarzulloSettleSamples + SynactionEstimatorMinSamples, "Marzullo settled after only %zu samples", samples);
+    check(samples < SynactionEstimatorCapacity, "Marzullo never settled, moved %llu", (unsigned long long)estimate.settling);
+    check(llabs(estimate.offset - TestTrueOffset) <= (long long)estimate.halfWidth, "Marzullo stopped %lldns off with a bound of %llu", (long long)(estimate.offset - TestTrueOffset), (unsigned long long)estimate.halfWidth);
+}
+
+// A sample that disagrees with the rest is left out of the intersection.
+static void testMarzulloRejectsFalseticker(void) {
+    SynactionEstimator estimator;
+    SynactionEstimatorStart(&estimator, SynactionEstimatorMarzullo);
+    
+    for (size_t i = 0; i < 16; i++) {
+        SynactionProbeSample sample = {.offset = TestTrueOffset, .roundTripTime = 200000};
+        if (i == 3) sample.offset += 10000000;
+        
+        SynactionEstimatorAddSample(&estimator, sample, i * 1000000);
+    }
+    
+    SynactionEstimate estimate = SynactionEstimatorCurrent(&estimator);
+    check(estimate.samplesUsed == 15 && estimate.samplesRejected == 1, "Marzullo used %zu and rejected %zu", estimate.samplesUsed, estimate.samplesRejected);
+    check(estimate.offset == TestTrueOffset && estimate.halfWidth == 100000, "Marzullo at %lld +-%llu", (long long)(estimate.offset - TestTrueOffset), (unsigned long long)estimate.halfWidth);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) randomState = strtoull(argv[1], NULL, 10) | 1;
+    
+    testNeverConfidentOnFewSamples();
+    testMinRoundTripTimeStopsOnQuietLink();
+    testMinRoundTripTimeIgnoresSpike();
+    testKalmanStopsAndTracksSkew();
+    testMarzulloBoundIsTheIntersection();
+    testMarzulloStopsOnceSettled();
+    testMarzulloRejectsFalseticker();
+    
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    
+    printf("Estimator tests passed\n");
+    return 0;
+}